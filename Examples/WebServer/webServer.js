@@ -42,6 +42,8 @@ var url = require('url');
 var port = 8080;
 // Global, persistent, shared memory that is visible from any process during any HTTP request callback
 var globallySharedData;
+// Files uploaded to the server, served from shared memory without copying
+var blobs;
 
 
 /**
@@ -58,6 +60,15 @@ ems.parallel(function () {
         dataFill: 0,
         filename: 'serverState.ems'
     });
+    blobs = ems.new({
+        dimensions: [100],
+        heapSize: [100000000],
+        useExisting: false,
+        useMap: true,
+        doSetFEtags: true,
+        setFEtags: 'full',
+        filename: 'blobs.ems'
+    });
 });
 
 
@@ -82,6 +93,23 @@ function handleRequest(request, response) {
     // Session ID part of the request path
     var key = parsedRequest.pathname.split(/\//g)[1];
 
+    if (key === 'blob') {
+        // Files are uploaded with PUT, and sent directly from the EMS heap with GET
+        var name = parsedRequest.pathname.split(/\//g)[2];
+        if (request.method === 'PUT') {
+            var chunks = [];
+            request.on('data', function (chunk) { chunks.push(chunk); });
+            request.on('end', function () {
+                blobs.writeXF(name, Buffer.concat(chunks));
+                response.end('Stored ' + name);
+            });
+        } else {
+            var view = blobs.readView(name);
+            response.end(Buffer.isBuffer(view) ? view : 'ERROR: No file named ' + name);
+        }
+        return;
+    }
+
     if(!key) {
         response.end('ERROR: Incorrectly formatted or missing session unique ID (' + parsedRequest.pathname + ')');
     } else {
@@ -173,6 +201,7 @@ http.createServer(handleRequest).listen(port, function () {
         "  curl http://localhost:8080/foo?old&keep  # Modify the existing \"foo\" memory\n" +
         "  curl http://localhost:8080/bar?old       # Error because \"bar\" does not yet exist\n" +
         "  curl http://localhost:8080/bar?new&free  # Create and free session memory \"bar\"\n" +
+        "  curl -T file http://localhost:8080/blob/f # Store a file, GET returns it without copying\n" +
         "\nServer listening on: http://localhost:" + port + "\n"
     );
 });
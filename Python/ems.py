@@ -36,7 +36,15 @@ import math
 import json
 import re
 import subprocess
-from multiprocessing import Process, Pipe
+import pickle
+import marshal
+import base64
+import types
+import atexit
+import struct
+import traceback
+import msgpack
+from multiprocessing import Process
 from cffi import FFI
 import site
 
@@ -86,6 +94,9 @@ for package_path in package_paths:
 import weakref
 global_weakkeydict = weakref.WeakKeyDictionary()
 
+# Functions already posted to the fork-join workers
+_parallelFuncs = []
+
 # class initialize(object):
 # This enumeration is copied from ems.h
 TYPE_INVALID   = 0
@@ -95,6 +106,8 @@ TYPE_FLOAT     = 3
 TYPE_INTEGER   = 4
 TYPE_UNDEFINED = 5
 TYPE_JSON      = 6  # Catch-all for JSON arrays and Objects
+TYPE_BLOB      = 7  # Uninterpreted binary data
+JSON_PACKED    = 0xc1  # First byte of JSON values stored as MessagePack
 
 TAG_ANY     = 4  # Never stored, used for matching
 TAG_RW_LOCK = 3
@@ -102,31 +115,49 @@ TAG_BUSY    = 2
 TAG_EMPTY   = 1
 TAG_FULL    = 0
 
+REGION_SCALABLE_RW = 0x1  # Readers-writer locks use per-process reader indicators
+REGION_OPTIMISTIC_READS = 0x2  # Elements have version stamps, reads are optimistic
+REGION_MAILBOXES = 0x4  # The control block has a fork-join task mailbox for each process
+REGION_EPOCHS = 0x8  # Heap storage of replaced values is reclaimed by epochs
+REGION_INTERN = 0x10  # Equal strings and blobs share one reference counted copy
+REGION_STATS = 0x20  # Each process counts its waits and map probes
+REGION_RECOVERY = 0x40  # Element tags held by processes that died are restored
 
-def emsThreadStub(conn, taskn):
-    """Function that receives EMS fork-join functions, executes them,
-       and returns the results."""
-    sys.path.append("../Python/")
-    global ems
-    import ems
-    ems.initialize(taskn, True, 'fj', '/tmp/fj_main.ems')
-    print("STUB: This is the start of it", taskn)
-    ems.myID = taskn
-    ems.diag("Stub diag.  Taskn=" + str(taskn) + "   myid=" + str(ems.myID))
-    while True:
-        msg = conn.recv()
-        print("CONN RECV ON", taskn)
-        func = msg['func']
-        args = msg['args']
-        if func is None:
-            print("Farewell!!!!!!!!  from ", taskn)
-            conn.close()
-            exit(0)
-        ems.diag("func=" + str(func) + "   args=" + str(args))
-        # print("func=" + str(func) + "   args=" + str(args))
-        retval = func(*args)
-        conn.send(str(retval))
-        # time.sleep(taskn * 0.01)
+HOTSPOT_KINDS = ['element', 'bucket', 'control']  # EMS_HOTSPOT_* in ems_types.h
+FORMATS = {'ndjson': 0, 'csv': 1, 'columns': 2}  # EMS_FORMAT_* in ems_types.h
+
+LOCK_MUTEX     = 0
+LOCK_RW        = 1
+LOCK_SEMAPHORE = 2
+
+SCAN_AFTER  = 0x1  # EMS_SCAN_* in ems.h
+SCAN_PREFIX = 0x2
+
+
+def emsThreadStub(taskN):
+    """Long-lived fork-join worker, waits for functions posted to its
+       mailbox by the master and executes them.  A function that raises
+       an exception is reported to the master when it joins the workers."""
+    global myID, libems, EMSmmapID, _regionN, pinThreads, domainName, inParallelContext, tasks, nThreads
+    os.environ['EMS_Subtask'] = str(taskN)
+    initialize(nThreads, pinThreads, 'fj', domainName)
+    funcs = []
+    msg = _new_EMSval(None)
+    while libems.EMStaskReceive(EMSmmapID, myID, msg):
+        funcN, code, args = pickle.loads(base64.b64decode(ffi.string(ffi.cast('char *', msg[0].value))))
+        if funcN < 0:
+            break
+        if code is not None:
+            #  Functions are rebuilt in the worker's copy of their module
+            funcs.append(types.FunctionType(marshal.loads(code[1]), sys.modules[code[0]].__dict__, None, code[2]))
+        try:
+            funcs[funcN](*args)
+            failed = False
+        except:
+            traceback.print_exc()
+            failed = True
+        libems.EMStaskDone(EMSmmapID, myID, failed)
+    os._exit(0)
 
 
 def initialize(nThreadsArg, pinThreadsArg=False, threadingType='bsp',
@@ -158,7 +189,8 @@ def initialize(nThreadsArg, pinThreadsArg=False, threadingType='bsp',
                                      False, False,  #  4-5
                                      False, 0,  # 6-7
                                      c_None,  # 8
-                                     False, TAG_FULL, myID, pinThreads, nThreads, 99)
+                                     False, TAG_FULL, myID, pinThreads, nThreads, 99,
+                                     REGION_MAILBOXES if threadingType == 'fj' else 0)
 
     #  The master thread has completed initialization, other threads may now
     #  safely execute.
@@ -175,11 +207,11 @@ def initialize(nThreadsArg, pinThreadsArg=False, threadingType='bsp',
             inParallelContext = False
             tasks = []
             for taskN in range(1, nThreads):
-                parent_conn, child_conn = Pipe()
-                p = Process(target=emsThreadStub, args=(child_conn, taskN), name="EMS" + str(taskN))
+                p = Process(target=emsThreadStub, args=(taskN,), name="EMS" + str(taskN))
                 p.start()
-                print("Started job:", taskN)
-                tasks.append((p, parent_conn, child_conn))
+                libems.EMStaskStarted(EMSmmapID, taskN, p.pid)
+                tasks.append(p)
+            atexit.register(_release_tasks)
         else:
             inParallelContext = True
     elif threadingType == 'user':
@@ -207,25 +239,41 @@ def diag(text):
     print("EMStask " + str(myID) + ": " + text)
 
 
+def _release_tasks():
+    """Release the fork-join workers when the master exits"""
+    global myID, libems, EMSmmapID, _regionN, pinThreads, domainName, inParallelContext, tasks, nThreads
+    msg = base64.b64encode(pickle.dumps((-1, None, None)))
+    for taskN in range(1, nThreads):
+        libems.EMStaskPost(EMSmmapID, taskN, msg)
+
+
 def parallel(func, *kargs):
-    """Co-Begin a FJ parallel region, executing the function 'func'"""
+    """Co-Begin a FJ parallel region, executing the function 'func'
+    The function and arguments are posted to the mailboxes of the worker
+    processes, workers keep the function so later parallel regions
+    executing the same function only send its index.  Functions are
+    rebuilt from their code so they cannot be closures.  Raises an
+    exception if the function failed in a worker or a worker exited."""
     global myID, libems, EMSmmapID, _regionN, pinThreads, domainName, inParallelContext, tasks, nThreads
-    # print("EMSparallel: starting", len(tasks), tasks)
+    if getattr(func, '__closure__', None) is not None:
+        raise ValueError("parallel: " + func.__name__ + " is a closure, the variables it captures " +
+                         "cannot be sent to the workers, pass them as arguments instead")
+    code = None
+    if func not in _parallelFuncs:
+        code = (func.__module__, marshal.dumps(func.__code__), func.__defaults__)
+        _parallelFuncs.append(func)
+    msg = base64.b64encode(pickle.dumps((_parallelFuncs.index(func), code, kargs)))
     inParallelContext = True
-    taskN = 1
-    for proc, parent_conn, child_conn in tasks:
-        print("Sending to", kargs[0])
-        parent_conn.send({'func': func, 'args': kargs})
-        taskN += 1
-    for proc, parent_conn, child_conn in tasks:
-        retval = parent_conn.recv()
-        print("ParRegion ret: ", retval)
-        # assert retval ==
-    print("Starting local copy in parallel region")
-    func(*kargs)  # Perform the work on this process
-    print("barrier at end of perallel region")
-    barrier()
-    inParallelContext = False
+    try:
+        for taskN in range(1, nThreads):
+            if not libems.EMStaskPost(EMSmmapID, taskN, msg):
+                raise RuntimeError("parallel: Worker process " + str(taskN) + " exited")
+        func(*kargs)  # Perform the work on this process
+    finally:
+        failedN = libems.EMStaskJoin(EMSmmapID)  # Wait for all processes to finish
+        inParallelContext = False
+    if failedN >= 0:
+        raise RuntimeError("parallel: " + func.__name__ + " failed in worker process " + str(failedN))
 
 
 def parForEach(start,        # First iteration's index
@@ -279,31 +327,23 @@ def tmStart(emsElems):
     arr = [ [ emsArr0, idx0 ], [ emsArr1, idx1, true ], [ emsArr2, idx2 ] ]
     """
     global myID, libems, EMSmmapID, _regionN, pinThreads, domainName, inParallelContext, tasks, nThreads
-
-    def getElemUID(item):
-        # print("item=", item[0], item[1], item[0].index2key(item[1]) )
-        # return (item[0].mmapID * MAX_ELEM_PER_REGION) + item[0].index2key(item[1])
-        return str(item[0].mmapID * MAX_ELEM_PER_REGION) + str(item[1])
-
-    MAX_ELEM_PER_REGION = 10000000000000
-
-    #  Build a list of indexes of the elements to lock which will hold
-    #  the elements sorted for deadlock free acquisition
-    #  Sort the elements to lock according to a global ordering
-    sortedElems = sorted(emsElems, key=getElemUID)
-
-    #  Acquire the locks in the deadlock free order, saving the contents
-    #  of the memory when it locked.
-    #  Mark read-write data as Empty, and read-only data under a readers-writer lock
-    tmHandle = []
-    for elem in sortedElems:
-        if len(elem) > 2:
-            val = elem[0].readRW(elem[1])
-            readonly = True
-        else:
-            val = elem[0].readFE(elem[1])
-            readonly = False
-        tmHandle.append([elem[0], elem[1], readonly, val])
+    #  The whole read and write set is acquired in one call, the core
+    #  sorts the elements into a global order for deadlock free acquisition
+    tmHandle = EMStransaction(len(emsElems))
+    for elemN, elem in enumerate(emsElems):
+        key = _new_EMSval(elem[0]._idx(elem[1]))
+        tmHandle.keys.append(key)
+        tmHandle.elems[elemN].mmapID = elem[0].mmapID
+        tmHandle.elems[elemN].key = key[0]
+        tmHandle.elems[elemN].readOnly = len(elem) > 2
+    if not libems.EMStmStart(len(emsElems), tmHandle.elems):
+        raise ValueError("tmStart: Unable to acquire the elements of the transaction")
+
+    #  Return the value of each element when it was acquired:
+    #    [ [ EMSarray, index, isReadOnly, origValue ], ... ]
+    for elemN, elem in enumerate(emsElems):
+        val = elem[0]._returnData(ffi.addressof(tmHandle.elems[elemN], 'value'))
+        tmHandle.append([elem[0], elem[1], len(elem) > 2, val])
     return tmHandle
 
 
@@ -314,33 +354,59 @@ def tmEnd(
     """Commit or abort a transaction
     The tmHandle contains the result from tmStart:
         [ [ EMSarray, index, isReadOnly, origValue ], ... ]
+    Returns True if the transaction committed.  A commit is aborted if an
+    element read optimistically was written during the transaction.
     """
     global myID, libems, EMSmmapID, _regionN, pinThreads, domainName, inParallelContext, tasks, nThreads
-    for emsElem in tmHandle:
-        if doCommit:
-            if emsElem[2]:
-                #  Is a read-only element
-                emsElem[0].releaseRW(emsElem[1])
-            else:
-                #  Is read-write, keep current value and mark Full
-                emsElem[0].setTag(emsElem[1], 'full')
-        else:
-            #  Abort the transaction
-            if emsElem[2]:
-                #  Is read-only element
-                emsElem[0].releaseRW(emsElem[1])
-            else:
-                #  Write back the original value and mark full
-                emsElem[0].writeEF(emsElem[1], emsElem[3])
+    return libems.EMStmEnd(len(tmHandle), tmHandle.elems, doCommit)
+
+
+class EMSstmConflict(Exception):
+    """Raised when a software transaction conflicts with another transaction"""
+    pass
+
+
+def stm(func):
+    """Software Transactional Memory
+    Reads are validated optimistically and writes are buffered until the
+    transaction commits, the function is re-run until its transaction
+    commits without conflicting with other transactions.  Elements must
+    be in regions created with optimisticReads.
+        def transfer(tx):
+            tx.write(accounts, to, tx.read(accounts, to) + amount)
+            tx.write(accounts, frm, tx.read(accounts, frm) - amount)
+        ems.stm(transfer)
+    """
+    global myID, libems, EMSmmapID, _regionN, pinThreads, domainName, inParallelContext, tasks, nThreads
+    while True:
+        tx = EMSstmTransaction(libems.EMSstmStart())
+        try:
+            retObj = func(tx)
+        except EMSstmConflict:
+            libems.EMSstmEnd(tx.txID, False)
+            continue
+        except:
+            libems.EMSstmEnd(tx.txID, False)
+            raise
+        if libems.EMSstmEnd(tx.txID, True):
+            return retObj
 
 
 # -------------------------------------------------
-def critical(func, timeout=1000000):
-    """Serialize execution through this function"""
+def critical(func, timeout=1000000, lock=None):
+    """Serialize execution through this function.  If a named lock
+    is given it is used instead of the global critical section lock."""
     global myID, libems, EMSmmapID, _regionN, pinThreads, domainName, inParallelContext, tasks, nThreads
-    libems.EMScriticalEnter(EMSmmapID, timeout)
-    retObj = func()
-    libems.EMScriticalExit(EMSmmapID)
+    if lock is None:
+        libems.EMScriticalEnter(EMSmmapID, timeout)
+        retObj = func()
+        libems.EMScriticalExit(EMSmmapID)
+    else:
+        lock.acquire(timeout)
+        try:
+            retObj = func()
+        finally:
+            lock.release()
     return retObj
 
 
@@ -433,6 +499,24 @@ def new(arg0=None,   # Maximum number of elements the EMS region can hold
             if 'doSetFEtags' in arg0:
                 emsDescriptor.doSetFEtags = arg0['doSetFEtags']
 
+            if 'scalableRW' in arg0  and  arg0['scalableRW']:
+                emsDescriptor.regionFlags |= REGION_SCALABLE_RW
+
+            if 'optimisticReads' in arg0  and  arg0['optimisticReads']:
+                emsDescriptor.regionFlags |= REGION_OPTIMISTIC_READS
+
+            if 'epochs' in arg0  and  arg0['epochs']:
+                emsDescriptor.regionFlags |= REGION_EPOCHS
+
+            if 'intern' in arg0  and  arg0['intern']:
+                emsDescriptor.regionFlags |= REGION_INTERN
+
+            if 'stats' in arg0  and  arg0['stats']:
+                emsDescriptor.regionFlags |= REGION_STATS
+
+            if 'recovery' in arg0  and  arg0['recovery']:
+                emsDescriptor.regionFlags |= REGION_RECOVERY
+
             if 'setFEtags' in arg0:
                 if (arg0['setFEtags'] == 'full'):
                     emsDescriptor.setFEtagsFull = True
@@ -498,7 +582,8 @@ def new(arg0=None,   # Maximum number of elements the EMS region can hold
         emsDescriptor.doSetFEtags,
         emsDescriptor.setFEtagsFull,
         myID, pinThreads, nThreads,
-        emsDescriptor.mlock
+        emsDescriptor.mlock,
+        emsDescriptor.regionFlags   # 15
     )
     if not emsDescriptor.useExisting  and  myID == 0:
         barrier()
@@ -523,6 +608,24 @@ def ems_thread_stub(taskN, conn):
 '''
 
 # =======================================================================================
+def _json_keys(val):
+    """Copy of a list or dict with the keys of every dict converted to strings
+    as json.dumps converts them, objects read back from EMS have string keys"""
+    if type(val) == dict:
+        obj = {}
+        for key, member in val.items():
+            if type(key) != str:
+                if key is True or key is False or key is None or type(key) in (int, float):
+                    key = json.dumps(key)
+                else:
+                    raise TypeError("EMS: keys must be str, int, float, bool or None, not " + type(key).__name__)
+            obj[key] = _json_keys(member)
+        return obj
+    if type(val) == list or type(val) == tuple:
+        return [_json_keys(elem) for elem in val]
+    return val
+
+
 def _new_EMSval(val):
     global myID, libems, EMSmmapID, _regionN, pinThreads, domainName, inParallelContext, tasks, nThreads
     global global_weakkeydict
@@ -530,13 +633,20 @@ def _new_EMSval(val):
     emsval[0].length = 0
     if type(val) == str:
         if sys.version_info[0] == 2:  # Python 2 or 3
-            newval = ffi.new('char []', bytes(val))
+            encoded = bytes(val)
         else:
-            newval = ffi.new('char []', bytes(val, 'utf-8'))
+            encoded = bytes(val, 'utf-8')
+        newval = ffi.new('char []', encoded)
         emsval[0].value = newval
-        emsval[0].length = len(newval) + 1
+        emsval[0].length = len(encoded)
         emsval[0].type = TYPE_STRING
         global_weakkeydict[emsval] = (emsval[0].length, emsval[0].type, emsval[0].value, newval)
+    elif type(val) == bytes or type(val) == bytearray:
+        newval = ffi.new('char []', bytes(val))
+        emsval[0].value = newval
+        emsval[0].length = len(val)
+        emsval[0].type = TYPE_BLOB
+        global_weakkeydict[emsval] = (emsval[0].length, emsval[0].type, emsval[0].value, newval)
     elif type(val) == int:
         emsval[0].type = TYPE_INTEGER
         emsval[0].value = ffi.cast('void *', val)
@@ -548,22 +658,12 @@ def _new_EMSval(val):
     elif type(val) == bool:
         emsval[0].type = TYPE_BOOLEAN
         emsval[0].value = ffi.cast('void *', val)
-    elif type(val) == list:
-        if sys.version_info[0] == 2:  # Python 2 or 3
-            newval = ffi.new('char []', bytes(json.dumps(val)))
-        else:
-            newval = ffi.new('char []', bytes(json.dumps(val), 'utf-8'))
+    elif type(val) == list or type(val) == dict:
+        # Objects are stored packed as MessagePack behind a marker byte and the length
+        packed = msgpack.packb(_json_keys(val))
+        newval = ffi.new('char []', struct.pack('=BI', JSON_PACKED, len(packed)) + packed)
         emsval[0].value = newval
-        emsval[0].length = len(newval) + 1
-        emsval[0].type = TYPE_JSON
-        global_weakkeydict[emsval] = (emsval[0].length, emsval[0].type, emsval[0].value, newval)
-    elif type(val) == dict:
-        if sys.version_info[0] == 2:  # Python 2 or 3
-            newval = ffi.new('char []', bytes(json.dumps(val)))
-        else:
-            newval = ffi.new('char []', bytes(json.dumps(val), 'utf-8'))
-        emsval[0].value = newval
-        emsval[0].length = len(newval) + 1
+        emsval[0].length = len(newval) - 1
         emsval[0].type = TYPE_JSON
         global_weakkeydict[emsval] = (emsval[0].length, emsval[0].type, emsval[0].value, newval)
     elif val is None:
@@ -609,6 +709,7 @@ class EMSarray(object):
         self.mlock = 1
         self.doSetFEtags = False # Optional, initialize full/empty tags
         self.setFEtagsFull = True # Optional, used only if doSetFEtags is true
+        self.regionFlags = 0  # Region creation flags (REGION_*)
 
         # set any attributes here - before initialisation
         # these remain as normal attributes
@@ -629,10 +730,16 @@ class EMSarray(object):
         global myID, libems, EMSmmapID, _regionN, pinThreads, domainName, inParallelContext, tasks, nThreads
         if emsval[0].type == TYPE_STRING:
             if sys.version_info[0] == 2:  # Python 2 or 3
-                return ffi.string(ffi.cast("char *", emsval[0].value))
+                return ffi.unpack(ffi.cast("char *", emsval[0].value), emsval[0].length)
             else:
-                return ffi.string(ffi.cast('char *', emsval[0].value)).decode('utf-8')
+                return ffi.unpack(ffi.cast('char *', emsval[0].value), emsval[0].length).decode('utf-8')
+        elif emsval[0].type == TYPE_BLOB:
+            return ffi.unpack(ffi.cast('char *', emsval[0].value), emsval[0].length)
         elif emsval[0].type == TYPE_JSON:
+            packed = ffi.cast('unsigned char *', emsval[0].value)
+            if packed[0] == JSON_PACKED:
+                length = struct.unpack('=I', ffi.buffer(packed + 1, 4))[0]
+                return msgpack.unpackb(ffi.buffer(packed + 5, length), strict_map_key=False)
             if sys.version_info[0] == 2:  # Python 2 or 3
                 json_str = ffi.string(ffi.cast("char *", emsval[0].value))
             else:
@@ -653,17 +760,128 @@ class EMSarray(object):
             print("EMS ERROR - unknown type of value:", type(emsval), emsval)
             return None
 
+    def newLock(self, name, lockType='mutex', count=1):
+        """Find or create the lock with this name in the region's heap"""
+        lockTypes = {'mutex': LOCK_MUTEX, 'rw': LOCK_RW, 'semaphore': LOCK_SEMAPHORE}
+        if lockType not in lockTypes:
+            raise ValueError("EMSnewLock: Unknown lock type " + str(lockType))
+        lockID = libems.EMSnewLock(self.mmapID, str(name).encode('utf-8'), lockTypes[lockType], count)
+        if lockID < 0:
+            raise MemoryError("EMSnewLock: Unable to find or create the named lock " + str(name))
+        return EMSlock(self, name, lockID)
+
+    def newTaskGraph(self, name, maxTasks, maxEdges=None):
+        """Find or create the task graph with this name in the region's heap"""
+        if maxEdges is None:
+            maxEdges = maxTasks * 4
+        graphID = libems.EMStaskGraphNew(self.mmapID, str(name).encode('utf-8'), maxTasks, maxEdges)
+        if graphID < 0:
+            raise MemoryError("EMSnewTaskGraph: Unable to find or create the named task graph " + str(name))
+        return EMStaskGraph(self, name, graphID)
+
+    def newOrderedIndex(self, name):
+        """Find or create the ordered index with this name in the region's heap"""
+        indexID = libems.EMSorderedNew(self.mmapID, str(name).encode('utf-8'))
+        if indexID < 0:
+            raise MemoryError("EMSnewOrderedIndex: Unable to find or create the named ordered index " + str(name))
+        return EMSorderedIndex(self, name, indexID)
+
     def sync(self):
         """Synchronize memory with storage"""
         global myID, libems, EMSmmapID, _regionN, pinThreads, domainName, inParallelContext, tasks, nThreads
         return libems.EMSsync(self.mmapID)
 
+    def stats(self, reset=False):
+        """Return the region's performance counters summed over all processes,
+        optionally zeroing them, with the heap and stack/queue depth sampled now"""
+        global myID, libems, EMSmmapID, _regionN, pinThreads, domainName, inParallelContext, tasks, nThreads
+        stats = ffi.new("EMSstatsType *")
+        if not libems.EMSstats(self.mmapID, stats, reset):
+            raise ValueError("EMSstats: Unable to read the counters of the region")
+        return {field: getattr(stats, field) for field in
+                ('tagWaits', 'tagWaitNs', 'lookups', 'probes', 'allocWaits', 'allocWaitNs',
+                 'allocFails', 'heapFree', 'heapLargestFree', 'depth')}
+
+    def hotspots(self, maxSpots=10):
+        """Return the tags processes recently waited on longest, summed from
+        the region's ring of sampled waits"""
+        global myID, libems, EMSmmapID, _regionN, pinThreads, domainName, inParallelContext, tasks, nThreads
+        spots = ffi.new("EMShotspotType[]", maxSpots)
+        nSpots = libems.EMShotspots(self.mmapID, spots, maxSpots)
+        assert nSpots >= 0
+        result = []
+        for spot in spots[0:nSpots]:
+            kind = HOTSPOT_KINDS[spot.kind]
+            if kind != 'control' and self.useMap:
+                key = self.index2key(spot.index)
+            else:
+                key = spot.index
+            result.append({'key': key, 'index': spot.index, 'kind': kind,
+                           'waits': spot.waits, 'waitNs': spot.waitNs, 'maxWaitNs': spot.maxWaitNs,
+                           'processes': [proc for proc in range(64) if spot.processes & (1 << proc)],
+                           'histogram': list(spot.histogram)})
+        return result
+
+    def exportFile(self, filename, format='ndjson', start=0, end=None):
+        """Write the defined elements from index start up to end to a file,
+        one row per element.  Returns the number of rows written."""
+        global myID, libems, EMSmmapID, _regionN, pinThreads, domainName, inParallelContext, tasks, nThreads
+        if format not in FORMATS:
+            raise ValueError("EMSexportFile: Unknown format " + str(format))
+        if end is None:
+            end = self.nElements
+        nRows = libems.EMSexport(self.mmapID, filename.encode(), FORMATS[format], start, end)
+        if nRows < 0:
+            raise IOError("EMSexportFile: Unable to export the array to " + filename)
+        return nRows
+
+    def importFile(self, filename, format='ndjson', part=0, nParts=1):
+        """Write the rows of a file to the array.  Processes importing a file
+        together each import a different part of the nParts it is split into.
+        Returns the number of rows imported."""
+        global myID, libems, EMSmmapID, _regionN, pinThreads, domainName, inParallelContext, tasks, nThreads
+        if format not in FORMATS:
+            raise ValueError("EMSimportFile: Unknown format " + str(format))
+        nRows = libems.EMSimport(self.mmapID, filename.encode(), FORMATS[format], part, nParts)
+        if nRows < 0:
+            raise IOError("EMSimportFile: Unable to import " + filename)
+        return nRows
+
     def index2key(self, index):
         global myID, libems, EMSmmapID, _regionN, pinThreads, domainName, inParallelContext, tasks, nThreads
         key = _new_EMSval(None)
         assert libems.EMSindex2key(self.mmapID, index, key)
         return self._returnData(key)
 
+    def items(self, start=0, end=None, batch=256):
+        """Generate the (key, value) pairs of a mapped array whose keys are at
+        map indexes start up to end, skipping empty indexes.  Keys are read
+        batch at a time, keys added or removed meanwhile may or may not be seen."""
+        global myID, libems, EMSmmapID, _regionN, pinThreads, domainName, inParallelContext, tasks, nThreads
+        if end is None  or  end > self.nElements:
+            end = self.nElements
+        keys = ffi.new('EMSvalueType []', batch)
+        values = ffi.new('EMSvalueType []', batch)
+        nextIdx = ffi.new('int64_t *')
+        while start < end:
+            nItems = libems.EMSscanKeys(self.mmapID, start, end, batch, keys, values, nextIdx)
+            if nItems < 0:
+                raise ValueError("EMSitems: Unable to scan the keys from index " + str(start))
+            items = [(self._returnData(keys + itemN), self._returnData(values + itemN))
+                     for itemN in range(nItems)]
+            start = nextIdx[0]
+            for item in items:
+                yield item
+
+    def parForEachKey(self, loopBody, scheduleType='guided', blockSize=4096):
+        """Call loopBody(key, value) for every key of a mapped array, each
+        process scanning the blocks of map indexes parForEach assigns it"""
+        global myID, libems, EMSmmapID, _regionN, pinThreads, domainName, inParallelContext, tasks, nThreads
+        def scanBlock(blockN):
+            for key, value in self.items(blockN * blockSize, (blockN + 1) * blockSize):
+                loopBody(key, value)
+        parForEach(0, (self.nElements + blockSize - 1) // blockSize, scanBlock, scheduleType)
+
     # ==================================================================
     #  Wrappers around Stacks and Queues
     def push(self, value):
@@ -713,6 +931,25 @@ class EMSarray(object):
         libems.EMSwriteXE(self.mmapID, nativeIndex, nativeValue)
         return (self.mmapID, nativeIndex, nativeValue)
 
+    def writeMany(self, indexes, values):
+        """Write each value to the index or key at the same position, as write does.
+        Processes building a map together each write their own part of the keys.
+        Returns the number of elements written."""
+        if len(indexes) != len(values):
+            raise ValueError("EMSwriteMany: " + str(len(indexes)) + " keys but " + str(len(values)) + " values")
+        keep = []
+        nativeIndexes = ffi.new('EMSvalueType []', max(len(indexes), 1))
+        nativeValues = ffi.new('EMSvalueType []', max(len(values), 1))
+        for itemN in range(len(indexes)):
+            for native, item in ((nativeIndexes, self._idx(indexes[itemN])), (nativeValues, values[itemN])):
+                emsval = _new_EMSval(item)
+                keep.append(emsval)
+                native[itemN] = emsval[0]
+        nWritten = libems.EMSwriteMany(self.mmapID, len(indexes), nativeIndexes, nativeValues)
+        if nWritten < 0:
+            raise ValueError("EMSwriteMany: Unable to write the elements")
+        return nWritten
+
     # ---------------------------------------------------
     def read(self, indexes):
         emsnativeidx = _new_EMSval(self._idx(indexes))
@@ -732,6 +969,23 @@ class EMSarray(object):
         libems.EMSreadFF(self.mmapID, emsnativeidx, val)
         return self._returnData(val)
 
+    def readView(self, indexes):
+        """Wait until full and read a string or blob in place, without copying it,
+        as a read-only memoryview of its bytes.  The value stays in the heap, even if
+        it is replaced, until the memoryview is garbage collected."""
+        emsnativeidx = _new_EMSval(self._idx(indexes))
+        val = _new_EMSval(None)
+        view = ffi.new('int64_t *')
+        libems.EMSreadView(self.mmapID, emsnativeidx, val, view)
+        if view[0] < 0:
+            if val[0].type in (TYPE_STRING, TYPE_BLOB):
+                # Short values are stored inline and are returned in a copy
+                return memoryview(ffi.buffer(val[0].value, val[0].length)[:]).toreadonly()
+            return self._returnData(val)
+        mmapID, offset = self.mmapID, view[0]
+        data = ffi.gc(ffi.cast('char *', val[0].value), lambda data: libems.EMSreleaseView(mmapID, offset))
+        return memoryview(ffi.buffer(data, val[0].length)).toreadonly()
+
     def readRW(self, indexes):
         emsnativeidx = _new_EMSval(self._idx(indexes))
         val = _new_EMSval(None)
@@ -759,6 +1013,45 @@ class EMSarray(object):
             assert libems.EMSfaa(self.mmapID, ems_nativeidx, ems_val, ems_retval)
             return self._returnData(ems_retval)
 
+    @staticmethod
+    def _path(path, keep):
+        """Native path to a field, a string path is a list of keys separated by dots"""
+        if type(path) == str:
+            path = path.split('.')
+        native = ffi.new('EMSvalueType []', max(len(path), 1))
+        for componentN, component in enumerate(path):
+            emsval = _new_EMSval(component)
+            keep.append(emsval)
+            native[componentN] = emsval[0]
+        return len(path), native
+
+    def readField(self, indexes, path):
+        """Read a field of the object or array stored in an element"""
+        keep = []
+        nPath, native_path = self._path(path, keep)
+        ems_retval = _new_EMSval(None)
+        if not libems.EMSreadField(self.mmapID, _new_EMSval(self._idx(indexes)), nPath, native_path, ems_retval):
+            raise ValueError("EMSreadField: Unable to read the field " + str(path))
+        return self._returnData(ems_retval)
+
+    def writeField(self, indexes, path, value):
+        """Write a field of the object or array stored in an element without rewriting the whole value"""
+        keep = []
+        nPath, native_path = self._path(path, keep)
+        if not libems.EMSwriteField(self.mmapID, _new_EMSval(self._idx(indexes)), nPath, native_path,
+                                    _new_EMSval(value)):
+            raise ValueError("EMSwriteField: Unable to write the field " + str(path))
+
+    def faaField(self, indexes, path, value):
+        """Atomically add to a number in the object or array stored in an element, returns the original value"""
+        keep = []
+        nPath, native_path = self._path(path, keep)
+        ems_retval = _new_EMSval(None)
+        if not libems.EMSfaaField(self.mmapID, _new_EMSval(self._idx(indexes)), nPath, native_path,
+                                  _new_EMSval(value), ems_retval):
+            raise ValueError("EMSfaaField: Unable to add to the field " + str(path))
+        return self._returnData(ems_retval)
+
     def cas(self, indexes, oldVal, newVal):
         if type(oldVal) == dict:
             print("EMScas ERROR: Cannot compare objects, only JSON primitives")
@@ -832,6 +1125,9 @@ class EMSelement(object):
     def readFE(self):
         return self._ems_array.readFE(self._index)
 
+    def readView(self):
+        return self._ems_array.readView(self._index)
+
     def releaseRW(self):
         return self._ems_array.releaseRW(self._index)
 
@@ -844,5 +1140,201 @@ class EMSelement(object):
     def faa(self, value):
         return self._ems_array.faa(self._index, value)
 
+    def readField(self, path):
+        return self._ems_array.readField(self._index, path)
+
+    def writeField(self, path, value):
+        return self._ems_array.writeField(self._index, path, value)
+
+    def faaField(self, path, value):
+        return self._ems_array.faaField(self._index, path, value)
+
     def cas(self, oldVal, newVal):
         return self._ems_array.cas(self._index, oldVal, newVal)
+
+
+# =============================================================================================
+
+class EMStransaction(list):
+    """Handle of a transaction started by tmStart, also holds the native
+    read and write set until the transaction ends"""
+    def __init__(self, nElems):
+        list.__init__(self)
+        self.elems = ffi.new('EMStmElement []', nElems)
+        self.keys = []
+
+
+# =============================================================================================
+
+class EMSstmTransaction(object):
+    """A software transaction in progress, passed to the function run by stm"""
+    def __init__(self, txID):
+        assert txID >= 0
+        self.txID = txID
+
+    def read(self, ems_array, indexes):
+        key = _new_EMSval(ems_array._idx(indexes))
+        val = _new_EMSval(None)
+        if not libems.EMSstmRead(self.txID, ems_array.mmapID, key, val):
+            if not libems.EMSstmAborted(self.txID):
+                raise ValueError("EMSstmTransaction.read: Unable to read " + str(indexes))
+            raise EMSstmConflict()
+        return ems_array._returnData(val)
+
+    def write(self, ems_array, indexes, value):
+        key = _new_EMSval(ems_array._idx(indexes))
+        assert libems.EMSstmWrite(self.txID, ems_array.mmapID, key, _new_EMSval(value))
+
+
+# =============================================================================================
+
+class EMSlock(object):
+    """A mutex, readers-writer lock, or semaphore allocated on the heap of an EMS region"""
+    def __init__(self, ems_array, name, lockID):
+        self._ems_array = ems_array
+        self.name = name
+        self.lockID = lockID
+
+    def _acquire(self, shared, timeout):
+        remaining = libems.EMSlockAcquire(self._ems_array.mmapID, self.lockID, shared, timeout)
+        if remaining <= 0:
+            raise TimeoutError("EMSlock: Timed out acquiring lock " + str(self.name))
+        return remaining
+
+    def acquire(self, timeout=1000000):
+        return self._acquire(False, timeout)
+
+    def _release(self, shared):
+        if not libems.EMSlockRelease(self._ems_array.mmapID, self.lockID, shared):
+            raise ValueError("EMSlock: Lock " + str(self.name) + " was not held")
+        return True
+
+    def release(self):
+        return self._release(False)
+
+    def acquireRead(self, timeout=1000000):
+        return self._acquire(True, timeout)
+
+    def releaseRead(self):
+        return self._release(True)
+
+    def __enter__(self):
+        self.acquire()
+        return self
+
+    def __exit__(self, exc_type, exc_value, traceback):
+        self.release()
+
+
+# =============================================================================================
+
+class EMStaskGraph(object):
+    """A graph of tasks allocated on the heap of an EMS region.  Every process
+    adds the same tasks in the same order, the master registers them in the
+    graph.  Each task names the elements it reads and writes, a task runs
+    when its inputs are full.  Tasks producing an input must be added before
+    the tasks consuming it."""
+    def __init__(self, ems_array, name, graphID):
+        self._ems_array = ems_array
+        self.name = name
+        self.graphID = graphID
+        self._funcs = []
+
+    @staticmethod
+    def _elements(elems, keys):
+        native = ffi.new('EMStaskElement []', max(len(elems), 1))
+        for elemN, elem in enumerate(elems):
+            key = _new_EMSval(elem[0]._idx(elem[1]))
+            keys.append(key)
+            native[elemN].mmapID = elem[0].mmapID
+            native[elemN].key = key[0]
+        return native
+
+    def add(self, func, inputs=(), outputs=()):
+        """Add a task, inputs and outputs are lists of [ emsArray, index ]"""
+        global myID
+        taskN = len(self._funcs)
+        self._funcs.append(func)
+        if myID == 0:
+            keys = []
+            nativeTaskN = libems.EMStaskGraphAdd(self._ems_array.mmapID, self.graphID,
+                                                 len(inputs), self._elements(inputs, keys),
+                                                 len(outputs), self._elements(outputs, keys))
+            if nativeTaskN != taskN:
+                self._funcs.pop()
+                raise ValueError("EMStaskGraph: Unable to add task " + str(taskN))
+        return taskN
+
+    def run(self):
+        """Every process executes ready tasks until all the tasks are done"""
+        global myID
+        mmapID = self._ems_array.mmapID
+        if myID == 0:
+            libems.EMStaskGraphStart(mmapID, self.graphID)
+        barrier()
+        taskN = libems.EMStaskGraphNext(mmapID, self.graphID)
+        while taskN >= 0:
+            self._funcs[taskN]()
+            libems.EMStaskGraphDone(mmapID, self.graphID, taskN)
+            taskN = libems.EMStaskGraphNext(mmapID, self.graphID)
+        barrier()
+
+
+# =============================================================================================
+
+class EMSorderedIndex(object):
+    """Keys kept in order on the heap of an EMS region, each with a value.
+    Every process may put, remove, and scan keys concurrently.  Keys are
+    booleans, numbers, strings, or bytes, ordered in that order, numbers by
+    value and strings and bytes by their bytes."""
+    def __init__(self, ems_array, name, indexID):
+        self._ems_array = ems_array
+        self.name = name
+        self.indexID = indexID
+
+    def put(self, key, value):
+        """Insert the key, or replace its value if it is already in the index"""
+        if not libems.EMSorderedPut(self._ems_array.mmapID, self.indexID, _new_EMSval(key), _new_EMSval(value)):
+            raise ValueError("EMSorderedIndex: Unable to put key " + str(key))
+
+    def get(self, key, default=None):
+        """The value of the key, or default if it is not in the index"""
+        val = _new_EMSval(None)
+        if not libems.EMSorderedGet(self._ems_array.mmapID, self.indexID, _new_EMSval(key), val):
+            return default
+        return self._ems_array._returnData(val)
+
+    def remove(self, key):
+        """Remove the key, returning False if it was not in the index"""
+        return libems.EMSorderedRemove(self._ems_array.mmapID, self.indexID, _new_EMSval(key))
+
+    def __len__(self):
+        return libems.EMSorderedCount(self._ems_array.mmapID, self.indexID)
+
+    def _scan(self, start, end, flags, batch):
+        keys = ffi.new('EMSvalueType []', batch)
+        values = ffi.new('EMSvalueType []', batch)
+        nativeEnd = _new_EMSval(end)
+        nItems = batch
+        while nItems == batch:
+            nItems = libems.EMSorderedScan(self._ems_array.mmapID, self.indexID, _new_EMSval(start), nativeEnd,
+                                           flags, batch, keys, values)
+            if nItems < 0:
+                raise ValueError("EMSorderedIndex: Unable to scan from " + str(start))
+            items = [(self._ems_array._returnData(keys + itemN), self._ems_array._returnData(values + itemN))
+                     for itemN in range(nItems)]
+            for item in items:
+                yield item
+            if nItems > 0:
+                start = items[-1][0]
+                flags |= SCAN_AFTER
+
+    def range(self, start=None, end=None, batch=256):
+        """Generate the (key, value) pairs of the keys from start up to but not
+        including end in order, None leaves that end unbounded.  Keys are read
+        batch at a time, keys put or removed meanwhile may or may not be seen."""
+        return self._scan(start, end, 0, batch)
+
+    def prefix(self, prefix, batch=256):
+        """Generate the (key, value) pairs of the string or bytes keys beginning with prefix in order"""
+        return self._scan(prefix, prefix, SCAN_PREFIX, batch)
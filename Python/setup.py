@@ -51,7 +51,7 @@ setup(
     version="1.6.1",
     py_modules=["ems"],
     setup_requires=["cffi>=1.0.0"],
-    install_requires=["cffi>=1.0.0"],
+    install_requires=["cffi>=1.0.0", "msgpack>=1.0.0"],
 
     # Author details
     author='Jace A Mogill',
@@ -65,7 +65,8 @@ setup(
 
     ext_modules=[Extension('libems.so',
                            [src_path + filename for filename in
-                               ['collectives.cc', 'ems.cc', 'ems_alloc.cc', 'loops.cc', 'primitives.cc', 'rmw.cc']],
+                               ['collectives.cc', 'ems.cc', 'ems_alloc.cc', 'loops.cc', 'primitives.cc', 'rmw.cc',
+                                'transactions.cc', 'taskgraph.cc', 'ordered.cc', 'jsonpath.cc', 'bulk.cc']],
                            extra_link_args=link_args
                            )],
     long_description='Persistent Shared Memory and Parallel Programming Model',
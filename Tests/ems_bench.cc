@@ -0,0 +1,388 @@
+/*-----------------------------------------------------------------------------+
+ |  Extended Memory Semantics (EMS)                            Version 1.6.1   |
+ |  http://mogill.com/                                       jace@mogill.com   |
+ +-----------------------------------------------------------------------------+
+ |  Copyright (c) 2016-2020, Jace A Mogill.  All rights reserved.              |
+ |                                                                             |
+ | Redistribution and use in source and binary forms, with or without          |
+ | modification, are permitted provided that the following conditions are met: |
+ |    * Redistributions of source code must retain the above copyright         |
+ |      notice, this list of conditions and the following disclaimer.          |
+ |    * Redistributions in binary form must reproduce the above copyright      |
+ |      notice, this list of conditions and the following disclaimer in the    |
+ |      documentation and/or other materials provided with the distribution.   |
+ |    * Neither the name of the Synthetic Semantics nor the names of its       |
+ |      contributors may be used to endorse or promote products derived        |
+ |      from this software without specific prior written permission.          |
+ |                                                                             |
+ |    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS      |
+ |    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT        |
+ |    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR    |
+ |    A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SYNTHETIC         |
+ |    SEMANTICS LLC BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,   |
+ |    EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,      |
+ |    PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR       |
+ |    PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF   |
+ |    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING     |
+ |    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS       |
+ |    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.             |
+ |                                                                             |
+ +-----------------------------------------------------------------------------*/
+//  Native benchmark of the core EMS primitives, linked directly with src/*.cc.
+//  Every benchmark is run by 1, 2, 4, ... processes forked after the regions
+//  are created, and the wall clock time between two barriers is reported
+//  as JSON on stdout.  nsPerOp and opsPerSecond are for all processes
+//  together, a pair such as push+pop counts as one operation.
+//
+//  Usage:  ems_bench [-p maxProcesses] [-n iterationsPerProcess]
+//
+#include "../src/ems.h"
+#include <sys/wait.h>
+
+#define BENCH_N_ELEMENTS  4096             // Elements of every data region
+#define BENCH_HEAP_SIZE   (16 * 1024 * 1024)
+#define BENCH_TIMEOUT     0x7fffffff       // Barriers and critical sections never time out
+#define BENCH_KEY_LEN     (3 + 20 + 1)     // "key", the digits of any int64_t, and the NUL
+#define BENCH_BATCH       256              // Keys written by one call of EMSwriteMany
+#define BENCH_SCAN        64               // Keys read by one scan of an ordered index or map indexes
+
+static int benchCB;                  // Control block with the barrier and critical section
+static int benchData;                // Region the benchmark operates on
+static int benchNProcs;              // Processes running the benchmark
+static int64_t benchNKeys;           // Keys of a mapped region in use
+static int64_t benchIndex;           // Ordered index in the heap of the region
+static char (*benchKeyNames)[BENCH_KEY_LEN];
+static double *benchElapsed;         // Seconds measured by process 0, shared with the parent
+static int benchRegionN = 0;
+
+
+//==================================================================
+//  Create a region, returning its mmapID
+static int benchRegion(int64_t nElements, size_t heapSize, bool useMap, bool setFull, int32_t nThreads) {
+    char filename[MAX_FNAME_LEN];
+    snprintf(filename, sizeof(filename), "/ems_bench_%d_%d", (int) getpid(), benchRegionN++);
+    EMSvalueType fill = {0, (void *) 0, EMS_TYPE_INTEGER};
+    int mmapID = EMSinitialize(nElements, heapSize, useMap, filename, false, false,
+                               nElements > 0, false, &fill, nElements > 0, setFull,
+                               0, false, nThreads, 0, 0);
+    if (mmapID < 0) {
+        fprintf(stderr, "ems_bench: unable to create region %s\n", filename);
+        exit(1);
+    }
+    return mmapID;
+}
+
+
+//==================================================================
+//  Unmap a region and remove its shared memory object
+static void benchDestroy(int mmapID) {
+    char filename[MAX_FNAME_LEN];
+    strncpy(filename, emsBufFilenames[mmapID], sizeof(filename) - 1);
+    filename[sizeof(filename) - 1] = '\0';
+    EMSdestroy(mmapID, false);
+    shm_unlink(filename);
+}
+
+
+//==================================================================
+//  Key of the i'th element used by a benchmark
+static EMSvalueType benchKey(const char *keyType, int64_t i) {
+    EMSvalueType key = {0, (void *) 0, EMS_TYPE_INTEGER};
+    if (strcmp(keyType, "string") == 0) {
+        key.type = EMS_TYPE_STRING;
+        key.value = (void *) benchKeyNames[i % benchNKeys];
+        key.length = strlen(benchKeyNames[i % benchNKeys]);
+    } else if (strcmp(keyType, "integer") == 0) {
+        key.value = (void *) (i % benchNKeys);
+    } else {
+        key.value = (void *) (i % BENCH_N_ELEMENTS);
+    }
+    return key;
+}
+
+
+//==================================================================
+//  Operations timed by the benchmarks, one call is one operation.
+//  Each process starts at a different element to spread contention.
+static const char *benchKeyType;
+
+static bool benchRead(int64_t i) {
+    EMSvalueType key = benchKey(benchKeyType, i + EMSmyID * 61), returnValue;
+    return EMSread(benchData, &key, &returnValue);
+}
+
+static bool benchWrite(int64_t i) {
+    EMSvalueType key = benchKey(benchKeyType, i + EMSmyID * 61);
+    EMSvalueType value = {0, (void *) i, EMS_TYPE_INTEGER};
+    return EMSwrite(benchData, &key, &value);
+}
+
+//  Building a map from empty, each process writes its own part of the keys
+static bool benchBuild(int64_t i) {
+    EMSvalueType key = benchKey(benchKeyType, i * benchNProcs + EMSmyID);
+    EMSvalueType value = {0, (void *) i, EMS_TYPE_INTEGER};
+    return EMSwrite(benchData, &key, &value);
+}
+
+static bool benchBuildMany(int64_t i) {
+    if (i % BENCH_BATCH != 0) return true;
+    EMSvalueType keys[BENCH_BATCH], values[BENCH_BATCH];
+    int64_t nItems = 0;
+    while (nItems < BENCH_BATCH  &&  (i + nItems + 1) * benchNProcs <= benchNKeys) {
+        keys[nItems] = benchKey(benchKeyType, (i + nItems) * benchNProcs + EMSmyID);
+        values[nItems] = (EMSvalueType) {0, (void *) (i + nItems), EMS_TYPE_INTEGER};
+        nItems++;
+    }
+    return EMSwriteMany(benchData, nItems, keys, values) == nItems;
+}
+
+//  Enumerating the keys of a block of map indexes, one index at a time and by scanning the tags
+static bool benchIndex2key(int64_t i) {
+    int64_t first = ((i * benchNProcs + EMSmyID) * BENCH_SCAN) % BENCH_N_ELEMENTS;
+    for (int64_t idx = first;  idx < first + BENCH_SCAN;  idx++) {
+        EMSvalueType key, returnValue;
+        if (!EMSindex2key(benchData, idx, &key)) return false;
+        if (key.type != EMS_TYPE_UNDEFINED  &&  !EMSread(benchData, &key, &returnValue)) return false;
+    }
+    return true;
+}
+
+static bool benchScanKeys(int64_t i) {
+    int64_t first = ((i * benchNProcs + EMSmyID) * BENCH_SCAN) % BENCH_N_ELEMENTS;
+    EMSvalueType keys[BENCH_SCAN], values[BENCH_SCAN];
+    int64_t next;
+    return EMSscanKeys(benchData, first, first + BENCH_SCAN, BENCH_SCAN, keys, values, &next) >= 0;
+}
+
+static bool benchOrderedPut(int64_t i) {
+    EMSvalueType key = benchKey(benchKeyType, i * benchNProcs + EMSmyID);
+    EMSvalueType value = {0, (void *) i, EMS_TYPE_INTEGER};
+    return EMSorderedPut(benchData, benchIndex, &key, &value);
+}
+
+static bool benchOrderedGet(int64_t i) {
+    EMSvalueType key = benchKey(benchKeyType, i + EMSmyID * 61), returnValue;
+    return EMSorderedGet(benchData, benchIndex, &key, &returnValue);
+}
+
+static bool benchOrderedScan(int64_t i) {
+    EMSvalueType from = benchKey(benchKeyType, i * 7 + EMSmyID * 61);
+    EMSvalueType to = {0, (void *) 0, EMS_TYPE_UNDEFINED};
+    EMSvalueType keys[BENCH_SCAN], values[BENCH_SCAN];
+    return EMSorderedScan(benchData, benchIndex, &from, &to, 0, BENCH_SCAN, keys, values) >= 0;
+}
+
+static bool benchFE(int64_t i) {
+    //  Each process uses its own elements so a read never waits for another process' write
+    EMSvalueType key = {0, (void *) (EMSmyID + benchNProcs * (i % (BENCH_N_ELEMENTS / benchNProcs))),
+                        EMS_TYPE_INTEGER};
+    EMSvalueType value = {0, (void *) i, EMS_TYPE_INTEGER}, returnValue;
+    return EMSwriteEF(benchData, &key, &value)  &&  EMSreadFE(benchData, &key, &returnValue);
+}
+
+static bool benchFAA(int64_t i) {
+    EMSvalueType key = benchKey(benchKeyType, i + EMSmyID * 61);
+    EMSvalueType value = {0, (void *) 1, EMS_TYPE_INTEGER}, returnValue;
+    return EMSfaa(benchData, &key, &value, &returnValue);
+}
+
+static bool benchCAS(int64_t i) {
+    EMSvalueType key = benchKey(benchKeyType, i + EMSmyID * 61), oldValue, returnValue;
+    if (!EMSread(benchData, &key, &oldValue)) return false;
+    EMSvalueType newValue = {0, (void *) ((int64_t) oldValue.value + 1), EMS_TYPE_INTEGER};
+    return EMScas(benchData, &key, &oldValue, &newValue, &returnValue);
+}
+
+static bool benchStack(int64_t i) {
+    EMSvalueType value = {0, (void *) i, EMS_TYPE_INTEGER}, returnValue;
+    return EMSpush(benchData, &value) >= 0  &&  EMSpop(benchData, &returnValue);
+}
+
+static bool benchQueue(int64_t i) {
+    EMSvalueType value = {0, (void *) i, EMS_TYPE_INTEGER}, returnValue;
+    return EMSenqueue(benchData, &value) >= 0  &&  EMSdequeue(benchData, &returnValue);
+}
+
+static bool benchBarrier(int64_t) {
+    return EMSbarrier(benchCB, BENCH_TIMEOUT) > 0;
+}
+
+static bool benchCritical(int64_t) {
+    return EMScriticalEnter(benchCB, BENCH_TIMEOUT) > 0  &&  EMScriticalExit(benchCB);
+}
+
+static bool benchAlloc(int64_t i) {
+    char *bufChar = emsBufs[benchData];
+    volatile int64_t *bufInt64 = (int64_t *) bufChar;
+    volatile char *mutex = (char *) &bufInt64[EMScbData(EMS_ARR_MEM_MUTEX)];
+    int64_t addr = (int64_t) emsMutexMem_alloc(EMS_MEM_MALLOCBOT(bufChar), 8 << (i % 8), mutex);
+    if (addr < 0) return false;
+    emsMutexMem_free(EMS_MEM_MALLOCBOT(bufChar), (size_t) addr, mutex);
+    return true;
+}
+
+
+//==================================================================
+//  Run one benchmark with nProcs processes and print its result
+static void benchRun(const char *op, bool (*step)(int64_t), int64_t nIters, double loadFactor, bool *first) {
+    *benchElapsed = -1.0;
+    for (int proc = 0;  proc < benchNProcs;  proc++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("ems_bench: fork");
+            exit(1);
+        }
+        if (pid == 0) {
+            struct timespec start, end;
+            EMSmyID = proc;
+            EMSbarrier(benchCB, BENCH_TIMEOUT);
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for (int64_t i = 0;  i < nIters;  i++) {
+                if (!step(i)) {
+                    fprintf(stderr, "ems_bench: %s failed\n", op);
+                    _exit(1);
+                }
+            }
+            EMSbarrier(benchCB, BENCH_TIMEOUT);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            if (proc == 0) {
+                *benchElapsed = (double) (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+            }
+            _exit(0);
+        }
+    }
+    bool failed = false;
+    for (int proc = 0;  proc < benchNProcs;  proc++) {
+        int status;
+        if (wait(&status) < 0  ||  !WIFEXITED(status)  ||  WEXITSTATUS(status) != 0) failed = true;
+    }
+    if (failed  ||  *benchElapsed <= 0.0) {
+        fprintf(stderr, "ems_bench: %s with %d processes did not complete\n", op, benchNProcs);
+        exit(1);
+    }
+
+    int64_t nOps = nIters * benchNProcs;
+    printf("%s\n    {\"op\": \"%s\", \"processes\": %d, \"keys\": \"%s\", ",
+           *first ? "" : ",", op, benchNProcs, benchKeyType);
+    if (loadFactor > 0.0) printf("\"loadFactor\": %.2f, ", loadFactor);
+    else                  printf("\"loadFactor\": null, ");
+    printf("\"operations\": %" PRId64 ", \"seconds\": %.6f, \"nsPerOp\": %.1f, \"opsPerSecond\": %.0f}",
+           nOps, *benchElapsed, *benchElapsed * 1e9 / nOps, nOps / *benchElapsed);
+    fflush(stdout);
+    *first = false;
+}
+
+
+//==================================================================
+//  Fill a mapped region with keys so the given fraction of its elements is in use
+static void benchMapKeys(const char *keyType, double loadFactor) {
+    benchNKeys = (int64_t) (loadFactor * BENCH_N_ELEMENTS);
+    for (int64_t i = 0;  i < benchNKeys;  i++) {
+        snprintf(benchKeyNames[i], BENCH_KEY_LEN, "key%08" PRId64, i);
+        EMSvalueType key = benchKey(keyType, i);
+        EMSvalueType value = {0, (void *) 0, EMS_TYPE_INTEGER};
+        if (!EMSwrite(benchData, &key, &value)) {
+            fprintf(stderr, "ems_bench: unable to map key %" PRId64 "\n", i);
+            exit(1);
+        }
+    }
+}
+
+
+int main(int argc, char **argv) {
+    int maxProcs = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    int64_t nIters = 100000;
+    for (int argN = 1;  argN < argc;  argN++) {
+        if (strcmp(argv[argN], "-p") == 0  &&  argN + 1 < argc) {
+            maxProcs = atoi(argv[++argN]);
+        } else if (strcmp(argv[argN], "-n") == 0  &&  argN + 1 < argc) {
+            nIters = atoll(argv[++argN]);
+        } else {
+            fprintf(stderr, "usage: %s [-p maxProcesses] [-n iterationsPerProcess]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (maxProcs < 1) maxProcs = 1;
+    if (maxProcs > BENCH_N_ELEMENTS / 2) maxProcs = BENCH_N_ELEMENTS / 2;
+
+    benchElapsed = (double *) mmap(NULL, sizeof(double), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    benchKeyNames = (char (*)[BENCH_KEY_LEN]) malloc(BENCH_N_ELEMENTS * BENCH_KEY_LEN);
+    if (benchElapsed == MAP_FAILED  ||  benchKeyNames == NULL) {
+        fprintf(stderr, "ems_bench: unable to allocate memory\n");
+        return 1;
+    }
+
+    char hostname[256] = "";
+    gethostname(hostname, sizeof(hostname) - 1);
+    printf("{\n  \"benchmark\": \"ems_bench\",\n  \"version\": \"1.6.1\",\n  \"host\": \"%s\",\n"
+           "  \"cpus\": %ld,\n  \"iterationsPerProcess\": %" PRId64 ",\n  \"results\": [",
+           hostname, sysconf(_SC_NPROCESSORS_ONLN), nIters);
+
+    bool first = true;
+    const char *mappedKeys[] = {"integer", "string"};
+    const double loadFactors[] = {0.25, 0.5, 0.75};
+    for (benchNProcs = 1;  benchNProcs <= maxProcs;  benchNProcs *= 2) {
+        benchCB = benchRegion(0, 0, false, false, benchNProcs);
+
+        //  Elements selected by index
+        benchKeyType = "index";
+        benchData = benchRegion(BENCH_N_ELEMENTS, BENCH_HEAP_SIZE, false, true, 1);
+        benchRun("read", benchRead, nIters, 0.0, &first);
+        benchRun("write", benchWrite, nIters, 0.0, &first);
+        benchRun("faa", benchFAA, nIters, 0.0, &first);
+        benchRun("cas", benchCAS, nIters, 0.0, &first);
+        benchRun("alloc+free", benchAlloc, nIters, 0.0, &first);
+        benchDestroy(benchData);
+
+        //  Elements start empty, and are left empty by each operation
+        benchData = benchRegion(BENCH_N_ELEMENTS, BENCH_HEAP_SIZE, false, false, 1);
+        benchRun("writeEF+readFE", benchFE, nIters, 0.0, &first);
+        benchDestroy(benchData);
+
+        benchData = benchRegion(BENCH_N_ELEMENTS, BENCH_HEAP_SIZE, false, false, 1);
+        benchRun("push+pop", benchStack, nIters, 0.0, &first);
+        benchDestroy(benchData);
+
+        benchData = benchRegion(BENCH_N_ELEMENTS, BENCH_HEAP_SIZE, false, false, 1);
+        benchRun("enqueue+dequeue", benchQueue, nIters, 0.0, &first);
+        benchDestroy(benchData);
+
+        benchRun("critical", benchCritical, nIters, 0.0, &first);
+        benchRun("barrier", benchBarrier, nIters / 10 + 1, 0.0, &first);
+
+        //  Elements selected by mapped keys, sweeping the fraction of elements in use
+        for (int keyN = 0;  keyN < 2;  keyN++) {
+            benchKeyType = mappedKeys[keyN];
+            for (int lfN = 0;  lfN < 3;  lfN++) {
+                benchData = benchRegion(BENCH_N_ELEMENTS, BENCH_HEAP_SIZE, true, true, 1);
+                benchMapKeys(benchKeyType, loadFactors[lfN]);
+                benchRun("read", benchRead, nIters, loadFactors[lfN], &first);
+                benchRun("write", benchWrite, nIters, loadFactors[lfN], &first);
+                benchRun("faa", benchFAA, nIters, loadFactors[lfN], &first);
+                benchRun("index2key", benchIndex2key, nIters / 10 + 1, loadFactors[lfN], &first);
+                benchRun("scanKeys", benchScanKeys, nIters / 10 + 1, loadFactors[lfN], &first);
+                benchDestroy(benchData);
+
+                //  The same keys written to an empty map one at a time and in batches
+                benchData = benchRegion(BENCH_N_ELEMENTS, BENCH_HEAP_SIZE, true, true, 1);
+                benchRun("build", benchBuild, benchNKeys / benchNProcs, loadFactors[lfN], &first);
+                benchDestroy(benchData);
+                benchData = benchRegion(BENCH_N_ELEMENTS, BENCH_HEAP_SIZE, true, true, 1);
+                benchRun("buildMany", benchBuildMany, benchNKeys / benchNProcs, loadFactors[lfN], &first);
+                benchDestroy(benchData);
+            }
+
+            //  The keys of the fullest map in an ordered index, put then looked up and scanned
+            benchData = benchRegion(BENCH_N_ELEMENTS, BENCH_HEAP_SIZE, false, true, 1);
+            benchIndex = EMSorderedNew(benchData, "bench");
+            benchRun("orderedPut", benchOrderedPut, benchNKeys / benchNProcs, 0.0, &first);
+            benchRun("orderedGet", benchOrderedGet, nIters, 0.0, &first);
+            benchRun("orderedScan", benchOrderedScan, nIters / 10 + 1, 0.0, &first);
+            benchDestroy(benchData);
+        }
+
+        benchDestroy(benchCB);
+    }
+    printf("\n  ]\n}\n");
+    return 0;
+}
@@ -0,0 +1,72 @@
+/*-----------------------------------------------------------------------------+
+ |  Extended Memory Semantics (EMS)                            Version 1.6.1   |
+ |  http://mogill.com/                                       jace@mogill.com   |
+ +-----------------------------------------------------------------------------+
+ |  Copyright (c) 2011-2014, Synthetic Semantics LLC.  All rights reserved.    |
+ |  Copyright (c) 2015-2020, Jace A Mogill.  All rights reserved.              |
+ |                                                                             |
+ | Redistribution and use in source and binary forms, with or without          |
+ | modification, are permitted provided that the following conditions are met: |
+ |    * Redistributions of source code must retain the above copyright         |
+ |      notice, this list of conditions and the following disclaimer.          |
+ |    * Redistributions in binary form must reproduce the above copyright      |
+ |      notice, this list of conditions and the following disclaimer in the    |
+ |      documentation and/or other materials provided with the distribution.   |
+ |    * Neither the name of the Synthetic Semantics nor the names of its       |
+ |      contributors may be used to endorse or promote products derived        |
+ |      from this software without specific prior written permission.          |
+ |                                                                             |
+ |    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS      |
+ |    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT        |
+ |    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR    |
+ |    A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SYNTHETIC         |
+ |    SEMANTICS LLC BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,   |
+ |    EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,      |
+ |    PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR       |
+ |    PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF   |
+ |    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING     |
+ |    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS       |
+ |    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.             |
+ |                                                                             |
+ +-----------------------------------------------------------------------------*/
+var assert = require('assert');
+var ems = require('ems')(parseInt(process.argv[2]), false);
+var nIters = 20000;
+//  The heap only holds a few of the strings written, it is exhausted unless they are reclaimed
+var shared = ems.new({
+    dimensions: [100],
+    heapSize: 20000,
+    useMap: true,
+    useExisting: false,
+    setFEtags: 'full',
+    epochs: true
+});
+
+function makeValue(n) {
+    return n + ":" + "x".repeat((n % 50) * 20);
+}
+
+if (ems.myID === 0) {
+    shared.writeXF("text", makeValue(0));
+}
+ems.barrier();
+
+//  Half the tasks replace the value while the others read it without locking
+//  the element, every value read must be one that was written in its entirety
+for (var iter = 0; iter < nIters; iter++) {
+    if (ems.myID % 2 === 0) {
+        shared.writeXF("text", makeValue(iter));
+    } else {
+        var fields = shared.read("text").split(":");
+        assert(fields[1].length === (parseInt(fields[0]) % 50) * 20, "Torn read: " + fields[0]);
+    }
+}
+ems.barrier();
+
+//  A view keeps the value read when the value is replaced
+var key = "view " + ems.myID;
+shared.writeXF(key, Buffer.from("viewed"));
+var view = shared.readView(key);
+shared.writeXF(key, "replaced");
+assert(view.toString() === "viewed"  &&  shared.read(key) === "replaced");
+ems.barrier();
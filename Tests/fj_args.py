@@ -33,6 +33,7 @@
  +-----------------------------------------------------------------------------+
 """
 import sys
+import os
 import time
 sys.path.append("../Python/")
 
@@ -65,10 +66,44 @@ def fj_test(a, b, c, taskN=None):
     # global_str += "Updated by process " + str(ems.myID)
 
 ems.diag("Entering first parallel region")
-ems.parallel(fj_test, global_str, 'two', 'three', 'taaaaaasdasdasda')
+ems.parallel(fj_test, global_str, 'two', 'three')
 ems.diag("globstr=" + global_str)
 
 ems.diag("This side")
 time.sleep(ems.myID/2)
 ems.parallel(ems.barrier)
 ems.diag("That side")
+
+#  A function that fails in a worker fails the parallel region on the master
+def fail_in_workers():
+    if ems.myID != 0:
+        raise ValueError("Expected failure in process " + str(ems.myID))
+
+try:
+    ems.parallel(fail_in_workers)
+    assert False
+except RuntimeError:
+    pass
+ems.parallel(ems.barrier)
+
+#  Closures cannot be rebuilt in the workers
+def make_closure(value):
+    return lambda: value
+
+try:
+    ems.parallel(make_closure(1))
+    assert False
+except ValueError:
+    pass
+
+#  A worker that exits fails the parallel region instead of hanging it
+def exit_in_workers():
+    if ems.myID != 0:
+        os._exit(1)
+
+try:
+    ems.parallel(exit_in_workers)
+    assert False
+except RuntimeError:
+    pass
+ems.diag("Failures reported")
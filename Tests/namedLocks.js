@@ -0,0 +1,86 @@
+/*-----------------------------------------------------------------------------+
+ |  Extended Memory Semantics (EMS)                            Version 1.6.1   |
+ |  http://mogill.com/                                       jace@mogill.com   |
+ +-----------------------------------------------------------------------------+
+ |  Copyright (c) 2011-2014, Synthetic Semantics LLC.  All rights reserved.    |
+ |  Copyright (c) 2015-2020, Jace A Mogill.  All rights reserved.              |
+ |                                                                             |
+ | Redistribution and use in source and binary forms, with or without          |
+ | modification, are permitted provided that the following conditions are met: |
+ |    * Redistributions of source code must retain the above copyright         |
+ |      notice, this list of conditions and the following disclaimer.          |
+ |    * Redistributions in binary form must reproduce the above copyright      |
+ |      notice, this list of conditions and the following disclaimer in the    |
+ |      documentation and/or other materials provided with the distribution.   |
+ |    * Neither the name of the Synthetic Semantics nor the names of its       |
+ |      contributors may be used to endorse or promote products derived        |
+ |      from this software without specific prior written permission.          |
+ |                                                                             |
+ |    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS      |
+ |    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT        |
+ |    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR    |
+ |    A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SYNTHETIC         |
+ |    SEMANTICS LLC BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,   |
+ |    EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,      |
+ |    PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR       |
+ |    PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF   |
+ |    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING     |
+ |    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS       |
+ |    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.             |
+ |                                                                             |
+ +-----------------------------------------------------------------------------*/
+var assert = require('assert');
+var ems = require('ems')(parseInt(process.argv[2]), false);
+var nIters = 1000;
+var shared = ems.new({
+    dimensions: [10],
+    heapSize: 100000,
+    useExisting: false,
+    setFEtags: 'full'
+});
+
+//  Every process naming the same lock gets the same lock
+var mutex = shared.newLock("counter");
+assert(mutex.lockID === shared.newLock("counter").lockID, "Named lock was created twice");
+var rw = shared.newLock("table", "rw");
+var sema = shared.newLock("pool", "semaphore", 3);
+
+shared.writeXF(0, 0);
+shared.writeXF(1, 0);
+shared.writeXF(2, 0);
+ems.barrier();
+
+//  Unprotected read-modify-write made safe by a mutex
+for (var iter = 0; iter < nIters; iter++) {
+    ems.critical(function () {
+        shared.write(0, shared.read(0) + 1);
+    }, undefined, mutex);
+}
+ems.barrier();
+assert(shared.readFF(0) === nIters * ems.nThreads, "Mutex lost updates: " + shared.readFF(0));
+
+//  Readers may share the lock, writers are exclusive
+for (iter = 0; iter < nIters; iter++) {
+    if (iter % 10 === 0) {
+        rw.acquire();
+        shared.write(1, shared.read(1) + 1);
+        rw.release();
+    } else {
+        rw.acquireRead();
+        assert(shared.read(1) >= 0);
+        rw.releaseRead();
+    }
+}
+ems.barrier();
+assert(shared.readFF(1) === (nIters / 10) * ems.nThreads, "RW lock lost updates: " + shared.readFF(1));
+
+//  No more than the initial semaphore count may be inside at once
+for (iter = 0; iter < nIters; iter++) {
+    sema.acquire();
+    var nInside = shared.faa(2, 1) + 1;
+    assert(nInside <= 3, "Too many holders of the semaphore: " + nInside);
+    shared.faa(2, -1);
+    sema.release();
+}
+ems.barrier();
+shared.destroy(true);
@@ -0,0 +1,92 @@
+/*-----------------------------------------------------------------------------+
+ |  Extended Memory Semantics (EMS)                            Version 1.6.1   |
+ |  http://mogill.com/                                       jace@mogill.com   |
+ +-----------------------------------------------------------------------------+
+ |  Copyright (c) 2011-2014, Synthetic Semantics LLC.  All rights reserved.    |
+ |  Copyright (c) 2015-2020, Jace A Mogill.  All rights reserved.              |
+ |                                                                             |
+ | Redistribution and use in source and binary forms, with or without          |
+ | modification, are permitted provided that the following conditions are met: |
+ |    * Redistributions of source code must retain the above copyright         |
+ |      notice, this list of conditions and the following disclaimer.          |
+ |    * Redistributions in binary form must reproduce the above copyright      |
+ |      notice, this list of conditions and the following disclaimer in the    |
+ |      documentation and/or other materials provided with the distribution.   |
+ |    * Neither the name of the Synthetic Semantics nor the names of its       |
+ |      contributors may be used to endorse or promote products derived        |
+ |      from this software without specific prior written permission.          |
+ |                                                                             |
+ |    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS      |
+ |    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT        |
+ |    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR    |
+ |    A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SYNTHETIC         |
+ |    SEMANTICS LLC BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,   |
+ |    EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,      |
+ |    PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR       |
+ |    PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF   |
+ |    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING     |
+ |    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS       |
+ |    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.             |
+ |                                                                             |
+ +-----------------------------------------------------------------------------*/
+var assert = require('assert');
+var ems = require('ems')(parseInt(process.argv[2]), false);
+var nIters = 20000;
+var keys = ["apple", "banana", 1234, 5.678];
+var shared = ems.new({
+    dimensions: [100],
+    heapSize: 1000000,
+    useMap: true,
+    useExisting: false,
+    setFEtags: 'full',
+    optimisticReads: true
+});
+
+function makeValue(n) {
+    return {n: n, s: "x".repeat(n % 500)};
+}
+
+if (ems.myID === 0) {
+    keys.forEach(function (key) {
+        shared.writeXF(key, makeValue(0));
+    });
+}
+ems.barrier();
+
+//  Half the tasks update the values while the others read them,
+//  every value read must be one that was written in its entirety
+for (var iter = 0; iter < nIters; iter++) {
+    var key = keys[iter % keys.length];
+    if (ems.myID % 2 === 0  &&  iter % 10 === 0) {
+        var old = shared.readFE(key);
+        shared.writeEF(key, makeValue(old.n + 1));
+    } else {
+        var value = (iter % 2) ? shared.read(key) : shared.readFF(key);
+        assert(value.s.length === value.n % 500, "Torn read of " + key + ": " + JSON.stringify(value));
+    }
+}
+ems.barrier();
+
+var nUpdates = 0;
+keys.forEach(function (key) {
+    nUpdates += shared.readFF(key).n;
+});
+assert(nUpdates === Math.ceil(ems.nThreads / 2) * (nIters / 10), "Lost updates: " + nUpdates);
+
+//  Transactions validate the read-only elements they read optimistically when they commit
+var rwKey = "tm rw " + ems.myID;
+var roKey = "tm ro " + ems.myID;
+shared.writeXF(rwKey, "original");
+shared.writeXF(roKey, 100);
+var tm = ems.tmStart([[shared, rwKey], [shared, roKey, true]]);
+assert(tm[0][3] === "original"  &&  tm[1][3] === 100, "Wrong values at the start of the transaction");
+shared.write(rwKey, "committed");
+assert(ems.tmEnd(tm, true), "Transaction did not commit");
+assert(shared.readFF(rwKey) === "committed");
+
+tm = ems.tmStart([[shared, roKey, true], [shared, rwKey]]);
+shared.write(rwKey, "discarded");
+shared.writeXF(roKey, 200);
+assert(!ems.tmEnd(tm, true), "Transaction committed after its read set changed");
+assert(shared.readFF(rwKey) === "committed", "Aborted transaction was not rolled back");
+ems.barrier();
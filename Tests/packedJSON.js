@@ -0,0 +1,166 @@
+/*-----------------------------------------------------------------------------+
+ |  Extended Memory Semantics (EMS)                            Version 1.6.1   |
+ |  http://mogill.com/                                       jace@mogill.com   |
+ +-----------------------------------------------------------------------------+
+ |  Copyright (c) 2011-2014, Synthetic Semantics LLC.  All rights reserved.    |
+ |  Copyright (c) 2015-2020, Jace A Mogill.  All rights reserved.              |
+ |                                                                             |
+ | Redistribution and use in source and binary forms, with or without          |
+ | modification, are permitted provided that the following conditions are met: |
+ |    * Redistributions of source code must retain the above copyright         |
+ |      notice, this list of conditions and the following disclaimer.          |
+ |    * Redistributions in binary form must reproduce the above copyright      |
+ |      notice, this list of conditions and the following disclaimer in the    |
+ |      documentation and/or other materials provided with the distribution.   |
+ |    * Neither the name of the Synthetic Semantics nor the names of its       |
+ |      contributors may be used to endorse or promote products derived        |
+ |      from this software without specific prior written permission.          |
+ |                                                                             |
+ |    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS      |
+ |    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT        |
+ |    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR    |
+ |    A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SYNTHETIC         |
+ |    SEMANTICS LLC BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,   |
+ |    EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,      |
+ |    PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR       |
+ |    PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF   |
+ |    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING     |
+ |    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS       |
+ |    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.             |
+ |                                                                             |
+ +-----------------------------------------------------------------------------*/
+var ems = require('ems')(parseInt(process.argv[2]));
+var util = require('./testUtils');
+var assert = require('assert');
+var arrLen = 10000;
+var nIters = 100000;
+
+var objs = ems.new({
+    dimensions: [arrLen],
+    heapSize: arrLen * 1000,
+    useExisting: false,
+    filename: '/tmp/EMS_packedJSON',
+    dataFill: {fill: [1, 'one']},
+    doDataFill: true,
+    setFEtags: 'full'
+});
+
+//---------------------------------------------------------------------------
+//  Objects and arrays are stored as MessagePack and must read back
+//  the same as a JSON.stringify()/JSON.parse() round trip
+var when = new Date(1500000000000);
+var samples = [
+    {a: 1, b: -2.5, c: 'cee', d: true, e: null, f: [1, [2, [3]]], g: {h: {i: 'deep'}}},
+    [0, -1, -32, -33, 127, 128, 255, 256, 65535, 65536, -40000, 4294967296, -5000000000, 0.1],
+    ['簣ひょ갤妣ゃキェぱ覣.𐤦ぴ盥', '', Array(40).join('x'), Array(300).join('y'), Array(70000).join('z')],
+    {undef: undefined, fn: function () {}, kept: 1, arr: [undefined, function () {}, NaN, Infinity]},
+    {when: when, nested: {when: when}},
+    [],
+    {},
+    {'0': 'zero', '1': 'one'}
+];
+
+ems.master(function () {
+    samples.forEach(function (sample, sampleN) {
+        objs.writeXF(sampleN, sample);
+        assert.deepStrictEqual(objs.readFF(sampleN), JSON.parse(JSON.stringify(sample)),
+            'Packed round trip ' + sampleN + ' read back ' + JSON.stringify(objs.readFF(sampleN)));
+    });
+    objs.writeXF(0, null);
+    assert(objs.readFF(0) === null);
+    assert.deepStrictEqual(objs.readFF(arrLen - 1), {fill: [1, 'one']});
+
+    //  Buffers are stored as binary data
+    objs.writeXF(1, {buf: Buffer.from([0, 1, 2, 255])});
+    assert(Buffer.isBuffer(objs.readFF(1).buf)  &&  objs.readFF(1).buf.equals(Buffer.from([0, 1, 2, 255])));
+    objs.writeXF(1, {buf: Buffer.alloc(0)});
+    assert(Buffer.isBuffer(objs.readFF(1).buf)  &&  objs.readFF(1).buf.length === 0);
+
+    //  Compare-and-swap compares the encoded objects
+    objs.writeXF(2, {x: 1});
+    assert.deepStrictEqual(objs.cas(2, {x: 1}, 'swapped'), {x: 1});
+    assert(objs.readFF(2) === 'swapped');
+
+    //  Only own properties are packed, inherited ones are left behind
+    var derived = Object.create({inherited: 1});
+    derived.own = 2;
+    objs.writeXF(2, derived);
+    assert.deepStrictEqual(objs.readFF(2), {own: 2});
+
+    //  JSON text written by earlier versions is still readable
+    objs.data.writeXF(3, JSON.stringify({legacy: [1, 2]}), true);
+    assert.deepStrictEqual(objs.readFF(3), {legacy: [1, 2]});
+});
+ems.barrier();
+
+//---------------------------------------------------------------------------
+//  Fields of stored objects are read and updated in place
+var session = {user: 'someone', hits: 0, cart: {items: ['a', 'b'], total: 1.5}};
+ems.master(function () {
+    objs.writeXF(4, session);
+    assert(objs.readField(4, 'cart.items.1') === 'b');
+    assert(objs.readField(4, ['cart', 'total']) === 1.5);
+    assert.deepStrictEqual(objs.readField(4, 'cart'), session.cart);
+    assert(objs.readField(4, 'cart.missing') === undefined);
+    objs.writeField(4, 'user', 'someone else entirely');
+    objs.writeField(4, ['cart', 'items', 2], {sku: 'c', qty: 2});
+    objs.writeField(4, 'cart.total', 10);
+    objs.writeField(4, 'lastSeen', Array(1000).join('t'));
+    assert(objs.faaField(4, 'cart.items.2.qty', 1) === 2);
+    assert(objs.faaField(4, 'visits', 1) === undefined);
+    assert.deepStrictEqual(objs.readFF(4), {
+        user: 'someone else entirely', hits: 0,
+        cart: {items: ['a', 'b', {sku: 'c', qty: 3}], total: 10},
+        lastSeen: Array(1000).join('t'), visits: 1
+    });
+});
+ems.barrier();
+for (var hitN = 0; hitN < 1000; hitN++) {
+    objs.faaField(4, 'hits', 1);
+}
+ems.barrier();
+assert(objs.readField(4, 'hits') === 1000 * ems.nThreads);
+ems.barrier();
+
+//---------------------------------------------------------------------------
+//  Objects pass through stacks and queues
+var stack = ems.new({
+    dimensions: [ems.nThreads * 10],
+    heapSize: ems.nThreads * 10 * 200,
+    useExisting: false,
+    filename: '/tmp/EMS_packedJSONstack',
+    setFEtags: 'empty'
+});
+for (var pushN = 0; pushN < 10; pushN++) {
+    stack.push({id: ems.myID, n: pushN, tag: 'p' + pushN});
+}
+ems.barrier();
+var popped = stack.pop();
+assert(typeof popped.id === 'number'  &&  popped.tag === 'p' + popped.n);
+ems.barrier();
+
+
+//---------------------------------------------------------------------------
+//  Throughput of packed and text JSON values
+var record = {name: 'record', id: 12345, price: 12.75, tags: ['a', 'bb', 'ccc'], pos: {x: 1, y: 2, z: 3}};
+ems.barrier();
+var startTime = util.timerStart();
+ems.parForEach(0, nIters, function (idx) {
+    objs.write(idx % arrLen, record);
+});
+util.timerStop(startTime, nIters, " packed JSON writes      ", ems.myID);
+
+startTime = util.timerStart();
+ems.parForEach(0, nIters, function (idx) {
+    assert(objs.read(idx % arrLen).id === 12345);
+});
+util.timerStop(startTime, nIters, " packed JSON reads       ", ems.myID);
+
+ems.parForEach(0, arrLen, function (idx) {
+    objs.data.write(idx, JSON.stringify(record), true);
+});
+startTime = util.timerStart();
+ems.parForEach(0, nIters, function (idx) {
+    assert(objs.read(idx % arrLen).id === 12345);
+});
+util.timerStop(startTime, nIters, " text JSON reads         ", ems.myID);
@@ -221,6 +221,576 @@ readback = unmapped.readFF(0)
 assert readback == -1234
 
 
+# ==========================================================================
+#  Named locks allocated on the region's heap
+counterLock = unmapped.newLock('counter')
+assert counterLock.lockID == unmapped.newLock('counter').lockID
+rwLock = unmapped.newLock('rw', 'rw')
+sema = unmapped.newLock('sema', 'semaphore', 2)
+ems.barrier()
+unmapped.writeXF(1, 0)
+unmapped.writeXF(2, 0)
+ems.barrier()
+for i in range(100):
+    ems.critical(lambda: unmapped.write(1, unmapped.read(1) + 1), lock=counterLock)
+    with rwLock:
+        unmapped.write(2, unmapped.read(2) + 1)
+    rwLock.acquireRead()
+    assert unmapped.read(2) > 0
+    rwLock.releaseRead()
+    sema.acquire()
+    sema.release()
+ems.barrier()
+assert unmapped.readFF(1) == nprocs * 100
+assert unmapped.readFF(2) == nprocs * 100
+#  Releasing a lock that is not held raises
+try:
+    counterLock.release()
+    assert False
+except ValueError:
+    pass
+#  A writer that gives up waiting does not keep readers out
+ownLock = unmapped.newLock('rw %d' % ems.myID, 'rw')
+ownLock.acquireRead()
+try:
+    ownLock.acquire(100)
+    assert False
+except TimeoutError:
+    pass
+ownLock.acquireRead(100)
+ownLock.releaseRead()
+ownLock.releaseRead()
+with ownLock:
+    pass
+
+
+# ==========================================================================
+#  Task graphs execute tasks when the elements they read are full
+flow = ems.new({
+    'dimensions': [40],
+    'heapSize': 100000,
+    'doSetFEtags': True,
+    'setFEtags': 'empty'
+})
+graph = flow.newTaskGraph('flow', 30)
+nTasksRun = [0]
+
+def task(func):
+    def counted():
+        nTasksRun[0] += 1
+        func()
+    return counted
+
+def source(n):
+    return task(lambda: flow.writeEF(n, n))
+
+def pair(n):
+    return task(lambda: flow.writeEF(10 + n, flow.readFF(n) + flow.readFF((n + 1) % 10)))
+
+def total():
+    result = 0
+    for n in range(10):
+        result += flow.readFF(10 + n)
+    flow.writeEF(20, result)
+    flow.writeEF(30, result + 1)   # Not an output of the graph
+
+#  Element 30 is not a declared output, the task reading it waits until it is full
+graph.add(task(lambda: flow.writeEF(31, flow.readFF(30) * 2)), [[flow, 30]], [[flow, 31]])
+for n in range(10):
+    graph.add(source(n), [], [[flow, n]])
+for n in range(10):
+    graph.add(pair(n), [[flow, n], [flow, (n + 1) % 10]], [[flow, 10 + n]])
+graph.add(task(total), [[flow, 10 + n] for n in range(10)], [[flow, 20]])
+#  A task with an output not in its map is not added, its input does not become an edge
+try:
+    graph.add(task(total), [[flow, 0]], [[mapped, "graph output never written"]])
+    assert ems.myID != 0
+except ValueError:
+    assert ems.myID == 0
+for repeat in range(2):
+    graph.run()
+    assert flow.readFF(20) == 90
+    assert flow.readFF(31) == 182
+    ems.barrier()
+    if ems.myID == 0:
+        for n in [0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 30, 31]:
+            flow.readFE(n)
+    ems.barrier()
+flow.writeXF(39, 0)
+ems.barrier()
+flow.faa(39, nTasksRun[0])
+ems.barrier()
+assert flow.readFF(39) == 2 * 22
+flow.destroy(False)
+
+
+# ==========================================================================
+#  Readers-writer locks using per-process reader indicators
+scalable = ems.new({
+    'dimensions': [10],
+    'heapSize': 10000,
+    'useMap': True,
+    'scalableRW': True,
+    'doSetFEtags': True
+})
+scalable.writeXF('hot', 0)
+ems.barrier()
+for i in range(200):
+    if i % 20 == 0:
+        scalable.faa('hot', 1)
+    else:
+        assert scalable.readRW('hot') >= 0
+        assert scalable.releaseRW('hot') >= 0
+ems.barrier()
+assert scalable.readFF('hot') == nprocs * 10
+scalable.destroy(False)
+
+
+# ==========================================================================
+#  Optimistic reads of version stamped elements
+optimistic = ems.new({
+    'dimensions': [100],
+    'heapSize': 100000,
+    'useMap': True,
+    'optimisticReads': True,
+    'doSetFEtags': True
+})
+optimistic.writeXF('text', '0:')
+ems.barrier()
+for i in range(200):
+    if ems.myID % 2 == 0 and i % 10 == 0:
+        n = int(optimistic.readFE('text').split(':')[0]) + 1
+        optimistic.writeEF('text', str(n) + ':' + 'y' * n)
+    else:
+        n, text = optimistic.read('text').split(':')
+        assert len(text) == int(n)
+ems.barrier()
+assert optimistic.readFF('text').split(':')[0] == str(((nprocs + 1) // 2) * 20)
+
+#  Transactions validate the read-only elements of version stamped regions when they commit
+rwKey = 'tm rw ' + str(ems.myID)
+roKey = 'tm ro ' + str(ems.myID)
+optimistic.writeXF(rwKey, 'original')
+optimistic.writeXF(roKey, 100)
+tm = ems.tmStart([[optimistic, rwKey], [optimistic, roKey, True]])
+assert tm[0][3] == 'original'  and  tm[1][3] == 100
+optimistic.write(rwKey, 'committed')
+assert ems.tmEnd(tm, True)
+assert optimistic.readFF(rwKey) == 'committed'
+tm = ems.tmStart([[optimistic, roKey, True], [optimistic, rwKey]])
+optimistic.write(rwKey, 'discarded')
+optimistic.writeXF(roKey, 200)
+assert not ems.tmEnd(tm, True)
+assert optimistic.readFF(rwKey) == 'committed'
+#  A transaction whose elements cannot be found raises instead of starting
+try:
+    ems.tmStart([[optimistic, rwKey], [optimistic, None]])
+    assert False
+except ValueError:
+    pass
+assert optimistic.readFF(rwKey) == 'committed'
+
+#  Software transactions move value between elements without creating or destroying any
+if ems.myID == 0:
+    optimistic.writeXF('stm from', 1000)
+    optimistic.writeXF('stm to', 0)
+    optimistic.writeXF('stm log', [])
+ems.barrier()
+
+def transfer(tx):
+    amount = tx.read(optimistic, 'stm from') % 7 + 1
+    tx.write(optimistic, 'stm from', tx.read(optimistic, 'stm from') - amount)
+    tx.write(optimistic, 'stm to', tx.read(optimistic, 'stm to') + amount)
+    tx.write(optimistic, 'stm log', tx.read(optimistic, 'stm log') + [amount])
+    assert tx.read(optimistic, 'stm to') > 0
+    return amount
+
+for i in range(20):
+    ems.stm(transfer)
+    assert ems.stm(lambda tx: tx.read(optimistic, 'stm from') + tx.read(optimistic, 'stm to')) == 1000
+ems.barrier()
+log = optimistic.readFF('stm log')
+total = 0
+for amount in log:
+    total += amount
+assert len(log) == nprocs * 20
+assert optimistic.readFF('stm to') == total
+assert optimistic.readFF('stm from') == 1000 - total
+
+#  A key read while absent conflicts with its being added before the commit
+absentKey = 'stm absent ' + str(ems.myID)
+attempts = []
+def readAbsent(tx):
+    attempts.append(tx.read(optimistic, absentKey))
+    if len(attempts) == 1:
+        optimistic.writeXF(absentKey, 'added')
+    return attempts[-1]
+assert ems.stm(readAbsent) == 'added'
+assert attempts == [None, 'added']
+
+#  An element emptied while a transaction reads it conflicts instead of blocking the transaction
+emptiedKey = 'stm emptied ' + str(ems.myID)
+optimistic.writeXF(emptiedKey, 'initial')
+attempts = []
+def readEmptied(tx):
+    attempts.append(len(attempts))
+    if len(attempts) == 1:
+        optimistic.readFE(emptiedKey)
+    elif len(attempts) == 2:
+        optimistic.writeEF(emptiedKey, 'refilled')
+    return tx.read(optimistic, emptiedKey)
+assert ems.stm(readEmptied) == 'refilled'
+assert attempts == [0, 1]
+
+#  Elements of regions without version stamps cannot be read in a transaction
+try:
+    ems.stm(lambda tx: tx.read(mapped, 'stm unversioned'))
+    assert False
+except ValueError:
+    pass
+ems.barrier()
+optimistic.destroy(False)
+
+
+# ==========================================================================
+#  Replaced strings are freed by epochs, plain reads copy them without locking the element.
+#  The heap only holds a few of the strings written, it is exhausted unless they are reclaimed.
+epochs = ems.new({
+    'dimensions': [100],
+    'heapSize': 20000,
+    'useMap': True,
+    'epochs': True,
+    'doSetFEtags': True
+})
+epochs.writeXF('text', '0:')
+ems.barrier()
+for i in range(3000):
+    if ems.myID % 2 == 0:
+        n = i % 50
+        epochs.writeXF('text', str(n) + ':' + 'z' * (n * 20))
+    else:
+        n, text = epochs.read('text').split(':')
+        assert len(text) == int(n) * 20
+ems.barrier()
+epochs.writeXF(ems.myID, b'viewed')
+view = epochs.readView(ems.myID)
+epochs.writeXF(ems.myID, 'replaced')
+assert bytes(view) == b'viewed' and epochs.read(ems.myID) == 'replaced'
+del view
+if ems.myID == 0:
+    epochs.writeXF('doc', {'text': '0:', 'tail': [1, 2, 3]})
+ems.barrier()
+#  Fields of documents are edited in a copy, plain reads never see a document being edited
+for i in range(1000):
+    if ems.myID % 2 == 0:
+        n = i % 50
+        epochs.writeField('doc', 'text', str(n) + ':' + 'z' * (n * 5))
+    else:
+        doc = epochs.read('doc')
+        n, text = doc['text'].split(':')
+        assert len(text) == int(n) * 5  and  doc['tail'] == [1, 2, 3]
+ems.barrier()
+epochs.destroy(False)
+
+
+# ==========================================================================
+#  Equal strings and blobs share one copy on the heap of regions created with intern.
+#  The heap only holds a few copies of the value stored in every element.
+interned = ems.new({
+    'dimensions': [130],
+    'heapSize': 4000,
+    'useMap': True,
+    'intern': True,
+    'doSetFEtags': True
+})
+shared = 'shared by every element ' * 5
+long_key = 'a key longer than seven bytes'
+for i in range(10):
+    interned.writeXF(ems.myID * 10 + i, shared)
+ems.barrier()
+for i in range(nprocs * 10):
+    assert interned.readFF(i) == shared
+interned.writeXF(long_key, shared)
+assert interned.readFF(long_key) == shared
+ems.barrier()
+for rep in range(200):
+    mine = ('%d %d ' % (ems.myID, rep)) * 10
+    interned.writeXF(ems.myID * 10, mine)
+    assert interned.readFF(ems.myID * 10) == mine
+    assert interned.cas(ems.myID * 10 + 1, shared, mine) == shared
+    assert interned.cas(ems.myID * 10 + 1, mine, shared) == mine
+interned.writeXF(ems.myID * 10, shared)
+assert interned.faa(ems.myID * 10, '!') == shared
+assert interned.readFF(ems.myID * 10) == shared + '!'
+ems.barrier()
+interned.destroy(False)
+
+
+# ==========================================================================
+#  Regions created with stats count lookups and probes in every process and
+#  report the free heap when the counters are read.
+counted = ems.new({
+    'dimensions': [nprocs * 20],
+    'heapSize': 10000,
+    'useMap': True,
+    'stats': True,
+    'doSetFEtags': True
+})
+for i in range(10):
+    counted.writeXF('key %d %d' % (ems.myID, i), 'value')
+    assert counted.readFF('key %d %d' % (ems.myID, i)) == 'value'
+ems.barrier()
+stats = counted.stats()
+assert stats['lookups'] >= nprocs * 20
+assert stats['probes'] >= stats['lookups']
+assert 0 < stats['heapLargestFree'] <= stats['heapFree']
+assert stats['allocFails'] == 0
+ems.barrier()
+if ems.myID == 0:
+    counted.stats(True)
+ems.barrier()
+assert counted.stats()['lookups'] == 0
+assert counted.hotspots() == []
+ems.barrier()
+
+#  Waits on the one key every process takes turns emptying are sampled.
+#  Process 0 holds the key empty until every other process is about to wait for it.
+counted.writeXF('hot', 0)
+counted.writeXF('arrived', 0)
+ems.barrier()
+if ems.myID == 0:
+    hot = counted.readFE('hot')
+ems.barrier()
+if ems.myID == 0:
+    while counted.readFF('arrived') < nprocs - 1:
+        time.sleep(0.01)
+    time.sleep(0.1)
+    counted.writeEF('hot', hot + 1)
+else:
+    counted.faa('arrived', 1)
+    counted.writeEF('hot', counted.readFE('hot') + 1)
+ems.barrier()
+assert counted.readFF('hot') == nprocs
+assert counted.stats()['tagWaits'] >= nprocs - 1
+spots = counted.hotspots(3)
+assert 1 <= len(spots) <= 3
+assert spots[0]['key'] == 'hot'
+assert spots[0]['kind'] == 'element'
+assert spots[0]['waits'] >= nprocs - 1
+nSampled = 0
+for count in spots[0]['histogram']:
+    nSampled += count
+assert nSampled == spots[0]['waits']
+assert all(0 < proc < nprocs for proc in spots[0]['processes'])
+ems.barrier()
+counted.destroy(False)
+
+
+# ==========================================================================
+#  Arrays are exported to files and imported back, each process importing
+#  its own part of the file
+bulk_values = {'int': -7, 'float': 2.5, 'true': True, 'text': 'a "quoted", comma\'d \u00e9 string',
+                'short': 'hi', 'doc': {'list': [1, 2.25, None, 'x'], 'nested': {'flag': False}}, 3: 'three',
+                'brackets': '[1, 2]', '{"a": 1}': 'braces',
+                'lines': '\r\n'.join('"line" %d' % i for i in range(300)) + '\n'}
+bulk_src = ems.new({
+    'dimensions': [nprocs * 20],
+    'heapSize': 100000,
+    'useMap': True,
+    'doSetFEtags': True
+})
+if ems.myID == 0:
+    for key in bulk_values:
+        bulk_src.writeXF(key, bulk_values[key])
+    for i in range(100):
+        bulk_src.writeXF('row%d' % i, i * 1.5)
+ems.barrier()
+for format in ['ndjson', 'csv', 'columns']:
+    bulk_fname = '/tmp/py_bulk.' + format
+    if ems.myID == 0:
+        assert bulk_src.exportFile(bulk_fname, format) == len(bulk_values) + 100
+    ems.barrier()
+    bulk_dst = ems.new({
+        'dimensions': [nprocs * 20],
+        'heapSize': 100000,
+        'useMap': True,
+        'doSetFEtags': True
+    })
+    if ems.myID == 0:
+        bulk_dst.writeXF('imported', 0)
+    ems.barrier()
+    bulk_dst.faa('imported', bulk_dst.importFile(bulk_fname, format, ems.myID, nprocs))
+    ems.barrier()
+    assert bulk_dst.readFF('imported') == len(bulk_values) + 100
+    for key in bulk_values:
+        assert bulk_dst.readFF(key) == bulk_values[key]
+    assert bulk_dst.readFF('row99') == 99 * 1.5
+    ems.barrier()
+    bulk_dst.destroy(True)
+    if ems.myID == 0:
+        os.remove(bulk_fname)
+
+#  Blobs are only exported to columns
+if ems.myID == 0:
+    bulk_src.writeXF('blob', b'\x00\x01binary')
+    try:
+        bulk_src.exportFile('/tmp/py_bulk.ndjson', 'ndjson')
+        assert False
+    except IOError:
+        pass
+    assert bulk_src.exportFile('/tmp/py_bulk.columns', 'columns', 0, nprocs * 20) == len(bulk_values) + 101
+    bulk_src.writeXF('blob', None)
+    assert bulk_src.importFile('/tmp/py_bulk.columns', 'columns') == len(bulk_values) + 101
+    assert bulk_src.readFF('blob') == b'\x00\x01binary'
+    os.remove('/tmp/py_bulk.columns')
+    os.remove('/tmp/py_bulk.ndjson')
+ems.barrier()
+bulk_src.destroy(True)
+
+#  Column files are written in blocks holding a bounded amount of data,
+#  and parts of an import span the blocks
+big_src = ems.new(6, 8000000)
+big_dst = ems.new(6, 8000000)
+if ems.myID == 0:
+    for i in range(6):
+        big_src.writeXF(i, chr(ord('a') + i) * 1000000)
+    assert big_src.exportFile('/tmp/py_bulk_big.columns', 'columns') == 6
+    assert os.path.getsize('/tmp/py_bulk_big.columns') > 6000000
+    nImported = 0
+    for part in range(4):
+        nImported += big_dst.importFile('/tmp/py_bulk_big.columns', 'columns', part, 4)
+    assert nImported == 6
+    assert [big_dst.read(i) for i in range(6)] == [chr(ord('a') + i) * 1000000 for i in range(6)]
+    os.remove('/tmp/py_bulk_big.columns')
+ems.barrier()
+big_src.destroy(True)
+big_dst.destroy(True)
+
+
+# ==========================================================================
+#  A map is built by every process writing its own part of the keys
+many = ems.new({
+    'dimensions': [nprocs * 400],
+    'heapSize': 1000000,
+    'useMap': True
+})
+many_keys = [('key number %d' % i) if i % 3 else i for i in range(nprocs * 200)]
+mine = many_keys[ems.myID::nprocs]
+assert many.writeMany(mine + ['s%d' % ems.myID], [str(key) * 2 for key in mine] + [ems.myID]) == len(mine) + 1
+ems.barrier()
+for key in many_keys:
+    assert many.read(key) == str(key) * 2
+assert [many.read('s%d' % proc) for proc in range(nprocs)] == list(range(nprocs))
+ems.barrier()
+#  Keys already in the map are rewritten in place, freeing the copies of their keys
+heap_free = many.stats()['heapFree']
+ems.barrier()
+assert many.writeMany(mine, [str(key) * 2 for key in mine]) == len(mine)
+ems.barrier()
+assert many.stats()['heapFree'] == heap_free
+ems.barrier()
+#  The last of equal keys in a batch remains
+assert many.writeMany([mine[0], mine[0]], ['first', 'last']) == 2
+assert many.read(mine[0]) == 'last'
+ems.barrier()
+#  A key whose value cannot be stored is not left in the map
+unstored = 'unstored key %d' % ems.myID
+try:
+    many.writeMany([unstored], ['x' * 2000000])
+    assert False
+except ValueError:
+    pass
+assert many.read(unstored) is None
+many.writeXF(unstored, 'stored')
+assert many.read(unstored) == 'stored'
+ems.barrier()
+many.destroy(False)
+
+
+# ==========================================================================
+#  Ordered index: every process puts and removes its own keys, then scans all of them
+ordered = ems.new({
+    'dimensions': [1],
+    'heapSize': 4000000,
+    'filename': '/tmp/py_ordered.ems'
+})
+index = ordered.newOrderedIndex('keys')
+n_ordered = nprocs * 300
+for n in range(ems.myID, n_ordered, nprocs):
+    index.put('k%05d' % n, n)
+    index.put(n, 'value %d' % n)
+ems.barrier()
+assert len(index) == 2 * n_ordered
+ems.barrier()
+for n in range(ems.myID, n_ordered, 2 * nprocs):
+    assert index.remove('k%05d' % n)
+    assert not index.remove('k%05d' % n)
+index.put(ems.myID, 'replaced %d' % ems.myID)
+if ems.myID == 0:
+    index.put(False, 'false')
+    index.put(2.5, 'float')
+ems.barrier()
+kept = [('k%05d' % n, n) for n in range(n_ordered) if n % (2 * nprocs) >= nprocs]
+assert list(index.prefix('k')) == kept
+assert list(index.prefix('k001', batch=7)) == [item for item in kept if item[0].startswith('k001')]
+assert list(index.range('k00100', 'k00200')) == [item for item in kept if 'k00100' <= item[0] < 'k00200']
+assert list(index.range(None, 3)) == [(False, 'false'), (0, 'replaced 0'), (1, 'replaced 1'), (2, 'replaced 2'), (2.5, 'float')]
+assert list(index.range(100, 110, batch=3)) == [(n, 'value %d' % n) for n in range(100, 110)]
+assert index.get('k%05d' % nprocs) == nprocs
+assert index.get('k00000') is None
+assert index.get('k00000', 'gone') == 'gone'
+assert len(index) == n_ordered + len(kept) + 2
+ems.barrier()
+#  Keys put and removed by every process at once are always scanned in order
+for n in range(200):
+    key = 'c%03d' % ((n * 7 + ems.myID) % 50)
+    if n % 2:
+        index.put(key, ems.myID)
+    else:
+        index.remove(key)
+    scanned = [key for key, value in index.prefix('c', batch=16)]
+    assert scanned == sorted(set(scanned))
+ems.barrier()
+assert ordered.newOrderedIndex('keys').get(nprocs - 1) == 'replaced %d' % (nprocs - 1)
+ordered.destroy(False)
+
+
+# ==========================================================================
+#  The keys of a map are enumerated from its occupied slots, in batches and in parallel
+scanned = ems.new({
+    'dimensions': [nprocs * 64],
+    'heapSize': 1000000,
+    'useMap': True
+})
+scan_keys = [('scanned key %d' % i) if i % 3 == 0 else ('s%d' % i) if i % 3 == 1 else i * 1000
+             for i in range(nprocs * 20)] + [2.5]
+visits = ems.new(len(scan_keys))
+for i in range(ems.myID, len(scan_keys), nprocs):
+    scanned.write(scan_keys[i], [i, scan_keys[i]])
+    visits.write(i, 0)
+ems.barrier()
+expected = dict((key, [i, key]) for i, key in enumerate(scan_keys))
+assert dict(scanned.items()) == expected
+assert len(list(scanned.items(batch=5))) == len(expected)
+low = dict(scanned.items(0, 100, batch=3))
+high = dict(scanned.items(100))
+assert len(low) + len(high) == len(expected)
+low.update(high)
+assert low == expected
+
+
+def visit(key, value):
+    assert expected[key] == value
+    visits.faa(value[0], 1)
+
+
+scanned.parForEachKey(visit, blockSize=50)
+assert [visits.read(i) for i in range(len(scan_keys))] == [1] * len(scan_keys)
+ems.barrier()
+visits.destroy(False)
+scanned.destroy(False)
+
+
 # ==========================================================================
 def check_master():
     assert ems.myID == 0
@@ -286,6 +856,119 @@ ems.barrier()
 assert stack.dequeue() is None
 ems.barrier()
 
+# ==========================================================================
+# Lists and dicts are stored as MessagePack
+packed_idx = nelem * ems.myID + 7
+packed_val = {'id': ems.myID, 'name': various_consts[0], 'nested': {'list': [1, -2, 3.5, None, True, 'x' * 300]},
+              'big': 1 << 40, 'empty': {}}
+unmapped.writeXF(packed_idx, packed_val)
+assert unmapped.readFF(packed_idx) == packed_val
+unmapped.writeXF(packed_idx, [packed_val, [[]]])
+assert unmapped.readFF(packed_idx) == [packed_val, [[]]]
+assert unmapped.cas(packed_idx, [packed_val, [[]]], 'swapped') == [packed_val, [[]]]
+assert unmapped.readFF(packed_idx) == 'swapped'
+
+# Keys of objects are converted to strings as JSON converts them, bytes are kept as binary
+unmapped.writeXF(packed_idx, {1: 'a', 2.5: [{True: None}], 'blob': (b'\x00\x01', None)})
+assert unmapped.readFF(packed_idx) == {'1': 'a', '2.5': [{'true': None}], 'blob': [b'\x00\x01', None]}
+
+# JSON text written by earlier versions is still readable
+legacy_val = ems._new_EMSval('{"legacy": [1, 2]}')
+legacy_val[0].type = ems.TYPE_JSON
+ems.libems.EMSwriteXF(unmapped.mmapID, ems._new_EMSval(packed_idx), legacy_val)
+assert unmapped.readFF(packed_idx) == {'legacy': [1, 2]}
+
+# Fields of packed objects are read and updated in place
+unmapped.writeXF(packed_idx, packed_val)
+assert unmapped.readField(packed_idx, ['nested', 'list', 2]) == 3.5
+assert unmapped.readField(packed_idx, 'nested.list.5') == 'x' * 300
+assert unmapped.readField(packed_idx, 'nested') == packed_val['nested']
+assert unmapped.readField(packed_idx, 'missing') is None
+unmapped.writeField(packed_idx, 'nested.list.0', 2)
+unmapped.writeField(packed_idx, 'nested.list.1', 'longer than before')
+unmapped.writeField(packed_idx, 'nested.list.6', {'appended': True})
+unmapped.writeField(packed_idx, 'added', 'x' * 1000)
+assert unmapped.faaField(packed_idx, 'big', 1) == 1 << 40
+assert unmapped.faaField(packed_idx, 'id', 0.5) == ems.myID
+assert unmapped.faaField(packed_idx, 'count', 3) is None
+packed_val['nested']['list'][0:2] = [2, 'longer than before']
+packed_val['nested']['list'].append({'appended': True})
+packed_val.update({'added': 'x' * 1000, 'big': (1 << 40) + 1, 'id': ems.myID + 0.5, 'count': 3})
+assert unmapped.readFF(packed_idx) == packed_val
+# An integer sum that overflows becomes a float
+unmapped.writeField(packed_idx, 'max', (1 << 63) - 1)
+assert unmapped.faaField(packed_idx, 'max', 1) == (1 << 63) - 1
+assert unmapped.readField(packed_idx, 'max') == 2.0 ** 63
+
+# Every process increments the same field
+counter_idx = nelem * nprocs - 1
+if ems.myID == 0:
+    unmapped.writeXF(counter_idx, {'session': {'hits': 0, 'user': 'u'}})
+ems.barrier()
+for hit in range(100):
+    unmapped.faaField(counter_idx, 'session.hits', 1)
+ems.barrier()
+assert unmapped.readField(counter_idx, 'session.hits') == 100 * nprocs
+ems.barrier()
+
+# ==========================================================================
+# Strings carry their length, bytes are stored as blobs
+blob_idx = nelem * ems.myID + 8
+nul_str = 'before\x00after \u7c23'
+unmapped.writeXF(blob_idx, nul_str)
+assert unmapped.readFF(blob_idx) == nul_str
+assert unmapped.faa(blob_idx, '\x00!') == nul_str
+assert unmapped.readFF(blob_idx) == nul_str + '\x00!'
+unmapped.writeXF(blob_idx, '')
+assert unmapped.readFF(blob_idx) == ''
+blob = bytes([0, 1, 2, 0xc0, 0xc1, 255, 0])
+unmapped.writeXF(blob_idx, blob)
+assert unmapped.readFF(blob_idx) == blob
+assert unmapped.cas(blob_idx, blob, bytearray(b'\x00' * 1000)) == blob
+assert unmapped.readFF(blob_idx) == b'\x00' * 1000
+unmapped.writeXF(blob_idx, {'inside': blob})
+assert unmapped.readFF(blob_idx) == {'inside': blob}
+mapped.writeXF('key\x00' + str(ems.myID), blob)
+assert mapped.readFF('key\x00' + str(ems.myID)) == blob
+assert mapped.read('key') is None
+ems.barrier()
+
+# Views read strings and blobs in place, a replaced value lives until its last view is released
+unmapped.writeXF(blob_idx, blob)
+view = unmapped.readView(blob_idx)
+assert view.readonly and bytes(view) == blob
+unmapped.writeXF(blob_idx, b'replaced')
+assert bytes(view) == blob and unmapped.readFF(blob_idx) == b'replaced'
+del view
+unmapped.writeXF(blob_idx, nul_str)
+assert bytes(unmapped.readView(blob_idx)).decode('utf-8') == nul_str
+unmapped.writeXF(blob_idx, 12.5)
+assert unmapped.readView(blob_idx) == 12.5
+for rep in range(2000):
+    unmapped.writeXF(blob_idx, str(rep).encode() * 200)
+    view = unmapped.readView(blob_idx)
+    unmapped.writeXF(blob_idx, None)
+    assert bytes(view[:len(str(rep))]) == str(rep).encode()
+del view
+ems.barrier()
+
+# Strings and blobs of up to 7 bytes are stored in the data word instead of the heap
+for length in range(10):
+    short = 'abc\x00efghij'[:length]
+    unmapped.writeXF(blob_idx, short)
+    assert unmapped.readFF(blob_idx) == short
+    assert bytes(unmapped.readView(blob_idx)) == short.encode()
+    unmapped.writeXF(blob_idx, short.encode())
+    assert unmapped.readFF(blob_idx) == short.encode()
+    mapped.writeXF(short + str(ems.myID), length)
+    assert mapped.readFF(short + str(ems.myID)) == length
+unmapped.writeXF(blob_idx, 'abc')
+assert unmapped.faa(blob_idx, 'defg') == 'abc'
+assert unmapped.faa(blob_idx, 'h') == 'abcdefg'
+assert unmapped.cas(blob_idx, 'abcdefgh', 'xy') == 'abcdefgh'
+assert unmapped.readFF(blob_idx) == 'xy'
+ems.barrier()
+
 # ==========================================================================
 # Fancy array syntax
 mapped.writeXF(-1234, 'zero')
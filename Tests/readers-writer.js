@@ -90,3 +90,35 @@ ems.barrier();
         objMap.releaseRW(elem);
     }
 });
+
+
+//  Readers announced in per-process reader indicators are not limited
+//  by the reader count in the tag, writers wait for them to drain
+var scalable = ems.new({
+    dimensions: [10],
+    heapSize: arrLen * 200,
+    useMap: true,
+    useExisting: false,
+    setFEtags: 'full',
+    scalableRW: true
+});
+
+scalable.writeXF('hot', 0);
+count.writeXF(1, 0);
+ems.barrier();
+
+for (nTimes = 0; nTimes < 10000; nTimes += 1) {
+    if (nTimes % 100 === ems.myID) {
+        //  Exclusive update while no readers hold the element
+        scalable.faa('hot', 1);
+        assert(count.read(1) === 0, "Writer entered while readers held the lock");
+    } else {
+        var readback = scalable.readRW('hot');
+        count.faa(1, 1);
+        assert(typeof readback === "number", "Scalable reader read wrong data: " + readback);
+        count.faa(1, -1);
+        scalable.releaseRW('hot');
+    }
+}
+ems.barrier();
+assert(scalable.readFF('hot') === ems.nThreads * 100, "Lost updates to a scalable RW element: " + scalable.readFF('hot'));
@@ -75,3 +75,79 @@ for (var len=maxlen;  len >= 1;  len = Math.floor(len * 0.666) ) {
     assert(readback === str, 'Mismatched string.  Expected len ' + str.length + ' got ' + readback.length);
     ems.barrier();
 }
+
+
+//  Strings carry their length, so empty strings and embedded NULs survive,
+//  and keys which differ only after a NUL are different keys
+var nulStr = 'before\u0000after';
+if (ems.myID === 0) {
+    stats.writeXF('nul', nulStr);
+    stats.writeXF('nul\u0000key', 1);
+    stats.writeXF('empty', '');
+}
+ems.barrier();
+assert(stats.readFF('nul') === nulStr, 'Embedded NUL was lost: ' + JSON.stringify(stats.readFF('nul')));
+assert(stats.readFF('nul\u0000key') === 1);
+assert(stats.readFF('empty') === '');
+ems.barrier();
+if (ems.myID === 0) {
+    assert(stats.faa('empty', 'a\u0000b') === '');
+    assert(stats.readFF('empty') === 'a\u0000b');
+
+    //  Buffers are stored as blobs and read back as Buffers
+    var blob = Buffer.from([0, 1, 2, 0xc0, 0xc1, 255, 0]);
+    stats.writeXF('blob', blob);
+    assert(Buffer.isBuffer(stats.readFF('blob'))  &&  stats.readFF('blob').equals(blob));
+    assert(stats.cas('blob', blob, Buffer.alloc(0)).equals(blob));
+    assert(stats.readFF('blob').length === 0);
+}
+ems.barrier();
+
+
+//  Views of strings and blobs are copies, writing a view or
+//  replacing the value does not change the other
+if (ems.myID === 0) {
+    var served = Buffer.from('served in place \u0000 from the heap');
+    stats.writeXF('blob', served);
+    var view = stats.readView('blob');
+    assert(Buffer.isBuffer(view)  &&  view.equals(served));
+    view.write('S');
+    assert(stats.readFF('blob').equals(served));
+    view.write('s');
+    stats.writeXF('blob', 'replaced');
+    assert(view.equals(served)  &&  stats.readView('blob').toString() === 'replaced');
+    stats.writeXF('blob', 12.5);
+    assert(stats.readView('blob') === 12.5);
+
+    //  Strings and blobs of up to 7 bytes are stored in the data word
+    stats.writeXF('blob', 'tiny\u0000');
+    assert(stats.readFF('blob') === 'tiny\u0000'  &&  stats.readView('blob').toString() === 'tiny\u0000');
+    assert(stats.faa('blob', 'er') === 'tiny\u0000'  &&  stats.readFF('blob') === 'tiny\u0000er');
+    stats.writeXF('short', 1);
+    assert(stats.readFF('short') === 1);
+}
+ems.barrier();
+
+
+//  Equal strings share one copy on the heap of regions created with intern,
+//  the heap holds the shared string but not a copy of it for every element
+var interned = ems.new({
+    dimensions: [100],
+    heapSize: 2000,
+    useMap: true,
+    intern: true,
+    setFEtags: 'full'
+});
+var shared = stringFill('shared ', 20);
+for (var i = 0; i < 5; i++) {
+    interned.writeXF((ems.myID * 5) + i, shared);
+}
+ems.barrier();
+assert(interned.readFF(ems.myID * 5) === shared);
+for (var rep = 0; rep < 100; rep++) {
+    var mine = stringFill(ems.myID + ' ' + rep + ' ', 10);
+    interned.writeXF(ems.myID * 5, mine);
+    assert(interned.readFF(ems.myID * 5) === mine);
+    interned.writeXF(ems.myID * 5, shared);
+}
+ems.barrier();
@@ -0,0 +1,65 @@
+/*-----------------------------------------------------------------------------+
+ |  Extended Memory Semantics (EMS)                            Version 1.6.1   |
+ |  http://mogill.com/                                       jace@mogill.com   |
+ +-----------------------------------------------------------------------------+
+ |  Copyright (c) 2011-2014, Synthetic Semantics LLC.  All rights reserved.    |
+ |  Copyright (c) 2015-2020, Jace A Mogill.  All rights reserved.              |
+ |                                                                             |
+ | Redistribution and use in source and binary forms, with or without          |
+ | modification, are permitted provided that the following conditions are met: |
+ |    * Redistributions of source code must retain the above copyright         |
+ |      notice, this list of conditions and the following disclaimer.          |
+ |    * Redistributions in binary form must reproduce the above copyright      |
+ |      notice, this list of conditions and the following disclaimer in the    |
+ |      documentation and/or other materials provided with the distribution.   |
+ |    * Neither the name of the Synthetic Semantics nor the names of its       |
+ |      contributors may be used to endorse or promote products derived        |
+ |      from this software without specific prior written permission.          |
+ |                                                                             |
+ |    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS      |
+ |    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT        |
+ |    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR    |
+ |    A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SYNTHETIC         |
+ |    SEMANTICS LLC BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,   |
+ |    EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,      |
+ |    PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR       |
+ |    PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF   |
+ |    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING     |
+ |    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS       |
+ |    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.             |
+ |                                                                             |
+ +-----------------------------------------------------------------------------*/
+var ems = require('ems')(parseInt(process.argv[2]));
+var assert = require('assert');
+var n = 12;
+var grid = ems.new({
+    dimensions: [n, n],
+    heapSize: 1000000,
+    doSetFEtags: true,
+    setFEtags: 'empty'
+});
+var graph = grid.newTaskGraph('wavefront', n * n);
+
+//  Each cell is the sum of the cells above and to the left, the
+//  cells become ready in diagonal wavefronts
+function cell(i, j) {
+    return function () {
+        var above = (i > 0) ? grid.readFF([i - 1, j]) : 0;
+        var left = (j > 0) ? grid.readFF([i, j - 1]) : 0;
+        grid.writeEF([i, j], (i === 0 && j === 0) ? 1 : above + left);
+    };
+}
+
+for (var i = 0; i < n; i++) {
+    for (var j = 0; j < n; j++) {
+        var inputs = [];
+        if (i > 0) inputs.push([grid, [i - 1, j]]);
+        if (j > 0) inputs.push([grid, [i, j - 1]]);
+        graph.add(cell(i, j), inputs, [[grid, [i, j]]]);
+    }
+}
+graph.run();
+
+//  Paths through the grid are binomial coefficients
+assert(grid.readFF([n - 1, n - 1]) === 705432, "Wrong wavefront result " + grid.readFF([n - 1, n - 1]));
+assert(grid.readFF([n - 1, 0]) === 1  &&  grid.readFF([1, 1]) === 2, "Wrong edge of the wavefront");
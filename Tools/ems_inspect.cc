@@ -0,0 +1,289 @@
+/*-----------------------------------------------------------------------------+
+ |  Extended Memory Semantics (EMS)                            Version 1.6.1   |
+ |  http://mogill.com/                                       jace@mogill.com   |
+ +-----------------------------------------------------------------------------+
+ |  Copyright (c) 2016-2020, Jace A Mogill.  All rights reserved.              |
+ |                                                                             |
+ | Redistribution and use in source and binary forms, with or without          |
+ | modification, are permitted provided that the following conditions are met: |
+ |    * Redistributions of source code must retain the above copyright         |
+ |      notice, this list of conditions and the following disclaimer.          |
+ |    * Redistributions in binary form must reproduce the above copyright      |
+ |      notice, this list of conditions and the following disclaimer in the    |
+ |      documentation and/or other materials provided with the distribution.   |
+ |    * Neither the name of the Synthetic Semantics nor the names of its       |
+ |      contributors may be used to endorse or promote products derived        |
+ |      from this software without specific prior written permission.          |
+ |                                                                             |
+ |    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS      |
+ |    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT        |
+ |    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR    |
+ |    A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SYNTHETIC         |
+ |    SEMANTICS LLC BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,   |
+ |    EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,      |
+ |    PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR       |
+ |    PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF   |
+ |    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING     |
+ |    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS       |
+ |    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.             |
+ |                                                                             |
+ +-----------------------------------------------------------------------------*/
+//  Offline inspector of an EMS region's file, linked directly with src/*.cc.
+//  The file is mapped read-only and never attached as a region, so it may be
+//  inspected while processes are using it or after they have all died.
+//  Reports the region's geometry, the states and types of its tags, the
+//  load factor and probe lengths of its map, and the use and fragmentation
+//  of its heap.  Tags are scanned in order and the pages already scanned
+//  are released, so the memory used does not grow with the size of the file.
+//
+//  Usage:  ems_inspect [-b maxBusyListed] [-d] file
+//          -d  also print the allocator's tree of blocks, as emsMem_dump does
+//
+#include "../src/ems.h"
+
+#define INSPECT_WINDOW     (64 * 1024 * 1024)  // Bytes of tags scanned between releases of pages
+#define INSPECT_N_PROBES   9                   // Distances of keys from their home index: 0, 1, 2-3, ... 128+
+
+static const char *inspectFEnames[] = { "full", "empty", "busy", "rw-lock" };
+static const char *inspectTypeNames[] = { "invalid", "boolean", "string", "float",
+                                          "integer", "undefined", "json", "blob" };
+
+static char *bufChar;                // Base of the read-only mapping
+static volatile int64_t *bufInt64;
+static volatile EMStag_t *bufTags;
+static size_t inspectFileSize;
+static size_t inspectReleased = 0;   // Bytes at the start of the mapping already released
+static int64_t inspectMaxBusy = 10;
+
+
+//==================================================================
+//  Release the pages below a byte offset once a window of them has been scanned
+static void inspectRelease(size_t offset) {
+    size_t pageSize = (size_t) sysconf(_SC_PAGESIZE);
+    offset -= offset % pageSize;
+    if (offset >= inspectReleased + INSPECT_WINDOW) {
+        madvise(bufChar + inspectReleased, offset - inspectReleased, MADV_DONTNEED);
+        inspectReleased = offset;
+    }
+}
+
+
+//==================================================================
+//  Count the states and types of a range of tags, listing the busy ones
+typedef struct {
+    int64_t fe[4];
+    int64_t types[8];
+    int64_t readers;                 // Readers holding the readers-writer locks
+    int64_t nBusy;
+} inspectTagCounts;
+
+static void inspectTags(const char *what, int64_t firstApp, int64_t nTags, inspectTagCounts *counts) {
+    memset(counts, 0, sizeof(inspectTagCounts));
+    for (int64_t idx = 0;  idx < nTags;  idx++) {
+        EMStag_t tag;
+        tag.byte = bufTags[EMSappTag2emsTag(firstApp + idx)].byte;
+        counts->fe[tag.tags.fe]++;
+        counts->types[tag.tags.type]++;
+        if (tag.tags.fe == EMS_TAG_RW_LOCK) counts->readers += tag.tags.rw;
+        if (tag.tags.fe == EMS_TAG_BUSY  &&  counts->nBusy++ < inspectMaxBusy) {
+            printf("    busy %s tag at index %" PRId64 "\n", what, idx);
+        }
+        if (idx % EMSnWordsPerTagWord == 0) inspectRelease(EMSappTag2emsTag(firstApp + idx));
+    }
+}
+
+static void inspectPrintTags(const char *what, const inspectTagCounts *counts) {
+    printf("%-12s", what);
+    for (int fe = 0;  fe < 4;  fe++) printf("  %s=%" PRId64, inspectFEnames[fe], counts->fe[fe]);
+    if (counts->fe[EMS_TAG_RW_LOCK] > 0) printf("  (%" PRId64 " readers)", counts->readers);
+    printf("\n%-12s", "");
+    for (int type = 0;  type < 8;  type++) {
+        if (counts->types[type] > 0) printf("  %s=%" PRId64, inspectTypeNames[type], counts->types[type]);
+    }
+    printf("\n");
+    if (counts->nBusy > 0) {
+        printf("%-12s  %" PRId64 " busy tags, stuck if no process is using the region\n", "", counts->nBusy);
+    }
+}
+
+
+//==================================================================
+//  Index a key hashes to, before probing, as EMSkey2index computes it
+static int64_t inspectHome(int64_t nElements, int64_t idx) {
+    EMStag_t tag;
+    tag.byte = bufTags[EMSappTag2emsTag(idx + EMS_ARR_CB_SIZE + nElements)].byte;
+    int64_t word = bufInt64[EMSappIdx2emsIdx(idx + EMS_ARR_CB_SIZE + nElements)];
+    switch (tag.tags.type) {
+        case EMS_TYPE_BOOLEAN:
+            return (word ? 1 : 0) % nElements;
+        case EMS_TYPE_INTEGER:
+        case EMS_TYPE_FLOAT:
+            return llabs(word) % nElements;
+        case EMS_TYPE_STRING: {
+            char inlineBuf[EMS_INLINE_MAX + 1];
+            size_t length;
+            const char *data = EMSwordData(EMS_TYPE_STRING, word, inlineBuf, &length);
+            char *key = (char *) malloc(length + 1);   // Hash only up to the first NULL, as the bindings do
+            if (key == NULL) return -1;
+            memcpy(key, data, length);
+            key[length] = '\0';
+            int64_t home = EMShashString(key) % nElements;
+            free(key);
+            return home;
+        }
+        default:
+            return -1;
+    }
+}
+
+
+//==================================================================
+//  Load factor and distribution of the distances of keys from their home index
+static void inspectMap(int64_t nElements) {
+    int64_t probes[INSPECT_N_PROBES] = { 0 };
+    int64_t nKeys = 0, longest = 0, totalProbes = 0;
+    for (int64_t idx = 0;  idx < nElements;  idx++) {
+        int64_t home = inspectHome(nElements, idx);
+        if (idx % EMSnWordsPerTagWord == 0) inspectRelease(EMSappTag2emsTag(idx + EMS_ARR_CB_SIZE + nElements));
+        if (home < 0) continue;
+        int64_t distance = (idx - home + nElements) % nElements;
+        int bucket = 0;
+        while (bucket < INSPECT_N_PROBES - 1  &&  distance >= (1 << bucket)) bucket++;
+        probes[bucket]++;
+        nKeys++;
+        totalProbes += distance + 1;
+        if (distance > longest) longest = distance;
+    }
+    printf("map         %" PRId64 " keys, load factor %.3f, %.2f probes per key, longest %" PRId64
+           " of %d allowed\n", nKeys, (double) nKeys / nElements,
+           nKeys > 0 ? (double) totalProbes / nKeys : 0.0, longest + (nKeys > 0), MAX_OPEN_HASH_STEPS);
+    printf("            %14s %12s\n", "distance", "keys");
+    for (int bucket = 0;  bucket < INSPECT_N_PROBES;  bucket++) {
+        if (probes[bucket] == 0) continue;
+        char range[32];
+        int64_t low = bucket == 0 ? 0 : ((int64_t) 1 << (bucket - 1));
+        if (bucket == INSPECT_N_PROBES - 1) {
+            snprintf(range, sizeof(range), "%" PRId64 "+", low);
+        } else if (bucket < 2) {
+            snprintf(range, sizeof(range), "%" PRId64, low);
+        } else {
+            snprintf(range, sizeof(range), "%" PRId64 "-%" PRId64, low, ((int64_t) 1 << bucket) - 1);
+        }
+        printf("            %14s %12" PRId64 "\n", range, probes[bucket]);
+    }
+}
+
+
+//==================================================================
+//  Use of the heap and the free and allocated blocks of each size
+static void inspectHeap(bool dumpTree) {
+    volatile char *mutex = (char *) &bufInt64[EMScbData(EMS_ARR_MEM_MUTEX)];
+    struct emsMem *heap = EMS_MEM_MALLOCBOT(bufChar);
+    size_t heapSize = ((size_t) 1 << heap->level) * EMS_MEM_BLOCKSZ;
+    size_t bytesFree, largestFree;
+    emsMem_usage(heap, &bytesFree, &largestFree);
+    printf("heap        %zu bytes, %zu allocated, %zu free, largest free block %zu",
+           heapSize, heapSize - bytesFree, bytesFree, largestFree);
+    if (bytesFree > 0) printf(", %.1f%% of free space fragmented", 100.0 * (bytesFree - largestFree) / bytesFree);
+    printf("\n            allocator mutex %s\n", *mutex == EMS_TAG_EMPTY ? "free" : "held");
+
+    int64_t *freeBlocks = (int64_t *) calloc(heap->level + 1, sizeof(int64_t));
+    int64_t *usedBlocks = (int64_t *) calloc(heap->level + 1, sizeof(int64_t));
+    if (freeBlocks == NULL  ||  usedBlocks == NULL) {
+        fprintf(stderr, "ems_inspect: Unable to allocate the table of block sizes\n");
+        exit(1);
+    }
+    emsMem_blocks(heap, freeBlocks, usedBlocks);
+    printf("            %14s %12s %12s\n", "block bytes", "free", "allocated");
+    for (int level = 0;  level <= heap->level;  level++) {
+        if (freeBlocks[level] == 0  &&  usedBlocks[level] == 0) continue;
+        printf("            %14zu %12" PRId64 " %12" PRId64 "\n",
+               (size_t) EMS_MEM_BLOCKSZ << level, freeBlocks[level], usedBlocks[level]);
+    }
+    free(freeBlocks);
+    free(usedBlocks);
+    if (dumpTree) emsMem_dump(heap);
+}
+
+
+int main(int argc, char *argv[]) {
+    bool dumpTree = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "b:d")) != -1) {
+        switch (opt) {
+            case 'b': inspectMaxBusy = atoll(optarg);  break;
+            case 'd': dumpTree = true;  break;
+            default:
+                fprintf(stderr, "Usage: %s [-b maxBusyListed] [-d] file\n", argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "Usage: %s [-b maxBusyListed] [-d] file\n", argv[0]);
+        return 1;
+    }
+
+    const char *filename = argv[optind];
+    int fd = open(filename, O_RDONLY);
+    struct stat fileStat;
+    if (fd < 0  ||  fstat(fd, &fileStat) != 0) {
+        fprintf(stderr, "ems_inspect: Unable to open %s: %s\n", filename, strerror(errno));
+        return 1;
+    }
+    inspectFileSize = (size_t) fileStat.st_size;
+    if (inspectFileSize < EMSappIdx2LineIdx(EMS_ARR_CB_SIZE) * EMSwordSize) {
+        fprintf(stderr, "ems_inspect: %s is too small to be an EMS region\n", filename);
+        return 1;
+    }
+    bufChar = (char *) mmap(0, inspectFileSize, PROT_READ, MAP_SHARED, fd, (off_t) 0);
+    if (bufChar == MAP_FAILED) {
+        fprintf(stderr, "ems_inspect: Unable to map %s: %s\n", filename, strerror(errno));
+        return 1;
+    }
+    close(fd);
+    madvise(bufChar, inspectFileSize, MADV_SEQUENTIAL);
+    bufInt64 = (int64_t *) bufChar;
+    bufTags = (EMStag_t *) bufChar;
+
+    //  A region's control block records the size of its file
+    int64_t nElements = bufInt64[EMScbData(EMS_ARR_NELEM)];
+    if ((size_t) bufInt64[EMScbData(EMS_ARR_FILESZ)] != inspectFileSize  ||  nElements <= 0) {
+        fprintf(stderr, "ems_inspect: %s is not an EMS region, or is the control block of a domain\n", filename);
+        return 1;
+    }
+    bool isMapped = bufInt64[EMScbData(EMS_ARR_MAPBOT)] * (int64_t) EMSwordSize !=
+                    bufInt64[EMScbData(EMS_ARR_MALLOCBOT)];
+
+    printf("file        %s, %zu bytes\n", filename, inspectFileSize);
+    printf("elements    %" PRId64 "%s\n", nElements, isMapped ? ", mapped" : "");
+    printf("options    ");
+    if (bufInt64[EMScbData(EMS_ARR_READERS)] != 0)  printf(" scalableRW");
+    if (bufInt64[EMScbData(EMS_ARR_VERSIONS)] != 0) printf(" optimisticReads");
+    if (bufInt64[EMScbData(EMS_ARR_EPOCHS)] != 0)   printf(" epochs");
+    if (bufInt64[EMScbData(EMS_ARR_INTERN)] != 0)   printf(" intern");
+    if (bufInt64[EMScbData(EMS_ARR_STATS)] != 0)    printf(" stats");
+    if (bufInt64[EMScbData(EMS_ARR_READERS)] == 0  &&  bufInt64[EMScbData(EMS_ARR_VERSIONS)] == 0  &&
+        bufInt64[EMScbData(EMS_ARR_EPOCHS)] == 0  &&  bufInt64[EMScbData(EMS_ARR_INTERN)] == 0  &&
+        bufInt64[EMScbData(EMS_ARR_STATS)] == 0) printf(" none");
+    printf("\nlayout      malloc tree at %" PRId64 ", heap at %" PRId64 ", map at %" PRId64 "\n",
+           bufInt64[EMScbData(EMS_ARR_MALLOCBOT)], bufInt64[EMScbData(EMS_ARR_HEAPBOT)],
+           isMapped ? bufInt64[EMScbData(EMS_ARR_MAPBOT)] * (int64_t) EMSwordSize : 0);
+    printf("stack/queue top %" PRId64 ", bottom %" PRId64 ", tag %s\n",
+           bufInt64[EMScbData(EMS_ARR_STACKTOP)], bufInt64[EMScbData(EMS_ARR_Q_BOTTOM)],
+           inspectFEnames[bufTags[EMScbTag(EMS_ARR_STACKTOP)].tags.fe]);
+    printf("transactions %" PRId64 " committed\n", bufInt64[EMScbData(EMS_ARR_STMCLOCK)]);
+
+    inspectHeap(dumpTree);
+
+    inspectTagCounts counts;
+    inspectTags("element", EMS_ARR_CB_SIZE, nElements, &counts);
+    inspectPrintTags("elements", &counts);
+    if (isMapped) {
+        inspectTags("map", EMS_ARR_CB_SIZE + nElements, nElements, &counts);
+        inspectPrintTags("map tags", &counts);
+        inspectMap(nElements);
+    }
+
+    munmap(bufChar, inspectFileSize);
+    return 0;
+}
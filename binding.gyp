@@ -4,7 +4,8 @@
       "target_name": "ems",
       "sources": [
         "src/collectives.cc", "src/ems.cc", "src/ems_alloc.cc", "src/loops.cc",
-        "nodejs/nodejs.cc", "src/primitives.cc", "src/rmw.cc"],
+        "nodejs/nodejs.cc", "src/primitives.cc", "src/rmw.cc", "src/transactions.cc", "src/taskgraph.cc", "src/ordered.cc",
+        "src/jsonpath.cc", "src/bulk.cc"],
       'include_dirs': ["<!@(node -p \"require('node-addon-api').include\")"],
       'dependencies': ["<!(node -p \"require('node-addon-api').gyp\")"],
       'conditions': [
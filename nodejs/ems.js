@@ -36,6 +36,17 @@ var child_process = require("child_process");
 var EMS = require("bindings")("ems.node");
 var EMSglobal;
 
+// Region creation flags, copied from ems.h
+var EMS_REGION_SCALABLE_RW = 0x1;
+var EMS_REGION_OPTIMISTIC_READS = 0x2;
+var EMS_REGION_MAILBOXES = 0x4;
+var EMS_REGION_EPOCHS = 0x8;
+var EMS_REGION_INTERN = 0x10;
+var EMS_REGION_STATS = 0x20;
+var EMS_REGION_RECOVERY = 0x40;
+var EMS_HOTSPOT_KINDS = ["element", "bucket", "control"];  // EMS_HOTSPOT_* in ems_types.h
+var EMS_FORMATS = {"ndjson": 0, "csv": 1, "columns": 2};  // EMS_FORMAT_* in ems_types.h
+
 // The Proxy object is built in or defined by Reflect
 try {
     var EMS_Harmony_Reflect = require("harmony-reflect");
@@ -75,18 +86,53 @@ function EMSdiag(text) {
 
 //==================================================================
 //  Co-Begin a parallel region, executing the function "func"
+//  The function and arguments are posted to the mailboxes of the
+//  worker processes, workers keep the compiled function so later
+//  parallel regions executing the same function only send its index.
+//  Throws if the function threw in a worker or a worker exited.
+var EMSparallelFuncs = [];
+
 function EMSparallel() {
     EMSglobal.inParallelContext = true;
     var user_args = (arguments.length === 1?[arguments[0]]:Array.apply(null, arguments));
     var func = user_args.pop();  // Remove the function
-    // Loop over remote processes, starting each of them
-    this.tasks.forEach(function (task, taskN) {
-        task.send({"taskN": taskN + 1, "args": user_args, "func": func.toString()});
-        task.send({"taskN": taskN + 1, "args": [], "func": "function() { ems.barrier(); }"});
-    });
-    func.apply(null, user_args);  // Invoke on master process
-    EMSbarrier();  // Wait for all processes to finish
-    EMSglobal.inParallelContext = false;
+    var source = func.toString();
+    var msg = {"funcN": EMSparallelFuncs.indexOf(source), "args": user_args};
+    if (msg.funcN < 0) {
+        msg.funcN = EMSparallelFuncs.length;
+        msg.func = source;
+        EMSparallelFuncs.push(source);
+    }
+    var msgText = JSON.stringify(msg);
+    var failedN;
+    try {
+        for (var taskN = 1; taskN < EMSglobal.nThreads; taskN++) {
+            if (!EMS.taskPost.call(EMSglobal, taskN, msgText)) {
+                throw new Error("EMSparallel: Worker process " + taskN + " exited");
+            }
+        }
+        func.apply(null, user_args);  // Invoke on master process
+    } finally {
+        failedN = EMS.taskJoin.call(EMSglobal);  // Wait for all processes to finish
+        EMSglobal.inParallelContext = false;
+    }
+    if (failedN >= 0) {
+        throw new Error("EMSparallel: The parallel region failed in worker process " + failedN);
+    }
+}
+
+
+//==================================================================
+//  Wait for the next fork-join task posted to this process
+function EMStaskReceive() {
+    return EMS.taskReceive.call(EMSglobal, EMSglobal.myID);
+}
+
+
+//==================================================================
+//  Report the last fork-join task received finished, failed if it threw
+function EMStaskDone(failed) {
+    return EMS.taskDone.call(EMSglobal, EMSglobal.myID, !!failed);
 }
 
 
@@ -149,32 +195,19 @@ function EMSparForEach(start,         // First iteration's index
 //  Full to Empty:
 //     arr = [ [ emsArr0, idx0 ], [ emsArr1, idx1, true ], [ emsArr2, idx2 ] ]
 function EMStmStart(emsElems) {
-    var MAX_ELEM_PER_REGION = 10000000000000;
-
-    // Build a list of indexes of the elements to lock which will hold
-    // the elements sorted for deadlock free acquisition
-    var indicies = [];
-    for (var i = 0; i < emsElems.length; ++i) indicies[i] = i;
-
-    //  Sort the elements to lock according to a global ordering
-    var sorted = indicies.sort(function (a, b) {
-        return ( ((emsElems[a][0].regionN * MAX_ELEM_PER_REGION) + emsElems[a][1]) -
-        ((emsElems[b][0].regionN * MAX_ELEM_PER_REGION) + emsElems[b][1]) )
+    //  The whole read and write set is acquired in one call, the core
+    //  sorts the elements into a global order for deadlock free acquisition.
+    //  Read-write data is marked Empty, read-only data is held under a
+    //  readers-writer lock or, in regions with optimisticReads, validated
+    //  when the transaction ends.
+    var nativeElems = emsElems.map(function (elem) {
+        return [elem[0].data.mmapID, EMSidx(elem[1], elem[0]), elem[2] === true];
     });
-
-    //  Acquire the locks in the deadlock free order, saving the contents
-    //  of the memory when it locked.
-    //  Mark read-write data as Empty, and read-only data under a readers-writer lock
-    var tmHandle = [];
-    sorted.forEach(function (e) {
-        var val;
-        if (emsElems[e][2] === true) {
-            val = emsElems[e][0].readRW(emsElems[e][1]);
-        } else {
-            val = emsElems[e][0].readFE(emsElems[e][1]);
-        }
-        tmHandle.push([emsElems[e][0], emsElems[e][1], emsElems[e][2], val])
+    var tm = EMS.tmStart(nativeElems);
+    var tmHandle = emsElems.map(function (elem, elemN) {
+        return [elem[0], elem[1], elem[2] === true, tm.values[elemN]];
     });
+    tmHandle.native = tm.native;
     return tmHandle;
 }
 
@@ -183,44 +216,62 @@ function EMStmStart(emsElems) {
 //  Commit or abort a transaction
 //  The tmHandle contains the result from tmStart:
 //    [ [ EMSarray, index, isReadOnly, origValue ], ... ]
+//  Returns true if the transaction committed.  A commit is aborted if
+//  an element read optimistically was written during the transaction.
 function EMStmEnd(tmHandle,   //  The returned value from tmStart
                   doCommit) { //  Commit or Abort the transaction
-    tmHandle.forEach(function (emsElem) {
-        if (emsElem[2] === true) {
-            // Is a read-only element
-            emsElem[0].releaseRW(emsElem[1]);
-        } else {
-            if (doCommit) {
-                // Is read-write, keep current value and mark Full
-                emsElem[0].setTag(emsElem[1], true);
-            } else {
-                // Write back the original value and mark full
-                emsElem[0].writeEF(emsElem[1], emsElem[3]);
-            }
-        }
-    });
+    return EMS.tmEnd(tmHandle.native, doCommit);
 }
 
 
 //==================================================================
-function EMSreturnData(value) {
-    if (typeof value === "object") {
-        var retval;
+//  Software Transactional Memory
+//  Reads are validated optimistically and writes are buffered until
+//  the transaction commits, the function is re-run until its
+//  transaction commits without conflicting with other transactions.
+//  Elements must be in regions created with optimisticReads.
+//      ems.stm(function (tx) {
+//          tx.write(accounts, to, tx.read(accounts, to) + amount);
+//          tx.write(accounts, from, tx.read(accounts, from) - amount);
+//      });
+function EMSstmConflict() {
+    this.message = "Software transaction conflicted with another transaction";
+}
+
+function EMSstmTransaction(txID) {
+    this.txID = txID;
+}
+
+EMSstmTransaction.prototype.read = function (emsArr, indexes) {
+    var value = EMS.stmRead(this.txID, emsArr.data.mmapID, EMSidx(indexes, emsArr));
+    if (value === null) {
+        throw new EMSstmConflict();
+    }
+    return value;
+};
+
+EMSstmTransaction.prototype.write = function (emsArr, indexes, value) {
+    if (!EMS.stmWrite(this.txID, emsArr.data.mmapID, EMSidx(indexes, emsArr), value)) {
+        throw new Error("EMSstmTransaction.write: Unable to write to the transaction");
+    }
+};
+
+function EMSstm(func) {
+    while (true) {
+        var tx = new EMSstmTransaction(EMS.stmStart());
+        var retObj;
         try {
-            if (value.data[0] === "[" && value.data.slice(-1) === "]") {
-                retval = eval(value.data);
-            } else {
-                retval = JSON.parse(value.data);
-            }
+            retObj = func(tx);
         } catch (err) {
-            // TODO: Throw error?
-            console.log('EMSreturnData: Corrupt memory, unable to reconstruct JSON value of (' +
-                value.data + ')\n');
-            retval = undefined;
+            EMS.stmEnd(tx.txID, false);
+            if (err instanceof EMSstmConflict) {
+                continue;
+            }
+            throw err;
+        }
+        if (EMS.stmEnd(tx.txID, true)) {
+            return retObj;
         }
-        return retval;
-    } else {
-        return value;
     }
 }
 
@@ -233,6 +284,58 @@ function EMSsync(emsArr) {
 }
 
 
+//==================================================================
+//  Return the region's performance counters summed over all processes,
+//  optionally zeroing them
+function EMSstats(reset) {
+    return this.data.stats(reset === true);
+}
+
+
+//==================================================================
+//  Return the tags processes recently waited on longest, summed from
+//  the region's ring of sampled waits
+function EMShotspots(maxSpots) {
+    if (typeof maxSpots === "undefined") maxSpots = 10;
+    var spots = this.data.hotspots(maxSpots);
+    for (var spotN = 0;  spotN < spots.length;  spotN++) {
+        var spot = spots[spotN];
+        spot.kind = EMS_HOTSPOT_KINDS[spot.kind];
+        spot.key = (spot.kind !== "control"  &&  this.useMap) ? this.index2key(spot.index) : spot.index;
+    }
+    return spots;
+}
+
+
+//==================================================================
+//  Write the defined elements from index start up to end to a file,
+//  one row per element.  Returns the number of rows written.
+function EMSexportFile(filename, format, start, end) {
+    if (typeof format === "undefined") format = "ndjson";
+    if (typeof start === "undefined") start = 0;
+    if (typeof end === "undefined") end = this.nElements;
+    if (!(format in EMS_FORMATS)) {
+        throw new Error("EMSexportFile: Unknown format " + format);
+    }
+    return this.data.exportFile(filename, EMS_FORMATS[format], start, end);
+}
+
+
+//==================================================================
+//  Write the rows of a file to the array.  Processes importing a file
+//  together each import a different part of the nParts it is split into.
+//  Returns the number of rows imported.
+function EMSimportFile(filename, format, part, nParts) {
+    if (typeof format === "undefined") format = "ndjson";
+    if (typeof part === "undefined") part = 0;
+    if (typeof nParts === "undefined") nParts = 1;
+    if (!(format in EMS_FORMATS)) {
+        throw new Error("EMSimportFile: Unknown format " + format);
+    }
+    return this.data.importFile(filename, EMS_FORMATS[format], part, nParts);
+}
+
+
 //==================================================================
 //  Convert an EMS index into a mapped key
 function EMSindex2key(index) {
@@ -245,30 +348,53 @@ function EMSindex2key(index) {
 }
 
 
+//==================================================================
+//  [ key, value ] pairs of a mapped array whose keys are at map indexes
+//  start up to end, skipping empty indexes.  Keys are read a batch at a
+//  time, keys added or removed meanwhile may or may not be returned.
+function EMSitems(start, end) {
+    if (typeof start === "undefined") start = 0;
+    if (typeof end === "undefined"  ||  end > this.nElements) end = this.nElements;
+    var items = [];
+    while (start < end) {
+        var batch = this.data.scanKeys(start, end, EMS_SCAN_BATCH);
+        Array.prototype.push.apply(items, batch.items);
+        start = batch.next;
+    }
+    return items;
+}
+
+
+//==================================================================
+//  Call func(key, value) for every key of a mapped array, each process
+//  scanning the blocks of map indexes EMSparForEach assigns it
+function EMSparForEachKey(func, scheduleType, blockSize) {
+    if (typeof blockSize === "undefined") blockSize = 4096;
+    var region = this;
+    EMSparForEach(0, Math.ceil(region.nElements / blockSize), function (blockN) {
+        region.items(blockN * blockSize, (blockN + 1) * blockSize).forEach(function (item) {
+            func(item[0], item[1]);
+        });
+    }, scheduleType);
+}
+
+
 //==================================================================
 //  Wrappers around Stacks and Queues
 function EMSpush(value) {
-    if (typeof value === "object") {
-        return this.data.push(JSON.stringify(value), true);
-    } else {
-        return this.data.push(value);
-    }
+    return this.data.push(value);
 }
 
 function EMSpop() {
-    return EMSreturnData(this.data.pop());
+    return this.data.pop();
 }
 
 function EMSdequeue() {
-    return EMSreturnData(this.data.dequeue());
+    return this.data.dequeue();
 }
 
 function EMSenqueue(value) {
-    if (typeof value === "object") {
-        return this.data.enqueue(JSON.stringify(value), true);   // Retuns only integers
-    } else {
-        return this.data.enqueue(value);   // Retuns only integers
-    }
+    return this.data.enqueue(value);   // Retuns only integers
 }
 
 
@@ -279,54 +405,53 @@ function EMSenqueue(value) {
 //  Apparently it is illegal to pass a native function as an argument
 function EMSwrite(indexes, value) {
     var linearIndex = EMSidx(indexes, this);
-    if (typeof value === "object") {
-        this.data.write(linearIndex, JSON.stringify(value), true);
-    } else {
-        this.data.write(linearIndex, value);
-    }
+    this.data.write(linearIndex, value);
 }
 
 function EMSwriteEF(indexes, value) {
     var linearIndex = EMSidx(indexes, this);
-    if (typeof value === "object") {
-        this.data.writeEF(linearIndex, JSON.stringify(value), true);
-    } else {
-        this.data.writeEF(linearIndex, value);
-    }
+    this.data.writeEF(linearIndex, value);
 }
 
 function EMSwriteXF(indexes, value) {
     var linearIndex = EMSidx(indexes, this);
-    if (typeof value === "object") {
-        this.data.writeXF(linearIndex, JSON.stringify(value), true);
-    } else {
-        this.data.writeXF(linearIndex, value);
-    }
+    this.data.writeXF(linearIndex, value);
 }
 
 function EMSwriteXE(indexes, value) {
     var nativeIndex = EMSidx(indexes, this);
-    if (typeof value === "object") {
-        this.data.writeXE(nativeIndex, JSON.stringify(value), true);
-    } else {
-        this.data.writeXE(nativeIndex, value);
-    }
+    this.data.writeXE(nativeIndex, value);
+}
+
+//==================================================================
+//  Write each value to the index or key at the same position, as write does.
+//  Processes building a map together each write their own part of the keys.
+function EMSwriteMany(indexes, values) {
+    var emsArray = this;
+    var nativeIndexes = indexes.map(function (indexes) { return EMSidx(indexes, emsArray); });
+    return this.data.writeMany(nativeIndexes, values);
 }
 
 function EMSread(indexes) {
-    return EMSreturnData(this.data.read(EMSidx(indexes, this)))
+    return this.data.read(EMSidx(indexes, this))
 }
 
 function EMSreadFE(indexes) {
-    return EMSreturnData(this.data.readFE(EMSidx(indexes, this)))
+    return this.data.readFE(EMSidx(indexes, this))
 }
 
 function EMSreadFF(indexes) {
-    return EMSreturnData(this.data.readFF(EMSidx(indexes, this)))
+    return this.data.readFF(EMSidx(indexes, this))
+}
+
+//  Strings and blobs are returned as a Buffer holding a copy of the value,
+//  a Buffer referring to the EMS heap could not be made read-only
+function EMSreadView(indexes) {
+    return this.data.readView(EMSidx(indexes, this))
 }
 
 function EMSreadRW(indexes) {
-    return EMSreturnData(this.data.readRW(EMSidx(indexes, this)))
+    return this.data.readRW(EMSidx(indexes, this))
 }
 
 function EMSreleaseRW(indexes) {
@@ -346,8 +471,23 @@ function EMSfaa(indexes, val) {
     }
 }
 
+//==================================================================
+//  Fields of stored objects and arrays, the path is an array of keys
+//  and indexes, or a string of keys separated by dots
+function EMSreadField(indexes, path) {
+    return this.data.readField(EMSidx(indexes, this), path);
+}
+
+function EMSwriteField(indexes, path, value) {
+    this.data.writeField(EMSidx(indexes, this), path, value);
+}
+
+function EMSfaaField(indexes, path, val) {
+    return this.data.faaField(EMSidx(indexes, this), path, val);
+}
+
 function EMScas(indexes, oldVal, newVal) {
-    if (typeof newVal === "object") {
+    if (typeof newVal === "object"  &&  !Buffer.isBuffer(newVal)) {
         console.log("EMScas: ERROR -- objects are not a valid new type");
         return undefined;
     } else {
@@ -357,18 +497,189 @@ function EMScas(indexes, oldVal, newVal) {
 
 
 //==================================================================
-//  Serialize execution through this function
-function EMScritical(func, timeout) {
+//  Serialize execution through this function.  If a named lock
+//  is given it is used instead of the global critical section lock.
+function EMScritical(func, timeout, lock) {
     if (typeof timeout === "undefined") {
         timeout = 500000;  // TODO: Magic number -- long enough for errors, not load imbalance
     }
-    EMSglobal.criticalEnter(timeout);
-    var retObj = func();
-    EMSglobal.criticalExit();
+    var retObj;
+    if (typeof lock === "undefined") {
+        EMSglobal.criticalEnter(timeout);
+        retObj = func();
+        EMSglobal.criticalExit();
+    } else {
+        lock.acquire(timeout);
+        try {
+            retObj = func();
+        } finally {
+            lock.release();
+        }
+    }
     return retObj
 }
 
 
+//==================================================================
+//  Named locks allocated in the EMS heap.  Every process that names
+//  the same lock in the same region shares it.
+var EMSlockTypes = {"mutex": 0, "rw": 1, "semaphore": 2};
+
+function EMSlockAcquireCommon(lock, shared, timeout) {
+    if (typeof timeout === "undefined") {
+        timeout = 500000;  // TODO: Magic number -- long enough for errors, not load imbalance
+    }
+    var remaining = lock.region.data.lockAcquire(lock.lockID, shared, timeout);
+    if (remaining <= 0) {
+        throw new Error("EMSlock: Timed out acquiring lock " + lock.name);
+    }
+    return remaining;
+}
+
+function EMSlockAcquire(timeout) {
+    return EMSlockAcquireCommon(this, false, timeout);
+}
+
+function EMSlockRelease() {
+    return this.region.data.lockRelease(this.lockID, false);
+}
+
+function EMSlockAcquireRead(timeout) {
+    return EMSlockAcquireCommon(this, true, timeout);
+}
+
+function EMSlockReleaseRead() {
+    return this.region.data.lockRelease(this.lockID, true);
+}
+
+function EMSnewLock(name,      // Name shared by all processes using the lock
+                    lockType,  // "mutex" (default), "rw", or "semaphore"
+                    count) {   // Initial count of a semaphore
+    if (typeof lockType === "undefined") {
+        lockType = "mutex";
+    }
+    if (typeof count === "undefined") {
+        count = 1;
+    }
+    if (!(lockType in EMSlockTypes)) {
+        throw new Error("EMSnewLock: Unknown lock type " + lockType);
+    }
+    return {
+        name: name,
+        lockType: lockType,
+        region: this,
+        lockID: this.data.newLock(String(name), EMSlockTypes[lockType], count),
+        acquire: EMSlockAcquire,
+        release: EMSlockRelease,
+        acquireRead: EMSlockAcquireRead,
+        releaseRead: EMSlockReleaseRead
+    };
+}
+
+
+//==================================================================
+//  Task graphs allocated in the EMS heap.  Every process adds the same
+//  tasks in the same order, the master registers them in the graph.
+//  Each task names the elements it reads and writes, a task runs when
+//  its inputs are full.  Tasks producing an input must be added
+//  before the tasks consuming it.
+//      graph.add(function () { b.writeEF(0, a.readFF(0) + 1); }, [[a, 0]], [[b, 0]]);
+function EMStaskGraphElements(elems) {
+    return (elems || []).map(function (elem) {
+        return [elem[0].data.mmapID, EMSidx(elem[1], elem[0])];
+    });
+}
+
+function EMStaskGraphAdd(func,      // Function performing the task
+                         inputs,    // Elements read by the task: [ [ emsArray, index ], ... ]
+                         outputs) { // Elements the task fills: [ [ emsArray, index ], ... ]
+    var taskN = this.funcs.length;
+    this.funcs.push(func);
+    if (EMSglobal.myID === 0) {
+        var nativeTaskN = this.region.data.taskGraphAdd(this.graphID,
+            EMStaskGraphElements(inputs), EMStaskGraphElements(outputs));
+        if (nativeTaskN !== taskN) {
+            this.funcs.pop();
+            throw new Error("EMStaskGraph: Unable to add task " + taskN);
+        }
+    }
+    return taskN;
+}
+
+//  Every process executes ready tasks until all the tasks are done
+function EMStaskGraphRun() {
+    var data = this.region.data;
+    if (EMSglobal.myID === 0) {
+        data.taskGraphStart(this.graphID);
+    }
+    EMSbarrier();
+    var taskN = data.taskGraphNext(this.graphID);
+    while (taskN >= 0) {
+        this.funcs[taskN]();
+        data.taskGraphDone(this.graphID, taskN);
+        taskN = data.taskGraphNext(this.graphID);
+    }
+    EMSbarrier();
+}
+
+function EMSnewTaskGraph(name,       // Name shared by all processes using the graph
+                         maxTasks,   // Maximum number of tasks in the graph
+                         maxEdges) { // Maximum number of inputs of all tasks, default 4 per task
+    if (typeof maxEdges === "undefined") {
+        maxEdges = maxTasks * 4;
+    }
+    return {
+        name: name,
+        region: this,
+        graphID: this.data.taskGraphNew(String(name), maxTasks, maxEdges),
+        funcs: [],
+        add: EMStaskGraphAdd,
+        run: EMStaskGraphRun
+    };
+}
+
+
+//==================================================================
+//  Ordered indexes allocated in the EMS heap.  Keys are kept in order so
+//  they can be scanned by range or prefix, booleans first, then numbers,
+//  then strings.  Every process may put, remove, and scan keys concurrently.
+//      index.put("apple", 1);  index.range("a", "b");  index.prefix("app");
+var EMS_SCAN_AFTER = 0x1;    // EMS_SCAN_* in ems.h
+var EMS_SCAN_PREFIX = 0x2;
+var EMS_SCAN_BATCH = 256;
+
+//  Scan the index a batch at a time, each batch continuing after the last key of the one before
+function EMSorderedScan(index, start, end, flags) {
+    var items = [];
+    var batch;
+    do {
+        batch = index.region.data.orderedScan(index.indexID, start, end, flags, EMS_SCAN_BATCH);
+        Array.prototype.push.apply(items, batch);
+        if (batch.length > 0) {
+            start = batch[batch.length - 1][0];
+            flags |= EMS_SCAN_AFTER;
+        }
+    } while (batch.length === EMS_SCAN_BATCH);
+    return items;
+}
+
+function EMSnewOrderedIndex(name) {  // Name shared by all processes using the index
+    return {
+        name: name,
+        region: this,
+        indexID: this.data.orderedNew(String(name)),
+        put: function (key, value) { return this.region.data.orderedPut(this.indexID, key, value); },
+        get: function (key) { return this.region.data.orderedGet(this.indexID, key); },
+        remove: function (key) { return this.region.data.orderedRemove(this.indexID, key); },
+        count: function () { return this.region.data.orderedCount(this.indexID); },
+        //  [ key, value ] pairs of the keys from start up to but not including end, undefined is unbounded
+        range: function (start, end) { return EMSorderedScan(this, start, end, 0); },
+        //  [ key, value ] pairs of the string keys beginning with prefix
+        prefix: function (prefix) { return EMSorderedScan(this, prefix, prefix, EMS_SCAN_PREFIX); }
+    };
+}
+
+
 //==================================================================
 //  Perform func only on thread 0
 function EMSmaster(func) {
@@ -459,6 +770,13 @@ function EMSnew(arg0,        //  Maximum number of elements the EMS region can h
         dataFill: undefined,//Optional, default=false: Value to initialize data to
         doSetFEtags: false, // Optional, initialize full/empty tags
         setFEtagsFull: true, // Optional, used only if doSetFEtags is true
+        scalableRW: false, // Optional, default=false: Readers-writer locks use per-process reader indicators
+        optimisticReads: false, // Optional, default=false: Version stamp elements so reads do not modify tags
+        epochs: false,    // Optional, default=false: Reclaim the storage of replaced values by epochs
+        intern: false,    // Optional, default=false: Equal strings and blobs share one copy on the heap
+        stats: false,     // Optional, default=false: Count waits and map probes per process
+        recovery: false,  // Optional, default=false: Restore element tags held by processes that died
+        regionFlags: 0,   // Region creation flags (EMS_REGION_* in ems.h) derived from the options
         dimStride: []     //  Stride factors for each dimension of multidimensional arrays
     };
 
@@ -496,12 +814,7 @@ function EMSnew(arg0,        //  Maximum number of elements the EMS region can h
             }
             if(arg0.doDataFill) {
                 emsDescriptor.doDataFill = arg0.doDataFill;
-                if (typeof arg0.dataFill === "object") {
-                    emsDescriptor.dataFill = JSON.stringify(arg0.dataFill);
-                    fillIsJSON = true;
-                } else {
-                    emsDescriptor.dataFill = arg0.dataFill;
-                }
+                emsDescriptor.dataFill = arg0.dataFill;
             }
             if (typeof arg0.doSetFEtags !== "undefined") {
                 emsDescriptor.doSetFEtags = arg0.doSetFEtags
@@ -516,6 +829,24 @@ function EMSnew(arg0,        //  Maximum number of elements the EMS region can h
             if (typeof arg0.hashFunc !== "undefined") {
                 emsDescriptor.hashFunc = arg0.hashFunc
             }
+            if (typeof arg0.scalableRW !== "undefined") {
+                emsDescriptor.scalableRW = arg0.scalableRW
+            }
+            if (typeof arg0.optimisticReads !== "undefined") {
+                emsDescriptor.optimisticReads = arg0.optimisticReads
+            }
+            if (typeof arg0.epochs !== "undefined") {
+                emsDescriptor.epochs = arg0.epochs
+            }
+            if (typeof arg0.intern !== "undefined") {
+                emsDescriptor.intern = arg0.intern
+            }
+            if (typeof arg0.stats !== "undefined") {
+                emsDescriptor.stats = arg0.stats
+            }
+            if (typeof arg0.recovery !== "undefined") {
+                emsDescriptor.recovery = arg0.recovery
+            }
         } else {
             if (EMSisArray(arg0)) { // User passed in multi-dimensional array
                 emsDescriptor.dimensions = arg0
@@ -565,6 +896,13 @@ function EMSnew(arg0,        //  Maximum number of elements the EMS region can h
     //  only operations (ie: unlinking an old file, opening a new
     //  file).  After thread 0 has completed initialization, other
     //  threads can safely share the EMS array.
+    if (emsDescriptor.scalableRW) emsDescriptor.regionFlags |= EMS_REGION_SCALABLE_RW;
+    if (emsDescriptor.optimisticReads) emsDescriptor.regionFlags |= EMS_REGION_OPTIMISTIC_READS;
+    if (emsDescriptor.epochs) emsDescriptor.regionFlags |= EMS_REGION_EPOCHS;
+    if (emsDescriptor.intern) emsDescriptor.regionFlags |= EMS_REGION_INTERN;
+    if (emsDescriptor.stats) emsDescriptor.regionFlags |= EMS_REGION_STATS;
+    if (emsDescriptor.recovery) emsDescriptor.regionFlags |= EMS_REGION_RECOVERY;
+
     if (!emsDescriptor.useExisting && this.myID !== 0) EMSbarrier();
     emsDescriptor.data = this.init(emsDescriptor.nElements, emsDescriptor.heapSize,  // 0, 1
         emsDescriptor.useMap, emsDescriptor.filename,  // 2, 3
@@ -574,7 +912,8 @@ function EMSnew(arg0,        //  Maximum number of elements the EMS region can h
         emsDescriptor.doSetFEtags,  // 9
         emsDescriptor.setFEtagsFull,  // 10
         this.myID, this.pinThreads, this.nThreads,  // 11, 12, 13
-        emsDescriptor.mlock);  // 14
+        emsDescriptor.mlock,  // 14
+        emsDescriptor.regionFlags);  // 15
 
     if (!emsDescriptor.useExisting && this.myID === 0) EMSbarrier();
 
@@ -588,16 +927,30 @@ function EMSnew(arg0,        //  Maximum number of elements the EMS region can h
     emsDescriptor.writeEF = EMSwriteEF;
     emsDescriptor.writeXF = EMSwriteXF;
     emsDescriptor.writeXE = EMSwriteXE;
+    emsDescriptor.writeMany = EMSwriteMany;
     emsDescriptor.read = EMSread;
     emsDescriptor.readRW = EMSreadRW;
     emsDescriptor.releaseRW = EMSreleaseRW;
     emsDescriptor.readFE = EMSreadFE;
     emsDescriptor.readFF = EMSreadFF;
+    emsDescriptor.readView = EMSreadView;
     emsDescriptor.faa = EMSfaa;
+    emsDescriptor.readField = EMSreadField;
+    emsDescriptor.writeField = EMSwriteField;
+    emsDescriptor.faaField = EMSfaaField;
     emsDescriptor.cas = EMScas;
     emsDescriptor.sync = EMSsync;
+    emsDescriptor.stats = EMSstats;
+    emsDescriptor.hotspots = EMShotspots;
+    emsDescriptor.exportFile = EMSexportFile;
+    emsDescriptor.importFile = EMSimportFile;
     emsDescriptor.index2key = EMSindex2key;
+    emsDescriptor.items = EMSitems;
+    emsDescriptor.parForEachKey = EMSparForEachKey;
     emsDescriptor.destroy = EMSdestroy;
+    emsDescriptor.newLock = EMSnewLock;
+    emsDescriptor.newTaskGraph = EMSnewTaskGraph;
+    emsDescriptor.newOrderedIndex = EMSnewOrderedIndex;
     this.newRegionN++;
     EMSbarrier();
 
@@ -666,13 +1019,17 @@ function ems_wrapper(nThreadsArg, pinThreadsArg, threadingType, filename) {
 
     var domainName = "/EMS_MainDomain";
     if (filename) domainName = filename;
+    //  Fork-join tasks are posted to mailboxes in the control block
+    var regionFlags = (threadingType === "fj") ? EMS_REGION_MAILBOXES : 0;
+
     //  All arguments are defined -- now do the EMS initialization
     retObj.data = EMS.initialize(0, 0, // 0= # elements, 1=Heap Size
         false, // 2 = useMap
         domainName, false, false,  // 3=name, 4=persist, 5=useExisting
         false, false, undefined,  //  6=doDataFill, 7=fillIsJSON, 8=fillValue
         false, false,  retObj.myID, //  9=doSetFEtags, 10=setFEtags, 11=EMS myID
-        pinThreads, nThreads, 99);  // 12=pinThread,  13=nThreads, 14=pctMlock
+        pinThreads, nThreads, 99,  // 12=pinThread,  13=nThreads, 14=pctMlock
+        regionFlags);  // 15=regionFlags
 
     var targetScript;
     switch (threadingType) {
@@ -684,7 +1041,7 @@ function ems_wrapper(nThreadsArg, pinThreadsArg, threadingType, filename) {
             break;
         case "fj":
             targetScript = "./EMSthreadStub";
-            retObj.inParallelContext = false;
+            retObj.inParallelContext = (retObj.myID !== 0);
             break;
         case "user":
             targetScript = undefined;
@@ -702,18 +1059,39 @@ function ems_wrapper(nThreadsArg, pinThreadsArg, threadingType, filename) {
         var emsThreadStub =
             "// Automatically Generated EMS Slave Thread Script\n" +
             "// To edit this file, see ems.js:emsThreadStub()\n" +
-            "var ems = require(\"ems\")(parseInt(process.env.EMS_Ntasks));\n" +
-            "process.on(\"message\", function(msg) {\n" +
-            "    eval(\"func = \" + msg.func);\n" +
-            "    func.apply(null, msg.args);\n" +
-            "} );\n";
+            "var ems = require(\"ems\")(parseInt(process.env.EMS_Ntasks), " + JSON.stringify(pinThreads) +
+                ", \"fj\", " + JSON.stringify(domainName) + ");\n" +
+            "var funcs = [];\n" +
+            "var msgText;\n" +
+            "while ((msgText = ems.taskReceive()) !== undefined) {\n" +
+            "    var msg = JSON.parse(msgText);\n" +
+            "    if (msg.funcN < 0) break;\n" +
+            "    var failed = false;\n" +
+            "    try {\n" +
+            "        if (msg.func !== undefined) eval(\"funcs[msg.funcN] = \" + msg.func);\n" +
+            "        funcs[msg.funcN].apply(null, msg.args);\n" +
+            "    } catch (err) {\n" +
+            "        console.error(\"EMS: Parallel region failed in process \" + ems.myID + \":\", err);\n" +
+            "        failed = true;\n" +
+            "    }\n" +
+            "    ems.taskDone(failed);\n" +
+            "}\n" +
+            "process.exit(0);\n";
         fs.writeFileSync('./EMSthreadStub.js', emsThreadStub, {flag: 'w+'});
         process.env.EMS_Ntasks = nThreads;
         for (var taskN = 1; taskN < nThreads; taskN++) {
             process.env.EMS_Subtask = taskN;
-            retObj.tasks.push(
-                child_process.fork(targetScript,
-                    process.argv.slice(2, process.argv.length)));
+            var task = child_process.fork(targetScript, process.argv.slice(2, process.argv.length));
+            EMS.taskStarted.call(retObj, taskN, task.pid);
+            retObj.tasks.push(task);
+        }
+        if (threadingType === "fj") {
+            //  Release the workers when the master exits
+            process.on("exit", function () {
+                for (var taskN = 1; taskN < nThreads; taskN++) {
+                    EMS.taskPost.call(retObj, taskN, JSON.stringify({"funcN": -1}));
+                }
+            });
         }
     }
 
@@ -732,9 +1110,12 @@ function ems_wrapper(nThreadsArg, pinThreadsArg, threadingType, filename) {
     retObj.diag = EMSdiag;
     retObj.parallel = EMSparallel;
     retObj.barrier = EMSbarrier;
+    retObj.taskReceive = EMStaskReceive;
+    retObj.taskDone = EMStaskDone;
     retObj.parForEach = EMSparForEach;
     retObj.tmStart = EMStmStart;
     retObj.tmEnd = EMStmEnd;
+    retObj.stm = EMSstm;
     retObj.loopInit = EMS.loopInit;
     retObj.loopChunk = EMS.loopChunk;
     EMSglobal = retObj;
@@ -30,10 +30,268 @@
  |    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.             |
  |                                                                             |
  +-----------------------------------------------------------------------------*/
+#include <vector>
 #include "nodejs.h"
 #include "../src/ems.h"
 #include "../src/ems_types.h"
 
+
+//==================================================================
+//  MessagePack encoding of JSON values.  Values are packed the way
+//  JSON.stringify() would serialize them: toJSON() is called when
+//  present, members of objects which are undefined or functions are
+//  skipped, and those and non-finite numbers are null within arrays.
+//  Buffers are packed as binary data.
+#define EMS_PACK_MAX_DEPTH 1000
+
+static inline void EMSpackBigEndian(std::string &out, uint64_t value, int nBytes) {
+    for (int byteN = nBytes - 1;  byteN >= 0;  byteN--) {
+        out.push_back((char) ((value >> (8 * byteN)) & 0xff));
+    }
+}
+
+//  Header of a string, array, map, or binary, with a fixed-size form for small
+//  lengths unless fixBase is 0, and an 8-bit length form unless op8 is 0
+static void EMSpackHeader(std::string &out, uint32_t len, unsigned char fixBase, uint32_t fixMax,
+                          unsigned char op8, unsigned char op16, unsigned char op32) {
+    if (fixBase != 0  &&  len <= fixMax) {
+        out.push_back((char) (fixBase | len));
+    } else if (op8 != 0  &&  len <= UINT8_MAX) {
+        out.push_back((char) op8);
+        EMSpackBigEndian(out, len, 1);
+    } else if (len <= UINT16_MAX) {
+        out.push_back((char) op16);
+        EMSpackBigEndian(out, len, 2);
+    } else {
+        out.push_back((char) op32);
+        EMSpackBigEndian(out, len, 4);
+    }
+}
+
+static void EMSpackNumber(std::string &out, double d) {
+    if (!std::isfinite(d)) {
+        out.push_back((char) 0xc0);
+    } else if (fabs(d) < 9.0e18  &&  d == (double) (int64_t) d) {
+        int64_t i = (int64_t) d;
+        if (i >= -32  &&  i <= INT8_MAX) {
+            out.push_back((char) i);  // Positive and negative fixint
+        } else if (i > 0) {
+            int nBytes = (i <= UINT8_MAX) ? 1 : (i <= UINT16_MAX) ? 2 : (i <= UINT32_MAX) ? 4 : 8;
+            out.push_back((char) (0xcc + (nBytes == 8 ? 3 : nBytes / 2)));
+            EMSpackBigEndian(out, (uint64_t) i, nBytes);
+        } else if (i >= INT8_MIN) {
+            out.push_back((char) 0xd0);
+            EMSpackBigEndian(out, (uint64_t) i, 1);
+        } else if (i >= INT16_MIN) {
+            out.push_back((char) 0xd1);
+            EMSpackBigEndian(out, (uint64_t) i, 2);
+        } else if (i >= INT32_MIN) {
+            out.push_back((char) 0xd2);
+            EMSpackBigEndian(out, (uint64_t) i, 4);
+        } else {
+            out.push_back((char) 0xd3);
+            EMSpackBigEndian(out, (uint64_t) i, 8);
+        }
+    } else {
+        EMSulong_double alias = {.d = d};
+        out.push_back((char) 0xcb);
+        EMSpackBigEndian(out, alias.u64, 8);
+    }
+}
+
+//  Returns false if the value cannot be represented as JSON
+static bool EMSpackValue(Napi::Value value, std::string &out, int depth) {
+    if (depth > EMS_PACK_MAX_DEPTH  ||  value.IsBigInt()) return false;
+    if (value.IsNull()  ||  value.IsUndefined()  ||  value.IsFunction()  ||  value.IsSymbol()) {
+        out.push_back((char) 0xc0);
+    } else if (value.IsBoolean()) {
+        out.push_back((char) (value.As<Napi::Boolean>().Value() ? 0xc3 : 0xc2));
+    } else if (value.IsNumber()) {
+        EMSpackNumber(out, value.As<Napi::Number>().DoubleValue());
+    } else if (value.IsString()) {
+        std::string s = value.As<Napi::String>().Utf8Value();
+        EMSpackHeader(out, (uint32_t) s.length(), 0xa0, 31, 0xd9, 0xda, 0xdb);
+        out.append(s);
+    } else if (value.IsBuffer()) {
+        Napi::Buffer<char> buf = value.As<Napi::Buffer<char> >();
+        EMSpackHeader(out, (uint32_t) buf.Length(), 0, 0, 0xc4, 0xc5, 0xc6);
+        out.append(buf.Data(), buf.Length());
+    } else {
+        Napi::Object obj = value.As<Napi::Object>();
+        Napi::Value toJSON = obj.Get("toJSON");
+        if (toJSON.IsFunction()) {
+            return EMSpackValue(toJSON.As<Napi::Function>().Call(obj, {}), out, depth + 1);
+        }
+        if (value.IsArray()) {
+            Napi::Array arr = value.As<Napi::Array>();
+            uint32_t len = arr.Length();
+            EMSpackHeader(out, len, 0x90, 15, 0, 0xdc, 0xdd);
+            for (uint32_t elemN = 0;  elemN < len;  elemN++) {
+                if (!EMSpackValue(arr.Get(elemN), out, depth + 1)) return false;
+            }
+        } else {
+            //  Like JSON.stringify, only the object's own enumerable properties are packed,
+            //  GetPropertyNames also returns those inherited from its prototypes
+            Napi::Array names = obj.GetPropertyNames();
+            uint32_t nNames = names.Length();
+            std::vector<std::pair<Napi::Value, Napi::Value> > members;
+            for (uint32_t nameN = 0;  nameN < nNames;  nameN++) {
+                Napi::Value name = names.Get(nameN);
+                if (!obj.HasOwnProperty(name)) continue;
+                Napi::Value member = obj.Get(name);
+                if (member.IsUndefined()  ||  member.IsFunction()  ||  member.IsSymbol()) continue;
+                members.push_back(std::make_pair(name, member));
+            }
+            EMSpackHeader(out, (uint32_t) members.size(), 0x80, 15, 0, 0xde, 0xdf);
+            for (size_t memberN = 0;  memberN < members.size();  memberN++) {
+                if (!EMSpackValue(members[memberN].first.ToString(), out, depth + 1)  ||
+                    !EMSpackValue(members[memberN].second, out, depth + 1)) return false;
+            }
+        }
+    }
+    return true;
+}
+
+//  Pack a value behind the EMS header of packed JSON
+static bool EMSpackJSON(Napi::Value value, std::string &out) {
+    out.assign(EMS_JSON_PACKED_HDR_SZ, '\0');
+    if (!EMSpackValue(value, out, 0)) return false;
+    uint32_t packedLen = (uint32_t) (out.length() - EMS_JSON_PACKED_HDR_SZ);
+    out[0] = (char) EMS_JSON_PACKED;
+    memcpy(&out[1], &packedLen, sizeof(packedLen));
+    return true;
+}
+
+static inline uint64_t EMSunpackBigEndian(const unsigned char *p, int nBytes) {
+    uint64_t value = 0;
+    for (int byteN = 0;  byteN < nBytes;  byteN++) value = (value << 8) | p[byteN];
+    return value;
+}
+
+//  Returns false if the encoding is truncated or uses an unsupported type
+static bool EMSunpackValue(Napi::Env env, const unsigned char *&p, const unsigned char *end,
+                           Napi::Value &value, int depth) {
+#define EMS_UNPACK_NEED(n)  if ((size_t) (end - p) < (size_t) (n)) return false
+    EMS_UNPACK_NEED(1);
+    if (depth > EMS_PACK_MAX_DEPTH) return false;
+    unsigned char op = *p++;
+    uint32_t len;
+    if (op <= 0x7f  ||  op >= 0xe0) {
+        value = Napi::Number::New(env, (int8_t) op);
+        return true;
+    } else if (op >= 0xa0  &&  op <= 0xbf) {
+        len = op & 0x1f;
+        goto unpack_str;
+    } else if (op >= 0x90  &&  op <= 0x9f) {
+        len = op & 0x0f;
+        goto unpack_array;
+    } else if (op >= 0x80  &&  op <= 0x8f) {
+        len = op & 0x0f;
+        goto unpack_map;
+    }
+    switch (op) {
+        case 0xc0: value = env.Null();  return true;
+        case 0xc2: value = Napi::Boolean::New(env, false);  return true;
+        case 0xc3: value = Napi::Boolean::New(env, true);  return true;
+        case 0xc4: case 0xc5: case 0xc6: {
+            int nBytes = 1 << (op - 0xc4);
+            EMS_UNPACK_NEED(nBytes);
+            len = (uint32_t) EMSunpackBigEndian(p, nBytes);
+            p += nBytes;
+            EMS_UNPACK_NEED(len);
+            value = Napi::Buffer<char>::Copy(env, (const char *) p, len);
+            p += len;
+            return true;
+        }
+        case 0xca: {
+            EMS_UNPACK_NEED(4);
+            uint32_t u32 = (uint32_t) EMSunpackBigEndian(p, 4);
+            float f;
+            memcpy(&f, &u32, sizeof(f));
+            p += 4;
+            value = Napi::Number::New(env, f);
+            return true;
+        }
+        case 0xcb: {
+            EMS_UNPACK_NEED(8);
+            EMSulong_double alias = {.u64 = EMSunpackBigEndian(p, 8)};
+            p += 8;
+            value = Napi::Number::New(env, alias.d);
+            return true;
+        }
+        case 0xcc: case 0xcd: case 0xce: case 0xcf: {
+            int nBytes = 1 << (op - 0xcc);
+            EMS_UNPACK_NEED(nBytes);
+            value = Napi::Number::New(env, (double) EMSunpackBigEndian(p, nBytes));
+            p += nBytes;
+            return true;
+        }
+        case 0xd0: case 0xd1: case 0xd2: case 0xd3: {
+            int nBytes = 1 << (op - 0xd0);
+            EMS_UNPACK_NEED(nBytes);
+            uint64_t u64 = EMSunpackBigEndian(p, nBytes);
+            int shift = 64 - 8 * nBytes;  // Sign extend
+            value = Napi::Number::New(env, (double) ((int64_t) (u64 << shift) >> shift));
+            p += nBytes;
+            return true;
+        }
+        case 0xd9: case 0xda: case 0xdb: {
+            int nBytes = 1 << (op - 0xd9);
+            EMS_UNPACK_NEED(nBytes);
+            len = (uint32_t) EMSunpackBigEndian(p, nBytes);
+            p += nBytes;
+            goto unpack_str;
+        }
+        case 0xdc: case 0xdd: {
+            int nBytes = 2 << (op - 0xdc);
+            EMS_UNPACK_NEED(nBytes);
+            len = (uint32_t) EMSunpackBigEndian(p, nBytes);
+            p += nBytes;
+            goto unpack_array;
+        }
+        case 0xde: case 0xdf: {
+            int nBytes = 2 << (op - 0xde);
+            EMS_UNPACK_NEED(nBytes);
+            len = (uint32_t) EMSunpackBigEndian(p, nBytes);
+            p += nBytes;
+            goto unpack_map;
+        }
+        default:
+            return false;  // Extension types
+    }
+
+unpack_str:
+    EMS_UNPACK_NEED(len);
+    value = Napi::String::New(env, (const char *) p, len);
+    p += len;
+    return true;
+
+unpack_array: {
+        EMS_UNPACK_NEED(len);  // Every element occupies at least one byte
+        Napi::Array arr = Napi::Array::New(env, len);
+        for (uint32_t elemN = 0;  elemN < len;  elemN++) {
+            Napi::Value elem;
+            if (!EMSunpackValue(env, p, end, elem, depth + 1)) return false;
+            arr.Set(elemN, elem);
+        }
+        value = arr;
+        return true;
+    }
+
+unpack_map: {
+        Napi::Object obj = Napi::Object::New(env);
+        for (uint32_t memberN = 0;  memberN < len;  memberN++) {
+            Napi::Value name, member;
+            if (!EMSunpackValue(env, p, end, name, depth + 1)  ||
+                !EMSunpackValue(env, p, end, member, depth + 1)) return false;
+            obj.Set(name.IsString() ? name : name.ToString(), member);
+        }
+        value = obj;
+        return true;
+    }
+#undef EMS_UNPACK_NEED
+}
+
 /**
  * Convert a NAPI object to an EMS object stored on the stack
  * @param napiValue Source Napi object
@@ -60,14 +318,34 @@
         }                                                               \
             break;                                                      \
         case EMS_TYPE_JSON:                                             \
+            if (!napiValue.IsString()) {                                \
+                std::string packed;                                     \
+                if (!EMSpackJSON(napiValue, packed)) {                  \
+                    THROW_TYPE_ERROR(QUOTE(__FUNCTION__) " ERROR: Value cannot be serialized as JSON");\
+                }                                                       \
+                emsValue.length = packed.length();                      \
+                emsValue.value = alloca(emsValue.length + 1);           \
+                if (!emsValue.value) {                                  \
+                    THROW_TYPE_ERROR(QUOTE(__FUNCTION__) " ERROR: Unable to allocate scratch memory for serialized value");\
+                }                                                       \
+                memcpy(emsValue.value, packed.data(), emsValue.length); \
+                break;                                                  \
+            }                                                           \
+            /* fall through: JSON text */                               \
         case EMS_TYPE_STRING: {                                         \
             std::string s = napiValue.As<Napi::String>().Utf8Value();   \
-            emsValue.length = s.length() + 1; /* +1 for trailing NULL */\
-            emsValue.value = alloca(emsValue.length);                   \
+            emsValue.length = s.length();                               \
+            emsValue.value = alloca(emsValue.length + 1);               \
             if (!emsValue.value) {                                      \
                 THROW_TYPE_ERROR(QUOTE(__FUNCTION__) " ERROR: Unable to allocate scratch memory for serialized value");\
             }                                                           \
-            memcpy(emsValue.value, s.c_str(), emsValue.length);         \
+            memcpy(emsValue.value, s.c_str(), emsValue.length + 1);     \
+        }                                                               \
+            break;                                                      \
+        case EMS_TYPE_BLOB: {                                           \
+            Napi::Buffer<char> buf = napiValue.As<Napi::Buffer<char> >();\
+            emsValue.length = buf.Length();                             \
+            emsValue.value = (emsValue.length > 0) ? (void *) buf.Data() : (void *) "";\
         }                                                               \
             break;                                                      \
         case EMS_TYPE_UNDEFINED:                                        \
@@ -103,13 +381,27 @@ ems2napiReturnValue(Napi::Env env, EMSvalueType *emsValue) {
         }
             break;
         case EMS_TYPE_JSON: {
-            Napi::Object retObj = Napi::Object::New(env);
-            retObj.Set("data", Napi::String::New(env, (char *) emsValue->value));
-            return retObj;
+            if (EMSisPackedJSON(EMS_TYPE_JSON, emsValue->value)) {
+                const unsigned char *packed = (const unsigned char *) emsValue->value;
+                const unsigned char *end = packed + EMSvalueBytes(EMS_TYPE_JSON, packed);
+                packed += EMS_JSON_PACKED_HDR_SZ;
+                Napi::Value retVal;
+                if (!EMSunpackValue(env, packed, end, retVal, 0)) {
+                    THROW_TYPE_ERROR("ems2napiReturnValue - ERROR: Corrupt packed JSON value");
+                }
+                return retVal;
+            }
+            //  JSON text
+            Napi::Function parse = env.Global().Get("JSON").As<Napi::Object>().Get("parse").As<Napi::Function>();
+            return parse.Call({Napi::String::New(env, (char *) emsValue->value)});
         }
             break;
         case EMS_TYPE_STRING: {
-            return Napi::String::New(env, (char *) emsValue->value);
+            return Napi::String::New(env, (char *) emsValue->value, emsValue->length);
+        }
+            break;
+        case EMS_TYPE_BLOB: {
+            return Napi::Buffer<char>::Copy(env, (char *) emsValue->value, emsValue->length);
         }
             break;
         case EMS_TYPE_UNDEFINED: {
@@ -152,6 +444,277 @@ Napi::Value NodeJScriticalExit(const Napi::CallbackInfo& info) {
 }
 
 
+Napi::Value NodeJSnewLock(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    NODE_MMAPID_DECL;
+    if (info.Length() != 3) {
+        THROW_ERROR("NodeJSnewLock: Wrong number of args");
+    }
+    std::string name = info[0].As<Napi::String>().Utf8Value();
+    int lockType = info[1].As<Napi::Number>();
+    int32_t count = info[2].As<Napi::Number>();
+    int64_t lockID = EMSnewLock(mmapID, name.c_str(), lockType, count);
+    if (lockID < 0) {
+        THROW_ERROR("NodeJSnewLock: Unable to find or create the named lock");
+    } else {
+        return Napi::Value::From(env, lockID);
+    }
+}
+
+
+Napi::Value NodeJStaskGraphNew(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    NODE_MMAPID_DECL;
+    if (info.Length() != 3) {
+        THROW_ERROR("NodeJStaskGraphNew: Wrong number of args");
+    }
+    std::string name = info[0].As<Napi::String>().Utf8Value();
+    int64_t maxTasks = info[1].As<Napi::Number>();
+    int64_t maxEdges = info[2].As<Napi::Number>();
+    int64_t graphID = EMStaskGraphNew(mmapID, name.c_str(), maxTasks, maxEdges);
+    if (graphID < 0) {
+        THROW_ERROR("NodeJStaskGraphNew: Unable to find or create the named task graph");
+    } else {
+        return Napi::Value::From(env, graphID);
+    }
+}
+
+
+//  Each input and output is [ mmapID, index or key ]
+static bool NodeJStaskElements(Napi::Array elemArr, EMStaskElement *elems, std::string *keys) {
+    for (uint32_t elemN = 0; elemN < elemArr.Length(); elemN++) {
+        Napi::Array elem = elemArr.Get(elemN).As<Napi::Array>();
+        Napi::Value keyArg = elem.Get((uint32_t) 1);
+        elems[elemN].mmapID = (int) elem.Get((uint32_t) 0).As<Napi::Number>();
+        elems[elemN].key.type = NapiObjToEMStype(keyArg, false);
+        switch (elems[elemN].key.type) {
+            case EMS_TYPE_INTEGER: {
+                int64_t idx = keyArg.As<Napi::Number>();
+                elems[elemN].key.value = (void *) idx;
+            }
+                break;
+            case EMS_TYPE_FLOAT: {
+                EMSulong_double alias = {.d = keyArg.As<Napi::Number>()};
+                elems[elemN].key.value = (void *) alias.u64;
+            }
+                break;
+            case EMS_TYPE_BOOLEAN: {
+                bool tmp = keyArg.As<Napi::Boolean>();
+                elems[elemN].key.value = (void *) tmp;
+            }
+                break;
+            case EMS_TYPE_STRING:
+                keys[elemN] = keyArg.As<Napi::String>().Utf8Value();
+                elems[elemN].key.length = keys[elemN].length();
+                elems[elemN].key.value = (void *) keys[elemN].c_str();
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+
+Napi::Value NodeJStaskGraphAdd(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    NODE_MMAPID_DECL;
+    if (info.Length() != 3  ||  !info[1].IsArray()  ||  !info[2].IsArray()) {
+        THROW_ERROR("NodeJStaskGraphAdd: Expected a graph and arrays of inputs and outputs");
+    }
+    int64_t graphID = info[0].As<Napi::Number>();
+    Napi::Array inputArr = info[1].As<Napi::Array>();
+    Napi::Array outputArr = info[2].As<Napi::Array>();
+    int nInputs = (int) inputArr.Length();
+    int nOutputs = (int) outputArr.Length();
+    EMStaskElement *inputs = (EMStaskElement *) calloc(nInputs + nOutputs + 1, sizeof(EMStaskElement));
+    std::string *keys = new std::string[nInputs + nOutputs + 1];
+    if (inputs == NULL) {
+        delete[] keys;
+        THROW_ERROR("NodeJStaskGraphAdd: Unable to allocate the task's elements");
+    }
+    EMStaskElement *outputs = &inputs[nInputs];
+    int64_t taskN = -1;
+    if (NodeJStaskElements(inputArr, inputs, keys)  &&  NodeJStaskElements(outputArr, outputs, &keys[nInputs])) {
+        taskN = EMStaskGraphAdd(mmapID, graphID, nInputs, inputs, nOutputs, outputs);
+    }
+    free(inputs);
+    delete[] keys;
+    if (taskN < 0) {
+        THROW_ERROR("NodeJStaskGraphAdd: Unable to add the task");
+    }
+    return Napi::Value::From(env, taskN);
+}
+
+
+Napi::Value NodeJStaskGraphStart(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    NODE_MMAPID_DECL;
+    if (info.Length() != 1) {
+        THROW_ERROR("NodeJStaskGraphStart: Wrong number of args");
+    }
+    int64_t graphID = info[0].As<Napi::Number>();
+    return Napi::Boolean::New(env, EMStaskGraphStart(mmapID, graphID));
+}
+
+
+Napi::Value NodeJStaskGraphNext(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    NODE_MMAPID_DECL;
+    if (info.Length() != 1) {
+        THROW_ERROR("NodeJStaskGraphNext: Wrong number of args");
+    }
+    int64_t graphID = info[0].As<Napi::Number>();
+    return Napi::Value::From(env, EMStaskGraphNext(mmapID, graphID));
+}
+
+
+Napi::Value NodeJStaskGraphDone(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    NODE_MMAPID_DECL;
+    if (info.Length() != 2) {
+        THROW_ERROR("NodeJStaskGraphDone: Wrong number of args");
+    }
+    int64_t graphID = info[0].As<Napi::Number>();
+    int64_t taskN = info[1].As<Napi::Number>();
+    return Napi::Boolean::New(env, EMStaskGraphDone(mmapID, graphID, taskN));
+}
+
+
+Napi::Value NodeJSorderedNew(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    NODE_MMAPID_DECL;
+    if (info.Length() != 1) {
+        THROW_ERROR("NodeJSorderedNew: Wrong number of args");
+    }
+    std::string name = info[0].As<Napi::String>().Utf8Value();
+    int64_t indexID = EMSorderedNew(mmapID, name.c_str());
+    if (indexID < 0) {
+        THROW_ERROR("NodeJSorderedNew: Unable to find or create the named ordered index");
+    }
+    return Napi::Value::From(env, indexID);
+}
+
+
+Napi::Value NodeJSorderedPut(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    NODE_MMAPID_DECL;
+    EMSvalueType key = EMS_VALUE_TYPE_INITIALIZER;
+    EMSvalueType value = EMS_VALUE_TYPE_INITIALIZER;
+    if (info.Length() != 3) {
+        THROW_ERROR("NodeJSorderedPut: Wrong number of args");
+    }
+    int64_t indexID = info[0].As<Napi::Number>();
+    NAPI_OBJ_2_EMS_OBJ(info[1], key, false);
+    NAPI_OBJ_2_EMS_OBJ(info[2], value, false);
+    if (!EMSorderedPut(mmapID, indexID, &key, &value)) {
+        THROW_ERROR("NodeJSorderedPut: Unable to put the key");
+    }
+    return Napi::Value::From(env, true);
+}
+
+
+Napi::Value NodeJSorderedGet(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    NODE_MMAPID_DECL;
+    EMSvalueType key = EMS_VALUE_TYPE_INITIALIZER;
+    EMSvalueType returnValue = EMS_VALUE_TYPE_INITIALIZER;
+    if (info.Length() != 2) {
+        THROW_ERROR("NodeJSorderedGet: Wrong number of args");
+    }
+    int64_t indexID = info[0].As<Napi::Number>();
+    NAPI_OBJ_2_EMS_OBJ(info[1], key, false);
+    EMSorderedGet(mmapID, indexID, &key, &returnValue);
+    return ems2napiReturnValue(env, &returnValue);
+}
+
+
+Napi::Value NodeJSorderedRemove(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    NODE_MMAPID_DECL;
+    EMSvalueType key = EMS_VALUE_TYPE_INITIALIZER;
+    if (info.Length() != 2) {
+        THROW_ERROR("NodeJSorderedRemove: Wrong number of args");
+    }
+    int64_t indexID = info[0].As<Napi::Number>();
+    NAPI_OBJ_2_EMS_OBJ(info[1], key, false);
+    return Napi::Boolean::New(env, EMSorderedRemove(mmapID, indexID, &key));
+}
+
+
+Napi::Value NodeJSorderedCount(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    NODE_MMAPID_DECL;
+    if (info.Length() != 1) {
+        THROW_ERROR("NodeJSorderedCount: Wrong number of args");
+    }
+    int64_t indexID = info[0].As<Napi::Number>();
+    return Napi::Value::From(env, EMSorderedCount(mmapID, indexID));
+}
+
+
+//  Returns an array of up to maxItems [ key, value ] pairs
+Napi::Value NodeJSorderedScan(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    NODE_MMAPID_DECL;
+    EMSvalueType from = EMS_VALUE_TYPE_INITIALIZER;
+    EMSvalueType to = EMS_VALUE_TYPE_INITIALIZER;
+    if (info.Length() != 5) {
+        THROW_ERROR("NodeJSorderedScan: Wrong number of args");
+    }
+    int64_t indexID = info[0].As<Napi::Number>();
+    NAPI_OBJ_2_EMS_OBJ(info[1], from, false);
+    NAPI_OBJ_2_EMS_OBJ(info[2], to, false);
+    int flags = info[3].As<Napi::Number>();
+    int maxItems = info[4].As<Napi::Number>();
+    std::vector<EMSvalueType> keys(maxItems > 0 ? maxItems : 1, EMS_VALUE_TYPE_INITIALIZER);
+    std::vector<EMSvalueType> values(maxItems > 0 ? maxItems : 1, EMS_VALUE_TYPE_INITIALIZER);
+    int nItems = EMSorderedScan(mmapID, indexID, &from, &to, flags, maxItems, keys.data(), values.data());
+    if (nItems < 0) {
+        THROW_ERROR("NodeJSorderedScan: Unable to scan the index");
+    }
+    Napi::Array items = Napi::Array::New(env, nItems);
+    for (int itemN = 0;  itemN < nItems;  itemN++) {
+        Napi::Array item = Napi::Array::New(env, 2);
+        item.Set((uint32_t) 0, ems2napiReturnValue(env, &keys[itemN]));
+        item.Set((uint32_t) 1, ems2napiReturnValue(env, &values[itemN]));
+        items.Set((uint32_t) itemN, item);
+    }
+    return items;
+}
+
+
+Napi::Value NodeJSlockAcquire(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    NODE_MMAPID_DECL;
+    if (info.Length() != 3) {
+        THROW_ERROR("NodeJSlockAcquire: Wrong number of args");
+    }
+    int64_t lockID = info[0].As<Napi::Number>();
+    bool shared = info[1].As<Napi::Boolean>();
+    int timeout = info[2].As<Napi::Number>();
+    int timeRemaining = EMSlockAcquire(mmapID, lockID, shared, timeout);
+    return Napi::Value::From(env, timeRemaining);
+}
+
+
+Napi::Value NodeJSlockRelease(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    NODE_MMAPID_DECL;
+    if (info.Length() != 2) {
+        THROW_ERROR("NodeJSlockRelease: Wrong number of args");
+    }
+    int64_t lockID = info[0].As<Napi::Number>();
+    bool shared = info[1].As<Napi::Boolean>();
+    bool success = EMSlockRelease(mmapID, lockID, shared);
+    if (!success) {
+        THROW_ERROR("NodeJSlockRelease: Released a lock that was not held");
+    } else {
+        return Napi::Value::From(env, success);
+    }
+}
+
+
 Napi::Value NodeJSbarrier(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
     NODE_MMAPID_DECL;
@@ -170,6 +733,69 @@ Napi::Value NodeJSbarrier(const Napi::CallbackInfo& info) {
 }
 
 
+//  Post a fork-join task to a process's mailbox
+Napi::Value NodeJStaskPost(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    NODE_MMAPID_DECL;
+    if (info.Length() != 2  ||  !info[1].IsString()) {
+        THROW_ERROR("NodeJStaskPost: Expected a process and a message");
+    }
+    int taskN = info[0].As<Napi::Number>();
+    std::string msg = info[1].As<Napi::String>().Utf8Value();
+    return Napi::Boolean::New(env, EMStaskPost(mmapID, taskN, msg.c_str()));
+}
+
+
+//  Record the PID of a worker process started by the master
+Napi::Value NodeJStaskStarted(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    NODE_MMAPID_DECL;
+    if (info.Length() != 2) {
+        THROW_ERROR("NodeJStaskStarted: Expected a process and its PID");
+    }
+    int taskN = info[0].As<Napi::Number>();
+    int pid = info[1].As<Napi::Number>();
+    return Napi::Boolean::New(env, EMStaskStarted(mmapID, taskN, pid));
+}
+
+
+//  Wait for the next task in this process's mailbox, undefined if the master exited
+Napi::Value NodeJStaskReceive(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    NODE_MMAPID_DECL;
+    if (info.Length() != 1) {
+        THROW_ERROR("NodeJStaskReceive: Expected the receiving process");
+    }
+    int taskN = info[0].As<Napi::Number>();
+    EMSvalueType returnValue = EMS_VALUE_TYPE_INITIALIZER;
+    if (!EMStaskReceive(mmapID, taskN, &returnValue)) {
+        return env.Undefined();
+    }
+    return ems2napiReturnValue(env, &returnValue);
+}
+
+
+//  Report the last task received finished, and whether it failed
+Napi::Value NodeJStaskDone(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    NODE_MMAPID_DECL;
+    if (info.Length() != 2) {
+        THROW_ERROR("NodeJStaskDone: Expected the receiving process and whether it failed");
+    }
+    int taskN = info[0].As<Napi::Number>();
+    bool failed = info[1].As<Napi::Boolean>();
+    return Napi::Boolean::New(env, EMStaskDone(mmapID, taskN, failed));
+}
+
+
+//  Wait for the workers to finish their tasks, -1 or the first that failed or exited
+Napi::Value NodeJStaskJoin(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    NODE_MMAPID_DECL;
+    return Napi::Number::New(env, EMStaskJoin(mmapID));
+}
+
+
 Napi::Value NodeJSsingleTask(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
     NODE_MMAPID_DECL;
@@ -209,6 +835,100 @@ Napi::Value NodeJSfaa(const Napi::CallbackInfo& info) {
 }
 
 
+//==================================================================
+//  Convert the path to a field, an array of keys and indexes or a string
+//  of keys separated by dots, to native path components
+static bool NodeJSfieldPath(Napi::Value pathArg, std::vector<EMSvalueType> &path, std::vector<std::string> &names) {
+    if (pathArg.IsString()) {
+        std::string pathStr = pathArg.As<Napi::String>().Utf8Value();
+        size_t start = 0, dot;
+        do {
+            dot = pathStr.find('.', start);
+            names.push_back(pathStr.substr(start, (dot == std::string::npos) ? std::string::npos : dot - start));
+            start = dot + 1;
+        } while (dot != std::string::npos);
+    } else if (pathArg.IsArray()) {
+        Napi::Array pathArr = pathArg.As<Napi::Array>();
+        for (uint32_t componentN = 0;  componentN < pathArr.Length();  componentN++) {
+            Napi::Value component = pathArr.Get(componentN);
+            if (component.IsNumber()) {
+                names.push_back("");
+                EMSvalueType index = EMS_VALUE_TYPE_INITIALIZER;
+                index.type = EMS_TYPE_INTEGER;
+                index.value = (void *) (int64_t) component.As<Napi::Number>();
+                path.push_back(index);
+            } else if (component.IsString()) {
+                names.push_back(component.As<Napi::String>().Utf8Value());
+                path.push_back(EMS_VALUE_TYPE_INITIALIZER);
+            } else {
+                return false;
+            }
+        }
+    } else {
+        return false;
+    }
+    //  Names are referenced once the vector of names is complete
+    path.resize(names.size(), EMS_VALUE_TYPE_INITIALIZER);
+    for (size_t componentN = 0;  componentN < names.size();  componentN++) {
+        if (path[componentN].type != EMS_TYPE_INTEGER) {
+            path[componentN].type = EMS_TYPE_STRING;
+            path[componentN].length = names[componentN].length();
+            path[componentN].value = (void *) names[componentN].c_str();
+        }
+    }
+    return !path.empty();
+}
+
+
+Napi::Value NodeJSreadField(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    EMSvalueType returnValue = EMS_VALUE_TYPE_INITIALIZER;
+    std::vector<EMSvalueType> path;
+    std::vector<std::string> names;
+    STACK_ALLOC_AND_CHECK_KEY_ARG;
+    if (info.Length() != 2  ||  !NodeJSfieldPath(info[1], path, names)) {
+        THROW_ERROR("NodeJSreadField: Requires a key and a path");
+    }
+    if (!EMSreadField(mmapID, &key, (int) path.size(), path.data(), &returnValue)) {
+        THROW_ERROR("NodeJSreadField: Unable to read the field");
+    }
+    return ems2napiReturnValue(env, &returnValue);
+}
+
+
+Napi::Value NodeJSwriteField(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    std::vector<EMSvalueType> path;
+    std::vector<std::string> names;
+    STACK_ALLOC_AND_CHECK_KEY_ARG;
+    if (info.Length() < 3  ||  !NodeJSfieldPath(info[1], path, names)) {
+        THROW_ERROR("NodeJSwriteField: Requires a key, a path, and a value");
+    }
+    STACK_ALLOC_AND_CHECK_VALUE_ARG(2);
+    if (!EMSwriteField(mmapID, &key, (int) path.size(), path.data(), &value)) {
+        THROW_ERROR("NodeJSwriteField: Unable to write the field");
+    }
+    return env.Undefined();
+}
+
+
+Napi::Value NodeJSfaaField(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    EMSvalueType returnValue = EMS_VALUE_TYPE_INITIALIZER;
+    std::vector<EMSvalueType> path;
+    std::vector<std::string> names;
+    STACK_ALLOC_AND_CHECK_KEY_ARG;
+    if (info.Length() != 3  ||  !NodeJSfieldPath(info[1], path, names)) {
+        THROW_ERROR("NodeJSfaaField: Requires a key, a path, and a number");
+    }
+    STACK_ALLOC_AND_CHECK_VALUE_ARG(2);
+    if (!EMSfaaField(mmapID, &key, (int) path.size(), path.data(), &value, &returnValue)) {
+        THROW_ERROR("NodeJSfaaField: Unable to add to the field");
+    }
+    return ems2napiReturnValue(env, &returnValue);
+}
+
+
 Napi::Value NodeJSpush(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
     NODE_MMAPID_DECL;
@@ -298,6 +1018,155 @@ Napi::Value NodeJSloopChunk(const Napi::CallbackInfo& info) {
 }
 
 
+//--------------------------------------------------------------
+//  Native read and write set of a transaction in progress
+typedef struct {
+    int nElems;
+    EMStmElement *elems;
+} NodeJStransaction;
+
+static void NodeJStmFree(NodeJStransaction *tm) {
+    if (tm->elems != NULL) {
+        for (int elemN = 0; elemN < tm->nElems; elemN++) {
+            if (tm->elems[elemN].key.type == EMS_TYPE_STRING) free(tm->elems[elemN].key.value);
+        }
+        free(tm->elems);
+        tm->elems = NULL;
+    }
+}
+
+
+Napi::Value NodeJStmStart(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (info.Length() != 1  ||  !info[0].IsArray()) {
+        THROW_ERROR("NodeJStmStart: Expected an array of transaction elements");
+    }
+    Napi::Array elemArr = info[0].As<Napi::Array>();
+    NodeJStransaction *tm = (NodeJStransaction *) malloc(sizeof(NodeJStransaction));
+    if (tm == NULL) {
+        THROW_ERROR("NodeJStmStart: Unable to allocate the transaction");
+    }
+    tm->nElems = (int) elemArr.Length();
+    tm->elems = (EMStmElement *) calloc(tm->nElems, sizeof(EMStmElement));
+    if (tm->elems == NULL) {
+        free(tm);
+        THROW_ERROR("NodeJStmStart: Unable to allocate the transaction's elements");
+    }
+
+    //  Each element is [ mmapID, index or key, isReadOnly ]
+    for (uint32_t elemN = 0; elemN < (uint32_t) tm->nElems; elemN++) {
+        Napi::Array elem = elemArr.Get(elemN).As<Napi::Array>();
+        EMStmElement *tmElem = &tm->elems[elemN];
+        Napi::Value keyArg = elem.Get((uint32_t) 1);
+        tmElem->mmapID = (int) elem.Get((uint32_t) 0).As<Napi::Number>();
+        tmElem->readOnly = elem.Get((uint32_t) 2).As<Napi::Boolean>();
+        NAPI_OBJ_2_EMS_OBJ(keyArg, tmElem->key, false);
+        if (tmElem->key.type == EMS_TYPE_STRING) {
+            //  Keys must outlive this call, replace the scratch copy
+            void *keyCopy = malloc(tmElem->key.length);
+            if (keyCopy == NULL) {
+                tmElem->key.type = EMS_TYPE_UNDEFINED;
+                NodeJStmFree(tm);
+                free(tm);
+                THROW_ERROR("NodeJStmStart: Unable to allocate space for a key");
+            }
+            memcpy(keyCopy, tmElem->key.value, tmElem->key.length);
+            tmElem->key.value = keyCopy;
+        }
+    }
+
+    if (!EMStmStart(tm->nElems, tm->elems)) {
+        NodeJStmFree(tm);
+        free(tm);
+        THROW_ERROR("NodeJStmStart: Unable to acquire the transaction's elements");
+    }
+
+    Napi::Array values = Napi::Array::New(env, tm->nElems);
+    for (uint32_t elemN = 0; elemN < (uint32_t) tm->nElems; elemN++) {
+        values.Set(elemN, ems2napiReturnValue(env, &tm->elems[elemN].value));
+    }
+    Napi::Object retObj = Napi::Object::New(env);
+    retObj.Set("values", values);
+    retObj.Set("native", Napi::External<NodeJStransaction>::New(env, tm,
+               [](Napi::Env env, NodeJStransaction *tm) { NodeJStmFree(tm); free(tm); }));
+    return retObj;
+}
+
+
+Napi::Value NodeJStmEnd(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (info.Length() != 2) {
+        THROW_ERROR("NodeJStmEnd: Expected a transaction and whether to commit it");
+    }
+    NodeJStransaction *tm = info[0].As<Napi::External<NodeJStransaction>>().Data();
+    bool doCommit = info[1].As<Napi::Boolean>();
+    if (tm->elems == NULL) {
+        THROW_ERROR("NodeJStmEnd: The transaction has already ended");
+    }
+    bool committed = EMStmEnd(tm->nElems, tm->elems, doCommit);
+    NodeJStmFree(tm);
+    return Napi::Boolean::New(env, committed);
+}
+
+
+//--------------------------------------------------------------
+//  Software transactions, identified by a process-local transaction ID
+Napi::Value NodeJSstmStart(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    int txID = EMSstmStart();
+    if (txID < 0) {
+        THROW_ERROR("NodeJSstmStart: Unable to start a transaction");
+    }
+    return Napi::Number::New(env, txID);
+}
+
+
+//  Returns null if the element conflicts with the transaction
+Napi::Value NodeJSstmRead(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (info.Length() != 3) {
+        THROW_ERROR("NodeJSstmRead: Expected a transaction, mmapID, and index");
+    }
+    int txID = info[0].As<Napi::Number>();
+    int mmapID = info[1].As<Napi::Number>();
+    EMSvalueType key = EMS_VALUE_TYPE_INITIALIZER;
+    EMSvalueType returnValue = EMS_VALUE_TYPE_INITIALIZER;
+    NAPI_OBJ_2_EMS_OBJ(info[2], key, false);
+    if (!EMSstmRead(txID, mmapID, &key, &returnValue)) {
+        if (!EMSstmAborted(txID)) THROW_ERROR("NodeJSstmRead: Unable to read the element");
+        return env.Null();
+    }
+    return ems2napiReturnValue(env, &returnValue);
+}
+
+
+Napi::Value NodeJSstmWrite(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (info.Length() < 4) {
+        THROW_ERROR("NodeJSstmWrite: Expected a transaction, mmapID, index, and value");
+    }
+    int txID = info[0].As<Napi::Number>();
+    int mmapID = info[1].As<Napi::Number>();
+    bool stringIsJSON = (info.Length() == 5) ? (bool) info[4].As<Napi::Boolean>() : false;
+    EMSvalueType key = EMS_VALUE_TYPE_INITIALIZER;
+    EMSvalueType value = EMS_VALUE_TYPE_INITIALIZER;
+    NAPI_OBJ_2_EMS_OBJ(info[2], key, false);
+    NAPI_OBJ_2_EMS_OBJ(info[3], value, stringIsJSON);
+    return Napi::Boolean::New(env, EMSstmWrite(txID, mmapID, &key, &value));
+}
+
+
+Napi::Value NodeJSstmEnd(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (info.Length() != 2) {
+        THROW_ERROR("NodeJSstmEnd: Expected a transaction and whether to commit it");
+    }
+    int txID = info[0].As<Napi::Number>();
+    bool doCommit = info[1].As<Napi::Boolean>();
+    return Napi::Boolean::New(env, EMSstmEnd(txID, doCommit));
+}
+
+
 //--------------------------------------------------------------
 Napi::Value NodeJSread(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
@@ -335,6 +1204,29 @@ Napi::Value NodeJSreadFF(const Napi::CallbackInfo& info) {
 }
 
 
+//  Strings and blobs are copied into a Buffer while the value is held by
+//  its view.  The bytes of a Buffer over the EMS heap could be written,
+//  changing a value other processes are reading, so the view is released
+//  as soon as they are copied.
+Napi::Value NodeJSreadView(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    EMSvalueType returnValue = EMS_VALUE_TYPE_INITIALIZER;
+    int64_t view;
+    STACK_ALLOC_AND_CHECK_KEY_ARG;
+    if (!EMSreadView(mmapID, &key, &returnValue, &view)) {
+        THROW_ERROR(QUOTE(__FUNCTION__) ": Unable to read (no return value) from EMS.");
+    }
+    Napi::Value result;
+    if (returnValue.type == EMS_TYPE_STRING  ||  returnValue.type == EMS_TYPE_BLOB) {
+        result = Napi::Buffer<char>::Copy(env, (const char *) returnValue.value, returnValue.length);
+    } else {
+        result = ems2napiReturnValue(env, &returnValue);
+    }
+    if (view >= 0) EMSreleaseView(mmapID, view);
+    return result;
+}
+
+
 Napi::Value NodeJSreadRW(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
     EMSvalueType returnValue = EMS_VALUE_TYPE_INITIALIZER;
@@ -369,6 +1261,46 @@ Napi::Value NodeJSwrite(const Napi::CallbackInfo& info) {
 }
 
 
+//  Convert an item of an array argument.  NAPI_OBJ_2_EMS_OBJ copies strings
+//  and JSON to the stack, so they are copied again to storage that outlives
+//  the conversion.  Returns null if the item cannot be converted.
+static Napi::Value NodeJSbatchItem(Napi::Env env, Napi::Value napiValue, EMSvalueType &value, std::string &storage) {
+    NAPI_OBJ_2_EMS_OBJ(napiValue, value, false);
+    if (value.type == EMS_TYPE_STRING  ||  value.type == EMS_TYPE_JSON) {
+        storage.assign((const char *) value.value, value.length);
+        value.value = (void *) storage.c_str();
+    }
+    return env.Undefined();
+}
+
+
+Napi::Value NodeJSwriteMany(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    NODE_MMAPID_DECL;
+    if (info.Length() != 2  ||  !info[0].IsArray()  ||  !info[1].IsArray()  ||
+        info[0].As<Napi::Array>().Length() != info[1].As<Napi::Array>().Length()) {
+        THROW_ERROR("NodeJSwriteMany: Expected arrays of keys and values of the same length");
+    }
+    Napi::Array keyArr = info[0].As<Napi::Array>();
+    Napi::Array valueArr = info[1].As<Napi::Array>();
+    uint32_t nItems = keyArr.Length();
+    std::vector<EMSvalueType> keys(nItems, EMS_VALUE_TYPE_INITIALIZER);
+    std::vector<EMSvalueType> values(nItems, EMS_VALUE_TYPE_INITIALIZER);
+    std::vector<std::string> storage(2 * (size_t) nItems);
+    for (uint32_t itemN = 0;  itemN < nItems;  itemN++) {
+        if (NodeJSbatchItem(env, keyArr.Get(itemN), keys[itemN], storage[2 * itemN]).IsNull()  ||
+            NodeJSbatchItem(env, valueArr.Get(itemN), values[itemN], storage[2 * itemN + 1]).IsNull()) {
+            return env.Null();
+        }
+    }
+    int64_t nWritten = EMSwriteMany(mmapID, nItems, keys.data(), values.data());
+    if (nWritten < 0) {
+        THROW_ERROR("NodeJSwriteMany: Unable to write the elements");
+    }
+    return Napi::Value::From(env, nWritten);
+}
+
+
 Napi::Value NodeJSwriteEF(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
     STACK_ALLOC_AND_CHECK_KEY_ARG;
@@ -418,6 +1350,108 @@ Napi::Value NodeJSsync(const Napi::CallbackInfo& info) {
 }
 
 
+Napi::Value NodeJSstats(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    NODE_MMAPID_DECL;
+    EMSstatsType stats;
+    bool reset = info.Length() > 0  &&  info[0].ToBoolean();
+    if (!EMSstats(mmapID, &stats, reset)) {
+        THROW_ERROR("NodeJSstats: Unable to read the region's counters");
+    }
+    Napi::Object retObj = Napi::Object::New(env);
+    retObj.Set("tagWaits", Napi::Value::From(env, stats.tagWaits));
+    retObj.Set("tagWaitNs", Napi::Value::From(env, stats.tagWaitNs));
+    retObj.Set("lookups", Napi::Value::From(env, stats.lookups));
+    retObj.Set("probes", Napi::Value::From(env, stats.probes));
+    retObj.Set("allocWaits", Napi::Value::From(env, stats.allocWaits));
+    retObj.Set("allocWaitNs", Napi::Value::From(env, stats.allocWaitNs));
+    retObj.Set("allocFails", Napi::Value::From(env, stats.allocFails));
+    retObj.Set("heapFree", Napi::Value::From(env, stats.heapFree));
+    retObj.Set("heapLargestFree", Napi::Value::From(env, stats.heapLargestFree));
+    retObj.Set("depth", Napi::Value::From(env, stats.depth));
+    return retObj;
+}
+
+
+Napi::Value NodeJShotspots(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    NODE_MMAPID_DECL;
+    if (info.Length() != 1  ||  !info[0].IsNumber()) {
+        THROW_ERROR("NodeJShotspots: Expected the maximum number of tags to return");
+    }
+    int maxSpots = info[0].As<Napi::Number>().Int32Value();
+    EMShotspotType *spots = (EMShotspotType *) calloc(maxSpots > 0 ? maxSpots : 1, sizeof(EMShotspotType));
+    if (spots == NULL) {
+        THROW_ERROR("NodeJShotspots: Unable to allocate the table of tags");
+    }
+    int nSpots = EMShotspots(mmapID, spots, maxSpots);
+    if (nSpots < 0) {
+        free(spots);
+        THROW_ERROR("NodeJShotspots: Region was not created with stats");
+    }
+    Napi::Array retArr = Napi::Array::New(env, nSpots);
+    for (int spotN = 0;  spotN < nSpots;  spotN++) {
+        Napi::Object spot = Napi::Object::New(env);
+        spot.Set("index", Napi::Value::From(env, spots[spotN].index));
+        spot.Set("kind", Napi::Value::From(env, spots[spotN].kind));
+        spot.Set("waits", Napi::Value::From(env, spots[spotN].waits));
+        spot.Set("waitNs", Napi::Value::From(env, spots[spotN].waitNs));
+        spot.Set("maxWaitNs", Napi::Value::From(env, spots[spotN].maxWaitNs));
+        Napi::Array processes = Napi::Array::New(env);
+        for (int proc = 0;  proc < 64;  proc++) {
+            if (spots[spotN].processes & ((uint64_t) 1 << proc)) {
+                processes.Set(processes.Length(), Napi::Value::From(env, proc));
+            }
+        }
+        spot.Set("processes", processes);
+        Napi::Array histogram = Napi::Array::New(env, EMS_HOTSPOT_NBUCKETS);
+        for (int bucket = 0;  bucket < EMS_HOTSPOT_NBUCKETS;  bucket++) {
+            histogram.Set(bucket, Napi::Value::From(env, spots[spotN].histogram[bucket]));
+        }
+        spot.Set("histogram", histogram);
+        retArr.Set(spotN, spot);
+    }
+    free(spots);
+    return retArr;
+}
+
+
+Napi::Value NodeJSexportFile(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    NODE_MMAPID_DECL;
+    if (info.Length() != 4  ||  !info[0].IsString()) {
+        THROW_ERROR("NodeJSexportFile: Expected a filename, format, and range of indexes");
+    }
+    std::string filename = info[0].As<Napi::String>().Utf8Value();
+    int format = info[1].As<Napi::Number>().Int32Value();
+    int64_t start = info[2].As<Napi::Number>().Int64Value();
+    int64_t end = info[3].As<Napi::Number>().Int64Value();
+    int64_t nRows = EMSexport(mmapID, filename.c_str(), format, start, end);
+    if (nRows < 0) {
+        THROW_ERROR("NodeJSexportFile: Unable to export the array");
+    }
+    return Napi::Value::From(env, nRows);
+}
+
+
+Napi::Value NodeJSimportFile(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    NODE_MMAPID_DECL;
+    if (info.Length() != 4  ||  !info[0].IsString()) {
+        THROW_ERROR("NodeJSimportFile: Expected a filename, format, and part of the file");
+    }
+    std::string filename = info[0].As<Napi::String>().Utf8Value();
+    int format = info[1].As<Napi::Number>().Int32Value();
+    int part = info[2].As<Napi::Number>().Int32Value();
+    int nParts = info[3].As<Napi::Number>().Int32Value();
+    int64_t nRows = EMSimport(mmapID, filename.c_str(), format, part, nParts);
+    if (nRows < 0) {
+        THROW_ERROR("NodeJSimportFile: Unable to import the file");
+    }
+    return Napi::Value::From(env, nRows);
+}
+
+
 Napi::Value NodeJSindex2key(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
     NODE_MMAPID_DECL;
@@ -430,6 +1464,37 @@ Napi::Value NodeJSindex2key(const Napi::CallbackInfo& info) {
 }
 
 
+//  Returns { items: [ [ key, value ], ... ], next: index to continue from }
+Napi::Value NodeJSscanKeys(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    NODE_MMAPID_DECL;
+    if (info.Length() != 3) {
+        THROW_ERROR("NodeJSscanKeys: Expected a range of indexes and the number of items");
+    }
+    int64_t start = info[0].As<Napi::Number>().Int64Value();
+    int64_t end = info[1].As<Napi::Number>().Int64Value();
+    int64_t maxItems = info[2].As<Napi::Number>().Int64Value();
+    std::vector<EMSvalueType> keys(maxItems > 0 ? maxItems : 1, EMS_VALUE_TYPE_INITIALIZER);
+    std::vector<EMSvalueType> values(maxItems > 0 ? maxItems : 1, EMS_VALUE_TYPE_INITIALIZER);
+    int64_t next = end;
+    int64_t nItems = EMSscanKeys(mmapID, start, end, maxItems, keys.data(), values.data(), &next);
+    if (nItems < 0) {
+        THROW_ERROR("NodeJSscanKeys: Unable to scan the keys");
+    }
+    Napi::Array items = Napi::Array::New(env, nItems);
+    for (int64_t itemN = 0;  itemN < nItems;  itemN++) {
+        Napi::Array item = Napi::Array::New(env, 2);
+        item.Set((uint32_t) 0, ems2napiReturnValue(env, &keys[itemN]));
+        item.Set((uint32_t) 1, ems2napiReturnValue(env, &values[itemN]));
+        items.Set((uint32_t) itemN, item);
+    }
+    Napi::Object retObj = Napi::Object::New(env);
+    retObj.Set("items", items);
+    retObj.Set("next", Napi::Value::From(env, next));
+    return retObj;
+}
+
+
 Napi::Value NodeJSdestroy(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
     NODE_MMAPID_DECL;
@@ -447,7 +1512,7 @@ Napi::Value NodeJSdestroy(const Napi::CallbackInfo& info) {
 //  EMS Entry Point:   Allocate and initialize the EMS domain memory
 Napi::Value NodeJSinitialize(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
-    if (info.Length() != 15) {
+    if (info.Length() != 16) {
         THROW_ERROR("NodeJSinitialize: Incorrect number of arguments");
     }
     EMSvalueType fillData = EMS_VALUE_TYPE_INITIALIZER;
@@ -469,6 +1534,7 @@ Napi::Value NodeJSinitialize(const Napi::CallbackInfo& info) {
     bool pinThreads    = info[12].As<Napi::Boolean>();
     int32_t nThreads   = info[13].As<Napi::Number>();
     int32_t pctMLock   = info[14].As<Napi::Number>();
+    int32_t regionFlags = info[15].As<Napi::Number>();
 
     if (doDataFill) {
         NAPI_OBJ_2_EMS_OBJ(info[8], fillData, fillIsJSON);
@@ -497,7 +1563,8 @@ Napi::Value NodeJSinitialize(const Napi::CallbackInfo& info) {
                                 EMSmyID,     // 11
                                 pinThreads,  // 12
                                 nThreads,    // 13
-                                pctMLock);   // 14
+                                pctMLock,    // 14
+                                regionFlags); // 15
 
     if (emsBufN < 0) {
         THROW_ERROR("NodeJSinitialize: failed to initialize EMS array");
@@ -507,6 +1574,9 @@ Napi::Value NodeJSinitialize(const Napi::CallbackInfo& info) {
     Napi::Object obj = Napi::Object::New(env);
     obj.Set(Napi::String::New(env, "mmapID"), Napi::Value::From(env, emsBufN));
     ADD_FUNC_TO_NAPI_OBJ(obj, "faa", NodeJSfaa);
+    ADD_FUNC_TO_NAPI_OBJ(obj, "readField", NodeJSreadField);
+    ADD_FUNC_TO_NAPI_OBJ(obj, "writeField", NodeJSwriteField);
+    ADD_FUNC_TO_NAPI_OBJ(obj, "faaField", NodeJSfaaField);
     ADD_FUNC_TO_NAPI_OBJ(obj, "cas", NodeJScas);
     ADD_FUNC_TO_NAPI_OBJ(obj, "read", NodeJSread);
     ADD_FUNC_TO_NAPI_OBJ(obj, "write", NodeJSwrite);
@@ -514,17 +1584,38 @@ Napi::Value NodeJSinitialize(const Napi::CallbackInfo& info) {
     ADD_FUNC_TO_NAPI_OBJ(obj, "releaseRW", NodeJSreleaseRW);
     ADD_FUNC_TO_NAPI_OBJ(obj, "readFE", NodeJSreadFE);
     ADD_FUNC_TO_NAPI_OBJ(obj, "readFF", NodeJSreadFF);
+    ADD_FUNC_TO_NAPI_OBJ(obj, "readView", NodeJSreadView);
     ADD_FUNC_TO_NAPI_OBJ(obj, "setTag", NodeJSsetTag);
     ADD_FUNC_TO_NAPI_OBJ(obj, "writeEF", NodeJSwriteEF);
     ADD_FUNC_TO_NAPI_OBJ(obj, "writeXF", NodeJSwriteXF);
     ADD_FUNC_TO_NAPI_OBJ(obj, "writeXE", NodeJSwriteXE);
+    ADD_FUNC_TO_NAPI_OBJ(obj, "writeMany", NodeJSwriteMany);
     ADD_FUNC_TO_NAPI_OBJ(obj, "push", NodeJSpush);
     ADD_FUNC_TO_NAPI_OBJ(obj, "pop", NodeJSpop);
     ADD_FUNC_TO_NAPI_OBJ(obj, "enqueue", NodeJSenqueue);
     ADD_FUNC_TO_NAPI_OBJ(obj, "dequeue", NodeJSdequeue);
     ADD_FUNC_TO_NAPI_OBJ(obj, "sync", NodeJSsync);
+    ADD_FUNC_TO_NAPI_OBJ(obj, "stats", NodeJSstats);
+    ADD_FUNC_TO_NAPI_OBJ(obj, "hotspots", NodeJShotspots);
+    ADD_FUNC_TO_NAPI_OBJ(obj, "exportFile", NodeJSexportFile);
+    ADD_FUNC_TO_NAPI_OBJ(obj, "importFile", NodeJSimportFile);
     ADD_FUNC_TO_NAPI_OBJ(obj, "index2key", NodeJSindex2key);
+    ADD_FUNC_TO_NAPI_OBJ(obj, "scanKeys", NodeJSscanKeys);
     ADD_FUNC_TO_NAPI_OBJ(obj, "destroy", NodeJSdestroy);
+    ADD_FUNC_TO_NAPI_OBJ(obj, "newLock", NodeJSnewLock);
+    ADD_FUNC_TO_NAPI_OBJ(obj, "lockAcquire", NodeJSlockAcquire);
+    ADD_FUNC_TO_NAPI_OBJ(obj, "lockRelease", NodeJSlockRelease);
+    ADD_FUNC_TO_NAPI_OBJ(obj, "taskGraphNew", NodeJStaskGraphNew);
+    ADD_FUNC_TO_NAPI_OBJ(obj, "taskGraphAdd", NodeJStaskGraphAdd);
+    ADD_FUNC_TO_NAPI_OBJ(obj, "taskGraphStart", NodeJStaskGraphStart);
+    ADD_FUNC_TO_NAPI_OBJ(obj, "taskGraphNext", NodeJStaskGraphNext);
+    ADD_FUNC_TO_NAPI_OBJ(obj, "taskGraphDone", NodeJStaskGraphDone);
+    ADD_FUNC_TO_NAPI_OBJ(obj, "orderedNew", NodeJSorderedNew);
+    ADD_FUNC_TO_NAPI_OBJ(obj, "orderedPut", NodeJSorderedPut);
+    ADD_FUNC_TO_NAPI_OBJ(obj, "orderedGet", NodeJSorderedGet);
+    ADD_FUNC_TO_NAPI_OBJ(obj, "orderedRemove", NodeJSorderedRemove);
+    ADD_FUNC_TO_NAPI_OBJ(obj, "orderedCount", NodeJSorderedCount);
+    ADD_FUNC_TO_NAPI_OBJ(obj, "orderedScan", NodeJSorderedScan);
     return obj;
 }
 
@@ -533,11 +1624,22 @@ Napi::Value NodeJSinitialize(const Napi::CallbackInfo& info) {
 static Napi::Object RegisterModule(Napi::Env env, Napi::Object exports) {
     ADD_FUNC_TO_NAPI_OBJ(exports, "initialize", NodeJSinitialize);
     ADD_FUNC_TO_NAPI_OBJ(exports, "barrier", NodeJSbarrier);
+    ADD_FUNC_TO_NAPI_OBJ(exports, "taskStarted", NodeJStaskStarted);
+    ADD_FUNC_TO_NAPI_OBJ(exports, "taskPost", NodeJStaskPost);
+    ADD_FUNC_TO_NAPI_OBJ(exports, "taskReceive", NodeJStaskReceive);
+    ADD_FUNC_TO_NAPI_OBJ(exports, "taskDone", NodeJStaskDone);
+    ADD_FUNC_TO_NAPI_OBJ(exports, "taskJoin", NodeJStaskJoin);
     ADD_FUNC_TO_NAPI_OBJ(exports, "singleTask", NodeJSsingleTask);
     ADD_FUNC_TO_NAPI_OBJ(exports, "criticalEnter", NodeJScriticalEnter);
     ADD_FUNC_TO_NAPI_OBJ(exports, "criticalExit", NodeJScriticalExit);
     ADD_FUNC_TO_NAPI_OBJ(exports, "loopInit", NodeJSloopInit);
     ADD_FUNC_TO_NAPI_OBJ(exports, "loopChunk", NodeJSloopChunk);
+    ADD_FUNC_TO_NAPI_OBJ(exports, "tmStart", NodeJStmStart);
+    ADD_FUNC_TO_NAPI_OBJ(exports, "tmEnd", NodeJStmEnd);
+    ADD_FUNC_TO_NAPI_OBJ(exports, "stmStart", NodeJSstmStart);
+    ADD_FUNC_TO_NAPI_OBJ(exports, "stmRead", NodeJSstmRead);
+    ADD_FUNC_TO_NAPI_OBJ(exports, "stmWrite", NodeJSstmWrite);
+    ADD_FUNC_TO_NAPI_OBJ(exports, "stmEnd", NodeJSstmEnd);
     return exports;
 }
 
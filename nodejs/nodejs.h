@@ -60,7 +60,8 @@
 
 #define IS_INTEGER(x) ((double)(int64_t)(x) == (double)x)
 //==================================================================
-//  Determine the EMS type of a Napi argument
+//  Determine the EMS type of a Napi argument, objects, arrays, and
+//  null are JSON values stored packed as MessagePack
 #define NapiObjToEMStype(arg, stringIsJSON)                          \
 (                                                                    \
    arg.IsNumber() ?                                                  \
@@ -70,6 +71,9 @@
    (arg.IsString() &&  stringIsJSON) ? EMS_TYPE_JSON  :              \
    arg.IsBoolean()                   ? EMS_TYPE_BOOLEAN :            \
    arg.IsUndefined()                 ? EMS_TYPE_UNDEFINED:           \
+   arg.IsFunction()                  ? EMS_TYPE_INVALID :            \
+   arg.IsBuffer()                    ? EMS_TYPE_BLOB :               \
+   (arg.IsObject() || arg.IsNull())  ? EMS_TYPE_JSON :               \
                                        EMS_TYPE_INVALID              \
 )
 
@@ -105,29 +109,60 @@
 
 Napi::Value NodeJScriticalEnter(const Napi::CallbackInfo& info);
 Napi::Value NodeJScriticalExit(const Napi::CallbackInfo& info);
+Napi::Value NodeJSnewLock(const Napi::CallbackInfo& info);
+Napi::Value NodeJSlockAcquire(const Napi::CallbackInfo& info);
+Napi::Value NodeJSlockRelease(const Napi::CallbackInfo& info);
+Napi::Value NodeJStaskGraphNew(const Napi::CallbackInfo& info);
+Napi::Value NodeJStaskGraphAdd(const Napi::CallbackInfo& info);
+Napi::Value NodeJStaskGraphStart(const Napi::CallbackInfo& info);
+Napi::Value NodeJStaskGraphNext(const Napi::CallbackInfo& info);
+Napi::Value NodeJStaskGraphDone(const Napi::CallbackInfo& info);
+Napi::Value NodeJSorderedNew(const Napi::CallbackInfo& info);
+Napi::Value NodeJSorderedPut(const Napi::CallbackInfo& info);
+Napi::Value NodeJSorderedGet(const Napi::CallbackInfo& info);
+Napi::Value NodeJSorderedRemove(const Napi::CallbackInfo& info);
+Napi::Value NodeJSorderedCount(const Napi::CallbackInfo& info);
+Napi::Value NodeJSorderedScan(const Napi::CallbackInfo& info);
 Napi::Value NodeJSbarrier(const Napi::CallbackInfo& info);
+Napi::Value NodeJStaskStarted(const Napi::CallbackInfo& info);
+Napi::Value NodeJStaskPost(const Napi::CallbackInfo& info);
+Napi::Value NodeJStaskReceive(const Napi::CallbackInfo& info);
+Napi::Value NodeJStaskDone(const Napi::CallbackInfo& info);
+Napi::Value NodeJStaskJoin(const Napi::CallbackInfo& info);
 Napi::Value NodeJSsingleTask(const Napi::CallbackInfo& info);
 Napi::Value NodeJScas(const Napi::CallbackInfo& info);
 Napi::Value NodeJSfaa(const Napi::CallbackInfo& info);
+Napi::Value NodeJSreadField(const Napi::CallbackInfo& info);
+Napi::Value NodeJSwriteField(const Napi::CallbackInfo& info);
+Napi::Value NodeJSfaaField(const Napi::CallbackInfo& info);
 Napi::Value NodeJSpush(const Napi::CallbackInfo& info);
 Napi::Value NodeJSpop(const Napi::CallbackInfo& info);
 Napi::Value NodeJSenqueue(const Napi::CallbackInfo& info);
 Napi::Value NodeJSdequeue(const Napi::CallbackInfo& info);
 Napi::Value NodeJSloopInit(const Napi::CallbackInfo& info);
 Napi::Value NodeJSloopChunk(const Napi::CallbackInfo& info);
+Napi::Value NodeJStmStart(const Napi::CallbackInfo& info);
+Napi::Value NodeJStmEnd(const Napi::CallbackInfo& info);
+Napi::Value NodeJSstmStart(const Napi::CallbackInfo& info);
+Napi::Value NodeJSstmRead(const Napi::CallbackInfo& info);
+Napi::Value NodeJSstmWrite(const Napi::CallbackInfo& info);
+Napi::Value NodeJSstmEnd(const Napi::CallbackInfo& info);
 //--------------------------------------------------------------
 Napi::Value NodeJSread(const Napi::CallbackInfo& info);
 Napi::Value NodeJSreadRW(const Napi::CallbackInfo& info);
 Napi::Value NodeJSreleaseRW(const Napi::CallbackInfo& info);
 Napi::Value NodeJSreadFE(const Napi::CallbackInfo& info);
 Napi::Value NodeJSreadFF(const Napi::CallbackInfo& info);
+Napi::Value NodeJSreadView(const Napi::CallbackInfo& info);
 Napi::Value NodeJSwrite(const Napi::CallbackInfo& info);
 Napi::Value NodeJSwriteEF(const Napi::CallbackInfo& info);
 Napi::Value NodeJSwriteXF(const Napi::CallbackInfo& info);
 Napi::Value NodeJSwriteXE(const Napi::CallbackInfo& info);
+Napi::Value NodeJSwriteMany(const Napi::CallbackInfo& info);
 Napi::Value NodeJSsetTag(const Napi::CallbackInfo& info);
 Napi::Value NodeJSsync(const Napi::CallbackInfo& info);
 Napi::Value NodeJSindex2key(const Napi::CallbackInfo& info);
+Napi::Value NodeJSscanKeys(const Napi::CallbackInfo& info);
 Napi::Value NodeJSdestroy(const Napi::CallbackInfo& info);
 
 #endif //EMSPROJ__H
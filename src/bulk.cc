@@ -0,0 +1,1314 @@
+/*-----------------------------------------------------------------------------+
+ |  Extended Memory Semantics (EMS)                            Version 1.6.1   |
+ |  http://mogill.com/                                       jace@mogill.com   |
+ +-----------------------------------------------------------------------------+
+ |  Copyright (c) 2016-2020, Jace A Mogill.  All rights reserved.              |
+ |                                                                             |
+ | Redistribution and use in source and binary forms, with or without          |
+ | modification, are permitted provided that the following conditions are met: |
+ |    * Redistributions of source code must retain the above copyright         |
+ |      notice, this list of conditions and the following disclaimer.          |
+ |    * Redistributions in binary form must reproduce the above copyright      |
+ |      notice, this list of conditions and the following disclaimer in the    |
+ |      documentation and/or other materials provided with the distribution.   |
+ |    * Neither the name of the Synthetic Semantics nor the names of its       |
+ |      contributors may be used to endorse or promote products derived        |
+ |      from this software without specific prior written permission.          |
+ |                                                                             |
+ |    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS      |
+ |    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT        |
+ |    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR    |
+ |    A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SYNTHETIC         |
+ |    SEMANTICS LLC BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,   |
+ |    EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,      |
+ |    PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR       |
+ |    PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF   |
+ |    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING     |
+ |    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS       |
+ |    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.             |
+ |                                                                             |
+ +-----------------------------------------------------------------------------*/
+#include "ems.h"
+
+//==================================================================
+//  Bulk Import and Export
+//
+//  The elements of an array are streamed to and from files in one of three
+//  formats.  Every row holds an element's key, which is its index in an
+//  indexed array, and its value, so rows may be imported in any order and
+//  a file is split among processes importing it without coordination:
+//  text files by byte range, starting each part at a line boundary, and
+//  column files by row range.  Undefined elements are not exported.
+//
+//    EMS_FORMAT_NDJSON   One JSON array [key,value] per line
+//    EMS_FORMAT_CSV      A key,value,keyFormat,valueFormat header, then a row per
+//                        element.  Strings are quoted, objects and arrays, and strings
+//                        with line breaks, are quoted JSON text with json in the
+//                        field's format column, so every row is one line.  Files
+//                        without the format columns are read as having none.
+//    EMS_FORMAT_COLUMNS  Blocks of at most EMS_COLUMNS_BLOCK rows, each an
+//                        EMScolumnsHeader followed by a column of the keys and a
+//                        column of the values of its rows, each made of:
+//                          uint8_t types[nRows]         EMS_TYPE_* padded to 8 bytes
+//                          int64_t words[nRows]         Integers, booleans and doubles
+//                          int64_t offsets[nRows + 1]   Of each row's bytes within data
+//                          char    data[dataLen]        Strings, blobs and JSON padded to 8 bytes
+//                        Numbers are in host byte order.
+//
+//  Blobs are only exported to the column format, which text formats cannot
+//  represent.  Exports write through a large buffer, building each block of
+//  columns in memory, and imports map the file and write its rows in batches
+//  with EMSwriteMany.
+#define EMS_BULK_BUF_SZ     (4 * 1024 * 1024)   // Bytes buffered between writes of an export
+#define EMS_JSON_MAX_DEPTH  512                 // Nesting of objects and arrays converted
+#define EMS_COLUMNS_MAGIC   "EMSCOLS1"
+#define EMS_COLUMNS_BLOCK   65536               // Most rows in a block of columns, also ended by EMS_BULK_BUF_SZ of data
+#define EMSalign8(n)        (((n) + 7) & ~(size_t) 7)
+
+typedef struct {
+    char magic[8];
+    int64_t nRows;
+    int64_t dataLen[2];     // Bytes of data of the key and value columns
+} EMScolumnsHeader;
+
+//  The columns of a block within a mapped file
+typedef struct {
+    int64_t nRows;
+    int64_t dataLen[2];
+    const unsigned char *types[2];
+    const int64_t *words[2];
+    const int64_t *offsets[2];
+    const char *data[2];
+} EMScolumnsBlock;
+
+
+//  Growable buffer of bytes.  A buffer with a file descriptor is written
+//  to the file whenever it fills, otherwise it grows in memory.
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t cap;
+    int fd;
+    bool failed;
+} EMSbytes;
+
+#define EMS_BYTES_INITIALIZER(fd) {NULL, 0, 0, (fd), false}
+
+static bool EMSwriteAll(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t nWritten = write(fd, data, len);
+        if (nWritten < 0) {
+            if (errno == EINTR) continue;
+            perror("EMSexport: Unable to write the file");
+            return false;
+        }
+        data += nWritten;
+        len -= (size_t) nWritten;
+    }
+    return true;
+}
+
+static bool EMSbytesFlush(EMSbytes *out) {
+    if (!out->failed  &&  !EMSwriteAll(out->fd, out->buf, out->len)) out->failed = true;
+    out->len = 0;
+    return !out->failed;
+}
+
+static bool EMSbytesReserve(EMSbytes *out, size_t len) {
+    if (out->failed) return false;
+    if (out->len + len <= out->cap) return true;
+    size_t cap = (out->cap > 0) ? out->cap : 256;
+    while (cap < out->len + len) cap *= 2;
+    char *buf = (char *) realloc(out->buf, cap);
+    if (buf == NULL) {
+        fprintf(stderr, "EMSbytesReserve: Unable to allocate %zu bytes\n", cap);
+        out->failed = true;
+        return false;
+    }
+    out->buf = buf;
+    out->cap = cap;
+    return true;
+}
+
+static void EMSbytesPut(EMSbytes *out, const void *data, size_t len) {
+    if (out->fd >= 0  &&  out->len + len > out->cap) {
+        //  Flush the buffer, and write data larger than the buffer directly
+        if (!EMSbytesFlush(out)) return;
+        if (len >= out->cap) {
+            if (!EMSwriteAll(out->fd, (const char *) data, len)) out->failed = true;
+            return;
+        }
+    }
+    if (!EMSbytesReserve(out, len)) return;
+    memcpy(out->buf + out->len, data, len);
+    out->len += len;
+}
+
+static void EMSbytesPutc(EMSbytes *out, char c) {
+    EMSbytesPut(out, &c, 1);
+}
+
+//  Keep a NULL after the data without counting it, so strings remain C strings
+static void EMSbytesTerminate(EMSbytes *out) {
+    EMSbytesPutc(out, '\0');
+    if (!out->failed) out->len--;
+}
+
+
+//==================================================================
+//  Writing JSON Text
+//
+static void EMSjsonPutString(EMSbytes *out, const char *data, size_t len) {
+    static const char hexDigits[] = "0123456789abcdef";
+    EMSbytesPutc(out, '"');
+    size_t runStart = 0;        // Bytes copied unchanged since the last escape
+    for (size_t byteN = 0;  byteN < len;  byteN++) {
+        unsigned char c = (unsigned char) data[byteN];
+        if (c >= 0x20  &&  c != '"'  &&  c != '\\') continue;
+        EMSbytesPut(out, data + runStart, byteN - runStart);
+        runStart = byteN + 1;
+        char esc[6] = {'\\', (char) c, '0', '0', hexDigits[c >> 4], hexDigits[c & 0xf]};
+        switch (c) {
+            case '"':
+            case '\\': EMSbytesPut(out, esc, 2);  break;
+            case '\n': esc[1] = 'n';  EMSbytesPut(out, esc, 2);  break;
+            case '\r': esc[1] = 'r';  EMSbytesPut(out, esc, 2);  break;
+            case '\t': esc[1] = 't';  EMSbytesPut(out, esc, 2);  break;
+            default:
+                esc[1] = 'u';
+                EMSbytesPut(out, esc, 6);
+        }
+    }
+    EMSbytesPut(out, data + runStart, len - runStart);
+    EMSbytesPutc(out, '"');
+}
+
+
+//  Doubles are written with the fewest digits that read back exactly, and
+//  keep a fraction so they are read back as doubles.  JSON has no infinities.
+static void EMSjsonPutNumber(EMSbytes *out, bool isInt, int64_t intValue, double dblValue) {
+    char num[40];
+    int len;
+    if (isInt) {
+        len = snprintf(num, sizeof(num), "%" PRId64, intValue);
+    } else if (!isfinite(dblValue)) {
+        len = snprintf(num, sizeof(num), "null");
+    } else {
+        len = snprintf(num, sizeof(num), "%.15g", dblValue);
+        if (strtod(num, NULL) != dblValue) len = snprintf(num, sizeof(num), "%.17g", dblValue);
+        if (strspn(num, "-0123456789") == (size_t) len) len += snprintf(num + len, sizeof(num) - len, ".0");
+    }
+    EMSbytesPut(out, num, (size_t) len);
+}
+
+
+//  Write the packed JSON item at p as JSON text.  Binary data is written as
+//  a string of its bytes, and map keys that are not strings as the string of
+//  their JSON text.  Returns the end of the item, or NULL if it is corrupt.
+static const unsigned char *EMSjsonPutPacked(EMSbytes *out, const unsigned char *p, const unsigned char *end,
+                                             int depth) {
+    int kind;
+    uint64_t count;
+    size_t hdrLen = EMSpackedHeader(p, end, &kind, &count);
+    if (hdrLen == 0  ||  depth > EMS_JSON_MAX_DEPTH) return NULL;
+    switch (kind) {
+        case EMS_PACKED_SCALAR: {
+            bool isInt;
+            int64_t intValue;
+            double dblValue;
+            if (*p == 0xc0) {
+                EMSbytesPut(out, "null", 4);
+            } else if (*p == 0xc2  ||  *p == 0xc3) {
+                if (*p == 0xc3) EMSbytesPut(out, "true", 4);
+                else EMSbytesPut(out, "false", 5);
+            } else if (EMSpackedNumber(p, end, &isInt, &intValue, &dblValue)) {
+                EMSjsonPutNumber(out, isInt, intValue, dblValue);
+            } else {
+                return NULL;
+            }
+            return p + hdrLen;
+        }
+        case EMS_PACKED_BYTES:
+            if ((uint64_t) (end - p) - hdrLen < count) return NULL;
+            EMSjsonPutString(out, (const char *) p + hdrLen, count);
+            return p + hdrLen + count;
+        default: {
+            bool isMap = (kind == EMS_PACKED_MAP);
+            p += hdrLen;
+            EMSbytesPutc(out, isMap ? '{' : '[');
+            for (uint64_t memberN = 0;  memberN < count  &&  p != NULL;  memberN++) {
+                if (memberN > 0) EMSbytesPutc(out, ',');
+                if (isMap) {
+                    if (p < end  &&  EMSpackedIsString(*p)) {
+                        p = EMSjsonPutPacked(out, p, end, depth + 1);
+                    } else {
+                        EMSbytes keyText = EMS_BYTES_INITIALIZER(-1);
+                        p = EMSjsonPutPacked(&keyText, p, end, depth + 1);
+                        EMSjsonPutString(out, keyText.buf, keyText.len);
+                        free(keyText.buf);
+                    }
+                    if (p == NULL) return NULL;
+                    EMSbytesPutc(out, ':');
+                }
+                p = EMSjsonPutPacked(out, p, end, depth + 1);
+            }
+            EMSbytesPutc(out, isMap ? '}' : ']');
+            return p;
+        }
+    }
+}
+
+
+//  Write a value read from EMS as JSON text, returns false for blobs
+static bool EMSjsonPutValue(EMSbytes *out, const EMSvalueType *value) {
+    switch (value->type) {
+        case EMS_TYPE_BOOLEAN:
+            if (value->value) EMSbytesPut(out, "true", 4);
+            else EMSbytesPut(out, "false", 5);
+            return true;
+        case EMS_TYPE_INTEGER:
+            EMSjsonPutNumber(out, true, (int64_t) value->value, 0.0);
+            return true;
+        case EMS_TYPE_FLOAT: {
+            EMSulong_double alias;
+            alias.u64 = (uint64_t) value->value;
+            EMSjsonPutNumber(out, false, 0, alias.d);
+            return true;
+        }
+        case EMS_TYPE_STRING:
+            EMSjsonPutString(out, (const char *) value->value, value->length);
+            return true;
+        case EMS_TYPE_JSON: {
+            const unsigned char *data = (const unsigned char *) value->value;
+            if (EMSisPackedJSON(value->type, data)) {
+                uint32_t len;
+                memcpy(&len, data + 1, sizeof(len));
+                return EMSjsonPutPacked(out, data + EMS_JSON_PACKED_HDR_SZ,
+                                        data + EMS_JSON_PACKED_HDR_SZ + len, 0) != NULL;
+            }
+            EMSbytesPut(out, data, strlen((const char *) data));   // Stored as JSON text
+            return true;
+        }
+        case EMS_TYPE_UNDEFINED:
+            EMSbytesPut(out, "null", 4);
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+//  Write a value as a CSV field.  Strings, objects and arrays are quoted,
+//  numbers and booleans are the same as in JSON.  Sets isJSON if the field is
+//  the JSON text of the value, which its format column must say.  Strings
+//  with line breaks are written as JSON so parts of a file split at any line.
+static bool EMScsvPutValue(EMSbytes *out, const EMSvalueType *value, EMSbytes *scratch, bool *isJSON) {
+    const char *data = (const char *) value->value;
+    size_t len = value->length;
+    *isJSON = (value->type == EMS_TYPE_JSON)  ||
+              (value->type == EMS_TYPE_STRING  &&
+               (memchr(data, '\n', len) != NULL  ||  memchr(data, '\r', len) != NULL));
+    if (*isJSON) {
+        scratch->len = 0;
+        if (!EMSjsonPutValue(scratch, value)) return false;
+        data = scratch->buf;
+        len = scratch->len;
+    } else if (value->type != EMS_TYPE_STRING) {
+        return EMSjsonPutValue(out, value);
+    }
+    EMSbytesPutc(out, '"');
+    for (const char *quote;  (quote = (const char *) memchr(data, '"', len)) != NULL;  ) {
+        EMSbytesPut(out, data, (size_t) (quote - data) + 1);
+        EMSbytesPutc(out, '"');
+        len -= (size_t) (quote - data) + 1;
+        data = quote + 1;
+    }
+    EMSbytesPut(out, data, len);
+    EMSbytesPutc(out, '"');
+    return true;
+}
+
+
+//  Write a row of CSV, key,value,keyFormat,valueFormat
+static bool EMScsvPutRow(EMSbytes *out, const EMSvalueType *key, const EMSvalueType *value, EMSbytes *scratch) {
+    bool isJSON[2];
+    bool converted = EMScsvPutValue(out, key, scratch, &isJSON[0]);
+    EMSbytesPutc(out, ',');
+    converted = converted  &&  EMScsvPutValue(out, value, scratch, &isJSON[1]);
+    if (!converted) return false;
+    EMSbytesPut(out, isJSON[0] ? ",json" : ",", isJSON[0] ? 5 : 1);
+    EMSbytesPut(out, isJSON[1] ? ",json\n" : ",\n", isJSON[1] ? 6 : 2);
+    return true;
+}
+
+
+//==================================================================
+//  Reading JSON Text
+//
+static const char *EMSjsonSkipSpace(const char *p, const char *end) {
+    while (p < end  &&  (*p == ' '  ||  *p == '\t'  ||  *p == '\r'  ||  *p == '\n')) p++;
+    return p;
+}
+
+static const char *EMSjsonLiteral(const char *p, const char *end, const char *literal) {
+    size_t len = strlen(literal);
+    if ((size_t) (end - p) < len  ||  memcmp(p, literal, len) != 0) return NULL;
+    return p + len;
+}
+
+static bool EMSjsonHex4(const char *p, const char *end, uint32_t *codePoint) {
+    if (end - p < 4) return false;
+    *codePoint = 0;
+    for (int digitN = 0;  digitN < 4;  digitN++) {
+        char c = p[digitN];
+        int digit = (c >= '0'  &&  c <= '9') ? c - '0' :
+                    (c >= 'a'  &&  c <= 'f') ? c - 'a' + 10 :
+                    (c >= 'A'  &&  c <= 'F') ? c - 'A' + 10 : -1;
+        if (digit < 0) return false;
+        *codePoint = (*codePoint << 4) | (uint32_t) digit;
+    }
+    return true;
+}
+
+static void EMSputUTF8(EMSbytes *out, uint32_t codePoint) {
+    char utf8[4];
+    size_t len;
+    if (codePoint < 0x80) {
+        utf8[0] = (char) codePoint;
+        len = 1;
+    } else if (codePoint < 0x800) {
+        utf8[0] = (char) (0xc0 | (codePoint >> 6));
+        utf8[1] = (char) (0x80 | (codePoint & 0x3f));
+        len = 2;
+    } else if (codePoint < 0x10000) {
+        utf8[0] = (char) (0xe0 | (codePoint >> 12));
+        utf8[1] = (char) (0x80 | ((codePoint >> 6) & 0x3f));
+        utf8[2] = (char) (0x80 | (codePoint & 0x3f));
+        len = 3;
+    } else {
+        utf8[0] = (char) (0xf0 | (codePoint >> 18));
+        utf8[1] = (char) (0x80 | ((codePoint >> 12) & 0x3f));
+        utf8[2] = (char) (0x80 | ((codePoint >> 6) & 0x3f));
+        utf8[3] = (char) (0x80 | (codePoint & 0x3f));
+        len = 4;
+    }
+    EMSbytesPut(out, utf8, len);
+}
+
+
+//  Append the bytes of the JSON string starting after its opening quote.
+//  Returns the position after the closing quote, or NULL if it is malformed.
+static const char *EMSjsonUnescape(const char *p, const char *end, EMSbytes *out) {
+    while (p < end) {
+        const char *runStart = p;
+        while (p < end  &&  *p != '"'  &&  *p != '\\') p++;
+        EMSbytesPut(out, runStart, (size_t) (p - runStart));
+        if (p >= end) return NULL;
+        if (*p++ == '"') return p;
+        if (p >= end) return NULL;
+        char c = *p++;
+        switch (c) {
+            case '"':
+            case '\\':
+            case '/': EMSbytesPutc(out, c);  break;
+            case 'b': EMSbytesPutc(out, '\b');  break;
+            case 'f': EMSbytesPutc(out, '\f');  break;
+            case 'n': EMSbytesPutc(out, '\n');  break;
+            case 'r': EMSbytesPutc(out, '\r');  break;
+            case 't': EMSbytesPutc(out, '\t');  break;
+            case 'u': {
+                uint32_t codePoint, low;
+                if (!EMSjsonHex4(p, end, &codePoint)) return NULL;
+                p += 4;
+                //  Join a UTF-16 surrogate pair
+                if (codePoint >= 0xd800  &&  codePoint < 0xdc00  &&  end - p >= 6  &&
+                    p[0] == '\\'  &&  p[1] == 'u'  &&  EMSjsonHex4(p + 2, end, &low)  &&
+                    low >= 0xdc00  &&  low < 0xe000) {
+                    codePoint = 0x10000 + ((codePoint - 0xd800) << 10) + (low - 0xdc00);
+                    p += 6;
+                }
+                EMSputUTF8(out, codePoint);
+                break;
+            }
+            default:
+                return NULL;
+        }
+    }
+    return NULL;
+}
+
+
+//  Parse a JSON number, integers that fit in 64 bits remain integers.
+//  Returns the position after the number, or NULL if there is none.
+static const char *EMSjsonParseNumber(const char *p, const char *end, bool *isInt,
+                                      int64_t *intValue, double *dblValue) {
+    char num[400];
+    const char *numEnd = p;
+    *isInt = true;
+    if (numEnd < end  &&  *numEnd == '-') numEnd++;
+    while (numEnd < end  &&  ((*numEnd >= '0'  &&  *numEnd <= '9')  ||  *numEnd == '.'  ||
+                              *numEnd == 'e'  ||  *numEnd == 'E'  ||  *numEnd == '+'  ||  *numEnd == '-')) {
+        if (*numEnd == '.'  ||  *numEnd == 'e'  ||  *numEnd == 'E') *isInt = false;
+        numEnd++;
+    }
+    size_t len = (size_t) (numEnd - p);
+    if (len == 0  ||  len >= sizeof(num)) return NULL;
+    memcpy(num, p, len);
+    num[len] = '\0';
+    char *parsedEnd;
+    errno = 0;
+    if (*isInt) {
+        *intValue = strtoll(num, &parsedEnd, 10);
+        if (errno != ERANGE  &&  parsedEnd == num + len) return numEnd;
+        *isInt = false;
+    }
+    *dblValue = strtod(num, &parsedEnd);
+    return (parsedEnd == num + len) ? numEnd : NULL;
+}
+
+
+//  Replace the longest header reserved at hdrPos with the header of the
+//  string, array or map that follows it
+#define EMS_PACKED_RESERVED_HDR  5
+static void EMSjsonPackHeader(EMSbytes *out, size_t hdrPos, int kind, uint64_t count) {
+    unsigned char hdr[EMS_PACKED_MAX_HDR];
+    size_t hdrLen = EMSpackHeader(hdr, kind, count);
+    if (out->failed) return;
+    char *base = out->buf + hdrPos;
+    memmove(base + hdrLen, base + EMS_PACKED_RESERVED_HDR, out->len - hdrPos - EMS_PACKED_RESERVED_HDR);
+    memcpy(base, hdr, hdrLen);
+    out->len -= EMS_PACKED_RESERVED_HDR - hdrLen;
+}
+
+static const char *EMSjsonPackString(const char *p, const char *end, EMSbytes *out) {
+    static const char reserved[EMS_PACKED_RESERVED_HDR] = {0};
+    size_t hdrPos = out->len;
+    EMSbytesPut(out, reserved, sizeof(reserved));
+    p = EMSjsonUnescape(p, end, out);
+    if (p != NULL) EMSjsonPackHeader(out, hdrPos, EMS_PACKED_BYTES, out->len - hdrPos - EMS_PACKED_RESERVED_HDR);
+    return p;
+}
+
+
+//  Append the JSON value at p packed as MessagePack.  Members are counted
+//  as they are packed, and the header of their object or array is written
+//  when its end is found.  Returns the position after the value, or NULL.
+static const char *EMSjsonPack(const char *p, const char *end, EMSbytes *out, int depth) {
+    static const char reserved[EMS_PACKED_RESERVED_HDR] = {0};
+    unsigned char enc[EMS_PACKED_MAX_HDR];
+    p = EMSjsonSkipSpace(p, end);
+    if (p >= end  ||  depth > EMS_JSON_MAX_DEPTH) return NULL;
+    switch (*p) {
+        case '{':
+        case '[': {
+            bool isMap = (*p == '{');
+            char closing = isMap ? '}' : ']';
+            size_t hdrPos = out->len;
+            uint64_t count = 0;
+            EMSbytesPut(out, reserved, sizeof(reserved));
+            p = EMSjsonSkipSpace(p + 1, end);
+            if (p < end  &&  *p == closing) {
+                p++;
+            } else {
+                for (;;) {
+                    if (isMap) {
+                        p = EMSjsonSkipSpace(p, end);
+                        if (p >= end  ||  *p != '"') return NULL;
+                        p = EMSjsonPackString(p + 1, end, out);
+                        if (p == NULL) return NULL;
+                        p = EMSjsonSkipSpace(p, end);
+                        if (p >= end  ||  *p++ != ':') return NULL;
+                    }
+                    p = EMSjsonPack(p, end, out, depth + 1);
+                    if (p == NULL) return NULL;
+                    count++;
+                    p = EMSjsonSkipSpace(p, end);
+                    if (p < end  &&  *p == ',') {
+                        p++;
+                    } else if (p < end  &&  *p == closing) {
+                        p++;
+                        break;
+                    } else {
+                        return NULL;
+                    }
+                }
+            }
+            EMSjsonPackHeader(out, hdrPos, isMap ? EMS_PACKED_MAP : EMS_PACKED_ARRAY, count);
+            return p;
+        }
+        case '"':
+            return EMSjsonPackString(p + 1, end, out);
+        case 't':
+        case 'f':
+        case 'n': {
+            const char *after;
+            if ((after = EMSjsonLiteral(p, end, "true")) != NULL) enc[0] = 0xc3;
+            else if ((after = EMSjsonLiteral(p, end, "false")) != NULL) enc[0] = 0xc2;
+            else if ((after = EMSjsonLiteral(p, end, "null")) != NULL) enc[0] = 0xc0;
+            else return NULL;
+            EMSbytesPut(out, enc, 1);
+            return after;
+        }
+        default: {
+            bool isInt;
+            int64_t intValue;
+            double dblValue;
+            p = EMSjsonParseNumber(p, end, &isInt, &intValue, &dblValue);
+            if (p == NULL) return NULL;
+            EMSbytesPut(out, enc, isInt ? EMSpackInteger(enc, intValue) : EMSpackDouble(enc, dblValue));
+            return p;
+        }
+    }
+}
+
+
+//  Parse the JSON value at p.  The data of strings, and objects and arrays
+//  packed as MessagePack behind the EMS_JSON_PACKED header, are kept in buf.
+//  Null is undefined.  Returns the position after the value, or NULL.
+static const char *EMSjsonParse(const char *p, const char *end, EMSbytes *buf, EMSvalueType *value) {
+    p = EMSjsonSkipSpace(p, end);
+    buf->len = 0;
+    value->length = 0;
+    if (p >= end) return NULL;
+    switch (*p) {
+        case '"':
+            p = EMSjsonUnescape(p + 1, end, buf);
+            EMSbytesTerminate(buf);
+            value->type = EMS_TYPE_STRING;
+            value->value = buf->buf;
+            value->length = buf->len;
+            break;
+        case '{':
+        case '[': {
+            unsigned char hdr[EMS_JSON_PACKED_HDR_SZ] = {EMS_JSON_PACKED};
+            EMSbytesPut(buf, hdr, sizeof(hdr));
+            p = EMSjsonPack(p, end, buf, 0);
+            EMSbytesTerminate(buf);
+            if (p == NULL  ||  buf->failed  ||  buf->len - EMS_JSON_PACKED_HDR_SZ > UINT32_MAX) return NULL;
+            uint32_t len = (uint32_t) (buf->len - EMS_JSON_PACKED_HDR_SZ);
+            memcpy(buf->buf + 1, &len, sizeof(len));
+            value->type = EMS_TYPE_JSON;
+            value->value = buf->buf;
+            value->length = buf->len;
+            break;
+        }
+        case 't':
+        case 'f': {
+            const char *after = EMSjsonLiteral(p, end, "true");
+            value->type = EMS_TYPE_BOOLEAN;
+            value->value = (void *) (after != NULL);
+            p = (after != NULL) ? after : EMSjsonLiteral(p, end, "false");
+            break;
+        }
+        case 'n':
+            value->type = EMS_TYPE_UNDEFINED;
+            value->value = (void *) 0xdeadbeef;
+            p = EMSjsonLiteral(p, end, "null");
+            break;
+        default: {
+            bool isInt;
+            int64_t intValue;
+            EMSulong_double alias;
+            p = EMSjsonParseNumber(p, end, &isInt, &intValue, &alias.d);
+            value->type = isInt ? EMS_TYPE_INTEGER : EMS_TYPE_FLOAT;
+            value->value = isInt ? (void *) intValue : (void *) alias.u64;
+        }
+    }
+    return (buf->failed) ? NULL : p;
+}
+
+
+//  Parse a row of NDJSON, [key,value]
+static bool EMSndjsonRow(const char *p, const char *end, EMSbytes *bufs, EMSvalueType *key, EMSvalueType *value) {
+    p = EMSjsonSkipSpace(p, end);
+    if (p >= end  ||  *p != '[') return false;
+    p = EMSjsonParse(p + 1, end, &bufs[0], key);
+    p = (p == NULL) ? NULL : EMSjsonSkipSpace(p, end);
+    if (p == NULL  ||  p >= end  ||  *p != ',') return false;
+    p = EMSjsonParse(p + 1, end, &bufs[2], value);
+    p = (p == NULL) ? NULL : EMSjsonSkipSpace(p, end);
+    if (p == NULL  ||  p >= end  ||  *p != ']') return false;
+    return EMSjsonSkipSpace(p + 1, end) == end;
+}
+
+
+//  Parse a field of a CSV row into buf.  Quoted fields are strings, unquoted
+//  fields are numbers, booleans, or strings if they are neither, and empty
+//  fields are undefined.
+//  Returns the position of the delimiter after the field, or NULL.
+static const char *EMScsvField(const char *p, const char *end, EMSbytes *buf, EMSvalueType *value) {
+    buf->len = 0;
+    value->length = 0;
+    if (p < end  &&  *p == '"') {
+        for (p++;  ;  p += 2) {
+            const char *quote = (const char *) memchr(p, '"', (size_t) (end - p));
+            if (quote == NULL) return NULL;
+            EMSbytesPut(buf, p, (size_t) (quote - p) + 1);
+            p = quote;
+            if (p + 1 >= end  ||  p[1] != '"') break;    // "" is a quote within the string
+        }
+        if (buf->failed) return NULL;
+        buf->len--;
+        EMSbytesTerminate(buf);
+        p++;
+    } else {
+        const char *fieldEnd = p;
+        while (fieldEnd < end  &&  *fieldEnd != ','  &&  *fieldEnd != '\n'  &&  *fieldEnd != '\r') fieldEnd++;
+        if (fieldEnd == p) {
+            value->type = EMS_TYPE_UNDEFINED;
+            value->value = (void *) 0xdeadbeef;
+            return fieldEnd;
+        }
+        const char *parsedEnd = EMSjsonParse(p, fieldEnd, buf, value);
+        if (parsedEnd == fieldEnd  &&  value->type != EMS_TYPE_STRING  &&  value->type != EMS_TYPE_JSON) {
+            return fieldEnd;
+        }
+        buf->len = 0;
+        EMSbytesPut(buf, p, (size_t) (fieldEnd - p));
+        EMSbytesTerminate(buf);
+        p = fieldEnd;
+    }
+    if (buf->failed) return NULL;
+    value->type = EMS_TYPE_STRING;
+    value->value = buf->buf;
+    value->length = buf->len;
+    return p;
+}
+
+
+//  Parse a format column, which is empty or json.  Returns the position of
+//  the delimiter after it, or NULL.
+static const char *EMScsvFormat(const char *p, const char *end, bool *isJSON) {
+    const char *fieldEnd = p;
+    while (fieldEnd < end  &&  *fieldEnd != ','  &&  *fieldEnd != '\n'  &&  *fieldEnd != '\r') fieldEnd++;
+    *isJSON = (fieldEnd - p == 4  &&  memcmp(p, "json", 4) == 0);
+    return (*isJSON  ||  fieldEnd == p) ? fieldEnd : NULL;
+}
+
+
+//  Replace a field whose format is json by the value of its JSON text
+static bool EMScsvJSON(EMSbytes *jsonBuf, EMSvalueType *value) {
+    if (value->type != EMS_TYPE_STRING) return true;    // Unquoted numbers and booleans
+    const char *text = (const char *) value->value;
+    const char *textEnd = text + value->length;
+    const char *jsonEnd = EMSjsonParse(text, textEnd, jsonBuf, value);
+    return jsonEnd != NULL  &&  EMSjsonSkipSpace(jsonEnd, textEnd) == textEnd;
+}
+
+
+//  Parse a row of CSV, key,value and optionally keyFormat,valueFormat.
+//  Quoted fields may span lines.  Returns the start of the next row, or NULL.
+static const char *EMScsvRow(const char *p, const char *end, EMSbytes *bufs, EMSvalueType *key, EMSvalueType *value) {
+    bool isJSON[2] = {false, false};
+    p = EMScsvField(p, end, &bufs[0], key);
+    if (p == NULL  ||  p >= end  ||  *p != ',') return NULL;
+    p = EMScsvField(p + 1, end, &bufs[2], value);
+    if (p != NULL  &&  p < end  &&  *p == ',') {
+        p = EMScsvFormat(p + 1, end, &isJSON[0]);
+        if (p == NULL  ||  p >= end  ||  *p != ',') return NULL;
+        p = EMScsvFormat(p + 1, end, &isJSON[1]);
+    }
+    if (p == NULL) return NULL;
+    if (p < end  &&  *p == '\r') p++;
+    if (p < end  &&  *p++ != '\n') return NULL;
+    if ((isJSON[0]  &&  !EMScsvJSON(&bufs[1], key))  ||  (isJSON[1]  &&  !EMScsvJSON(&bufs[3], value))) return NULL;
+    return p;
+}
+
+
+//==================================================================
+//  Columns of a block of an export, built in memory and written when it is full
+//
+typedef struct {
+    EMSbytes types;
+    EMSbytes words;
+    EMSbytes offsets;
+    EMSbytes data;
+} EMScolumn;
+
+static void EMScolumnAdd(EMScolumn *column, const EMSvalueType *value) {
+    unsigned char type = value->type;
+    int64_t word = 0;
+    switch (type) {
+        case EMS_TYPE_STRING:
+        case EMS_TYPE_BLOB:
+            EMSbytesPut(&column->data, value->value, value->length);
+            break;
+        case EMS_TYPE_JSON:
+            EMSbytesPut(&column->data, value->value,
+                        EMSvalueBytes(type, value->value) - !EMSisPackedJSON(type, value->value));
+            break;
+        default:
+            word = (int64_t) value->value;
+    }
+    int64_t offset = (int64_t) column->data.len;
+    EMSbytesPut(&column->types, &type, sizeof(type));
+    EMSbytesPut(&column->words, &word, sizeof(word));
+    EMSbytesPut(&column->offsets, &offset, sizeof(offset));
+}
+
+static void EMScolumnWrite(EMSbytes *out, EMScolumn *column) {
+    static const char padding[8] = {0};
+    EMSbytesPut(out, column->types.buf, column->types.len);
+    EMSbytesPut(out, padding, EMSalign8(column->types.len) - column->types.len);
+    EMSbytesPut(out, column->words.buf, column->words.len);
+    EMSbytesPut(out, column->offsets.buf, column->offsets.len);
+    EMSbytesPut(out, column->data.buf, column->data.len);
+    EMSbytesPut(out, padding, EMSalign8(column->data.len) - column->data.len);
+}
+
+//  Empty the columns for the rows of the next block
+static void EMScolumnsReset(EMScolumn *columns) {
+    int64_t firstOffset = 0;
+    for (int colN = 0;  colN < 2;  colN++) {
+        columns[colN].types.len = columns[colN].words.len = columns[colN].offsets.len = columns[colN].data.len = 0;
+        EMSbytesPut(&columns[colN].offsets, &firstOffset, sizeof(firstOffset));
+    }
+}
+
+//  Write a block of nRows rows of columns and empty them.  Returns false if
+//  building the columns failed.
+static bool EMScolumnsWriteBlock(EMSbytes *out, EMScolumn *columns, int64_t nRows) {
+    EMScolumnsHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, EMS_COLUMNS_MAGIC, sizeof(header.magic));
+    header.nRows = nRows;
+    for (int colN = 0;  colN < 2;  colN++) {
+        EMScolumn *column = &columns[colN];
+        header.dataLen[colN] = (int64_t) column->data.len;
+        if (column->types.failed  ||  column->words.failed  ||  column->offsets.failed  ||  column->data.failed) {
+            return false;
+        }
+    }
+    EMSbytesPut(out, &header, sizeof(header));
+    EMScolumnWrite(out, &columns[0]);
+    EMScolumnWrite(out, &columns[1]);
+    EMScolumnsReset(columns);
+    return true;
+}
+
+
+//==================================================================
+//  Export the defined elements from index start up to end to a file,
+//  replacing it.  Elements are read as by EMSread, so the range should not
+//  be written while it is exported.  The elements of an array can be
+//  exported in parallel by processes writing different ranges to
+//  different files.
+//  Returns the number of rows written, or -1 on error.
+//
+int64_t EMSexport(int mmapID, const char *filename, int format, int64_t start, int64_t end) {
+    const EMSregion *region = &emsRegions[mmapID];
+    if (format != EMS_FORMAT_NDJSON  &&  format != EMS_FORMAT_CSV  &&  format != EMS_FORMAT_COLUMNS) {
+        fprintf(stderr, "EMSexport: Unknown format %d\n", format);
+        return -1;
+    }
+    if (start < 0) start = 0;
+    if (end > region->nElements) end = region->nElements;
+
+    int fd = open(filename, O_CREAT | O_TRUNC | O_WRONLY, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd < 0) {
+        fprintf(stderr, "EMSexport: Unable to create %s: %s\n", filename, strerror(errno));
+        return -1;
+    }
+    EMSbytes out = EMS_BYTES_INITIALIZER(fd);
+    EMSbytes keyCopy = EMS_BYTES_INITIALIZER(-1);
+    EMSbytes scratch = EMS_BYTES_INITIALIZER(-1);
+    EMScolumn columns[2];
+    memset(columns, 0, sizeof(columns));
+    for (int colN = 0;  colN < 2;  colN++) {
+        columns[colN].types.fd = columns[colN].words.fd = columns[colN].offsets.fd = columns[colN].data.fd = -1;
+    }
+    EMScolumnsReset(columns);
+    int64_t blockRows = 0;
+    EMSbytesReserve(&out, EMS_BULK_BUF_SZ);
+    if (format == EMS_FORMAT_CSV) EMSbytesPut(&out, "key,value,keyFormat,valueFormat\n", 32);
+
+    int64_t nRows = 0;
+    bool failed = false;
+    for (int64_t idx = start;  idx < end  &&  !failed;  idx++) {
+        EMSvalueType key = EMS_VALUE_TYPE_INITIALIZER;
+        EMSvalueType value = EMS_VALUE_TYPE_INITIALIZER;
+        if (region->isMapped) {
+            if (!EMSindex2key(mmapID, idx, &key)) {
+                failed = true;
+                break;
+            }
+            if (key.type == EMS_TYPE_UNDEFINED) continue;
+            if (EMSisHeapType(key.type)) {
+                //  Reading the value may reuse the buffer an inline key was returned in
+                keyCopy.len = 0;
+                EMSbytesPut(&keyCopy, key.value, key.length);
+                EMSbytesTerminate(&keyCopy);
+                key.value = keyCopy.buf;
+            }
+        } else {
+            key.type = EMS_TYPE_INTEGER;
+            key.value = (void *) idx;
+        }
+        if (!EMSread(mmapID, &key, &value)) {
+            failed = true;
+            break;
+        }
+        if (value.type == EMS_TYPE_UNDEFINED) continue;
+        if (format != EMS_FORMAT_COLUMNS  &&  (key.type == EMS_TYPE_BLOB  ||  value.type == EMS_TYPE_BLOB)) {
+            fprintf(stderr, "EMSexport: Blobs can only be exported to the columns format\n");
+            failed = true;
+            break;
+        }
+        switch (format) {
+            case EMS_FORMAT_NDJSON:
+                EMSbytesPutc(&out, '[');
+                failed = !EMSjsonPutValue(&out, &key);
+                EMSbytesPutc(&out, ',');
+                failed = failed  ||  !EMSjsonPutValue(&out, &value);
+                EMSbytesPut(&out, "]\n", 2);
+                break;
+            case EMS_FORMAT_CSV:
+                failed = !EMScsvPutRow(&out, &key, &value, &scratch);
+                break;
+            default:
+                EMScolumnAdd(&columns[0], &key);
+                EMScolumnAdd(&columns[1], &value);
+                if (++blockRows == EMS_COLUMNS_BLOCK  ||
+                    columns[0].data.len + columns[1].data.len >= EMS_BULK_BUF_SZ) {
+                    failed = !EMScolumnsWriteBlock(&out, columns, blockRows);
+                    blockRows = 0;
+                }
+        }
+        if (failed) fprintf(stderr, "EMSexport: Unable to convert the element at index %" PRId64 "\n", idx);
+        nRows++;
+    }
+
+    if (format == EMS_FORMAT_COLUMNS  &&  !failed  &&  (blockRows > 0  ||  nRows == 0)) {
+        failed = !EMScolumnsWriteBlock(&out, columns, blockRows);
+    }
+    EMSbytesFlush(&out);
+    failed = failed  ||  out.failed  ||  keyCopy.failed;
+    if (close(fd) != 0) {
+        perror("EMSexport: Unable to close the file");
+        failed = true;
+    }
+
+    free(out.buf);
+    free(keyCopy.buf);
+    free(scratch.buf);
+    for (int colN = 0;  colN < 2;  colN++) {
+        free(columns[colN].types.buf);
+        free(columns[colN].words.buf);
+        free(columns[colN].offsets.buf);
+        free(columns[colN].data.buf);
+    }
+    return failed ? -1 : nRows;
+}
+
+
+//==================================================================
+//  Import
+//
+//  Rows are imported in batches written by EMSwriteMany.  The strings,
+//  blobs and JSON of a batch's rows are copied into its data, and the
+//  offsets of the copies replace their pointers until the batch is written.
+#define EMS_IMPORT_BATCH 4096
+
+typedef struct {
+    EMSvalueType keys[EMS_IMPORT_BATCH];
+    EMSvalueType values[EMS_IMPORT_BATCH];
+    int64_t firstPosition;   // Of the batch's first row in the file
+    int nRows;
+    EMSbytes data;
+} EMSimportBatch;
+
+
+static void EMSimportCopy(EMSimportBatch *batch, EMSvalueType *copy, const EMSvalueType *value) {
+    *copy = *value;
+    if (EMSisHeapType(value->type)) {
+        size_t len = (value->type == EMS_TYPE_JSON) ? EMSvalueBytes(value->type, value->value) : value->length + 1;
+        copy->value = (void *) (intptr_t) batch->data.len;
+        EMSbytesPut(&batch->data, value->value, len);
+        while (batch->data.len % 8 != 0) EMSbytesPutc(&batch->data, '\0');
+    }
+}
+
+
+//  Write the rows of a batch, reporting where they came from if it fails
+static bool EMSimportFlush(int mmapID, const char *filename, EMSimportBatch *batch) {
+    if (batch->nRows == 0) return true;
+    bool failed = batch->data.failed;
+    for (int rowN = 0;  rowN < batch->nRows  &&  !failed;  rowN++) {
+        EMSvalueType *rowValues[2] = {&batch->keys[rowN], &batch->values[rowN]};
+        for (int colN = 0;  colN < 2;  colN++) {
+            if (EMSisHeapType(rowValues[colN]->type)) {
+                rowValues[colN]->value = batch->data.buf + (intptr_t) rowValues[colN]->value;
+            }
+        }
+    }
+    if (failed  ||  EMSwriteMany(mmapID, batch->nRows, batch->keys, batch->values) < 0) {
+        fprintf(stderr, "EMSimport: Unable to write the rows from %" PRId64 " of %s\n",
+                batch->firstPosition, filename);
+        return false;
+    }
+    batch->nRows = 0;
+    batch->data.len = 0;
+    return true;
+}
+
+
+//  Add an imported row to the batch, writing the batch when it is full
+static bool EMSimportRow(int mmapID, const char *filename, EMSimportBatch *batch, int64_t position,
+                         EMSvalueType *key, EMSvalueType *value) {
+    if (batch->nRows == 0) batch->firstPosition = position;
+    EMSimportCopy(batch, &batch->keys[batch->nRows], key);
+    EMSimportCopy(batch, &batch->values[batch->nRows], value);
+    batch->nRows++;
+    return batch->nRows < EMS_IMPORT_BATCH  ||  EMSimportFlush(mmapID, filename, batch);
+}
+
+
+//  Import the rows of a text file that start within part of its bytes
+static int64_t EMSimportText(int mmapID, const char *filename, int format, const char *file, size_t fileLen,
+                             int part, int nParts, EMSimportBatch *batch) {
+    size_t begin = (size_t) ((uint64_t) fileLen * part / nParts);
+    size_t end = (size_t) ((uint64_t) fileLen * (part + 1) / nParts);
+    while (begin > 0  &&  begin < fileLen  &&  file[begin - 1] != '\n') begin++;
+    const char *p = file + begin;
+    const char *fileEnd = file + fileLen;
+    if (begin == 0  &&  format == EMS_FORMAT_CSV) {
+        //  Skip the header
+        p = (const char *) memchr(file, '\n', fileLen);
+        p = (p == NULL) ? fileEnd : p + 1;
+    }
+
+    EMSbytes bufs[4] = {EMS_BYTES_INITIALIZER(-1), EMS_BYTES_INITIALIZER(-1),
+                        EMS_BYTES_INITIALIZER(-1), EMS_BYTES_INITIALIZER(-1)};
+    int64_t nRows = 0;
+    while (p < file + end) {
+        EMSvalueType key, value;
+        const char *next;
+        if (*p == '\n'  ||  *p == '\r') {    // Blank line
+            p++;
+            continue;
+        }
+        if (format == EMS_FORMAT_NDJSON) {
+            const char *eol = (const char *) memchr(p, '\n', (size_t) (fileEnd - p));
+            next = (eol == NULL) ? fileEnd : eol + 1;
+            if (!EMSndjsonRow(p, (eol == NULL) ? fileEnd : eol, bufs, &key, &value)) next = NULL;
+        } else {
+            next = EMScsvRow(p, fileEnd, bufs, &key, &value);
+        }
+        if (next == NULL) {
+            fprintf(stderr, "EMSimport: Unable to parse the row at byte %zu of %s\n", (size_t) (p - file), filename);
+            nRows = -1;
+            break;
+        }
+        if (!EMSimportRow(mmapID, filename, batch, p - file, &key, &value)) {
+            nRows = -1;
+            break;
+        }
+        nRows++;
+        p = next;
+    }
+    for (int bufN = 0;  bufN < 4;  bufN++) free(bufs[bufN].buf);
+    return nRows;
+}
+
+
+//  A value of a column.  Strings, blobs and JSON are copied into buf so
+//  they are NULL terminated, and JSON stored as text is packed.
+static bool EMScolumnValue(unsigned char type, int64_t word, const char *data, size_t len,
+                           EMSbytes *buf, EMSvalueType *value) {
+    value->type = type;
+    value->value = (void *) word;
+    value->length = 0;
+    switch (type) {
+        case EMS_TYPE_BOOLEAN:
+        case EMS_TYPE_INTEGER:
+        case EMS_TYPE_FLOAT:
+        case EMS_TYPE_UNDEFINED:
+            return true;
+        case EMS_TYPE_JSON:
+            if (len == 0  ||  (unsigned char) data[0] != EMS_JSON_PACKED) {
+                return EMSjsonParse(data, data + len, buf, value) != NULL;
+            }
+            if (len < EMS_JSON_PACKED_HDR_SZ  ||  EMSvalueBytes(type, data) != len) return false;
+            // Fall through
+        case EMS_TYPE_STRING:
+        case EMS_TYPE_BLOB:
+            buf->len = 0;
+            EMSbytesPut(buf, data, len);
+            EMSbytesTerminate(buf);
+            value->value = buf->buf;
+            value->length = len;
+            return !buf->failed;
+        default:
+            return false;
+    }
+}
+
+
+//  Find the columns of the block at byte pos of a column file.
+//  Returns the position of the next block, or 0 if the block is incomplete.
+static size_t EMScolumnsFind(const char *file, size_t fileLen, size_t pos, EMScolumnsBlock *block) {
+    EMScolumnsHeader header;
+    if (fileLen - pos < sizeof(header)) return 0;
+    memcpy(&header, file + pos, sizeof(header));
+    if (memcmp(header.magic, EMS_COLUMNS_MAGIC, sizeof(header.magic)) != 0  ||
+        header.nRows < 0  ||  (uint64_t) header.nRows > fileLen) {
+        return 0;
+    }
+    pos += sizeof(header);
+    block->nRows = header.nRows;
+    for (int colN = 0;  colN < 2;  colN++) {
+        if (header.dataLen[colN] < 0  ||  (uint64_t) header.dataLen[colN] > fileLen) return 0;
+        block->dataLen[colN] = header.dataLen[colN];
+        block->types[colN] = (const unsigned char *) (file + pos);
+        pos += EMSalign8((size_t) header.nRows);
+        block->words[colN] = (const int64_t *) (file + pos);
+        pos += (size_t) header.nRows * sizeof(int64_t);
+        block->offsets[colN] = (const int64_t *) (file + pos);
+        pos += (size_t) (header.nRows + 1) * sizeof(int64_t);
+        block->data[colN] = file + pos;
+        pos += EMSalign8((size_t) header.dataLen[colN]);
+        if (pos > fileLen) return 0;
+    }
+    return pos;
+}
+
+
+//  Import part of the rows of a column file, counted across its blocks
+static int64_t EMSimportColumns(int mmapID, const char *filename, const char *file, size_t fileLen,
+                                int part, int nParts, EMSimportBatch *batch) {
+    EMScolumnsBlock block;
+    int64_t fileRows = 0;
+    for (size_t pos = 0;  pos < fileLen;  ) {
+        pos = EMScolumnsFind(file, fileLen, pos, &block);
+        if (pos == 0) {
+            fprintf(stderr, "EMSimport: %s is not a complete file of EMS columns\n", filename);
+            return -1;
+        }
+        fileRows += block.nRows;
+    }
+
+    EMSbytes bufs[2] = {EMS_BYTES_INITIALIZER(-1), EMS_BYTES_INITIALIZER(-1)};
+    EMSvalueType values[2];
+    int64_t firstRow = fileRows * part / nParts;
+    int64_t lastRow = fileRows * (part + 1) / nParts;
+    int64_t blockFirstRow = 0;
+    int64_t nRows = 0;
+    for (size_t pos = 0;  pos < fileLen  &&  blockFirstRow < lastRow  &&  nRows >= 0;  blockFirstRow += block.nRows) {
+        pos = EMScolumnsFind(file, fileLen, pos, &block);
+        int64_t rowN = (firstRow > blockFirstRow) ? firstRow - blockFirstRow : 0;
+        int64_t blockEnd = (lastRow - blockFirstRow < block.nRows) ? lastRow - blockFirstRow : block.nRows;
+        for (;  rowN < blockEnd;  rowN++) {
+            for (int colN = 0;  colN < 2  &&  nRows >= 0;  colN++) {
+                int64_t offset = block.offsets[colN][rowN];
+                int64_t offsetEnd = block.offsets[colN][rowN + 1];
+                if (offset < 0  ||  offset > offsetEnd  ||  offsetEnd > block.dataLen[colN]  ||
+                    !EMScolumnValue(block.types[colN][rowN], block.words[colN][rowN], block.data[colN] + offset,
+                                    (size_t) (offsetEnd - offset), &bufs[colN], &values[colN])) {
+                    fprintf(stderr, "EMSimport: Row %" PRId64 " of %s is corrupt\n", blockFirstRow + rowN, filename);
+                    nRows = -1;
+                }
+            }
+            if (nRows < 0  ||
+                !EMSimportRow(mmapID, filename, batch, blockFirstRow + rowN, &values[0], &values[1])) {
+                nRows = -1;
+                break;
+            }
+            nRows++;
+        }
+    }
+    free(bufs[0].buf);
+    free(bufs[1].buf);
+    return nRows;
+}
+
+
+//==================================================================
+//  Import part of the rows of a file written by EMSexport, or by other
+//  programs in the same format.  Processes importing one file in parallel
+//  each import a different part of the nParts it is split into.
+//  Returns the number of rows imported, or -1 on error.
+//
+int64_t EMSimport(int mmapID, const char *filename, int format, int part, int nParts) {
+    if (format != EMS_FORMAT_NDJSON  &&  format != EMS_FORMAT_CSV  &&  format != EMS_FORMAT_COLUMNS) {
+        fprintf(stderr, "EMSimport: Unknown format %d\n", format);
+        return -1;
+    }
+    if (nParts < 1  ||  part < 0  ||  part >= nParts) {
+        fprintf(stderr, "EMSimport: Part %d is not one of %d parts\n", part, nParts);
+        return -1;
+    }
+    int fd = open(filename, O_RDONLY);
+    struct stat statbuf;
+    if (fd < 0  ||  fstat(fd, &statbuf) != 0) {
+        fprintf(stderr, "EMSimport: Unable to open %s: %s\n", filename, strerror(errno));
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    size_t fileLen = (size_t) statbuf.st_size;
+    if (fileLen == 0) {
+        close(fd);
+        return 0;
+    }
+    char *file = (char *) mmap(NULL, fileLen, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED) {
+        fprintf(stderr, "EMSimport: Unable to map %s: %s\n", filename, strerror(errno));
+        return -1;
+    }
+    madvise(file, fileLen, MADV_SEQUENTIAL);
+
+    EMSimportBatch *batch = (EMSimportBatch *) malloc(sizeof(EMSimportBatch));
+    if (batch == NULL) {
+        fprintf(stderr, "EMSimport: Unable to allocate a batch of rows\n");
+        munmap(file, fileLen);
+        return -1;
+    }
+    batch->nRows = 0;
+    batch->data = EMS_BYTES_INITIALIZER(-1);
+    int64_t nRows;
+    if (format == EMS_FORMAT_COLUMNS) {
+        nRows = EMSimportColumns(mmapID, filename, file, fileLen, part, nParts, batch);
+    } else {
+        nRows = EMSimportText(mmapID, filename, format, file, fileLen, part, nParts, batch);
+    }
+    if (nRows >= 0  &&  !EMSimportFlush(mmapID, filename, batch)) nRows = -1;
+    munmap(file, fileLen);
+    free(batch->data.buf);
+    free(batch);
+    return nRows;
+}
+
+
+//==================================================================
+//  Parallel Iteration Over Keys
+//
+//  The occupied slots of a map are found from its tags without reading the
+//  slots: the map tags of seven slots share a tag word, so each word is
+//  loaded once and the type fields of all seven are compared to undefined
+//  together, leaving the high bit of each occupied slot's byte set.
+//  A type is three bits, so adding 0x7F to a byte cannot carry into the next.
+#define EMS_TAG_TYPES   0x0707070707070707ULL   // Type field of each tag after shifting out the F/E bits
+#define EMS_TAG_HIGHS   0x0080808080808080ULL   // High bit of the seven tag bytes of a word
+#define EMS_TAG_LOWS    0x7F7F7F7F7F7F7F7FULL
+#define EMS_TAG_UNDEFS  (EMS_TAG_TYPES & (0x0101010101010101ULL * EMS_TYPE_UNDEFINED))
+
+static inline uint64_t EMSoccupiedTags(uint64_t tagWord) {
+    uint64_t defined = ((tagWord >> EMS_TYPE_NBITS_FE) & EMS_TAG_TYPES) ^ EMS_TAG_UNDEFS;
+    return (defined + EMS_TAG_LOWS) & EMS_TAG_HIGHS;
+}
+
+//  Keys and values returned by the last scan, valid until the next one
+static EMSbytes EMSscanData = EMS_BYTES_INITIALIZER(-1);
+
+//  Copy a string, blob, or JSON key or value to the scan data, leaving its offset in place of the pointer
+static void EMSscanCopy(EMSvalueType *value) {
+    if (!EMSisHeapType(value->type)) return;
+    size_t offset = EMSscanData.len;
+    EMSbytesPut(&EMSscanData, value->value, value->length);
+    EMSbytesPutc(&EMSscanData, '\0');
+    value->value = (void *) offset;
+}
+
+
+//==================================================================
+//  Return up to maxItems keys of a mapped array, and their values, from
+//  the map indexes start up to end.  Empty slots are skipped without
+//  locking them, each occupied slot's key is read under its map tag and
+//  its value as by EMSread.  *next is set to the index to continue the
+//  scan from, end once the range has been scanned.  Processes scanning
+//  different ranges together enumerate the keys in parallel.
+//  Returns the number of items, or -1 on error.
+//
+int64_t EMSscanKeys(int mmapID, int64_t start, int64_t end, int64_t maxItems,
+                    EMSvalueType *keys, EMSvalueType *values, int64_t *next) {
+    const EMSregion *region = &emsRegions[mmapID];
+    void *emsBuf = region->buf;
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    const char *bufChar = (const char *) emsBuf;
+    volatile EMStag_t *bufTags = (EMStag_t *) emsBuf;
+
+    if (!EMSisMapped) {
+        fprintf(stderr, "EMSscanKeys: Array is not mapped\n");
+        return -1;
+    }
+    if (maxItems < 1) {
+        fprintf(stderr, "EMSscanKeys: At least one item must be returned\n");
+        return -1;
+    }
+    if (start < 0) start = 0;
+    if (end > region->nElements) end = region->nElements;
+
+    //  Slots are scanned by their index in the tagged memory, the map follows the data
+    const int64_t mapBase = EMS_ARR_CB_SIZE + region->nElements;
+    int64_t slot = mapBase + start;
+    int64_t slotEnd = mapBase + end;
+    int64_t nItems = 0;
+    EMSscanData.len = 0;
+    EMSscanData.failed = false;
+    while (slot < slotEnd  &&  nItems < maxItems) {
+        int64_t lineFirst = slot - slot % EMSnWordsPerTagWord;
+        uint64_t tagWord = *((volatile uint64_t *) &bufChar[EMSappIdx2TagWordOffset(slot)]);
+        uint64_t occupied = EMSoccupiedTags(tagWord) & (~0ULL << (8 * (slot - lineFirst)));
+        if (slotEnd - lineFirst < (int64_t) EMSnWordsPerTagWord) occupied &= (1ULL << (8 * (slotEnd - lineFirst))) - 1;
+        int64_t lastSlot = lineFirst;
+        while (occupied != 0  &&  nItems < maxItems) {
+            lastSlot = lineFirst + __builtin_ctzll(occupied) / 8;
+            occupied &= occupied - 1;
+            int64_t idx = lastSlot - mapBase;
+
+            //  Read the key under the map tag so it is not replaced while it is copied
+            EMSvalueType *key = &keys[nItems];
+            char inlineKey[EMS_INLINE_MAX + 1];
+            EMStag_t mapTag;
+            mapTag.byte = EMStransitionFEtag(&bufTags[EMSmapTag(idx)], NULL, EMS_TAG_FULL, EMS_TAG_BUSY, EMS_TAG_ANY);
+            key->type = mapTag.tags.type;
+            key->length = 0;
+            int64_t keyWord = bufInt64[EMSmapData(idx)];
+            switch (key->type) {
+                case EMS_TYPE_BOOLEAN:
+                case EMS_TYPE_INTEGER:
+                case EMS_TYPE_FLOAT:
+                    key->value = (void *) keyWord;
+                    break;
+                case EMS_TYPE_JSON:
+                case EMS_TYPE_STRING:
+                    key->value = (void *) EMSwordData(key->type, keyWord, inlineKey, &key->length);
+                    EMSscanCopy(key);
+                    break;
+                default:
+                    break;
+            }
+            bufTags[EMSmapTag(idx)].tags.fe = EMS_TAG_FULL;
+            if (key->type == EMS_TYPE_UNDEFINED) continue;   // Removed since the tags were scanned
+            if (key->type == EMS_TYPE_INVALID) {
+                fprintf(stderr, "EMSscanKeys: Unknown key type at index %" PRId64 "\n", idx);
+                return -1;
+            }
+
+            values[nItems].length = 0;
+            if (!EMSreadIndex(region, idx, &values[nItems])) return -1;
+            EMSscanCopy(&values[nItems]);
+            nItems++;
+        }
+        //  Continue after the last slot read if the batch filled before the line was done
+        slot = (occupied != 0) ? lastSlot + 1 : lineFirst + EMSnWordsPerTagWord;
+    }
+    if (slot > slotEnd) slot = slotEnd;
+    *next = slot - mapBase;
+
+    if (EMSscanData.failed) {
+        fprintf(stderr, "EMSscanKeys: Unable to allocate space for the keys and values\n");
+        return -1;
+    }
+    //  The data is in place now that it will not move, point the keys and values at it
+    for (int64_t itemN = 0;  itemN < nItems;  itemN++) {
+        if (EMSisHeapType(keys[itemN].type)) {
+            keys[itemN].value = EMSscanData.buf + (size_t) keys[itemN].value;
+        }
+        if (EMSisHeapType(values[itemN].type)) {
+            values[itemN].value = EMSscanData.buf + (size_t) values[itemN].value;
+        }
+    }
+    return nItems;
+}
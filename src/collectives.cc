@@ -58,14 +58,25 @@ bool EMSsingleTask(int mmapID) {
 //
 int EMScriticalEnter(int mmapID, int timeout) {
     RESET_NAP_TIME;
+    int nLongNaps = 0;
     void *emsBuf = emsBufs[mmapID];
-    int32_t *bufInt32 = (int32_t *) emsBuf;
+    volatile int32_t *bufInt32 = (int32_t *) emsBuf;
+    int32_t held = EMS_CRITICAL_HELD(EMSpid());
 
-    // Acquire the mutual exclusion lock
-    while (!__sync_bool_compare_and_swap(&(bufInt32[EMS_CB_CRITICAL]), EMS_TAG_FULL, EMS_TAG_EMPTY)
+    // Acquire the mutual exclusion lock, recording this process as its holder
+    while (!__sync_bool_compare_and_swap(&(bufInt32[EMS_CB_CRITICAL]), EMS_TAG_FULL, held)
         && timeout > 0 ) {
         NANOSLEEP;
         timeout -= 1;
+        if (EMS_STUCK_CHECK(nLongNaps)) {
+            int32_t holder = bufInt32[EMS_CB_CRITICAL];
+            if (holder != EMS_TAG_FULL  &&  EMSprocessDead(EMSlockHolder(holder))  &&
+                __sync_bool_compare_and_swap(&(bufInt32[EMS_CB_CRITICAL]), holder, held)) {
+                fprintf(stderr, "EMScriticalEnter: Took over the critical region from process %d, which died in it\n",
+                        EMSlockHolder(holder));
+                break;
+            }
+        }
     }
 
     return timeout;
@@ -76,10 +87,10 @@ int EMScriticalEnter(int mmapID, int timeout) {
 //  Critical Region Exit
 bool EMScriticalExit(int mmapID) {
     void *emsBuf = emsBufs[mmapID];
-    int32_t *bufInt32 = (int32_t *) emsBuf;
+    volatile int32_t *bufInt32 = (int32_t *) emsBuf;
 
     // Test the mutual exclusion lock wasn't somehow lost
-    if (bufInt32[EMS_CB_CRITICAL] != EMS_TAG_EMPTY) {
+    if (bufInt32[EMS_CB_CRITICAL] != EMS_CRITICAL_HELD(EMSpid())) {
         return false;
     }
 
@@ -117,3 +128,378 @@ int EMSbarrier(int mmapID, int timeout) {
 
     return timeout;
 }
+
+
+//==================================================================
+//  Find or create a named lock on the heap of an EMS region.
+//  Every process naming the same lock receives the same lock ID,
+//  the heap offset of the cache line holding the lock.
+//  Returns -1 if the lock could not be created
+//
+int64_t EMSnewLock(int mmapID, const char *name, int lockType, int32_t count) {
+    void *emsBuf = emsBufs[mmapID];
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    volatile EMStag_t *bufTags = (EMStag_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    volatile char *memMutex = (char *) &bufInt64[EMScbData(EMS_ARR_MEM_MUTEX)];
+    int32_t nameLen = (int32_t) strlen(name);
+
+    if (lockType != EMS_LOCK_MUTEX  &&  lockType != EMS_LOCK_RW  &&  lockType != EMS_LOCK_SEMAPHORE) {
+        fprintf(stderr, "EMSnewLock: Unknown lock type (%d)\n", lockType);
+        return -1;
+    }
+
+    //  Wait until the directory is full, mark it busy while it is searched and extended
+    EMStransitionFEtag(&bufTags[EMScbTag(EMS_ARR_NAMEDIR)], NULL, EMS_TAG_FULL, EMS_TAG_BUSY, EMS_TAG_ANY);
+    int64_t entryOffset = bufInt64[EMScbData(EMS_ARR_NAMEDIR)];
+    while (entryOffset != EMS_HEAP_NULL) {
+        EMSnamedObject *entry = (EMSnamedObject *) EMSheapPtr(entryOffset);
+        if (entry->objType == EMS_OBJ_LOCK  &&  entry->nameLen == nameLen  &&
+            memcmp(EMSnamedObjectName(entry), name, nameLen) == 0) {
+            int64_t lockOffset = entry->object;
+            bufTags[EMScbTag(EMS_ARR_NAMEDIR)].tags.fe = EMS_TAG_FULL;
+            if (((EMSlock *) EMSheapPtr(lockOffset))->lockType != lockType) {
+                fprintf(stderr, "EMSnewLock: Lock \"%s\" already exists with a different type\n", name);
+                return -1;
+            }
+            return lockOffset;
+        }
+        entryOffset = entry->next;
+    }
+
+    //  The lock does not exist yet, allocate a cache line for it and add it to the directory
+    int64_t lockOffset = emsMutexMem_alloc(EMS_MEM_MALLOCBOT(bufChar), EMS_CACHELINE_SZ, memMutex);
+    entryOffset = emsMutexMem_alloc(EMS_MEM_MALLOCBOT(bufChar), sizeof(EMSnamedObject) + nameLen + 1, memMutex);
+    if (lockOffset < 0  ||  entryOffset < 0) {
+        fprintf(stderr, "EMSnewLock: Out of heap memory to create lock \"%s\"\n", name);
+        if (lockOffset >= 0) EMS_FREE(lockOffset);
+        if (entryOffset >= 0) EMS_FREE(entryOffset);
+        bufTags[EMScbTag(EMS_ARR_NAMEDIR)].tags.fe = EMS_TAG_FULL;
+        return -1;
+    }
+
+    EMSlock *lock = (EMSlock *) EMSheapPtr(lockOffset);
+    lock->lockType = lockType;
+    lock->nWriters = 0;
+    if (lockType == EMS_LOCK_SEMAPHORE) lock->state = count;
+    else                                lock->state = 0;
+
+    EMSnamedObject *entry = (EMSnamedObject *) EMSheapPtr(entryOffset);
+    entry->object = lockOffset;
+    entry->objType = EMS_OBJ_LOCK;
+    entry->nameLen = nameLen;
+    memcpy(EMSnamedObjectName(entry), name, nameLen + 1);
+    entry->next = bufInt64[EMScbData(EMS_ARR_NAMEDIR)];
+    bufInt64[EMScbData(EMS_ARR_NAMEDIR)] = entryOffset;
+
+    bufTags[EMScbTag(EMS_ARR_NAMEDIR)].tags.fe = EMS_TAG_FULL;
+    return lockOffset;
+}
+
+
+//==================================================================
+//  Acquire a named lock, shared acquisition is only meaningful
+//  for readers-writer locks.  Semaphores are decremented.
+//  Returns the time remaining, or <= 0 if the lock was not acquired
+//
+int EMSlockAcquire(int mmapID, int64_t lockID, bool shared, int timeout) {
+    RESET_NAP_TIME;
+    void *emsBuf = emsBufs[mmapID];
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    EMSlock *lock = (EMSlock *) EMSheapPtr(lockID);
+    bool queued = false;
+
+    while (timeout > 0) {
+        int32_t state = lock->state;
+        switch (lock->lockType) {
+            case EMS_LOCK_MUTEX:
+                if (state == 0  &&  __sync_bool_compare_and_swap(&lock->state, 0, 1)) return timeout;
+                break;
+            case EMS_LOCK_RW:
+                if (shared) {
+                    //  Readers are held off by an active or waiting writer
+                    if (state >= 0  &&  !(state & EMS_LOCK_WRITER_WAIT)  &&
+                        __sync_bool_compare_and_swap(&lock->state, state, state + 1)) return timeout;
+                } else {
+                    if ((state == 0  ||  state == EMS_LOCK_WRITER_WAIT)  &&
+                        __sync_bool_compare_and_swap(&lock->state, state, EMS_LOCK_WRITER)) {
+                        if (queued) __sync_fetch_and_add(&lock->nWriters, -1);
+                        return timeout;
+                    }
+                    //  Count this writer as waiting and announce it so the readers drain
+                    if (!queued) {
+                        __sync_fetch_and_add(&lock->nWriters, 1);
+                        queued = true;
+                    }
+                    if (state > 0  &&  !(state & EMS_LOCK_WRITER_WAIT)) {
+                        __sync_bool_compare_and_swap(&lock->state, state, state | EMS_LOCK_WRITER_WAIT);
+                    }
+                }
+                break;
+            case EMS_LOCK_SEMAPHORE:
+                if (state > 0  &&  __sync_bool_compare_and_swap(&lock->state, state, state - 1)) return timeout;
+                break;
+            default:
+                fprintf(stderr, "EMSlockAcquire: Lock has unknown type (%d)\n", lock->lockType);
+                return 0;
+        }
+        NANOSLEEP;
+        timeout -= 1;
+    }
+
+    //  A writer giving up lets readers in again, unless other writers are waiting
+    if (queued  &&  __sync_fetch_and_add(&lock->nWriters, -1) == 1) {
+        int32_t state = lock->state;
+        while (state != EMS_LOCK_WRITER  &&  (state & EMS_LOCK_WRITER_WAIT)  &&  lock->nWriters == 0  &&
+               !__sync_bool_compare_and_swap(&lock->state, state, state & ~EMS_LOCK_WRITER_WAIT)) {
+            state = lock->state;
+        }
+    }
+    return timeout;
+}
+
+
+//==================================================================
+//  Release a named lock, or increment a semaphore
+//
+bool EMSlockRelease(int mmapID, int64_t lockID, bool shared) {
+    void *emsBuf = emsBufs[mmapID];
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    EMSlock *lock = (EMSlock *) EMSheapPtr(lockID);
+
+    switch (lock->lockType) {
+        case EMS_LOCK_MUTEX:
+            //  Test the mutual exclusion lock wasn't somehow lost
+            if (lock->state != 1) return false;
+            lock->state = 0;
+            return true;
+        case EMS_LOCK_RW:
+            if (shared) {
+                if ((lock->state & ~EMS_LOCK_WRITER_WAIT) <= 0) return false;
+                __sync_fetch_and_add(&lock->state, -1);
+            } else {
+                if (lock->state != EMS_LOCK_WRITER) return false;
+                //  Writers still waiting keep new readers out
+                lock->state = (lock->nWriters > 0) ? EMS_LOCK_WRITER_WAIT : 0;
+            }
+            return true;
+        case EMS_LOCK_SEMAPHORE:
+            __sync_fetch_and_add(&lock->state, 1);
+            return true;
+        default:
+            fprintf(stderr, "EMSlockRelease: Lock has unknown type (%d)\n", lock->lockType);
+            return false;
+    }
+}
+
+
+//==================================================================
+//  Fork-Join Task Mailboxes
+//
+//  The master process launches work on the other processes by posting
+//  messages to their mailboxes in the EMS control block, long-lived
+//  worker processes wait for messages instead of receiving them
+//  over IPC.  Messages are a length followed by the text, and are
+//  streamed through the ring so they may be longer than the ring.
+//
+static void EMSmailboxCopy(volatile int64_t *mailbox, int64_t position, char *buf, int64_t len, bool toRing) {
+    char *ring = EMSmailboxRing(mailbox);
+    int64_t offset = position % EMS_MAILBOX_SZ;
+    int64_t firstLen = (offset + len > EMS_MAILBOX_SZ) ? EMS_MAILBOX_SZ - offset : len;
+    if (toRing) {
+        memcpy(&ring[offset], buf, (size_t) firstLen);
+        memcpy(ring, &buf[firstLen], (size_t) (len - firstLen));
+    } else {
+        memcpy(buf, &ring[offset], (size_t) firstLen);
+        memcpy(&buf[firstLen], ring, (size_t) (len - firstLen));
+    }
+}
+
+
+//  True if the process with an EMS ID was started or attached and has not exited
+static bool EMStaskAlive(volatile int32_t *bufInt32, int taskN) {
+    int pid = bufInt32[EMS_CB_PIDS + taskN];
+    return pid != 0  &&  !EMSprocessDead(pid);
+}
+
+
+//  Returns false if the receiving process exited before the ring had space for the message
+static bool EMSmailboxWrite(volatile int32_t *bufInt32, int taskN, volatile int64_t *mailbox,
+                            const char *src, int64_t len) {
+    while (len > 0) {
+        RESET_NAP_TIME;
+        int64_t posted = mailbox[EMS_MAILBOX_POSTED];
+        int64_t space = EMS_MAILBOX_SZ - (posted - mailbox[EMS_MAILBOX_RECEIVED]);
+        while (space == 0) {
+            if (EMScurrentNapTime >= MAX_NAP_TIME  &&  !EMStaskAlive(bufInt32, taskN)) return false;
+            NANOSLEEP;
+            space = EMS_MAILBOX_SZ - (posted - mailbox[EMS_MAILBOX_RECEIVED]);
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        int64_t chunk = (len < space) ? len : space;
+        EMSmailboxCopy(mailbox, posted, (char *) src, chunk, true);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        mailbox[EMS_MAILBOX_POSTED] = posted + chunk;
+        src += chunk;
+        len -= chunk;
+    }
+    return true;
+}
+
+
+//  Returns false if the process posting messages exited before the message arrived
+static bool EMSmailboxRead(volatile int64_t *mailbox, char *dest, int64_t len) {
+    while (len > 0) {
+        RESET_NAP_TIME;
+        int64_t received = mailbox[EMS_MAILBOX_RECEIVED];
+        int64_t avail = mailbox[EMS_MAILBOX_POSTED] - received;
+        while (avail == 0) {
+            if (EMScurrentNapTime >= MAX_NAP_TIME  &&
+                kill((pid_t) mailbox[EMS_MAILBOX_PID], 0) != 0  &&  errno == ESRCH) {
+                return false;
+            }
+            NANOSLEEP;
+            avail = mailbox[EMS_MAILBOX_POSTED] - received;
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        int64_t chunk = (len < avail) ? len : avail;
+        EMSmailboxCopy(mailbox, received, dest, chunk, false);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        mailbox[EMS_MAILBOX_RECEIVED] = received + chunk;
+        dest += chunk;
+        len -= chunk;
+    }
+    return true;
+}
+
+
+//==================================================================
+//  Record the PID of a worker process as soon as the master starts it,
+//  before the worker attaches to the domain, so the master can tell a
+//  worker that exited from one that has not yet attached.
+bool EMStaskStarted(int mmapID, int taskN, int pid) {
+    int32_t *bufInt32 = (int32_t *) emsBufs[mmapID];
+    if (taskN < 0  ||  taskN >= bufInt32[EMS_CB_NTHREADS]) {
+        fprintf(stderr, "EMStaskStarted: Process %d is not in the domain\n", taskN);
+        return false;
+    }
+    bufInt32[EMS_CB_PIDS + taskN] = pid;
+    return true;
+}
+
+
+//==================================================================
+//  Post a message to a process's mailbox, only the master process posts.
+//  Returns false if the receiving process exited before the message was posted.
+bool EMStaskPost(int mmapID, int taskN, const char *msg) {
+    char *bufChar = (char *) emsBufs[mmapID];
+    volatile int32_t *bufInt32 = (int32_t *) bufChar;
+    if (taskN < 0  ||  taskN >= bufInt32[EMS_CB_NTHREADS]  ||
+        emsBufLengths[mmapID] < EMS_CB_MAILBOXES(bufInt32[EMS_CB_NTHREADS]) + (taskN + 1) * EMS_MAILBOX_STRIDE) {
+        fprintf(stderr, "EMStaskPost: Process %d does not have a mailbox\n", taskN);
+        return false;
+    }
+    volatile int64_t *mailbox = EMSmailbox(taskN);
+    int64_t len = (int64_t) strlen(msg);
+    mailbox[EMS_MAILBOX_PID] = getpid();
+    if (!EMSmailboxWrite(bufInt32, taskN, mailbox, (const char *) &len, sizeof(int64_t))  ||
+        !EMSmailboxWrite(bufInt32, taskN, mailbox, msg, len)) {
+        fprintf(stderr, "EMStaskPost: Process %d exited\n", taskN);
+        return false;
+    }
+    mailbox[EMS_MAILBOX_NPOSTED]++;
+    return true;
+}
+
+
+//==================================================================
+//  Wait for the next message in this process's mailbox.  The message is
+//  returned as a string in a process-local buffer which remains valid
+//  until the next message is received.  Returns false if the master
+//  process exited.
+static char   *EMStaskMsgBuf = NULL;
+static int64_t EMStaskMsgBufLen = 0;
+
+bool EMStaskReceive(int mmapID, int taskN, EMSvalueType *returnValue) {
+    char *bufChar = (char *) emsBufs[mmapID];
+    int32_t *bufInt32 = (int32_t *) bufChar;
+    if (taskN < 0  ||  taskN >= bufInt32[EMS_CB_NTHREADS]  ||
+        emsBufLengths[mmapID] < EMS_CB_MAILBOXES(bufInt32[EMS_CB_NTHREADS]) + (taskN + 1) * EMS_MAILBOX_STRIDE) {
+        fprintf(stderr, "EMStaskReceive: Process %d does not have a mailbox\n", taskN);
+        return false;
+    }
+    volatile int64_t *mailbox = EMSmailbox(taskN);
+    int64_t len;
+    if (!EMSmailboxRead(mailbox, (char *) &len, sizeof(int64_t))) return false;
+    if (len + 1 > EMStaskMsgBufLen) {
+        char *newBuf = (char *) realloc(EMStaskMsgBuf, (size_t) len + 1);
+        if (newBuf == NULL) {
+            fprintf(stderr, "EMStaskReceive: Unable to allocate space for a message of %" PRIi64 " bytes\n", len);
+            return false;
+        }
+        EMStaskMsgBuf = newBuf;
+        EMStaskMsgBufLen = len + 1;
+    }
+    if (!EMSmailboxRead(mailbox, EMStaskMsgBuf, len)) return false;
+    EMStaskMsgBuf[len] = '\0';
+    returnValue->type = EMS_TYPE_STRING;
+    returnValue->length = len;
+    returnValue->value = EMStaskMsgBuf;
+    return true;
+}
+
+
+//==================================================================
+//  A worker finished the last message it received, failed if the
+//  function it ran raised an error
+bool EMStaskDone(int mmapID, int taskN, bool failed) {
+    char *bufChar = (char *) emsBufs[mmapID];
+    int32_t *bufInt32 = (int32_t *) bufChar;
+    if (taskN < 0  ||  taskN >= bufInt32[EMS_CB_NTHREADS]  ||
+        emsBufLengths[mmapID] < EMS_CB_MAILBOXES(bufInt32[EMS_CB_NTHREADS]) + (taskN + 1) * EMS_MAILBOX_STRIDE) {
+        fprintf(stderr, "EMStaskDone: Process %d does not have a mailbox\n", taskN);
+        return false;
+    }
+    volatile int64_t *mailbox = EMSmailbox(taskN);
+    if (failed) mailbox[EMS_MAILBOX_FAILED] = 1;
+    __sync_fetch_and_add(&mailbox[EMS_MAILBOX_NDONE], 1);
+    return true;
+}
+
+
+//==================================================================
+//  Wait until every other process with a mailbox has finished the messages
+//  posted to it.  Returns -1 if they all succeeded, otherwise the ID of the
+//  first process whose function failed or which exited before finishing.
+int EMStaskJoin(int mmapID) {
+    char *bufChar = (char *) emsBufs[mmapID];
+    volatile int32_t *bufInt32 = (int32_t *) bufChar;
+    int32_t nThreads = bufInt32[EMS_CB_NTHREADS];
+    if (emsBufLengths[mmapID] < EMS_CB_MAILBOXES(nThreads) + nThreads * EMS_MAILBOX_STRIDE) {
+        fprintf(stderr, "EMStaskJoin: The domain does not have mailboxes\n");
+        return 0;
+    }
+    int failedN = -1;
+    for (int taskN = 0; taskN < nThreads; taskN++) {
+        if (taskN == EMSmyID) continue;
+        volatile int64_t *mailbox = EMSmailbox(taskN);
+        bool failed = false;
+        RESET_NAP_TIME;
+        while (mailbox[EMS_MAILBOX_NDONE] < mailbox[EMS_MAILBOX_NPOSTED]) {
+            if (EMScurrentNapTime >= MAX_NAP_TIME  &&  !EMStaskAlive(bufInt32, taskN)) {
+                failed = true;
+                break;
+            }
+            NANOSLEEP;
+        }
+        //  The worker sets the flag before finishing and is idle until the next message
+        if (mailbox[EMS_MAILBOX_FAILED]) {
+            mailbox[EMS_MAILBOX_FAILED] = 0;
+            failed = true;
+        }
+        if (failed  &&  failedN < 0) failedN = taskN;
+    }
+    return failedN;
+}
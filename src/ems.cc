@@ -39,6 +39,269 @@ int EMSmyID = -1;   // EMS Process ID
 char   *emsBufs[EMS_MAX_N_BUFS] = { NULL };
 size_t  emsBufLengths[EMS_MAX_N_BUFS] = { 0 };
 char    emsBufFilenames[EMS_MAX_N_BUFS][MAX_FNAME_LEN] = { { 0 } };
+EMSregion emsRegions[EMS_MAX_N_BUFS] = {};
+static int emsBufsEnd = 0;   // One past the highest mmapID ever used
+
+
+//==================================================================
+//  The region holding an address if it counts waits, otherwise NULL.
+//  Only called once a wait has begun, so the search is not on the path
+//  of uncontended operations.
+static const EMSregion *EMScountingRegion(const volatile void *addr) {
+    for (int mmapID = 0;  mmapID < emsBufsEnd;  mmapID++) {
+        const char *buf = emsRegions[mmapID].buf;
+        if (buf != NULL  &&  (const char *) addr >= buf  &&  (const char *) addr < buf + emsBufLengths[mmapID]) {
+            return emsRegions[mmapID].stats != NULL ? &emsRegions[mmapID] : NULL;
+        }
+    }
+    return NULL;
+}
+
+
+//==================================================================
+//  Record a wait on a tag in the region's ring of samples.  The sequence
+//  word is cleared while the sample is rewritten so a reader racing with
+//  the writer can tell the sample is not yet valid.
+static void EMShotSampleAdd(const EMSregion *region, const volatile void *tag, int64_t waitNs) {
+    char *bufChar = region->buf;
+    volatile int64_t *bufInt64 = (int64_t *) bufChar;
+    volatile int64_t *ring = EMShotRing;
+    int64_t claim = __sync_fetch_and_add(&ring[EMS_HOT_RING_COUNT], 1);
+    volatile int64_t *sample = EMShotSample(ring, claim);
+    size_t offset = (const char *) tag - bufChar;
+    size_t lineOffset = offset - (offset % (EMSnWordsPerLine * EMSwordSize));
+    sample[EMS_HOT_SEQ] = 0;
+    __sync_synchronize();
+    sample[EMS_HOT_TAG] = (lineOffset / (EMSnWordsPerLine * EMSwordSize)) * EMSnWordsPerTagWord +
+                          (offset - lineOffset - EMSnWordsPerTagWord * EMSwordSize);
+    sample[EMS_HOT_NS] = waitNs;
+    sample[EMS_HOT_PROC] = EMSmyID;
+    __sync_synchronize();
+    sample[EMS_HOT_SEQ] = claim + 1;
+}
+
+
+//==================================================================
+//  Time a wait, counting it and its duration in the stat and the one after it,
+//  and sampling the tag waited on if there is one
+static void EMSwaitBegin(const EMSregion *region, struct timespec *start) {
+    if (region != NULL  &&  region->stats != NULL) clock_gettime(CLOCK_MONOTONIC, start);
+}
+
+static void EMSwaitEnd(const EMSregion *region, int stat, const struct timespec *start,
+                       const volatile void *tag) {
+    struct timespec end;
+    if (region == NULL  ||  region->stats == NULL) return;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    int64_t waitNs = (int64_t) (end.tv_sec - start->tv_sec) * 1000000000 + (end.tv_nsec - start->tv_nsec);
+    EMS_STAT_ADD(region, stat, 1);
+    EMS_STAT_ADD(region, stat + 1, waitNs);
+    if (tag != NULL) EMShotSampleAdd(region, tag, waitNs);
+}
+
+
+//==================================================================
+//  Process ID of this process, forgotten by the child of a fork
+static int emsMyPid = 0;
+static void EMSforgetPid(void) { emsMyPid = 0; }
+
+int EMSpid(void) {
+    if (emsMyPid == 0) {
+        static bool forgetOnFork = false;
+        if (!forgetOnFork) {
+            forgetOnFork = true;
+            pthread_atfork(NULL, NULL, EMSforgetPid);
+        }
+        emsMyPid = (int) getpid();
+    }
+    return emsMyPid;
+}
+
+
+//==================================================================
+//  Registry of the processes attached to the domain, in its control block.
+//  A process that exits normally removes itself, one found dead is removed
+//  by the process that found it.
+static volatile int32_t *emsDomainPids = NULL;
+static int32_t emsDomainNThreads = 0;
+
+static void EMSderegister(void) {
+    if (emsDomainPids != NULL  &&  EMSmyID >= 0  &&  EMSmyID < emsDomainNThreads) {
+        __sync_bool_compare_and_swap(&emsDomainPids[EMSmyID], (int32_t) getpid(), 0);
+    }
+}
+
+
+//==================================================================
+//  True if a process has exited or was killed.  A process that was killed
+//  remains a zombie until its parent waits for it, and is dead too.
+static bool EMSprocessExited(int pid) {
+    if (kill((pid_t) pid, 0) != 0) return errno == ESRCH;
+#if defined(__linux)
+    char statName[64];
+    char stat[512];
+    snprintf(statName, sizeof(statName), "/proc/%d/stat", pid);
+    FILE *statFile = fopen(statName, "r");
+    if (statFile == NULL) return false;
+    size_t statLen = fread(stat, 1, sizeof(stat) - 1, statFile);
+    fclose(statFile);
+    stat[statLen] = '\0';
+    const char *state = strrchr(stat, ')');   // The state follows the parenthesized command name
+    return state != NULL  &&  (state[1] == ' ')  &&  (state[2] == 'Z'  ||  state[2] == 'X');
+#else
+    return false;
+#endif
+}
+
+
+bool EMSprocessDead(int pid) {
+    if (pid <= 0  ||  !EMSprocessExited(pid)) return false;
+    for (int32_t procN = 0;  emsDomainPids != NULL  &&  procN < emsDomainNThreads;  procN++) {
+        __sync_bool_compare_and_swap(&emsDomainPids[procN], (int32_t) pid, 0);
+    }
+    return true;
+}
+
+
+//  True if the process with an EMS ID is attached to the domain and alive,
+//  false if it left the registry, was found dead, or there is no registry
+static bool EMSprocessRegistered(int64_t procN) {
+    if (emsDomainPids == NULL  ||  procN >= emsDomainNThreads) return false;
+    int pid = emsDomainPids[procN];
+    return pid != 0  &&  !EMSprocessDead(pid);
+}
+
+
+//==================================================================
+//  Record that this process holds the tag of an element BUSY, and the state
+//  of the tag before it was made BUSY.  Returns the record to be cleared
+//  before the tag is released, NULL if the hold could not be recorded.
+static volatile int64_t *EMSholdTag(void *emsBuf, int64_t idx, unsigned char busyFrom) {
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    if (bufInt64[EMScbData(EMS_ARR_HOLDERS)] == 0  ||  EMSmyID < 0  ||
+        EMSmyID >= bufInt64[EMScbData(EMS_ARR_HOLDERS + 1)]) return NULL;
+    volatile int64_t *line = EMSholdLine(EMSmyID);
+    int64_t pid = EMSpid();
+    for (int holdN = 0;  holdN < EMS_HOLDS_PER_LINE;  holdN++) {
+        volatile int64_t *hold = &line[holdN * EMS_HOLD_WORDS];
+        if (hold[EMS_HOLD_PID] == 0  &&  __sync_bool_compare_and_swap(&hold[EMS_HOLD_PID], 0, pid)) {
+            hold[EMS_HOLD_INDEX] = idx;
+            hold[EMS_HOLD_DATA] = bufInt64[EMSdataData(idx)];
+            hold[EMS_HOLD_TAG] = ((int64_t) (EMSdataTag(idx) + 1) << 8) | busyFrom;
+            return hold;
+        }
+    }
+    return NULL;
+}
+
+
+static inline void EMSreleaseHold(volatile int64_t *hold) {
+    if (hold == NULL) return;
+    hold[EMS_HOLD_TAG] = 0;
+    hold[EMS_HOLD_PID] = 0;
+}
+
+
+//  A hold record released when the operation returns, if it was not
+//  released before the tag was
+struct EMSholdGuard {
+    volatile int64_t *hold;
+    void release() {
+        EMSreleaseHold(hold);
+        hold = NULL;
+    }
+    ~EMSholdGuard() { EMSreleaseHold(hold); }
+};
+
+
+//==================================================================
+//  Restore an element tag left BUSY by a process that died holding it.
+//  Called by a waiter that has found the tag BUSY for EMS_STUCK_NAPS long
+//  naps.  Only a tag whose holder recorded the hold is restored, to its state
+//  before it was made BUSY if the data was not yet replaced, otherwise to
+//  that state with an undefined value.  The records of processes registered
+//  alive in the domain are skipped.  Returns true if the tag was restored.
+bool EMSrecoverTag(EMStag_t volatile *tag) {
+    char *bufChar = NULL;
+    for (int mmapID = 0;  mmapID < emsBufsEnd;  mmapID++) {
+        char *buf = emsRegions[mmapID].buf;
+        if (buf != NULL  &&  (char *) tag >= buf  &&  (char *) tag < buf + emsBufLengths[mmapID]) bufChar = buf;
+    }
+    if (bufChar == NULL  ||  tag->tags.fe != EMS_TAG_BUSY) return false;
+    volatile int64_t *bufInt64 = (int64_t *) bufChar;
+    volatile EMStag_t *bufTags = (EMStag_t *) bufChar;
+    if (bufInt64[EMScbData(EMS_ARR_HOLDERS)] == 0) return false;
+    int64_t tagOffset = (int64_t) ((char *) tag - bufChar);
+    for (int64_t lineN = 0;  lineN < bufInt64[EMScbData(EMS_ARR_HOLDERS + 1)];  lineN++) {
+        if (EMSprocessRegistered(lineN)) continue;
+        volatile int64_t *line = EMSholdLine(lineN);
+        for (int holdN = 0;  holdN < EMS_HOLDS_PER_LINE;  holdN++) {
+            volatile int64_t *hold = &line[holdN * EMS_HOLD_WORDS];
+            int64_t held = hold[EMS_HOLD_TAG];
+            int pid = (int) hold[EMS_HOLD_PID];
+            if ((held >> 8) != tagOffset + 1  ||  !EMSprocessDead(pid)  ||
+                !__sync_bool_compare_and_swap(&hold[EMS_HOLD_TAG], held, 0)) continue;
+            //  The record was cleared before any release, so the tag is still the dead holder's
+            int64_t idx = hold[EMS_HOLD_INDEX];
+            EMStag_t restored;
+            restored.byte = (unsigned char) (held & 0xff);
+            bool replaced = bufInt64[EMSdataData(idx)] != hold[EMS_HOLD_DATA];
+            if (replaced) {
+                bufInt64[EMSdataData(idx)] = 0xdeadbeef;
+                restored.tags.type = EMS_TYPE_UNDEFINED;
+            }
+            if (bufInt64[EMScbData(EMS_ARR_VERSIONS)] != 0  &&  (*EMSversionPtr(idx) & 1)) {
+                EMS_VERSION_END_WRITE(idx);
+            }
+            hold[EMS_HOLD_PID] = 0;
+            bufTags[tagOffset].byte = restored.byte;
+            fprintf(stderr, "EMS: Restored the tag of element %" PRId64 ", which process %d died holding%s\n",
+                    idx, pid, replaced ? ", as undefined" : "");
+            return true;
+        }
+    }
+    return false;
+}
+
+
+//==================================================================
+//  Lock and unlock a slot of a region's control block, such as the stack top,
+//  by swapping the holder's PID into the lock word after the slot.  The
+//  slot's tag only identifies the slot in samples of waits.
+void EMScontrolLock(void *emsBuf, int slot) {
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    volatile EMStag_t *bufTags = (EMStag_t *) emsBuf;
+    volatile int64_t *lockWord = &bufInt64[EMScbData(EMS_CONTROL_OWNER(slot))];
+    int64_t held = EMS_CONTROL_HELD(EMSpid());
+    if (__sync_bool_compare_and_swap(lockWord, 0, held)) return;
+    RESET_NAP_TIME;
+    int nLongNaps = 0;
+    volatile EMStag_t *tag = &bufTags[EMScbTag(slot)];
+    const EMSregion *region = EMScountingRegion(tag);
+    struct timespec waitStart;
+    EMSwaitBegin(region, &waitStart);
+    do {
+        NANOSLEEP;
+        if (EMS_STUCK_CHECK(nLongNaps)) {
+            int64_t holder = *lockWord;
+            if (holder != 0  &&  EMSprocessDead(EMSlockHolder(holder))  &&
+                __sync_bool_compare_and_swap(lockWord, holder, held)) {
+                fprintf(stderr, "EMS: Took over control block slot %d from process %d, which died holding it\n",
+                        slot / NWORDS_PER_CACHELINE, EMSlockHolder(holder));
+                break;
+            }
+        }
+    } while (!__sync_bool_compare_and_swap(lockWord, 0, held));
+    EMSwaitEnd(region, EMS_STAT_TAG_WAITS, &waitStart, tag);
+}
+
+
+void EMScontrolUnlock(void *emsBuf, int slot) {
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    bufInt64[EMScbData(EMS_CONTROL_OWNER(slot))] = 0;
+}
+
 
 //==================================================================
 //  Wrappers around memory allocator to ensure mutual exclusion
@@ -48,17 +311,49 @@ char    emsBufFilenames[EMS_MAX_N_BUFS][MAX_FNAME_LEN] = { { 0 } };
 //
 //  Returns the byte offset in the EMS data space of the space allocated
 //
+static void EMSallocLock(volatile char *mutex) {
+    volatile int64_t *lockWord = (volatile int64_t *) mutex;
+    int64_t held = EMS_ALLOC_HELD(EMSpid());
+    if (!__sync_bool_compare_and_swap(lockWord, (int64_t) EMS_TAG_EMPTY, held)) {
+        RESET_NAP_TIME;
+        int nLongNaps = 0;
+        const EMSregion *region = EMScountingRegion(mutex);
+        struct timespec waitStart;
+        EMSwaitBegin(region, &waitStart);
+        do {
+            NANOSLEEP;
+            if (EMS_STUCK_CHECK(nLongNaps)) {
+                int64_t holder = *lockWord;
+                if (holder != EMS_TAG_EMPTY  &&  EMSprocessDead(EMSlockHolder(holder))  &&
+                    __sync_bool_compare_and_swap(lockWord, holder, held)) {
+                    fprintf(stderr, "EMS: Took over the heap allocator from process %d, which died holding it\n",
+                            EMSlockHolder(holder));
+                    break;
+                }
+            }
+        } while (!__sync_bool_compare_and_swap(lockWord, (int64_t) EMS_TAG_EMPTY, held));
+        EMSwaitEnd(region, EMS_STAT_ALLOC_WAITS, &waitStart, NULL);
+    }
+}
+
+
+static void EMSallocUnlock(volatile char *mutex) {
+    *((volatile int64_t *) mutex) = EMS_TAG_EMPTY;
+}
+
+
 size_t emsMutexMem_alloc(struct emsMem *heap,   // Base of EMS malloc structs
                          size_t len,            // Number of bytes to allocate
                          volatile char *mutex)  // Pointer to the mem allocator's mutex
 {
-    RESET_NAP_TIME;
     // Wait until we acquire the allocator's mutex
-    while (!__sync_bool_compare_and_swap(mutex, EMS_TAG_EMPTY, EMS_TAG_FULL)) {
-        NANOSLEEP;
-    }
+    EMSallocLock(mutex);
     size_t retval = emsMem_alloc(heap, len);
-    *mutex = EMS_TAG_EMPTY;    // Unlock the allocator's mutex
+    EMSallocUnlock(mutex);
+    if ((int64_t) retval < 0) {
+        const EMSregion *region = EMScountingRegion(mutex);
+        if (region != NULL) EMS_STAT_ADD(region, EMS_STAT_ALLOC_FAILS, 1);
+    }
     return (retval);
 }
 
@@ -67,27 +362,79 @@ void emsMutexMem_free(struct emsMem *heap,  // Base of EMS malloc structs
                       size_t addr,          // Offset of alloc'd block in EMS memory
                       volatile char *mutex) // Pointer to the mem allocator's mutex
 {
-    RESET_NAP_TIME;
     // Wait until we acquire the allocator's mutex
-    while (!__sync_bool_compare_and_swap(mutex, EMS_TAG_EMPTY, EMS_TAG_FULL)) {
-        NANOSLEEP;
-    }
+    EMSallocLock(mutex);
     emsMem_free(heap, addr);
-    *mutex = EMS_TAG_EMPTY;   // Unlock the allocator's mutex
+    EMSallocUnlock(mutex);
+}
+
+
+//  Allocate several blocks holding the allocator's mutex once.  The offsets
+//  of blocks that could not be allocated are set to -1.
+void emsMutexMem_allocMany(struct emsMem *heap,   // Base of EMS malloc structs
+                           int64_t nBlocks,       // Number of blocks to allocate
+                           const size_t *lens,    // Bytes of each block, blocks of 0 bytes are skipped
+                           int64_t *addrs,        // Returned offset of each block
+                           volatile char *mutex)  // Pointer to the mem allocator's mutex
+{
+    int64_t nFails = 0;
+    EMSallocLock(mutex);
+    for (int64_t blockN = 0;  blockN < nBlocks;  blockN++) {
+        if (lens[blockN] == 0) continue;
+        addrs[blockN] = (int64_t) emsMem_alloc(heap, lens[blockN]);
+        if (addrs[blockN] < 0) nFails++;
+    }
+    EMSallocUnlock(mutex);
+    if (nFails > 0) {
+        const EMSregion *region = EMScountingRegion(mutex);
+        if (region != NULL) EMS_STAT_ADD(region, EMS_STAT_ALLOC_FAILS, nFails);
+    }
+}
+
+
+//  Free several blocks holding the allocator's mutex once, offsets of -1 are skipped
+void emsMutexMem_freeMany(struct emsMem *heap,   // Base of EMS malloc structs
+                          int64_t nBlocks,       // Number of blocks to free
+                          const int64_t *addrs,  // Offset of each block
+                          volatile char *mutex)  // Pointer to the mem allocator's mutex
+{
+    EMSallocLock(mutex);
+    for (int64_t blockN = 0;  blockN < nBlocks;  blockN++) {
+        if (addrs[blockN] >= 0) emsMem_free(heap, (size_t) addrs[blockN]);
+    }
+    EMSallocUnlock(mutex);
 }
 
 
 
 
 
+//==================================================================
+//  True if a string key equals the map key held by a data word.  keyWord is
+//  the key's own data word if it is inline, otherwise the offset of its
+//  interned copy or EMS_HEAP_NULL.  Inline and interned keys are equal only
+//  if their words are equal, other keys compare their bytes.
+static bool EMSkeyEquals(void *emsBuf, const EMSvalueType *key, int64_t word, int64_t keyWord) {
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    if (EMSinlineable(key)) return word == keyWord;
+    if (EMSisInline(word)) return false;
+    const char *ptr = EMSheapPtr(word);
+    if (word != keyWord  &&  EMSinternRefs(ptr) != 0) return false;
+    size_t keyLen;
+    const char *keyStr = EMSheapData(key->type, ptr, &keyLen);
+    return keyLen == key->length  &&  memcmp(key->value, keyStr, keyLen) == 0;
+}
+
+
 //==================================================================
 //  Convert any type of key to an index
 //
-int64_t EMSkey2index(void *emsBuf, EMSvalueType *key, bool is_mapped) {
+int64_t EMSkey2index(const EMSregion *region, EMSvalueType *key, bool is_mapped) {
+    void *emsBuf = region->buf;
     volatile EMStag_t *bufTags = (EMStag_t *) emsBuf;
     volatile int64_t *bufInt64 = (int64_t *) emsBuf;
     volatile double *bufDouble = (double *) emsBuf;
-    const char *bufChar = (char *) emsBuf;
 
     int64_t idx = 0;
     switch (key->type) {
@@ -116,9 +463,17 @@ int64_t EMSkey2index(void *emsBuf, EMSvalueType *key, bool is_mapped) {
     bool matched = false;
     bool notPresent = false;
     EMStag_t mapTags;
+    int64_t keyWord = EMS_HEAP_NULL;
+    if (is_mapped  &&  key->type == EMS_TYPE_STRING) {
+        if (EMSinlineable(key)) {
+            keyWord = EMSinlineWord((const char *) key->value, key->length);
+        } else if (bufInt64[EMScbData(EMS_ARR_INTERN)] != 0) {
+            keyWord = EMSinternFind(emsBuf, (const char *) key->value, key->length);
+        }
+    }
     if (is_mapped) {
         while (nTries < MAX_OPEN_HASH_STEPS && !matched && !notPresent) {
-            idx = idx % bufInt64[EMScbData(EMS_ARR_NELEM)];
+            idx = idx % region->nElements;
             // Wait until the map key is FULL, mark it busy while map lookup is performed
             mapTags.byte = EMStransitionFEtag(&bufTags[EMSmapTag(idx)], NULL, EMS_TAG_FULL, EMS_TAG_BUSY, EMS_TAG_ANY);
             if (mapTags.tags.type == key->type) {
@@ -137,12 +492,10 @@ int64_t EMSkey2index(void *emsBuf, EMSvalueType *key, bool is_mapped) {
                         }
                     }
                         break;
-                    case EMS_TYPE_STRING: {
-                        int64_t keyStrOffset = bufInt64[EMSmapData(idx)];
-                        if (strcmp((const char *) key->value, EMSheapPtr(keyStrOffset)) == 0) {
+                    case EMS_TYPE_STRING:
+                        if (EMSkeyEquals(emsBuf, key, bufInt64[EMSmapData(idx)], keyWord)) {
                             matched = true;
                         }
-                    }
                         break;
                     case EMS_TYPE_UNDEFINED:
                         // Nothing hashed to this map index yet, so the key does not exist
@@ -161,10 +514,14 @@ int64_t EMSkey2index(void *emsBuf, EMSvalueType *key, bool is_mapped) {
                 idx++;
             }
         }
+        if (region->stats != NULL) {
+            EMS_STAT_ADD(region, EMS_STAT_LOOKUPS, 1);
+            EMS_STAT_ADD(region, EMS_STAT_PROBES, nTries + (matched || notPresent));
+        }
         if (!matched) { idx = -1; }
     }
 
-    int64_t retval = idx % bufInt64[EMScbData(EMS_ARR_NELEM)];
+    int64_t retval = idx % region->nElements;
     return retval;
 }
 
@@ -211,6 +568,10 @@ unsigned char EMStransitionFEtag(EMStag_t volatile *tag, EMStag_t volatile *mapT
     EMStag_t oldTag;           //  Desired tag value to start of the transition
     EMStag_t newTag;           //  Tag value at the end of the transition
     EMStag_t volatile memTag;  //  Tag value actually stored in memory
+    const EMSregion *region = NULL;
+    bool waited = false;
+    int nLongNaps = 0;
+    struct timespec waitStart;
     memTag.byte = tag->byte;
     while (oldType == EMS_TAG_ANY || memTag.tags.type == oldType) {
         oldTag.byte = memTag.byte;  // Copy current type and RW count information
@@ -221,15 +582,23 @@ unsigned char EMStransitionFEtag(EMStag_t volatile *tag, EMStag_t volatile *mapT
         //  Attempt to transition the state from old to new
         memTag.byte = __sync_val_compare_and_swap(&(tag->byte), oldTag.byte, newTag.byte);
         if (memTag.byte == oldTag.byte) {
+            if (waited) EMSwaitEnd(region, EMS_STAT_TAG_WAITS, &waitStart, tag);
             return (newTag.byte);
         } else {
+            if (!waited) {
+                waited = true;
+                region = EMScountingRegion(tag);
+                EMSwaitBegin(region, &waitStart);
+            }
             // Allow preemptive map acquisition while waiting for data
             if (mapTag) { mapTag->tags.fe = EMS_TAG_FULL; }
             NANOSLEEP;
+            if (EMS_STUCK_CHECK(nLongNaps)) EMSrecoverTag(tag);
             if (mapTag) { EMStransitionFEtag(mapTag, NULL, EMS_TAG_FULL, EMS_TAG_BUSY, EMS_TAG_ANY); }
             memTag.byte = tag->byte;  // Re-load tag in case was transitioned by another thread
         }
     }
+    if (waited) EMSwaitEnd(region, EMS_STAT_TAG_WAITS, &waitStart, tag);
     return (memTag.byte);
 }
 
@@ -259,7 +628,8 @@ int64_t EMShashString(const char *key) {
 //  returns the index of an existing or available array element.
 //
 int64_t EMSwriteIndexMap(const int mmapID, EMSvalueType *key) {
-    char *emsBuf = emsBufs[mmapID];
+    const EMSregion *region = &emsRegions[mmapID];
+    char *emsBuf = region->buf;
     volatile int64_t  *bufInt64  = (int64_t *) emsBuf;
     volatile char     *bufChar   = emsBuf;
     volatile EMStag_t *bufTags   = (EMStag_t *) emsBuf;
@@ -267,17 +637,24 @@ int64_t EMSwriteIndexMap(const int mmapID, EMSvalueType *key) {
     EMStag_t mapTags;
 
     //  If the key already exists, use it
-    int64_t idx = EMSkey2index(emsBuf, key, EMSisMapped);
+    int64_t idx = EMSkey2index(region, key, EMSisMapped);
     if(idx > 0) {
         // fprintf(stderr, "write index map -- key already existed\n");
         return idx;
     }
-    idx = EMSkey2index(emsBuf, key, false);
+    idx = EMSkey2index(region, key, false);
     int nTries = 0;
     if (EMSisMapped) {
         int matched = false;
+        //  Store the key before searching so a key inserted concurrently is found by
+        //  comparing words if it is inline or interned, the copy is released if unused
+        int64_t keyWord = EMS_HEAP_NULL;
+        bool keyUsed = false;
+        if (key->type == EMS_TYPE_STRING) {
+            EMS_STORE_VALUE(keyWord, key, "EMSwriteIndexMap(string): out of memory to store string", -1);
+        }
         while (nTries < MAX_OPEN_HASH_STEPS && !matched) {
-            idx = idx % bufInt64[EMScbData(EMS_ARR_NELEM)];
+            idx = idx % region->nElements;
             // Wait until the map key is FULL, mark it busy while map lookup is performed
             mapTags.byte = EMStransitionFEtag(&bufTags[EMSmapTag(idx)], NULL, EMS_TAG_FULL, EMS_TAG_BUSY, EMS_TAG_ANY);
             mapTags.tags.fe = EMS_TAG_FULL;  // When written back, mark FULL
@@ -304,13 +681,11 @@ int64_t EMSwriteIndexMap(const int mmapID, EMSvalueType *key) {
                         }
                     }
                         break;
-                    case EMS_TYPE_STRING: {
-                        int64_t keyStrOffset = bufInt64[EMSmapData(idx)];
-                        if (strcmp((const char *) key->value, (const char *) EMSheapPtr(keyStrOffset)) == 0) {
+                    case EMS_TYPE_STRING:
+                        if (EMSkeyEquals(emsBuf, key, bufInt64[EMSmapData(idx)], keyWord)) {
                             matched = true;
                             bufTags[EMSmapTag(idx)].tags.fe = EMS_TAG_FULL;
                         }
-                    }
                         break;
                     case EMS_TYPE_UNDEFINED:
                         // This map key index is still unused, so there was no match and a new
@@ -329,13 +704,9 @@ int64_t EMSwriteIndexMap(const int mmapID, EMSvalueType *key) {
                                 bufDouble[EMSmapData(idx)] = alias.d;
                             }
                                 break;
-                            case EMS_TYPE_STRING: {
-                                int64_t textOffset;
-                                EMS_ALLOC(textOffset, key->length + 1, bufChar,
-                                          "EMSwriteIndexMap(string): out of memory to store string", -1);
-                                bufInt64[EMSmapData(idx)] = textOffset;
-                                strcpy((char *) EMSheapPtr(textOffset), (const char *) key->value);
-                            }
+                            case EMS_TYPE_STRING:
+                                bufInt64[EMSmapData(idx)] = keyWord;
+                                keyUsed = true;
                                 break;
                             case EMS_TYPE_UNDEFINED:
                                 bufInt64[EMSmapData(idx)] = 0xdeadbeef;
@@ -358,8 +729,15 @@ int64_t EMSwriteIndexMap(const int mmapID, EMSvalueType *key) {
                 idx++;
             }
         }
+        if (key->type == EMS_TYPE_STRING  &&  !keyUsed) {
+            EMS_FREE_VALUE(keyWord);
+        }
+        if (region->stats != NULL) {
+            EMS_STAT_ADD(region, EMS_STAT_LOOKUPS, 1);
+            EMS_STAT_ADD(region, EMS_STAT_PROBES, nTries + matched);
+        }
     } else {  // Wasn't mapped, do bounds check
-        if (idx < 0 || idx >= bufInt64[EMScbData(EMS_ARR_NELEM)]) {
+        if (idx < 0 || idx >= region->nElements) {
             fprintf(stderr, "Wasn't mapped do bounds check\n");
             idx = -1;
         }
@@ -376,46 +754,627 @@ int64_t EMSwriteIndexMap(const int mmapID, EMSvalueType *key) {
 
 
 //==================================================================
-//  Read EMS memory, enforcing Full/Empty tag transitions
-bool EMSreadUsingTags(const int mmapID,
-                      EMSvalueType *key, // Index to read from
-                      EMSvalueType *returnValue,
-                      unsigned char initialFE,            // Block until F/E tags are this value
-                      unsigned char finalFE)              // Set the tag to this value when done
-{
+//  Scalable readers-writer locks
+//  Regions created with EMS_REGION_SCALABLE_RW have a table of reader
+//  indicators, one cache line per process.  A reader announces the
+//  element in its own line and then checks no writer holds the element,
+//  so readers of the same element never write to a shared cache line.
+//  Writers that take an element from FULL to BUSY then wait for the
+//  announced readers of the element to drain.
+#define EMSreaderLine(slot) \
+    ((volatile int64_t *) &bufChar[bufInt64[EMScbData(EMS_ARR_READERS)] + (slot) * EMS_CACHELINE_SZ])
+
+//  Announce this process is reading the element, fails if this process' line is full
+static bool EMSreaderAnnounce(void *emsBuf, int64_t idx) {
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    const char *bufChar = (const char *) emsBuf;
+    volatile int64_t *line = EMSreaderLine(EMSmyID % bufInt64[EMScbData(EMS_ARR_READERS + 1)]);
+    for (int entry = 0; entry < EMS_READERS_PER_LINE; entry++) {
+        if (line[entry] == 0  &&  __sync_bool_compare_and_swap(&line[entry], 0, idx + 1)) return true;
+    }
+    return false;
+}
+
+//  Withdraw this process' announcement, fails if the element was not announced
+static bool EMSreaderWithdraw(void *emsBuf, int64_t idx) {
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    const char *bufChar = (const char *) emsBuf;
+    volatile int64_t *line = EMSreaderLine(EMSmyID % bufInt64[EMScbData(EMS_ARR_READERS + 1)]);
+    for (int entry = 0; entry < EMS_READERS_PER_LINE; entry++) {
+        if (line[entry] == idx + 1  &&  __sync_bool_compare_and_swap(&line[entry], idx + 1, 0)) return true;
+    }
+    return false;
+}
+
+//  Wait until no process is announced as reading the element.
+//  Readers must look up the key to withdraw, so the map tag is released while waiting.
+void EMSdrainReaders(void *emsBuf, int64_t idx, EMStag_t volatile *mapTag) {
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    const char *bufChar = (const char *) emsBuf;
+    if (bufInt64[EMScbData(EMS_ARR_READERS)] == 0) return;
     RESET_NAP_TIME;
-    void *emsBuf = emsBufs[mmapID];
-    volatile EMStag_t *bufTags = (EMStag_t *) emsBuf;
+    bool mapReleased = false;
+    int64_t nLines = bufInt64[EMScbData(EMS_ARR_READERS + 1)];
+    for (int64_t slot = 0; slot < nLines; slot++) {
+        volatile int64_t *line = EMSreaderLine(slot);
+        for (int entry = 0; entry < EMS_READERS_PER_LINE; entry++) {
+            while (line[entry] == idx + 1) {
+                if (mapTag  &&  !mapReleased) {
+                    mapTag->tags.fe = EMS_TAG_FULL;
+                    mapReleased = true;
+                }
+                NANOSLEEP;
+            }
+        }
+    }
+    if (mapReleased) { EMStransitionFEtag(mapTag, NULL, EMS_TAG_FULL, EMS_TAG_BUSY, EMS_TAG_ANY); }
+}
+
+
+//==================================================================
+//  Epoch-based reclamation
+//  In regions created with EMS_REGION_EPOCHS the heap storage of a value
+//  replaced or removed from its element is retired to the limbo list of the
+//  retiring process, tagged with the global epoch.  Readers enter an epoch
+//  by announcing the global epoch in their process' slot of the epoch table.
+//  The global epoch only advances when every process in an epoch has
+//  announced the current one, so storage retired in epoch E is not freed
+//  until the global epoch reaches E+2 and no reader can still hold it.
+//  Processes sharing a slot join the epoch already announced there.
+//  The slot of a process that died in an epoch would hold back the global
+//  epoch forever, so a process waiting for storage to be reclaimed clears
+//  the announcement of a slot whose only process is dead.
+
+#define EMSepochMySlot() EMSepochSlot(EMSmyID % bufInt64[EMScbData(EMS_ARR_EPOCHS + 1)])
+
+static void EMSepochEnterBuf(void *emsBuf) {
     volatile int64_t *bufInt64 = (int64_t *) emsBuf;
-    volatile double *bufDouble = (double *) emsBuf;
     const char *bufChar = (const char *) emsBuf;
+    volatile int64_t *slot = EMSepochMySlot();
+    int64_t oldWord, newWord;
+    do {
+        oldWord = slot[EMS_EPOCH_ANNOUNCE];
+        if ((oldWord & EMS_EPOCH_NENTERED) == 0) {
+            newWord = (*EMSepochGlobal() << EMS_EPOCH_SHIFT) | 1;
+        } else {
+            newWord = oldWord + 1;
+        }
+    } while (!__sync_bool_compare_and_swap(&slot[EMS_EPOCH_ANNOUNCE], oldWord, newWord));
+    //  The announcer is recorded, a slot another process joined is never cleared
+    if ((oldWord & EMS_EPOCH_NENTERED) == 0) {
+        __sync_bool_compare_and_swap(&slot[EMS_EPOCH_PID], 0, (int64_t) EMSpid());
+    } else if (slot[EMS_EPOCH_PID] != EMSpid()) {
+        slot[EMS_EPOCH_PID] = -1;
+    }
+}
 
-    returnValue->type  = EMS_TYPE_UNDEFINED;
-    returnValue->value = (void *) 0xdeafbeef;  // TODO: Should return default value even when not doing write allocate
+//  Clear the announcement of a slot whose announcer died in the epoch.
+//  Returns true if the slot no longer holds back the epoch.
+static bool EMSepochClearDead(volatile int64_t *slot, int64_t announced) {
+    int pid = (int) slot[EMS_EPOCH_PID];
+    if (!EMSprocessDead(pid)  ||
+        !__sync_bool_compare_and_swap(&slot[EMS_EPOCH_ANNOUNCE], announced, 0)) return false;
+    __sync_bool_compare_and_swap(&slot[EMS_EPOCH_PID], (int64_t) pid, 0);
+    fprintf(stderr, "EMS: Cleared the epoch announced by process %d, which died in it\n", pid);
+    return true;
+}
 
-    EMStag_t newTag, oldTag, memTag;
-    int64_t idx = EMSkey2index(emsBuf, key, EMSisMapped);
+//  Advance the global epoch if every process in an epoch has announced the
+//  current one, first clearing the slots of dead processes if clearDead
+static void EMSepochAdvance(void *emsBuf, bool clearDead) {
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    const char *bufChar = (const char *) emsBuf;
+    int64_t epoch = *EMSepochGlobal();
+    int64_t nSlots = bufInt64[EMScbData(EMS_ARR_EPOCHS + 1)];
+    for (int64_t slotN = 0; slotN < nSlots; slotN++) {
+        volatile int64_t *slot = EMSepochSlot(slotN);
+        int64_t announced = slot[EMS_EPOCH_ANNOUNCE];
+        if ((announced & EMS_EPOCH_NENTERED) != 0  &&  (announced >> EMS_EPOCH_SHIFT) != epoch  &&
+            !(clearDead  &&  EMSepochClearDead(slot, announced))) return;
+    }
+    __sync_bool_compare_and_swap(EMSepochGlobal(), epoch, epoch + 1);
+}
 
-    //  Allocate on Write, writes include modification of the tag:
-    //  If the EMS object being read is undefined and we're changing the f/e state
-    //  then allocate the undefined object and set the state.  If the state is
-    //  not changing, do not allocate the undefined element.
-    if(EMSisMapped  &&  idx < 0) {
-        if (finalFE != EMS_TAG_ANY) {
-            idx = EMSwriteIndexMap(mmapID, key);
-            if (idx < 0) {
-                fprintf(stderr, "EMSreadUsingTags: Unable to allocate on read for new map index\n");
-                return false;
+//  Free the storage on a limbo list no process can still be reading,
+//  the caller holds the limbo list's lock
+static void EMSlimboReclaim(void *emsBuf, volatile int64_t *slot) {
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    if (slot[EMS_EPOCH_FREED] == slot[EMS_EPOCH_RETIRED]) return;
+    if (EMSlimboEntry(slot, slot[EMS_EPOCH_FREED])[1] + 2 > *EMSepochGlobal()) EMSepochAdvance(emsBuf, false);
+    while (slot[EMS_EPOCH_FREED] < slot[EMS_EPOCH_RETIRED]) {
+        volatile int64_t *entry = EMSlimboEntry(slot, slot[EMS_EPOCH_FREED]);
+        if (entry[1] + 2 > *EMSepochGlobal()) break;
+        EMS_FREE(entry[0]);
+        slot[EMS_EPOCH_FREED]++;
+    }
+}
+
+static void EMSepochExitBuf(void *emsBuf) {
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    const char *bufChar = (const char *) emsBuf;
+    volatile int64_t *slot = EMSepochMySlot();
+    //  The last process to leave forgets the announcer before the slot can be announced again
+    if ((slot[EMS_EPOCH_ANNOUNCE] & EMS_EPOCH_NENTERED) == 1) slot[EMS_EPOCH_PID] = 0;
+    if ((__sync_sub_and_fetch(&slot[EMS_EPOCH_ANNOUNCE], 1) & EMS_EPOCH_NENTERED) == 0  &&
+        slot[EMS_EPOCH_FREED] != slot[EMS_EPOCH_RETIRED]  &&
+        __sync_bool_compare_and_swap(&slot[EMS_EPOCH_LIMBO_LOCK], 0, 1)) {
+        //  Leaving the last epoch may let this process' retired storage be freed
+        EMSlimboReclaim(emsBuf, slot);
+        __sync_lock_release(&slot[EMS_EPOCH_LIMBO_LOCK]);
+    }
+}
+
+
+//==================================================================
+//  Free the heap storage of a value that has been unlinked from its
+//  element.  Regions with epochs put it on this process' limbo list.
+void EMSretire(void *emsBuf, int64_t offset) {
+    RESET_NAP_TIME;
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    if (bufInt64[EMScbData(EMS_ARR_EPOCHS)] == 0) {
+        EMS_FREE(offset);
+        return;
+    }
+    volatile int64_t *slot = EMSepochMySlot();
+    while (!__sync_bool_compare_and_swap(&slot[EMS_EPOCH_LIMBO_LOCK], 0, 1)) NANOSLEEP;
+    EMSlimboReclaim(emsBuf, slot);
+    while (slot[EMS_EPOCH_RETIRED] - slot[EMS_EPOCH_FREED] >= EMS_LIMBO_SZ) {
+        if ((slot[EMS_EPOCH_ANNOUNCE] & EMS_EPOCH_NENTERED) != 0) {
+            //  Waiting for the epoch to advance would wait on this process' own epoch
+            fprintf(stderr, "EMSretire: Limbo list is full inside an epoch, %" PRId64 " is not freed\n", offset);
+            __sync_lock_release(&slot[EMS_EPOCH_LIMBO_LOCK]);
+            return;
+        }
+        __sync_lock_release(&slot[EMS_EPOCH_LIMBO_LOCK]);
+        NANOSLEEP;
+        EMSepochAdvance(emsBuf, true);
+        while (!__sync_bool_compare_and_swap(&slot[EMS_EPOCH_LIMBO_LOCK], 0, 1)) NANOSLEEP;
+        EMSlimboReclaim(emsBuf, slot);
+    }
+    //  The epoch is sampled after the value was unlinked, readers that
+    //  could have found it announced this epoch or an earlier one
+    __sync_synchronize();
+    volatile int64_t *entry = EMSlimboEntry(slot, slot[EMS_EPOCH_RETIRED]);
+    entry[0] = offset;
+    entry[1] = *EMSepochGlobal();
+    slot[EMS_EPOCH_RETIRED]++;
+    __sync_lock_release(&slot[EMS_EPOCH_LIMBO_LOCK]);
+}
+
+
+//==================================================================
+//  Called when the heap is exhausted, frees what can be freed on the limbo
+//  list of every process, waiting a while for the epoch to advance.
+//  Returns true if storage was freed and the allocation should be retried.
+bool EMSlimboDrain(void *emsBuf) {
+    RESET_NAP_TIME;
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    const char *bufChar = (const char *) emsBuf;
+    if (bufInt64[EMScbData(EMS_ARR_EPOCHS)] == 0) return false;
+    int64_t nSlots = bufInt64[EMScbData(EMS_ARR_EPOCHS + 1)];
+    for (int nTries = 0; nTries < EMS_LIMBO_DRAIN_TRIES; nTries++) {
+        if (nTries > 0) EMSepochAdvance(emsBuf, true);
+        bool freed = false;
+        bool pending = false;
+        for (int64_t slotN = 0; slotN < nSlots; slotN++) {
+            volatile int64_t *slot = EMSepochSlot(slotN);
+            if (slot[EMS_EPOCH_FREED] == slot[EMS_EPOCH_RETIRED]) continue;
+            if (__sync_bool_compare_and_swap(&slot[EMS_EPOCH_LIMBO_LOCK], 0, 1)) {
+                int64_t nFreed = slot[EMS_EPOCH_FREED];
+                EMSlimboReclaim(emsBuf, slot);
+                freed = freed  ||  slot[EMS_EPOCH_FREED] != nFreed;
+                pending = pending  ||  slot[EMS_EPOCH_FREED] != slot[EMS_EPOCH_RETIRED];
+                __sync_lock_release(&slot[EMS_EPOCH_LIMBO_LOCK]);
+            } else {
+                pending = true;
             }
+        }
+        if (freed) return true;
+        if (!pending) return false;
+        NANOSLEEP;
+    }
+    return false;
+}
+
+
+//==================================================================
+//  String interning
+//  In regions created with EMS_REGION_INTERN equal strings and blobs stored
+//  in elements or used as map keys share one copy on the heap.  The intern
+//  table holds the offsets of the shared copies, and the header of each copy
+//  counts the elements referring to it.  The copy is released to be freed
+//  when the last of them is replaced.  Values which cannot be interned,
+//  because their stripe of the table is full or their count would overflow,
+//  are stored in a copy of their own as in other regions.
+
+static uint64_t EMShashBytes(const char *data, size_t length) {
+    uint64_t hash = 14695981039346656037ULL;  // FNV-1a
+    for (size_t charN = 0; charN < length; charN++) {
+        hash ^= (unsigned char) data[charN];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+//  Find the slot of a stripe holding the value equal to data, or -1 if the value
+//  is not interned and set *freeSlot to the slot where it would be inserted, or -1
+//  if the stripe is full.  The caller holds the stripe's lock.
+static int64_t EMSinternProbe(void *emsBuf, volatile int64_t *stripe, uint64_t hash,
+                              const char *data, size_t length, int64_t *freeSlot) {
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    int64_t nSlots = bufInt64[EMScbData(EMS_ARR_INTERN + 1)];
+    volatile int64_t *slots = EMSinternSlots(stripe);
+    *freeSlot = -1;
+    for (int64_t probeN = 0; probeN < nSlots; probeN++) {
+        int64_t slotN = (int64_t) ((hash / EMS_INTERN_STRIPES + probeN) & (nSlots - 1));
+        int64_t offset = slots[slotN];
+        if (offset == EMS_INTERN_EMPTY) {
+            if (*freeSlot < 0) *freeSlot = slotN;
+            return -1;
+        }
+        if (offset == EMS_INTERN_DELETED) {
+            if (*freeSlot < 0) *freeSlot = slotN;
         } else {
+            size_t valueLen;
+            const char *value = EMSheapData(EMS_TYPE_STRING, EMSheapPtr(offset), &valueLen);
+            if (valueLen == length  &&  memcmp(value, data, length) == 0) return slotN;
+        }
+    }
+    return -1;
+}
+
+
+//  Remove the deleted slots of a full stripe by inserting its values again,
+//  the caller holds the stripe's lock
+static void EMSinternRehash(void *emsBuf, volatile int64_t *stripe) {
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    int64_t nSlots = bufInt64[EMScbData(EMS_ARR_INTERN + 1)];
+    volatile int64_t *slots = EMSinternSlots(stripe);
+    int64_t *live = (int64_t *) malloc(nSlots * sizeof(int64_t));
+    if (live == NULL) return;
+    int64_t nLive = 0;
+    for (int64_t slotN = 0; slotN < nSlots; slotN++) {
+        if (slots[slotN] >= 0) live[nLive++] = slots[slotN];
+        slots[slotN] = EMS_INTERN_EMPTY;
+    }
+    for (int64_t liveN = 0; liveN < nLive; liveN++) {
+        size_t length;
+        const char *data = EMSheapData(EMS_TYPE_STRING, EMSheapPtr(live[liveN]), &length);
+        int64_t slotN = (int64_t) (EMShashBytes(data, length) / EMS_INTERN_STRIPES);
+        while (slots[slotN & (nSlots - 1)] != EMS_INTERN_EMPTY) slotN++;
+        slots[slotN & (nSlots - 1)] = live[liveN];
+    }
+    stripe[EMS_INTERN_USED] = nLive;
+    stripe[EMS_INTERN_NDELETED] = 0;
+    free(live);
+}
+
+
+//==================================================================
+//  Return the offset of the interned value equal to data, or -1 if there
+//  is none.  The caller holds no reference, so the value may be released
+//  as soon as this returns and the offset may only be compared to data
+//  words read after it.
+int64_t EMSinternFind(void *emsBuf, const char *data, size_t length) {
+    RESET_NAP_TIME;
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    uint64_t hash = EMShashBytes(data, length);
+    volatile int64_t *stripe = EMSinternStripe(hash % EMS_INTERN_STRIPES);
+    int64_t freeSlot;
+    while (!__sync_bool_compare_and_swap(&stripe[EMS_INTERN_LOCK], 0, 1)) NANOSLEEP;
+    int64_t slotN = EMSinternProbe(emsBuf, stripe, hash, data, length, &freeSlot);
+    int64_t offset = (slotN < 0) ? -1 : EMSinternSlots(stripe)[slotN];
+    __sync_lock_release(&stripe[EMS_INTERN_LOCK]);
+    return offset;
+}
+
+
+//==================================================================
+//  Add a reference to the interned value equal to a value about to be stored,
+//  returning its offset, or -1 if the value must be copied to the heap first
+int64_t EMSinternShare(void *emsBuf, const EMSvalueType *value) {
+    RESET_NAP_TIME;
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    uint64_t hash = EMShashBytes((const char *) value->value, value->length);
+    volatile int64_t *stripe = EMSinternStripe(hash % EMS_INTERN_STRIPES);
+    int64_t offset = -1;
+    int64_t freeSlot;
+    while (!__sync_bool_compare_and_swap(&stripe[EMS_INTERN_LOCK], 0, 1)) NANOSLEEP;
+    int64_t slotN = EMSinternProbe(emsBuf, stripe, hash, (const char *) value->value, value->length, &freeSlot);
+    if (slotN >= 0) {
+        char *ptr = EMSheapPtr(EMSinternSlots(stripe)[slotN]);
+        uint32_t nRefs = EMSinternRefs(ptr);
+        if (nRefs < EMS_INTERN_MAX_REFS) {
+            EMSsetInternRefs(ptr, nRefs + 1);
+            offset = EMSinternSlots(stripe)[slotN];
+        }
+    }
+    __sync_lock_release(&stripe[EMS_INTERN_LOCK]);
+    return offset;
+}
+
+
+//==================================================================
+//  Intern a value just copied to the heap at offset, not yet stored in any
+//  element.  If another process interned an equal value in the meantime the
+//  copy is freed and a reference to that value is returned instead.  The
+//  copy is returned uninterned if the value cannot be interned.
+int64_t EMSintern(void *emsBuf, int64_t offset) {
+    RESET_NAP_TIME;
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    size_t length;
+    const char *data = EMSheapData(EMS_TYPE_STRING, EMSheapPtr(offset), &length);
+    uint64_t hash = EMShashBytes(data, length);
+    volatile int64_t *stripe = EMSinternStripe(hash % EMS_INTERN_STRIPES);
+    volatile int64_t *slots = EMSinternSlots(stripe);
+    int64_t nSlots = bufInt64[EMScbData(EMS_ARR_INTERN + 1)];
+    int64_t freeSlot;
+    while (!__sync_bool_compare_and_swap(&stripe[EMS_INTERN_LOCK], 0, 1)) NANOSLEEP;
+    int64_t slotN = EMSinternProbe(emsBuf, stripe, hash, data, length, &freeSlot);
+    if (slotN < 0  &&  (freeSlot < 0  ||  slots[freeSlot] == EMS_INTERN_EMPTY)  &&
+        stripe[EMS_INTERN_USED] >= nSlots - nSlots / 4  &&  stripe[EMS_INTERN_NDELETED] > 0) {
+        EMSinternRehash(emsBuf, stripe);
+        slotN = EMSinternProbe(emsBuf, stripe, hash, data, length, &freeSlot);
+    }
+    if (slotN >= 0) {
+        char *ptr = EMSheapPtr(slots[slotN]);
+        uint32_t nRefs = EMSinternRefs(ptr);
+        if (nRefs < EMS_INTERN_MAX_REFS) {
+            EMSsetInternRefs(ptr, nRefs + 1);
+            int64_t shared = slots[slotN];
+            __sync_lock_release(&stripe[EMS_INTERN_LOCK]);
+            EMS_FREE(offset);
+            return shared;
+        }
+    } else if (freeSlot >= 0  &&
+               (slots[freeSlot] == EMS_INTERN_DELETED  ||  stripe[EMS_INTERN_USED] < nSlots - nSlots / 4)) {
+        //  Deleted slots are reused, empty ones are only used while the stripe is under 3/4 full
+        if (slots[freeSlot] == EMS_INTERN_EMPTY) stripe[EMS_INTERN_USED]++;
+        else                                     stripe[EMS_INTERN_NDELETED]--;
+        EMSsetInternRefs(EMSheapPtr(offset), 1);
+        slots[freeSlot] = offset;
+    }
+    __sync_lock_release(&stripe[EMS_INTERN_LOCK]);
+    return offset;
+}
+
+
+//==================================================================
+//  Drop a reference to an interned value being replaced in an element,
+//  returning true if it was the last one and the value should be freed
+bool EMSinternRelease(void *emsBuf, int64_t offset) {
+    RESET_NAP_TIME;
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    char *ptr = EMSheapPtr(offset);
+    size_t length;
+    const char *data = EMSheapData(EMS_TYPE_STRING, ptr, &length);
+    uint64_t hash = EMShashBytes(data, length);
+    volatile int64_t *stripe = EMSinternStripe(hash % EMS_INTERN_STRIPES);
+    int64_t freeSlot;
+    while (!__sync_bool_compare_and_swap(&stripe[EMS_INTERN_LOCK], 0, 1)) NANOSLEEP;
+    uint32_t nRefs = EMSinternRefs(ptr);
+    EMSsetInternRefs(ptr, nRefs - 1);
+    if (nRefs == 1) {
+        int64_t slotN = EMSinternProbe(emsBuf, stripe, hash, data, length, &freeSlot);
+        if (slotN >= 0  &&  EMSinternSlots(stripe)[slotN] == offset) {
+            EMSinternSlots(stripe)[slotN] = EMS_INTERN_DELETED;
+            stripe[EMS_INTERN_NDELETED]++;
+        }
+    }
+    __sync_lock_release(&stripe[EMS_INTERN_LOCK]);
+    return nRefs == 1;
+}
+
+
+//  Strings and blobs stored inline in a data word are returned decoded in a
+//  process-local buffer which remains valid until the next such read
+static char EMSinlineReturnBuf[EMS_INLINE_MAX + 1];
+
+
+//==================================================================
+//  Locate the string, blob, or JSON value at a heap offset read without
+//  holding the tag or lock protecting it.  The offset is only trusted after
+//  the caller validates the read, so it is bounds checked here.
+//  Returns false if the offset is not a value inside the heap.
+bool EMSheapValueUnlocked(void *emsBuf, unsigned char type, int64_t data, const char **str, size_t *length) {
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    const char *bufChar = (const char *) emsBuf;
+    int64_t heapBot = bufInt64[EMScbData(EMS_ARR_HEAPBOT)];
+    int64_t heapTop = bufInt64[EMScbData(EMS_ARR_FILESZ)];
+    if (data < 0  ||  heapBot + data >= heapTop) return false;
+    const char *ptr = &bufChar[heapBot + data];
+    size_t avail = (size_t) (heapTop - (heapBot + data));
+    if (*((const unsigned char *) ptr) == EMS_VALUE_COUNTED  ||  EMSisPackedJSON(type, ptr)) {
+        if (avail < EMS_COUNTED_HDR_SZ  ||  EMSvalueBytes(type, ptr) > avail) return false;
+        *str = EMSheapData(type, ptr, length);
+    } else {
+        *str = ptr;
+        *length = strnlen(ptr, avail);
+    }
+    return true;
+}
+
+
+//==================================================================
+//  Copy the string, blob, or JSON value at a heap offset read from an element
+//  without holding its tag to a process-local buffer which remains valid until
+//  the next such read.
+//  Returns 0 if the offset is not a value, -1 if the copy could not be made.
+static char  *EMSreadCopyBuf = NULL;
+static size_t EMSreadCopyBufLen = 0;
+
+static int EMSreadUnlocked(void *emsBuf, unsigned char type, int64_t data, EMSvalueType *returnValue) {
+    if (EMSisInline(data)) {
+        if (type == EMS_TYPE_JSON) return 0;
+        returnValue->value = (void *) EMSinlineData(data, EMSinlineReturnBuf, &returnValue->length);
+        return 1;
+    }
+    const char *str;
+    size_t len;
+    if (!EMSheapValueUnlocked(emsBuf, type, data, &str, &len)) return 0;
+    if (len + 1 > EMSreadCopyBufLen) {
+        char *newBuf = (char *) realloc(EMSreadCopyBuf, len + 1);
+        if (newBuf == NULL) {
+            fprintf(stderr, "EMSreadUnlocked: Unable to allocate space to copy the string\n");
+            return -1;
+        }
+        EMSreadCopyBuf = newBuf;
+        EMSreadCopyBufLen = len + 1;
+    }
+    memcpy(EMSreadCopyBuf, str, len);
+    EMSreadCopyBuf[len] = '\0';
+    returnValue->value = (void *) EMSreadCopyBuf;
+    returnValue->length = len;
+    return 1;
+}
+
+
+//==================================================================
+//  Optimistic read of an element in a region with version stamps.
+//  Samples the element's version, copies the value, then revalidates the
+//  version, retrying only if a writer intervened.  Nothing in the EMS
+//  region is written.  Strings and JSON are copied as by EMSreadUnlocked.
+bool EMSreadOptimistic(void *emsBuf,
+                       int64_t idx,                // Index to read from
+                       EMSvalueType *returnValue,
+                       bool waitFull,              // Block until the F/E tag is full
+                       int64_t *versionRead)       // If not NULL, the version the value was read at
+{
+    RESET_NAP_TIME;
+    volatile EMStag_t *bufTags = (EMStag_t *) emsBuf;
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    const char *bufChar = (const char *) emsBuf;
+    EMStag_t memTag;
+
+    while (true) {
+        int64_t version = *EMSversionPtr(idx);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        memTag.byte = bufTags[EMSdataTag(idx)].byte;
+        int64_t data = bufInt64[EMSdataData(idx)];
+        bool consistent = !(version & 1)  &&  (!waitFull  ||  memTag.tags.fe == EMS_TAG_FULL);
+        returnValue->type = memTag.tags.type;
+        switch (memTag.tags.type) {
+            case EMS_TYPE_BOOLEAN:
+                returnValue->value = (void *) (data != 0);
+                break;
+            case EMS_TYPE_INTEGER:
+            case EMS_TYPE_FLOAT:
+                returnValue->value = (void *) data;
+                break;
+            case EMS_TYPE_UNDEFINED:
+                returnValue->value = (void *) 0xcafebeef;
+                break;
+            case EMS_TYPE_JSON:
+            case EMS_TYPE_BLOB:
+            case EMS_TYPE_STRING:
+                //  The offset may be stale if a writer intervened, it is only trusted after revalidation
+                if (consistent) {
+                    int copied = EMSreadUnlocked(emsBuf, memTag.tags.type, data, returnValue);
+                    if (copied < 0) return false;
+                    consistent = (copied > 0);
+                }
+                break;
+            default:
+                if (consistent  &&  *EMSversionPtr(idx) == version) {
+                    fprintf(stderr, "EMSreadOptimistic: unknown type (%d) read from memory\n", memTag.tags.type);
+                    return false;
+                }
+                consistent = false;
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (consistent  &&  *EMSversionPtr(idx) == version) {
+            if (versionRead) *versionRead = version;
             return true;
         }
+        //  A writer intervened or the element is not yet full, wait and retry
+        NANOSLEEP;
     }
+}
 
-    if (idx < 0 || idx >= bufInt64[EMScbData(EMS_ARR_NELEM)]) {
-        fprintf(stderr, "EMSreadUsingTags: index out of bounds\n");
-        return false;
+
+//==================================================================
+//  Read an element without modifying its tag in a region with epochs.
+//  A writer holding the element is waited out and the tag is sampled
+//  before and after the data.  The read is made inside an epoch so the
+//  value cannot be freed while it is copied.
+static bool EMSreadEpoch(void *emsBuf, int64_t idx, EMSvalueType *returnValue) {
+    RESET_NAP_TIME;
+    volatile EMStag_t *bufTags = (EMStag_t *) emsBuf;
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    EMStag_t memTag;
+
+    EMSepochEnterBuf(emsBuf);
+    while (true) {
+        memTag.byte = bufTags[EMSdataTag(idx)].byte;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        int64_t data = bufInt64[EMSdataData(idx)];
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (memTag.tags.fe != EMS_TAG_BUSY  &&  bufTags[EMSdataTag(idx)].byte == memTag.byte) {
+            int copied = 1;
+            returnValue->type = memTag.tags.type;
+            switch (memTag.tags.type) {
+                case EMS_TYPE_BOOLEAN:
+                    returnValue->value = (void *) (data != 0);
+                    break;
+                case EMS_TYPE_INTEGER:
+                case EMS_TYPE_FLOAT:
+                    returnValue->value = (void *) data;
+                    break;
+                case EMS_TYPE_UNDEFINED:
+                    returnValue->value = (void *) 0xcafebeef;
+                    break;
+                case EMS_TYPE_JSON:
+                case EMS_TYPE_BLOB:
+                case EMS_TYPE_STRING:
+                    copied = EMSreadUnlocked(emsBuf, memTag.tags.type, data, returnValue);
+                    break;
+                default:
+                    fprintf(stderr, "EMSreadEpoch: unknown type (%d) read from memory\n", memTag.tags.type);
+                    copied = -1;
+            }
+            if (copied != 0) {
+                EMSepochExitBuf(emsBuf);
+                return copied > 0;
+            }
+        }
+        //  A writer holds the element or intervened, wait and retry outside the epoch
+        //  so a writer waiting for storage to be reclaimed is not blocked
+        EMSepochExitBuf(emsBuf);
+        NANOSLEEP;
+        EMSepochEnterBuf(emsBuf);
     }
+}
+
+
+//==================================================================
+//  Read an element of a region with mapped or indexed keys, enforcing
+//  Full/Empty tag transitions.  Instantiated for each tag mode so the
+//  tests of the mode and of the mapping are resolved at compile time.
+template <bool mapped, unsigned char initialFE, unsigned char finalFE>
+static bool EMSreadElement(const EMSregion *region,
+                           int64_t idx,
+                           EMSvalueType *returnValue,
+                           int64_t *view)     // If not NULL, pin strings and blobs for a view
+{
+    RESET_NAP_TIME;
+    void *emsBuf = region->buf;
+    volatile EMStag_t *bufTags = (EMStag_t *) emsBuf;
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    volatile double *bufDouble = (double *) emsBuf;
+    const char *bufChar = (const char *) emsBuf;
+    EMStag_t newTag, oldTag, memTag;
+    volatile int64_t *hold = NULL;
+    bool waited = false;
+    int nLongNaps = 0;
+    struct timespec waitStart;
 
     while (true) {
         memTag.byte = bufTags[EMSdataTag(idx)].byte;
@@ -433,49 +1392,80 @@ bool EMSreadUsingTags(const int mmapID,
             newTag.tags.fe = EMS_TAG_BUSY;
             if (initialFE == EMS_TAG_RW_LOCK) {
                 newTag.tags.rw++;
-            } else {
+            } else if (initialFE != EMS_TAG_ANY) {
                 oldTag.tags.fe = initialFE;
             }
             //  Transition FE from FULL to BUSY
             if (initialFE == EMS_TAG_ANY ||
                 __sync_bool_compare_and_swap(&(bufTags[EMSdataTag(idx)].byte), oldTag.byte, newTag.byte)) {
+                if (waited) EMSwaitEnd(region, EMS_STAT_TAG_WAITS, &waitStart, &bufTags[EMSdataTag(idx)]);
+                if (initialFE != EMS_TAG_ANY) hold = EMSholdTag(emsBuf, idx, oldTag.byte);
+                //  Taking a full element for exclusive use must wait for the scalable readers
+                if (initialFE == EMS_TAG_FULL  &&  finalFE != EMS_TAG_FULL) {
+                    EMSdrainReaders(emsBuf, idx, mapped ? &bufTags[EMSmapTag(idx)] : NULL);
+                }
                 // Under BUSY lock:
                 //   Read the data, then reset the FE tag, then return the original value in memory
-                newTag.tags.fe = finalFE;
+                if (finalFE != EMS_TAG_ANY) newTag.tags.fe = finalFE;
                 returnValue->type  = newTag.tags.type;
                 switch (newTag.tags.type) {
                     case EMS_TYPE_BOOLEAN: {
                         returnValue->value = (void *) (bufInt64[EMSdataData(idx)] != 0);
+                        EMSreleaseHold(hold);
                         if (finalFE != EMS_TAG_ANY) bufTags[EMSdataTag(idx)].byte = newTag.byte;
-                        if (EMSisMapped) bufTags[EMSmapTag(idx)].tags.fe = EMS_TAG_FULL;
+                        if (mapped) bufTags[EMSmapTag(idx)].tags.fe = EMS_TAG_FULL;
                         return true;
                     }
                     case EMS_TYPE_INTEGER: {
                         returnValue->value = (void *) bufInt64[EMSdataData(idx)];
+                        EMSreleaseHold(hold);
                         if (finalFE != EMS_TAG_ANY) bufTags[EMSdataTag(idx)].byte = newTag.byte;
-                        if (EMSisMapped) bufTags[EMSmapTag(idx)].tags.fe = EMS_TAG_FULL;
+                        if (mapped) bufTags[EMSmapTag(idx)].tags.fe = EMS_TAG_FULL;
                         return true;
                     }
                     case EMS_TYPE_FLOAT: {
                         EMSulong_double alias;
                         alias.d = bufDouble[EMSdataData(idx)];
                         returnValue->value = (void *) alias.u64;
+                        EMSreleaseHold(hold);
                         if (finalFE != EMS_TAG_ANY) bufTags[EMSdataTag(idx)].byte = newTag.byte;
-                        if (EMSisMapped) bufTags[EMSmapTag(idx)].tags.fe = EMS_TAG_FULL;
+                        if (mapped) bufTags[EMSmapTag(idx)].tags.fe = EMS_TAG_FULL;
                         return true;
                     }
                     case EMS_TYPE_JSON:
+                    case EMS_TYPE_BLOB:
                     case EMS_TYPE_STRING: {
-                        returnValue->value = (void *) EMSheapPtr(bufInt64[EMSdataData(idx)]);
-                        returnValue->length = strlen((const char *)returnValue->value);
+                        int64_t word = bufInt64[EMSdataData(idx)];
+                        if (EMSisInline(word)) {
+                            //  Inline values are decoded to a process-local buffer, there is nothing to view
+                            returnValue->value = (void *) EMSinlineData(word, EMSinlineReturnBuf, &returnValue->length);
+                            if (view != NULL) *view = -1;
+                            EMSreleaseHold(hold);
+                            if (finalFE != EMS_TAG_ANY) bufTags[EMSdataTag(idx)].byte = newTag.byte;
+                            if (mapped) bufTags[EMSmapTag(idx)].tags.fe = EMS_TAG_FULL;
+                            return true;
+                        }
+                        const char *heapPtr = EMSheapPtr(word);
+                        returnValue->value = (void *) EMSheapData(memTag.tags.type, heapPtr, &returnValue->length);
+                        if (view != NULL) {
+                            //  The element is held, so the value cannot be replaced until it is pinned
+                            if (*((const unsigned char *) heapPtr) == EMS_VALUE_COUNTED) {
+                                __sync_fetch_and_add((uint32_t *) (heapPtr + EMS_COUNTED_VIEWS), 1);
+                                *view = word;
+                            } else {
+                                *view = -1;
+                            }
+                        }
+                        EMSreleaseHold(hold);
                         if (finalFE != EMS_TAG_ANY) bufTags[EMSdataTag(idx)].byte = newTag.byte;
-                        if (EMSisMapped) bufTags[EMSmapTag(idx)].tags.fe = EMS_TAG_FULL;
+                        if (mapped) bufTags[EMSmapTag(idx)].tags.fe = EMS_TAG_FULL;
                         return true;
                     }
                     case EMS_TYPE_UNDEFINED: {
                         returnValue->value = (void *) 0xcafebeef;
+                        EMSreleaseHold(hold);
                         if (finalFE != EMS_TAG_ANY) bufTags[EMSdataTag(idx)].byte = newTag.byte;
-                        if (EMSisMapped) bufTags[EMSmapTag(idx)].tags.fe = EMS_TAG_FULL;
+                        if (mapped) bufTags[EMSmapTag(idx)].tags.fe = EMS_TAG_FULL;
                         return true;
                     }
                     default:
@@ -486,44 +1476,165 @@ bool EMSreadUsingTags(const int mmapID,
                 // Tag was marked BUSY between test read and CAS, must retry
             }
         } else {
-            // Tag was already marked BUSY, must retry
+            // Tag was already marked BUSY, must retry
+        }
+        // CAS failed or memory wasn't in initial state, wait and retry.
+        // Permit preemptive map acquisition while waiting for data.
+        if (!waited) {
+            waited = true;
+            EMSwaitBegin(region, &waitStart);
+        }
+        if (mapped) { bufTags[EMSmapTag(idx)].tags.fe = EMS_TAG_FULL; }
+        NANOSLEEP;
+        if (EMS_STUCK_CHECK(nLongNaps)) EMSrecoverTag(&bufTags[EMSdataTag(idx)]);
+        if (mapped) {
+            EMStransitionFEtag(&bufTags[EMSmapTag(idx)], NULL, EMS_TAG_FULL, EMS_TAG_BUSY, EMS_TAG_ANY);
+        }
+    }
+}
+
+
+//==================================================================
+//  Read EMS memory, enforcing Full/Empty tag transitions
+template <bool mapped, unsigned char initialFE, unsigned char finalFE>
+static bool EMSreadUsingTags(const int mmapID,
+                             EMSvalueType *key, // Index to read from
+                             EMSvalueType *returnValue,
+                             int64_t *view)     // If not NULL, pin strings and blobs for a view
+{
+    RESET_NAP_TIME;
+    const EMSregion *region = &emsRegions[mmapID];
+    void *emsBuf = region->buf;
+    volatile EMStag_t *bufTags = (EMStag_t *) emsBuf;
+    EMStag_t memTag;
+
+    returnValue->type  = EMS_TYPE_UNDEFINED;
+    returnValue->value = (void *) 0xdeafbeef;  // TODO: Should return default value even when not doing write allocate
+
+    int64_t idx = EMSkeyIndex<mapped>(region, key);
+
+    //  Allocate on Write, writes include modification of the tag:
+    //  If the EMS object being read is undefined and we're changing the f/e state
+    //  then allocate the undefined object and set the state.  If the state is
+    //  not changing, do not allocate the undefined element.
+    if(mapped  &&  idx < 0) {
+        if (finalFE != EMS_TAG_ANY) {
+            idx = EMSwriteIndexMap(mmapID, key);
+            if (idx < 0) {
+                fprintf(stderr, "EMSreadUsingTags: Unable to allocate on read for new map index\n");
+                return false;
+            }
+        } else {
+            return true;
         }
-        // CAS failed or memory wasn't in initial state, wait and retry.
-        // Permit preemptive map acquisition while waiting for data.
-        if (EMSisMapped) { bufTags[EMSmapTag(idx)].tags.fe = EMS_TAG_FULL; }
-        NANOSLEEP;
-        if (EMSisMapped) {
-            EMStransitionFEtag(&bufTags[EMSmapTag(idx)], NULL, EMS_TAG_FULL, EMS_TAG_BUSY, EMS_TAG_ANY);
+    }
+
+    if (idx < 0 || idx >= region->nElements) {
+        fprintf(stderr, "EMSreadUsingTags: index out of bounds\n");
+        return false;
+    }
+
+    //  Reads that leave the tag unchanged are optimistic in regions with version stamps
+    if (view == NULL  &&  (region->regionFlags & EMS_REGION_OPTIMISTIC_READS)  &&
+        (initialFE == EMS_TAG_ANY  ||  (initialFE == EMS_TAG_FULL  &&  finalFE == EMS_TAG_FULL))) {
+        return EMSreadOptimistic(emsBuf, idx, returnValue, initialFE == EMS_TAG_FULL, NULL);
+    }
+
+    //  Reads that ignore the tag are made inside an epoch in regions with epochs
+    if (view == NULL  &&  initialFE == EMS_TAG_ANY  &&  (region->regionFlags & EMS_REGION_EPOCHS)) {
+        return EMSreadEpoch(emsBuf, idx, returnValue);
+    }
+
+    //  Scalable readers-writer lock: announce the reader, then confirm no writer holds the element.
+    //  If this process' line of indicators is full, fall back on the reader count in the tag.
+    if (initialFE == EMS_TAG_RW_LOCK  &&  (region->regionFlags & EMS_REGION_SCALABLE_RW)) {
+        while (EMSreaderAnnounce(emsBuf, idx)) {
+            memTag.byte = bufTags[EMSdataTag(idx)].byte;
+            if (memTag.tags.fe == EMS_TAG_FULL  ||  memTag.tags.fe == EMS_TAG_RW_LOCK) {
+                //  Writers now wait for this reader to withdraw, read without modifying the tag
+                return EMSreadElement<mapped, EMS_TAG_ANY, EMS_TAG_ANY>(region, idx, returnValue, view);
+            }
+            //  A writer holds the element, withdraw so the writer is not blocked while waiting
+            EMSreaderWithdraw(emsBuf, idx);
+            NANOSLEEP;
         }
     }
+
+    return EMSreadElement<mapped, initialFE, finalFE>(region, idx, returnValue, view);
+}
+
+
+//==================================================================
+//  Read the element at an index as EMSread reads the element of a key,
+//  without looking up the key or touching the map tag.  Strings and JSON
+//  may be returned in place in the heap as by EMSread.
+bool EMSreadIndex(const EMSregion *region, int64_t idx, EMSvalueType *returnValue) {
+    if (region->regionFlags & EMS_REGION_OPTIMISTIC_READS) {
+        return EMSreadOptimistic(region->buf, idx, returnValue, false, NULL);
+    }
+    if (region->regionFlags & EMS_REGION_EPOCHS) {
+        return EMSreadEpoch(region->buf, idx, returnValue);
+    }
+    return EMSreadElement<false, EMS_TAG_ANY, EMS_TAG_ANY>(region, idx, returnValue, NULL);
 }
 
 
 //==================================================================
 //  Read under multiple readers-single writer lock
 bool EMSreadRW(const int mmapID, EMSvalueType *key, EMSvalueType *returnValue) {
-    return EMSreadUsingTags(mmapID, key, returnValue, EMS_TAG_RW_LOCK, EMS_TAG_RW_LOCK);
+    return emsRegions[mmapID].readRW(mmapID, key, returnValue, NULL);
 }
 
 
 //==================================================================
 //  Read when full and leave empty
 bool EMSreadFE(const int mmapID, EMSvalueType *key, EMSvalueType *returnValue) {
-    return EMSreadUsingTags(mmapID, key, returnValue, EMS_TAG_FULL, EMS_TAG_EMPTY);
+    return emsRegions[mmapID].readFE(mmapID, key, returnValue, NULL);
 }
 
 
 //==================================================================
 //  Read when full and leave Full
 bool EMSreadFF(const int mmapID, EMSvalueType *key, EMSvalueType *returnValue) {
-    return EMSreadUsingTags(mmapID, key, returnValue, EMS_TAG_FULL, EMS_TAG_FULL);
+    return emsRegions[mmapID].readFF(mmapID, key, returnValue, NULL);
 }
 
 
 //==================================================================
 //   Wrapper around read
 bool EMSread(const int mmapID, EMSvalueType *key, EMSvalueType *returnValue) {
-    return EMSreadUsingTags(mmapID, key, returnValue, EMS_TAG_ANY, EMS_TAG_ANY);
+    return emsRegions[mmapID].readAny(mmapID, key, returnValue, NULL);
+}
+
+
+//==================================================================
+//  Read a string or blob in place when full and leave it full.  The value
+//  is not freed, even if it is replaced, until the view is released.
+//  Other types, and short values stored inline in their data word, are
+//  returned as by EMSreadFF and the view is -1.
+bool EMSreadView(const int mmapID, EMSvalueType *key, EMSvalueType *returnValue, int64_t *view) {
+    *view = -1;
+    return emsRegions[mmapID].readFF(mmapID, key, returnValue, view);
+}
+
+
+//==================================================================
+//  Release a view returned by EMSreadView, freeing the value if it was
+//  replaced and this was the last view of it
+bool EMSreleaseView(const int mmapID, int64_t view) {
+    void *emsBuf = emsBufs[mmapID];
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    if (view < 0) return true;
+    if (view >= bufInt64[EMScbData(EMS_ARR_FILESZ)] - bufInt64[EMScbData(EMS_ARR_HEAPBOT)]  ||
+        *((unsigned char *) EMSheapPtr(view)) != EMS_VALUE_COUNTED) {
+        fprintf(stderr, "EMSreleaseView: %" PRId64 " is not a view\n", view);
+        return false;
+    }
+    if (__sync_sub_and_fetch((uint32_t *) (EMSheapPtr(view) + EMS_COUNTED_VIEWS), 1) == EMS_VIEW_ORPHANED) {
+        EMSretire(emsBuf, view);
+    }
+    return true;
 }
 
 
@@ -531,16 +1642,21 @@ bool EMSread(const int mmapID, EMSvalueType *key, EMSvalueType *returnValue) {
 //  Decrement the reference count of the multiple readers-single writer lock
 int EMSreleaseRW(const int mmapID, EMSvalueType *key) {
     RESET_NAP_TIME;
-    void *emsBuf = emsBufs[mmapID];
-    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    const EMSregion *region = &emsRegions[mmapID];
+    void *emsBuf = region->buf;
     volatile EMStag_t *bufTags = (EMStag_t *) emsBuf;
     EMStag_t newTag, oldTag;
-    int64_t idx = EMSkey2index(emsBuf, key, EMSisMapped);
-    if (idx < 0 || idx >= bufInt64[EMScbData(EMS_ARR_NELEM)]) {
+    int64_t idx = EMSkey2index(region, key, EMSisMapped);
+    if (idx < 0 || idx >= region->nElements) {
         fprintf(stderr, "EMSreleaseRW: invalid index (%" PRIi64 ")\n", idx);
         return -1;
     }
 
+    //  Readers announced in the reader indicators did not modify the tag
+    if ((region->regionFlags & EMS_REGION_SCALABLE_RW)  &&  EMSreaderWithdraw(emsBuf, idx)) {
+        return 0;
+    }
+
     while (true) {
         oldTag.byte = bufTags[EMSdataTag(idx)].byte;
         newTag.byte = oldTag.byte;
@@ -576,37 +1692,90 @@ int EMSreleaseRW(const int mmapID, EMSvalueType *key) {
 
 
 //==================================================================
-//  Write EMS honoring the F/E tags
-bool EMSwriteUsingTags(int mmapID,
-                       EMSvalueType *key,
-                       EMSvalueType *value,
-                       unsigned char initialFE,             // Block until F/E tags are this value
-                       unsigned char finalFE)               // Set the tag to this value when done
+//  Store a value in an element held BUSY by the caller, freeing the
+//  string the element held before once it is replaced.  The caller sets the tag's type.
+bool EMSstoreValue(void *emsBuf,
+                   int64_t idx,
+                   unsigned char oldType,  // Type of the value being replaced
+                   EMSvalueType *value,
+                   int64_t stored)         // Heap copy of the value already made, or EMS_HEAP_NULL
 {
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    volatile double *bufDouble = (double *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+
+    int64_t oldOffset = bufInt64[EMSdataData(idx)];
+
+    // Store argument value into EMS memory
+    switch (value->type) {
+        case EMS_TYPE_BOOLEAN:
+            bufInt64[EMSdataData(idx)] = (int64_t) value->value;
+            break;
+        case EMS_TYPE_INTEGER:
+            bufInt64[EMSdataData(idx)] = (int64_t) value->value;
+            break;
+        case EMS_TYPE_FLOAT: {
+            EMSulong_double alias;
+            alias.u64 = (uint64_t) value->value;
+            bufDouble[EMSdataData(idx)] = alias.d;
+        }
+            break;
+        case EMS_TYPE_JSON:
+        case EMS_TYPE_BLOB:
+        case EMS_TYPE_STRING: {
+            int64_t textOffset = stored;
+            if (textOffset == EMS_HEAP_NULL) {
+                EMS_CHECK_LENGTH(value, "EMSstoreValue", false);
+                EMS_STORE_VALUE(textOffset, value, "EMSstoreValue: out of memory to store string", false);
+            }
+            bufInt64[EMSdataData(idx)] = textOffset;
+        }
+            break;
+        case EMS_TYPE_UNDEFINED:
+            bufInt64[EMSdataData(idx)] = 0xdeadbeef;
+            break;
+        default:
+            fprintf(stderr, "EMSstoreValue: Unknown arg type\n");
+            return false;
+    }
+    //  If the old data was a string, free it now that it has been overwritten
+    if (EMSisHeapType(oldType)) {
+        EMS_FREE_VALUE(oldOffset);
+    }
+    return true;
+}
+
+
+//==================================================================
+//  Write an element honoring the F/E tags.  Block until the tag is initialFE
+//  and set it to finalFE when done, either may be EMS_TAG_ANY.  The map key
+//  of a mapped element is set FULL when the write is done.
+template <bool mapped, unsigned char initialFE, unsigned char finalFE>
+static bool EMSwriteElement(const EMSregion *region, int64_t idx, EMSvalueType *value, int64_t stored) {
     RESET_NAP_TIME;
-    char *emsBuf = emsBufs[mmapID];
+    char *emsBuf = region->buf;
     volatile EMStag_t *bufTags = (EMStag_t *) emsBuf;
     volatile int64_t *bufInt64 = (int64_t *) emsBuf;
-    volatile double *bufDouble = (double *) emsBuf;
     char *bufChar = emsBuf;
     EMStag_t newTag, oldTag, memTag;
-    int64_t idx = EMSwriteIndexMap(mmapID, key);
-    if (idx < 0) {
-        fprintf(stderr, "EMSwriteUsingTags: index out of bounds\n");
-        return false;
-    }
+    EMSholdGuard hold = {NULL};
+    bool waited = false;
+    int nLongNaps = 0;
+    struct timespec waitStart;
 
     // Wait for the memory to be in the initial F/E state and transition to Busy
     if (initialFE != EMS_TAG_ANY) {
         volatile EMStag_t *maptag;
-        if (EMSisMapped) { maptag = &bufTags[EMSmapTag(idx)]; }
+        if (mapped) { maptag = &bufTags[EMSmapTag(idx)]; }
         else             { maptag = NULL; }
-        EMStransitionFEtag(&bufTags[EMSdataTag(idx)], maptag,
-                           initialFE, EMS_TAG_BUSY, EMS_TAG_ANY);
+        oldTag.byte = EMStransitionFEtag(&bufTags[EMSdataTag(idx)], maptag,
+                                         initialFE, EMS_TAG_BUSY, EMS_TAG_ANY);
+        oldTag.tags.fe = initialFE;
+        hold.hold = EMSholdTag(emsBuf, idx, oldTag.byte);
     }
 
     while (true) {
-        idx = idx % bufInt64[EMScbData(EMS_ARR_NELEM)];
+        idx = idx % region->nElements;
         memTag.byte = bufTags[EMSdataTag(idx)].byte;
         //  Wait until FE tag is not BUSY
         if (initialFE != EMS_TAG_ANY || finalFE == EMS_TAG_ANY || memTag.tags.fe != EMS_TAG_BUSY) {
@@ -616,40 +1785,12 @@ bool EMSwriteUsingTags(int mmapID,
             //  Transition FE from !BUSY to BUSY
             if (initialFE != EMS_TAG_ANY || finalFE == EMS_TAG_ANY ||
                 __sync_bool_compare_and_swap(&(bufTags[EMSdataTag(idx)].byte), oldTag.byte, newTag.byte)) {
-                //  If the old data was a string, free it because it will be overwritten
-                if (oldTag.tags.type == EMS_TYPE_STRING || oldTag.tags.type == EMS_TYPE_JSON) {
-                    EMS_FREE(bufInt64[EMSdataData(idx)]);
-                }
-
-                // Store argument value into EMS memory
-                switch (value->type) {
-                    case EMS_TYPE_BOOLEAN:
-                        bufInt64[EMSdataData(idx)] = (int64_t) value->value;
-                        break;
-                    case EMS_TYPE_INTEGER:
-                        bufInt64[EMSdataData(idx)] = (int64_t) value->value;
-                        break;
-                    case EMS_TYPE_FLOAT: {
-                        EMSulong_double alias;
-                        alias.u64 = (uint64_t) value->value;
-                        bufDouble[EMSdataData(idx)] = alias.d;
-                    }
-                        break;
-                    case EMS_TYPE_JSON:
-                    case EMS_TYPE_STRING: {
-                        int64_t textOffset;
-                        EMS_ALLOC(textOffset, value->length + 1, bufChar,  // NULL padding at end
-                                  "EMSwriteUsingTags: out of memory to store string", false);
-                        bufInt64[EMSdataData(idx)] = textOffset;
-                        strcpy(EMSheapPtr(textOffset), (const char *) value->value);
-                    }
-                        break;
-                    case EMS_TYPE_UNDEFINED:
-                        bufInt64[EMSdataData(idx)] = 0xdeadbeef;
-                        break;
-                    default:
-                        fprintf(stderr, "EMSwriteUsingTags: Unknown arg type\n");
-                        return false;
+                if (waited) EMSwaitEnd(region, EMS_STAT_TAG_WAITS, &waitStart, &bufTags[EMSdataTag(idx)]);
+                if (initialFE == EMS_TAG_ANY  &&  finalFE != EMS_TAG_ANY) hold.hold = EMSholdTag(emsBuf, idx, oldTag.byte);
+                EMS_VERSION_BEGIN_WRITE(idx);
+                if (!EMSstoreValue(emsBuf, idx, oldTag.tags.type, value, stored)) {
+                    EMS_VERSION_END_WRITE(idx);
+                    return false;
                 }
 
                 oldTag.byte = newTag.byte;
@@ -659,13 +1800,15 @@ bool EMSwriteUsingTags(int mmapID,
                 }
                 newTag.tags.type = value->type;
                 if (finalFE != EMS_TAG_ANY && bufTags[EMSdataTag(idx)].byte != oldTag.byte) {
-                    fprintf(stderr, "EMSwriteUsingTags: Lost tag lock while BUSY\n");
+                    fprintf(stderr, "EMSwriteElement: Lost tag lock while BUSY\n");
                     return false;
                 }
 
                 //  Set the tags for the data (and map, if used) back to full to finish the operation
+                hold.release();
                 bufTags[EMSdataTag(idx)].byte = newTag.byte;
-                if (EMSisMapped) bufTags[EMSmapTag(idx)].tags.fe = EMS_TAG_FULL;
+                EMS_VERSION_END_WRITE(idx);
+                if (mapped) bufTags[EMSmapTag(idx)].tags.fe = EMS_TAG_FULL;
                 return true;
             } else {
                 // Tag was marked BUSY between test read and CAS, must retry
@@ -674,33 +1817,289 @@ bool EMSwriteUsingTags(int mmapID,
             // Tag was already marked BUSY, must retry
         }
         //  Failed to set the tags, sleep and retry
+        if (!waited) {
+            waited = true;
+            EMSwaitBegin(region, &waitStart);
+        }
         NANOSLEEP;
+        if (EMS_STUCK_CHECK(nLongNaps)) EMSrecoverTag(&bufTags[EMSdataTag(idx)]);
+    }
+}
+
+
+//==================================================================
+//  Write EMS honoring the F/E tags.  Block until the tag is initialFE
+//  and set it to finalFE when done, either may be EMS_TAG_ANY.
+template <bool mapped, unsigned char initialFE, unsigned char finalFE>
+static bool EMSwriteUsingTags(int mmapID, EMSvalueType *key, EMSvalueType *value) {
+    const EMSregion *region = &emsRegions[mmapID];
+    int64_t idx = EMSwriteIndex<mapped>(mmapID, region, key);
+    if (idx < 0) {
+        fprintf(stderr, "EMSwriteUsingTags: index out of bounds\n");
+        return false;
     }
+    return EMSwriteElement<mapped, initialFE, finalFE>(region, idx, value, EMS_HEAP_NULL);
 }
 
 
 //==================================================================
 //  WriteXF
 bool EMSwriteXF(int mmapID, EMSvalueType *key, EMSvalueType *value) {
-    return EMSwriteUsingTags(mmapID, key, value, EMS_TAG_ANY, EMS_TAG_FULL);
+    return emsRegions[mmapID].writeXF(mmapID, key, value);
 }
 
 //==================================================================
 //  WriteXE
 bool EMSwriteXE(int mmapID, EMSvalueType *key, EMSvalueType *value) {
-    return EMSwriteUsingTags(mmapID, key, value, EMS_TAG_ANY, EMS_TAG_EMPTY);
+    return emsRegions[mmapID].writeXE(mmapID, key, value);
 }
 
 //==================================================================
 //  WriteEF
 bool EMSwriteEF(int mmapID, EMSvalueType *key, EMSvalueType *value) {
-    return EMSwriteUsingTags(mmapID, key, value, EMS_TAG_EMPTY, EMS_TAG_FULL);
+    return emsRegions[mmapID].writeEF(mmapID, key, value);
 }
 
 //==================================================================
 //  Write
 bool EMSwrite(int mmapID, EMSvalueType *key, EMSvalueType *value) {
-    return EMSwriteUsingTags(mmapID, key, value, EMS_TAG_ANY, EMS_TAG_ANY);
+    return emsRegions[mmapID].writeAny(mmapID, key, value);
+}
+
+
+//==================================================================
+//  Bulk writes
+//  EMSwriteMany writes a batch of elements as EMSwrite does.  Processes
+//  building a map in parallel each write their own part of the keys.
+//  The keys of a batch are hashed first and placed in the order of their
+//  home slots, so the probes of a batch sweep the map once.  Map keys are
+//  not changed once written, so FULL map keys are compared without marking
+//  them BUSY, only unused slots are marked BUSY to be claimed.  The heap
+//  copies of a batch's keys and values are allocated holding the allocator's
+//  lock once, and the copies of keys found in the map are freed together.
+typedef struct {
+    int64_t home;   // Map slot the key hashes to, or the element's index
+    int64_t itemN;  // Position of the key in the batch
+} EMSbatchItem;
+
+
+//  Order of placement, keys with the same home keep their order in the batch
+static int EMSbatchOrder(const void *a, const void *b) {
+    const EMSbatchItem *itemA = (const EMSbatchItem *) a;
+    const EMSbatchItem *itemB = (const EMSbatchItem *) b;
+    if (itemA->home != itemB->home) return (itemA->home < itemB->home) ? -1 : 1;
+    return (itemA->itemN < itemB->itemN) ? -1 : (itemA->itemN > itemB->itemN);
+}
+
+
+//  Store a string, blob, or JSON value whose copy was not made with its batch
+static int64_t EMSbatchStore(void *emsBuf, EMSvalueType *value) {
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    int64_t word;
+    EMS_STORE_VALUE(word, value, "EMSwriteMany: out of memory to store string", EMS_HEAP_NULL);
+    return word;
+}
+
+
+//  Find the map slot of a key starting at its home slot, or claim the first
+//  unused slot for it, leaving its map tag BUSY until the element is written.
+//  keyWord is the key's data word if it is a string, and is set to
+//  EMS_HEAP_NULL if the key was stored in the slot.  claimed is set if
+//  the slot was claimed for the key.
+//  Returns the index of the element, or -1 if the map is full.
+static int64_t EMSbatchIndexMap(const EMSregion *region, EMSvalueType *key, int64_t home, int64_t *keyWord,
+                                bool *claimed) {
+    char *emsBuf = region->buf;
+    volatile int64_t  *bufInt64  = (int64_t *) emsBuf;
+    volatile EMStag_t *bufTags   = (EMStag_t *) emsBuf;
+    volatile double   *bufDouble = (double *) emsBuf;
+    EMSulong_double alias;
+    alias.u64 = (uint64_t) key->value;
+    int64_t idx = home;
+    for (int nTries = 0;  nTries < MAX_OPEN_HASH_STEPS;  nTries++, idx++) {
+        idx = idx % region->nElements;
+        EMStag_t mapTags;
+        mapTags.byte = bufTags[EMSmapTag(idx)].byte;
+        bool locked = (mapTags.tags.fe != EMS_TAG_FULL  ||  mapTags.tags.type == EMS_TYPE_UNDEFINED);
+        if (locked) {
+            mapTags.byte = EMStransitionFEtag(&bufTags[EMSmapTag(idx)], NULL, EMS_TAG_FULL, EMS_TAG_BUSY, EMS_TAG_ANY);
+        }
+        bool matched = false;
+        if (mapTags.tags.type == EMS_TYPE_UNDEFINED) {
+            //  Unused slot, the key is not in the map
+            bufTags[EMSmapTag(idx)].tags.type = key->type;
+            switch (key->type) {
+                case EMS_TYPE_BOOLEAN:
+                    bufInt64[EMSmapData(idx)] = ((int64_t) key->value != 0);
+                    break;
+                case EMS_TYPE_INTEGER:
+                    bufInt64[EMSmapData(idx)] = (int64_t) key->value;
+                    break;
+                case EMS_TYPE_FLOAT:
+                    bufDouble[EMSmapData(idx)] = alias.d;
+                    break;
+                default:
+                    bufInt64[EMSmapData(idx)] = *keyWord;
+                    *keyWord = EMS_HEAP_NULL;
+            }
+            matched = true;
+            locked = false;
+            *claimed = true;
+        } else if (mapTags.tags.type == key->type) {
+            switch (key->type) {
+                case EMS_TYPE_BOOLEAN:
+                    matched = (((int64_t) key->value != 0) == (bufInt64[EMSmapData(idx)] != 0));
+                    break;
+                case EMS_TYPE_INTEGER:
+                    matched = ((int64_t) key->value == bufInt64[EMSmapData(idx)]);
+                    break;
+                case EMS_TYPE_FLOAT:
+                    matched = (alias.d == bufDouble[EMSmapData(idx)]);
+                    break;
+                default:
+                    matched = EMSkeyEquals(emsBuf, key, bufInt64[EMSmapData(idx)], *keyWord);
+            }
+        }
+        if (locked) bufTags[EMSmapTag(idx)].tags.fe = EMS_TAG_FULL;
+        if (matched) {
+            if (region->stats != NULL) {
+                EMS_STAT_ADD(region, EMS_STAT_LOOKUPS, 1);
+                EMS_STAT_ADD(region, EMS_STAT_PROBES, nTries + 1);
+            }
+            return idx;
+        }
+    }
+    fprintf(stderr, "EMSwriteMany ran out of key mappings (ntries=%d)\n", MAX_OPEN_HASH_STEPS);
+    return -1;
+}
+
+
+//  Return a map slot claimed for a key whose element could not be written to
+//  the unused slots.  Processes looking up keys wait while the slot is BUSY.
+static void EMSbatchUnclaim(const EMSregion *region, EMSvalueType *key, int64_t idx) {
+    char *emsBuf = region->buf;
+    volatile int64_t  *bufInt64 = (int64_t *) emsBuf;
+    volatile EMStag_t *bufTags  = (EMStag_t *) emsBuf;
+    char *bufChar = emsBuf;
+    if (key->type == EMS_TYPE_STRING) {
+        int64_t keyWord = bufInt64[EMSmapData(idx)];
+        EMS_FREE_VALUE(keyWord);
+    }
+    bufTags[EMSmapTag(idx)].tags.type = EMS_TYPE_UNDEFINED;
+    bufTags[EMSmapTag(idx)].tags.fe = EMS_TAG_FULL;
+}
+
+
+//==================================================================
+//  Write a batch of values to their keys as EMSwrite does.  Equal keys in
+//  one batch are written in order, so the value of the last one remains.
+//  Returns the number of elements written, or -1 on error.
+//
+int64_t EMSwriteMany(int mmapID, int64_t nItems, EMSvalueType *keys, EMSvalueType *values) {
+    const EMSregion *region = &emsRegions[mmapID];
+    char *emsBuf = region->buf;
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = emsBuf;
+    if (nItems <= 0) return 0;
+
+    //  The heap copies of item i's key and value are stored[2i] and stored[2i + 1]
+    EMSbatchItem *order = (EMSbatchItem *) malloc((size_t) nItems * sizeof(EMSbatchItem));
+    size_t *lens = (size_t *) malloc((size_t) nItems * 2 * sizeof(size_t));
+    int64_t *stored = (int64_t *) malloc((size_t) nItems * 2 * sizeof(int64_t));
+    if (order == NULL  ||  lens == NULL  ||  stored == NULL) {
+        fprintf(stderr, "EMSwriteMany: Unable to allocate a batch of %" PRId64 " items\n", nItems);
+        free(order);
+        free(lens);
+        free(stored);
+        return -1;
+    }
+
+    //  Hash the keys and size their copies and the copies of the values
+    int64_t nWritten = 0;
+    int64_t nCopies = 0;
+    bool ordered = true;
+    for (int64_t itemN = 0;  itemN < nItems  &&  nWritten >= 0;  itemN++) {
+        EMSvalueType *key = &keys[itemN];
+        EMSvalueType *value = &values[itemN];
+        order[itemN].itemN = itemN;
+        order[itemN].home = EMSisMapped ? EMSkey2index(region, key, false) : EMSkeyIndex<false>(region, key);
+        stored[2 * itemN] = EMS_HEAP_NULL;
+        stored[2 * itemN + 1] = EMS_HEAP_NULL;
+        lens[2 * itemN] = 0;
+        lens[2 * itemN + 1] = 0;
+        if (itemN > 0  &&  order[itemN].home < order[itemN - 1].home) ordered = false;
+        if (order[itemN].home < 0) {
+            nWritten = -1;
+        } else if (EMSisHeapType(value->type)  &&  value->type != EMS_TYPE_JSON  &&
+                   value->length > EMS_MAX_VALUE_LEN) {
+            fprintf(stderr, "EMSwriteMany: value of %zu bytes is too long to store\n", (size_t) value->length);
+            nWritten = -1;
+        }
+        if (EMSisMapped  &&  key->type == EMS_TYPE_STRING  &&  !EMSinlineable(key)  &&  !EMSinterning(key)) {
+            lens[2 * itemN] = EMSheapBytes(key);
+        }
+        if (EMSisHeapType(value->type)  &&  !EMSinlineable(value)  &&  !EMSinterning(value)) {
+            lens[2 * itemN + 1] = EMSheapBytes(value);
+        }
+        nCopies += (lens[2 * itemN] != 0) + (lens[2 * itemN + 1] != 0);
+    }
+    if (nWritten < 0) nCopies = 0;
+
+    if (nWritten >= 0  &&  nCopies > 0) {
+        //  Copies that could not be allocated are stored one at a time, after epochs reclaim what they can
+        emsMutexMem_allocMany(EMS_MEM_MALLOCBOT(bufChar), 2 * nItems, lens, stored,
+                              (char *) &bufInt64[EMScbData(EMS_ARR_MEM_MUTEX)]);
+        for (int64_t itemN = 0;  itemN < nItems;  itemN++) {
+            if (stored[2 * itemN] >= 0) EMSheapStore((char *) EMSheapPtr(stored[2 * itemN]), &keys[itemN]);
+            if (stored[2 * itemN + 1] >= 0) EMSheapStore((char *) EMSheapPtr(stored[2 * itemN + 1]), &values[itemN]);
+        }
+    }
+
+    //  Place the keys in the order of their home slots and write their values
+    if (nWritten >= 0  &&  !ordered) qsort(order, (size_t) nItems, sizeof(EMSbatchItem), EMSbatchOrder);
+    for (int64_t orderN = 0;  orderN < nItems  &&  nWritten >= 0;  orderN++) {
+        int64_t itemN = order[orderN].itemN;
+        EMSvalueType *key = &keys[itemN];
+        int64_t idx = order[orderN].home;
+        bool written;
+        if (EMSisMapped) {
+            int64_t keyWord = stored[2 * itemN];
+            bool keyCopied = (keyWord != EMS_HEAP_NULL);
+            bool claimed = false;
+            if (key->type == EMS_TYPE_STRING  &&  !keyCopied) keyWord = EMSbatchStore(emsBuf, key);
+            idx = (key->type == EMS_TYPE_STRING  &&  keyWord == EMS_HEAP_NULL) ? -1 :
+                  EMSbatchIndexMap(region, key, idx, &keyWord, &claimed);
+            //  A copy made with the batch is freed with it, keys stored alone are released now
+            if (keyCopied) {
+                stored[2 * itemN] = keyWord;
+            } else if (key->type == EMS_TYPE_STRING  &&  keyWord != EMS_HEAP_NULL) {
+                EMS_FREE_VALUE(keyWord);
+            }
+            written = (idx >= 0)  &&
+                      EMSwriteElement<true, EMS_TAG_ANY, EMS_TAG_ANY>(region, idx, &values[itemN], stored[2 * itemN + 1]);
+            if (!written  &&  claimed) EMSbatchUnclaim(region, key, idx);
+        } else {
+            written = EMSwriteElement<false, EMS_TAG_ANY, EMS_TAG_ANY>(region, idx, &values[itemN], stored[2 * itemN + 1]);
+        }
+        if (written) {
+            stored[2 * itemN + 1] = EMS_HEAP_NULL;
+            nWritten++;
+        } else {
+            fprintf(stderr, "EMSwriteMany: Unable to write item %" PRId64 " of the batch\n", itemN);
+            nWritten = -1;
+        }
+    }
+
+    //  Free the copies of keys already in the map and of values not written
+    if (nCopies > 0) {
+        emsMutexMem_freeMany(EMS_MEM_MALLOCBOT(bufChar), 2 * nItems, stored,
+                             (char *) &bufInt64[EMScbData(EMS_ARR_MEM_MUTEX)]);
+    }
+    free(order);
+    free(lens);
+    free(stored);
+    return nWritten;
 }
 
 
@@ -708,13 +2107,13 @@ bool EMSwrite(int mmapID, EMSvalueType *key, EMSvalueType *value) {
 //  Set only the Full/Empty tag  from JavaScript 
 //  without inspecting or modifying the data.
 bool EMSsetTag(int mmapID, EMSvalueType *key, bool is_full) {
-    void *emsBuf = emsBufs[mmapID];
+    const EMSregion *region = &emsRegions[mmapID];
+    void *emsBuf = region->buf;
     volatile EMStag_t *bufTags = (EMStag_t *) emsBuf;
-    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
     EMStag_t tag;
 
-    int64_t idx = EMSkey2index(emsBuf, key, EMSisMapped);
-    if (idx < 0 || idx >= bufInt64[EMScbData(EMS_ARR_NELEM)]) {
+    int64_t idx = EMSkey2index(region, key, EMSisMapped);
+    if (idx < 0 || idx >= region->nElements) {
         return false;
     }
 
@@ -733,6 +2132,12 @@ bool EMSsetTag(int mmapID, EMSvalueType *key, bool is_full) {
 //  Release all the resources associated with an EMS array
 bool EMSdestroy(int mmapID, bool do_unlink) {
     void *emsBuf = emsBufs[mmapID];
+    //  A process detaching from the domain's control block leaves the registry
+    if (emsDomainPids != NULL  &&  (char *) emsDomainPids >= (char *) emsBuf  &&
+        (char *) emsDomainPids < (char *) emsBuf + emsBufLengths[mmapID]) {
+        EMSderegister();
+        emsDomainPids = NULL;
+    }
     if(munmap(emsBuf, emsBufLengths[mmapID]) != 0) {
         fprintf(stderr, "EMSdestroy: Unable to unmap memory\n");
         return false;
@@ -748,15 +2153,69 @@ bool EMSdestroy(int mmapID, bool do_unlink) {
     emsBufFilenames[mmapID][0] = 0;
     emsBufLengths[mmapID] = 0;
     emsBufs[mmapID] = NULL;
+    memset(&emsRegions[mmapID], 0, sizeof(EMSregion));
     return true;
 }
 
 
 
+//==================================================================
+//  Select the access kernels of a region once, when it is attached
+static void EMSregionKernels(EMSregion *region) {
+    if (region->isMapped) {
+        region->readAny  = EMSreadUsingTags<true, EMS_TAG_ANY, EMS_TAG_ANY>;
+        region->readFF   = EMSreadUsingTags<true, EMS_TAG_FULL, EMS_TAG_FULL>;
+        region->readFE   = EMSreadUsingTags<true, EMS_TAG_FULL, EMS_TAG_EMPTY>;
+        region->readRW   = EMSreadUsingTags<true, EMS_TAG_RW_LOCK, EMS_TAG_RW_LOCK>;
+        region->writeAny = EMSwriteUsingTags<true, EMS_TAG_ANY, EMS_TAG_ANY>;
+        region->writeXF  = EMSwriteUsingTags<true, EMS_TAG_ANY, EMS_TAG_FULL>;
+        region->writeXE  = EMSwriteUsingTags<true, EMS_TAG_ANY, EMS_TAG_EMPTY>;
+        region->writeEF  = EMSwriteUsingTags<true, EMS_TAG_EMPTY, EMS_TAG_FULL>;
+    } else {
+        region->readAny  = EMSreadUsingTags<false, EMS_TAG_ANY, EMS_TAG_ANY>;
+        region->readFF   = EMSreadUsingTags<false, EMS_TAG_FULL, EMS_TAG_FULL>;
+        region->readFE   = EMSreadUsingTags<false, EMS_TAG_FULL, EMS_TAG_EMPTY>;
+        region->readRW   = EMSreadUsingTags<false, EMS_TAG_RW_LOCK, EMS_TAG_RW_LOCK>;
+        region->writeAny = EMSwriteUsingTags<false, EMS_TAG_ANY, EMS_TAG_ANY>;
+        region->writeXF  = EMSwriteUsingTags<false, EMS_TAG_ANY, EMS_TAG_FULL>;
+        region->writeXE  = EMSwriteUsingTags<false, EMS_TAG_ANY, EMS_TAG_EMPTY>;
+        region->writeEF  = EMSwriteUsingTags<false, EMS_TAG_EMPTY, EMS_TAG_FULL>;
+    }
+    EMSrmwKernels(region);
+}
+
+
+//==================================================================
+//  Describe a region initialized by this or another process from its control block
+static void EMSregionDescribe(EMSregion *region, char *emsBuf, int64_t nElements) {
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = emsBuf;
+    memset(region, 0, sizeof(EMSregion));
+    region->buf = emsBuf;
+    if (nElements > 0) {   // Not the EMS control block
+        region->nElements = bufInt64[EMScbData(EMS_ARR_NELEM)];
+        region->isMapped = bufInt64[EMScbData(EMS_ARR_MAPBOT)] * (int64_t) EMSwordSize !=
+                           bufInt64[EMScbData(EMS_ARR_MALLOCBOT)];
+    }
+    EMSregionKernels(region);
+    if (nElements <= 0) return;
+    if (bufInt64[EMScbData(EMS_ARR_READERS)] != 0)  region->regionFlags |= EMS_REGION_SCALABLE_RW;
+    if (bufInt64[EMScbData(EMS_ARR_VERSIONS)] != 0) region->regionFlags |= EMS_REGION_OPTIMISTIC_READS;
+    if (bufInt64[EMScbData(EMS_ARR_EPOCHS)] != 0)   region->regionFlags |= EMS_REGION_EPOCHS;
+    if (bufInt64[EMScbData(EMS_ARR_INTERN)] != 0)   region->regionFlags |= EMS_REGION_INTERN;
+    if (bufInt64[EMScbData(EMS_ARR_HOLDERS)] != 0)  region->regionFlags |= EMS_REGION_RECOVERY;
+    if (bufInt64[EMScbData(EMS_ARR_STATS)] != 0) {
+        region->regionFlags |= EMS_REGION_STATS;
+        region->stats = EMSstatsLine(EMSmyID % bufInt64[EMScbData(EMS_ARR_STATS + 1)]);
+    }
+}
+
+
 //==================================================================
 //  Return the key of a mapped object given the EMS index
 bool EMSindex2key(int mmapID, int64_t idx, EMSvalueType *key) {
-    void *emsBuf = emsBufs[mmapID];
+    const EMSregion *region = &emsRegions[mmapID];
+    void *emsBuf = region->buf;
     volatile int64_t *bufInt64 = (int64_t *) emsBuf;
     char *bufChar = (char *) emsBuf;
     volatile EMStag_t *bufTags = (EMStag_t *) emsBuf;
@@ -767,7 +2226,7 @@ bool EMSindex2key(int mmapID, int64_t idx, EMSvalueType *key) {
         return false;
     }
 
-    if (idx < 0 || idx >= bufInt64[EMScbData(EMS_ARR_NELEM)]) {
+    if (idx < 0 || idx >= region->nElements) {
         fprintf(stderr, "EMSindex2key: index out of bounds\n");
         return false;
     }
@@ -787,7 +2246,8 @@ bool EMSindex2key(int mmapID, int64_t idx, EMSvalueType *key) {
         }
         case EMS_TYPE_JSON:
         case EMS_TYPE_STRING: {
-            key->value = (void *)(EMSheapPtr(bufInt64[EMSmapData(idx)]));
+            int64_t keyWord = bufInt64[EMSmapData(idx)];
+            key->value = (void *) EMSwordData(key->type, keyWord, EMSinlineReturnBuf, &key->length);
             return true;
         }
         case EMS_TYPE_UNDEFINED: {
@@ -811,6 +2271,124 @@ bool EMSsync(int mmapID) {
 }
 
 
+//==================================================================
+//  Sum the performance counters of every process, optionally resetting
+//  them, and sample the heap and the stack or queue of the region.
+//  Counts made while the counters are being reset may be lost.
+bool EMSstats(int mmapID, EMSstatsType *stats, bool reset) {
+    const EMSregion *region = &emsRegions[mmapID];
+    char *bufChar = region->buf;
+    volatile int64_t *bufInt64 = (int64_t *) bufChar;
+    memset(stats, 0, sizeof(EMSstatsType));
+    if (region->nElements <= 0) {
+        fprintf(stderr, "EMSstats: region %d has no elements\n", mmapID);
+        return false;
+    }
+
+    if (region->stats != NULL) {
+        for (int64_t line = 0;  line < bufInt64[EMScbData(EMS_ARR_STATS + 1)];  line++) {
+            volatile int64_t *counters = EMSstatsLine(line);
+            stats->tagWaits    += counters[EMS_STAT_TAG_WAITS];
+            stats->tagWaitNs   += counters[EMS_STAT_TAG_WAIT_NS];
+            stats->lookups     += counters[EMS_STAT_LOOKUPS];
+            stats->probes      += counters[EMS_STAT_PROBES];
+            stats->allocWaits  += counters[EMS_STAT_ALLOC_WAITS];
+            stats->allocWaitNs += counters[EMS_STAT_ALLOC_WAIT_NS];
+            stats->allocFails  += counters[EMS_STAT_ALLOC_FAILS];
+            if (reset) memset((void *) counters, 0, EMS_CACHELINE_SZ);
+        }
+        if (reset) EMShotRing[EMS_HOT_RING_BASE] = EMShotRing[EMS_HOT_RING_COUNT];
+    }
+
+    size_t bytesFree, largestFree;
+    volatile char *mutex = (char *) &bufInt64[EMScbData(EMS_ARR_MEM_MUTEX)];
+    EMSallocLock(mutex);
+    emsMem_usage(EMS_MEM_MALLOCBOT(bufChar), &bytesFree, &largestFree);
+    EMSallocUnlock(mutex);
+    stats->heapFree = (int64_t) bytesFree;
+    stats->heapLargestFree = (int64_t) largestFree;
+    stats->depth = bufInt64[EMScbData(EMS_ARR_STACKTOP)] - bufInt64[EMScbData(EMS_ARR_Q_BOTTOM)];
+    return true;
+}
+
+
+//==================================================================
+//  Sum the sampled waits of each tag in the region's ring, filling in
+//  up to maxSpots tags in order of decreasing time spent waiting on them.
+//  Returns the number of tags filled in, or -1 if the region does not count.
+static int EMShotspotCompare(const void *left, const void *right) {
+    int64_t leftNs = ((const EMShotspotType *) left)->waitNs;
+    int64_t rightNs = ((const EMShotspotType *) right)->waitNs;
+    return (leftNs < rightNs) - (leftNs > rightNs);
+}
+
+
+int EMShotspots(int mmapID, EMShotspotType *spots, int maxSpots) {
+    const EMSregion *region = &emsRegions[mmapID];
+    char *bufChar = region->buf;
+    volatile int64_t *bufInt64 = (int64_t *) bufChar;
+    if (region->stats == NULL) {
+        fprintf(stderr, "EMShotspots: region %d was not created with stats\n", mmapID);
+        return -1;
+    }
+
+    volatile int64_t *ring = EMShotRing;
+    int64_t count = ring[EMS_HOT_RING_COUNT];
+    int64_t first = ring[EMS_HOT_RING_BASE];
+    if (first < count - EMS_HOT_RING_LEN) first = count - EMS_HOT_RING_LEN;
+    EMShotspotType *tags = (EMShotspotType *) calloc(EMS_HOT_RING_LEN, sizeof(EMShotspotType));
+    if (tags == NULL) {
+        fprintf(stderr, "EMShotspots: Unable to allocate the table of tags\n");
+        return -1;
+    }
+
+    int nTags = 0;
+    for (int64_t claim = first;  claim < count;  claim++) {
+        volatile int64_t *sample = EMShotSample(ring, claim);
+        if (sample[EMS_HOT_SEQ] != claim + 1) continue;
+        int64_t tag = sample[EMS_HOT_TAG];
+        int64_t waitNs = sample[EMS_HOT_NS];
+        int64_t proc = sample[EMS_HOT_PROC];
+        __sync_synchronize();
+        if (sample[EMS_HOT_SEQ] != claim + 1) continue;   // Rewritten while it was read
+
+        int32_t kind = EMS_HOTSPOT_CONTROL;
+        int64_t index = tag;
+        if (tag >= EMS_ARR_CB_SIZE + region->nElements) {
+            kind = EMS_HOTSPOT_BUCKET;
+            index = tag - EMS_ARR_CB_SIZE - region->nElements;
+        } else if (tag >= EMS_ARR_CB_SIZE) {
+            kind = EMS_HOTSPOT_ELEMENT;
+            index = tag - EMS_ARR_CB_SIZE;
+        }
+        int tagN;
+        for (tagN = 0;  tagN < nTags;  tagN++) {
+            if (tags[tagN].index == index  &&  tags[tagN].kind == kind) break;
+        }
+        if (tagN == nTags) {
+            tags[nTags].index = index;
+            tags[nTags].kind = kind;
+            nTags++;
+        }
+
+        EMShotspotType *spot = &tags[tagN];
+        spot->waits++;
+        spot->waitNs += waitNs;
+        if (waitNs > spot->maxWaitNs) spot->maxWaitNs = waitNs;
+        spot->processes |= (uint64_t) 1 << (proc % 64);
+        int bucket = 0;
+        for (int64_t limit = 1000;  waitNs >= limit  &&  bucket < EMS_HOTSPOT_NBUCKETS - 1;  limit *= 10) bucket++;
+        spot->histogram[bucket]++;
+    }
+
+    qsort(tags, nTags, sizeof(EMShotspotType), EMShotspotCompare);
+    if (nTags > maxSpots) nTags = maxSpots;
+    memcpy(spots, tags, nTags * sizeof(EMShotspotType));
+    free(tags);
+    return nTags;
+}
+
+
 //==================================================================
 //  EMS Entry Point:   Allocate and initialize the EMS domain memory
 //
@@ -828,7 +2406,8 @@ int EMSinitialize(int64_t nElements,     // 0
                   int EMSmyIDarg,        // 11
                   bool pinThreads,       // 12
                   int32_t nThreads,      // 13
-                  int32_t pctMLock ) {   // 14
+                  int32_t pctMLock,      // 14
+                  int32_t regionFlags ) { // 15
     int fd;
     EMSmyID = EMSmyIDarg;
 
@@ -872,13 +2451,57 @@ int EMSinitialize(int64_t nElements,     // 0
         bottomOfMalloc = bottomOfMap;
     }
     size_t bottomOfHeap = bottomOfMalloc + sizeof(struct emsMem) + (nMemBlocksPow2 * 2 - 2);
+    // Align the heap so power-of-2 sized blocks of a cache line or more are cache line aligned
+    bottomOfHeap = ((bottomOfHeap + EMS_CACHELINE_SZ - 1) / EMS_CACHELINE_SZ) * EMS_CACHELINE_SZ;
 
     if (nElements <= 0) {
-        filesize = EMS_CB_LOCKS + nThreads;   // EMS Control Block
+        filesize = EMS_CB_PIDS + nThreads;   // EMS Control Block
         filesize *= sizeof(int);
+        if (regionFlags & EMS_REGION_MAILBOXES) {
+            filesize = EMS_CB_MAILBOXES(nThreads) + nThreads * EMS_MAILBOX_STRIDE;
+        }
     } else {
         filesize = bottomOfHeap + (nMemBlocksPow2 * EMS_MEM_BLOCKSZ);
     }
+    //  One cache line of reader indicators per process follows the heap
+    size_t bottomOfReaders = 0;
+    if (nElements > 0  &&  (regionFlags & EMS_REGION_SCALABLE_RW)) {
+        bottomOfReaders = filesize;
+        filesize += nThreads * EMS_CACHELINE_SZ;
+    }
+    //  Followed by the version stamp of every element
+    size_t bottomOfVersions = 0;
+    if (nElements > 0  &&  (regionFlags & EMS_REGION_OPTIMISTIC_READS)) {
+        bottomOfVersions = filesize;
+        filesize += nElements * sizeof(int64_t);
+    }
+    //  Followed by the epoch table
+    size_t bottomOfEpochs = 0;
+    if (nElements > 0  &&  (regionFlags & EMS_REGION_EPOCHS)) {
+        bottomOfEpochs = filesize;
+        filesize += EMS_CACHELINE_SZ + nThreads * EMS_EPOCH_SLOT_SZ;
+    }
+    //  Followed by the intern table, sized to be under half full if every element
+    //  and map key holds a different value
+    size_t bottomOfIntern = 0;
+    int64_t nInternSlots = 8;
+    if (nElements > 0  &&  (regionFlags & EMS_REGION_INTERN)) {
+        while (nInternSlots * EMS_INTERN_STRIPES < 4 * nElements) nInternSlots *= 2;
+        bottomOfIntern = filesize;
+        filesize += EMS_INTERN_STRIPES * EMS_INTERN_STRIPE_SZ(nInternSlots);
+    }
+    //  Followed by a line of performance counters for each process and a ring of sampled waits
+    size_t bottomOfStats = 0;
+    if (nElements > 0  &&  (regionFlags & EMS_REGION_STATS)) {
+        bottomOfStats = filesize;
+        filesize += nThreads * EMS_CACHELINE_SZ + EMS_HOT_RING_SZ;
+    }
+    //  Followed by a line of hold records for each process
+    size_t bottomOfHolders = 0;
+    if (nElements > 0  &&  (regionFlags & EMS_REGION_RECOVERY)) {
+        bottomOfHolders = filesize;
+        filesize += nThreads * EMS_CACHELINE_SZ;
+    }
     if (ftruncate(fd, (off_t) filesize) != 0) {
         if (errno != EINVAL) {
             fprintf(stderr, "EMSinitialize: Error during initialization, unable to set memory size to %" PRIu64 " bytes\n",
@@ -915,8 +2538,19 @@ int EMSinitialize(int64_t nElements,     // 0
             bufInt32[EMS_CB_BARPHASE] = 0;
             bufInt32[EMS_CB_CRITICAL] = 0;
             bufInt32[EMS_CB_SINGLE] = 0;
-            for (int i = EMS_CB_LOCKS; i < EMS_CB_LOCKS + nThreads; i++) {
-                bufInt32[i] = EMS_TAG_BUSY;  //  Reset all locks
+            for (int i = EMS_CB_PIDS; i < EMS_CB_PIDS + nThreads; i++) {
+                bufInt32[i] = 0;
+            }
+            if (regionFlags & EMS_REGION_MAILBOXES) {
+                for (int taskN = 0; taskN < nThreads; taskN++) {
+                    volatile int64_t *mailbox = EMSmailbox(taskN);
+                    mailbox[EMS_MAILBOX_POSTED] = 0;
+                    mailbox[EMS_MAILBOX_PID] = getpid();
+                    mailbox[EMS_MAILBOX_NPOSTED] = 0;
+                    mailbox[EMS_MAILBOX_RECEIVED] = 0;
+                    mailbox[EMS_MAILBOX_NDONE] = 0;
+                    mailbox[EMS_MAILBOX_FAILED] = 0;
+                }
             }
         } else {   //  This is a user data domain
             if (!useExisting) {
@@ -931,16 +2565,54 @@ int EMSinitialize(int64_t nElements,     // 0
                 bufInt64[EMScbData(EMS_ARR_HEAPBOT)] = bottomOfHeap;
                 bufInt64[EMScbData(EMS_ARR_Q_BOTTOM)] = 0;
                 bufTags[EMScbTag(EMS_ARR_Q_BOTTOM)].byte = tag.byte;
+                bufInt64[EMScbData(EMS_CONTROL_OWNER(EMS_ARR_Q_BOTTOM))] = 0;
                 bufInt64[EMScbData(EMS_ARR_STACKTOP)] = 0;
                 bufTags[EMScbTag(EMS_ARR_STACKTOP)].byte = tag.byte;
+                bufInt64[EMScbData(EMS_CONTROL_OWNER(EMS_ARR_STACKTOP))] = 0;
                 bufInt64[EMScbData(EMS_ARR_MEM_MUTEX)] = EMS_TAG_EMPTY;
                 bufInt64[EMScbData(EMS_ARR_FILESZ)] = filesize;
+                bufInt64[EMScbData(EMS_ARR_NAMEDIR)] = EMS_HEAP_NULL;
+                bufTags[EMScbTag(EMS_ARR_NAMEDIR)].byte = tag.byte;
+                bufInt64[EMScbData(EMS_ARR_READERS)] = bottomOfReaders;
+                bufInt64[EMScbData(EMS_ARR_READERS + 1)] = nThreads;
+                if (bottomOfReaders != 0) memset(&bufChar[bottomOfReaders], 0, nThreads * EMS_CACHELINE_SZ);
+                bufInt64[EMScbData(EMS_ARR_VERSIONS)] = bottomOfVersions;
+                if (bottomOfVersions != 0) memset(&bufChar[bottomOfVersions], 0, nElements * sizeof(int64_t));
+                bufInt64[EMScbData(EMS_ARR_EPOCHS)] = bottomOfEpochs;
+                bufInt64[EMScbData(EMS_ARR_EPOCHS + 1)] = nThreads;
+                if (bottomOfEpochs != 0) memset(&bufChar[bottomOfEpochs], 0, EMS_CACHELINE_SZ + nThreads * EMS_EPOCH_SLOT_SZ);
+                bufInt64[EMScbData(EMS_ARR_INTERN)] = bottomOfIntern;
+                bufInt64[EMScbData(EMS_ARR_INTERN + 1)] = nInternSlots;
+                for (int stripeN = 0;  bottomOfIntern != 0  &&  stripeN < EMS_INTERN_STRIPES;  stripeN++) {
+                    volatile int64_t *stripe = EMSinternStripe(stripeN);
+                    memset((void *) stripe, 0, EMS_CACHELINE_SZ);
+                    memset((void *) EMSinternSlots(stripe), 0xff, nInternSlots * sizeof(int64_t));  // EMS_INTERN_EMPTY
+                }
+                bufInt64[EMScbData(EMS_ARR_STATS)] = bottomOfStats;
+                bufInt64[EMScbData(EMS_ARR_STATS + 1)] = nThreads;
+                if (bottomOfStats != 0) memset(&bufChar[bottomOfStats], 0, nThreads * EMS_CACHELINE_SZ + EMS_HOT_RING_SZ);
+                bufInt64[EMScbData(EMS_ARR_HOLDERS)] = bottomOfHolders;
+                bufInt64[EMScbData(EMS_ARR_HOLDERS + 1)] = nThreads;
+                if (bottomOfHolders != 0) memset(&bufChar[bottomOfHolders], 0, nThreads * EMS_CACHELINE_SZ);
+                bufInt64[EMScbData(EMS_ARR_STMCLOCK)] = 0;
                 struct emsMem *emsMemBuffer = (struct emsMem *) &bufChar[bufInt64[EMScbData(EMS_ARR_MALLOCBOT)]];
                 emsMemBuffer->level = nMemLevels;
             }
         }
     }
 
+    //  Attaching to the domain's control block registers this process
+    if (nElements <= 0  &&  EMSmyID >= 0  &&  EMSmyID < nThreads) {
+        static bool registered = false;
+        if (!registered) {
+            registered = true;
+            atexit(EMSderegister);
+        }
+        emsDomainPids = (volatile int32_t *) &bufInt32[EMS_CB_PIDS];
+        emsDomainNThreads = nThreads;
+        emsDomainPids[EMSmyID] = (int32_t) getpid();
+    }
+
     if (pinThreads) {
 #if defined(__linux)
         cpu_set_t cpuset;
@@ -949,14 +2621,16 @@ int EMSinitialize(int64_t nElements,     // 0
         sched_setaffinity(0, sizeof(cpu_set_t), &cpuset);
 #endif
     }
+    EMSregion regionDesc;
+    EMSregionDescribe(&regionDesc, emsBuf, nElements);
+    const EMSregion *region = &regionDesc;
     EMStag_t tag;
     tag.tags.rw = 0;
     int64_t iterPerThread = (nElements / nThreads) + 1;
     int64_t startIter = iterPerThread * EMSmyID;
     int64_t endIter = iterPerThread * (EMSmyID + 1);
-    size_t fillStrLen = 0;
-    if (doDataFill  &&  (fillValue->type == EMS_TYPE_JSON || fillValue->type == EMS_TYPE_STRING)) {
-        fillStrLen = fillValue->length;
+    if (doDataFill  &&  EMSisHeapType(fillValue->type)) {
+        EMS_CHECK_LENGTH(fillValue, "EMSinitialize", -1);
     }
     if (endIter > nElements) endIter = nElements;
     for (int64_t idx = startIter; idx < endIter; idx++) {
@@ -978,12 +2652,11 @@ int EMSinitialize(int64_t nElements,     // 0
                     bufInt64[EMSdataData(idx)] = 0xdeadbeef;
                     break;
                 case EMS_TYPE_JSON:
+                case EMS_TYPE_BLOB:
                 case EMS_TYPE_STRING: {
                     int64_t textOffset;
-                    EMS_ALLOC(textOffset, fillStrLen + 1, bufChar,
-                              "EMSinitialize: out of memory to store string", false);
+                    EMS_STORE_VALUE(textOffset, fillValue, "EMSinitialize: out of memory to store string", false);
                     bufInt64[EMSdataData(idx)] = textOffset;
-                    strcpy(EMSheapPtr(textOffset), (const char *) fillValue->value);
                 }
                     break;
                 default:
@@ -1013,6 +2686,8 @@ int EMSinitialize(int64_t nElements,     // 0
     while(emsBufN < EMS_MAX_N_BUFS  &&  emsBufs[emsBufN] != NULL)  emsBufN++;
     if(emsBufN < EMS_MAX_N_BUFS) {
         emsBufs[emsBufN] = emsBuf;
+        emsRegions[emsBufN] = regionDesc;
+        if (emsBufN >= emsBufsEnd) emsBufsEnd = emsBufN + 1;
         emsBufLengths[emsBufN] = filesize;
         strncpy(emsBufFilenames[emsBufN], filename, MAX_FNAME_LEN);
     } else {
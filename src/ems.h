@@ -44,6 +44,8 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
 
 #if !defined _GNU_SOURCE
 #  define _GNU_SOURCE
@@ -72,7 +74,115 @@
 #define EMS_TYPE_INTEGER      ((unsigned char)4)
 #define EMS_TYPE_UNDEFINED    ((unsigned char)5)
 #define EMS_TYPE_JSON         ((unsigned char)6)  // Catch-all for JSON arrays and Objects
+#define EMS_TYPE_BLOB         ((unsigned char)7)  // Uninterpreted binary data
 
+// JSON values are stored on the heap as text or packed as MessagePack.  A packed value
+// starts with a byte used by neither MessagePack nor UTF-8, followed by the
+// 32 bit length (host byte order) of the encoding.
+#define EMS_JSON_PACKED         ((unsigned char)0xc1)
+#define EMS_JSON_PACKED_HDR_SZ  5
+#define EMSisPackedJSON(type, ptr) \
+    ((type) == EMS_TYPE_JSON  &&  *((const unsigned char *) (ptr)) == EMS_JSON_PACKED)
+
+// Kinds of items in packed JSON, decoded by EMSpackedHeader
+#define EMS_PACKED_SCALAR   0
+#define EMS_PACKED_BYTES    1   // String or binary data, the count is the number of bytes
+#define EMS_PACKED_ARRAY    2
+#define EMS_PACKED_MAP      3
+#define EMS_PACKED_MAX_HDR  9   // Longest encoding of a number or header
+#define EMSpackedIsString(op) (((op) >= 0xa0  &&  (op) <= 0xbf)  ||  ((op) >= 0xd9  &&  (op) <= 0xdb))
+
+// Strings and blobs are stored behind a header marked by the other byte that never
+// starts UTF-8 text, holding the number of views (zero-copy reads) of the value and
+// its 32 bit length.  The data is followed by a NULL so strings remain C strings.
+// Strings written without a header by earlier versions are measured with strlen.
+#define EMS_VALUE_COUNTED       ((unsigned char)0xc0)
+#define EMS_COUNTED_REFS        1   // Offset of the 24 bit count of elements sharing an interned value
+#define EMS_COUNTED_VIEWS       4   // Offset of the 32 bit count of views
+#define EMS_COUNTED_LEN         8   // Offset of the 32 bit length
+#define EMS_COUNTED_HDR_SZ      12
+#define EMS_VIEW_ORPHANED       0x80000000  // Replaced while viewed, freed by the last view
+#define EMS_MAX_VALUE_LEN       ((size_t) UINT32_MAX)
+
+//  Bytes of heap storage used by a string, blob, or JSON value
+static inline size_t EMSvalueBytes(unsigned char type, const void *ptr) {
+    uint32_t len;
+    if (*((const unsigned char *) ptr) == EMS_VALUE_COUNTED) {
+        memcpy(&len, ((const char *) ptr) + EMS_COUNTED_LEN, sizeof(len));
+        return EMS_COUNTED_HDR_SZ + (size_t) len + 1;
+    }
+    if (EMSisPackedJSON(type, ptr)) {
+        memcpy(&len, ((const char *) ptr) + 1, sizeof(len));
+        return EMS_JSON_PACKED_HDR_SZ + (size_t) len;
+    }
+    return strlen((const char *) ptr) + 1;
+}
+
+//  The data of a string, blob, or JSON value stored on the heap and its length
+//  without a trailing NULL.  Packed JSON is returned whole, header included.
+static inline const char *EMSheapData(unsigned char type, const char *ptr, size_t *length) {
+    if (*((const unsigned char *) ptr) == EMS_VALUE_COUNTED) {
+        uint32_t len;
+        memcpy(&len, ptr + EMS_COUNTED_LEN, sizeof(len));
+        *length = len;
+        return ptr + EMS_COUNTED_HDR_SZ;
+    }
+    *length = EMSvalueBytes(type, ptr) - !EMSisPackedJSON(type, ptr);
+    return ptr;
+}
+
+//  Mark a value on the heap as replaced, returning true if no views of it
+//  remain and it should be freed now
+static inline bool EMSorphanValue(char *ptr) {
+    if (*((unsigned char *) ptr) != EMS_VALUE_COUNTED) return true;
+    return __sync_fetch_and_or((uint32_t *) (ptr + EMS_COUNTED_VIEWS), EMS_VIEW_ORPHANED) == 0;
+}
+
+//  Number of elements sharing an interned value, 0 if the value is not interned.
+//  Only changed while holding the lock of the value's stripe of the intern table.
+#define EMS_INTERN_MAX_REFS  0xffffff
+static inline uint32_t EMSinternRefs(const char *ptr) {
+    const unsigned char *refs = (const unsigned char *) ptr + EMS_COUNTED_REFS;
+    if (*((const unsigned char *) ptr) != EMS_VALUE_COUNTED) return 0;
+    return (uint32_t) refs[0] | ((uint32_t) refs[1] << 8) | ((uint32_t) refs[2] << 16);
+}
+static inline void EMSsetInternRefs(char *ptr, uint32_t nRefs) {
+    unsigned char *refs = (unsigned char *) ptr + EMS_COUNTED_REFS;
+    refs[0] = (unsigned char) nRefs;
+    refs[1] = (unsigned char) (nRefs >> 8);
+    refs[2] = (unsigned char) (nRefs >> 16);
+}
+
+//  True for the types whose values are stored on the heap
+#define EMSisHeapType(type) \
+    ((type) == EMS_TYPE_STRING  ||  (type) == EMS_TYPE_JSON  ||  (type) == EMS_TYPE_BLOB)
+
+//  Strings and blobs of up to EMS_INLINE_MAX bytes are stored in the data word
+//  of their element instead of on the heap.  Heap offsets are never negative,
+//  so the sign bit marks an inline value.  The top byte of the word holds the
+//  mark and the length, the data is in the low bytes, first byte lowest.
+#define EMS_INLINE_MAX   7
+#define EMS_INLINE_MARK  0x80
+#define EMSisInline(word)  ((int64_t) (word) < 0)
+
+static inline int64_t EMSinlineWord(const char *data, size_t length) {
+    uint64_t word = (uint64_t) (EMS_INLINE_MARK | length) << 56;
+    for (size_t i = 0; i < length; i++) word |= (uint64_t) (unsigned char) data[i] << (8 * i);
+    return (int64_t) word;
+}
+
+//  Decode an inline value into buf, which has room for EMS_INLINE_MAX bytes and a trailing NULL
+static inline const char *EMSinlineData(int64_t word, char *buf, size_t *length) {
+    *length = (size_t) ((((uint64_t) word) >> 56) & ~EMS_INLINE_MARK & 0xff);
+    for (size_t i = 0; i < *length; i++) buf[i] = (char) (((uint64_t) word) >> (8 * i));
+    buf[*length] = '\0';
+    return buf;
+}
+
+//  The data and length of the string, blob, or JSON value held by a data word,
+//  inline values are decoded into buf
+#define EMSwordData(type, word, buf, length) \
+    (EMSisInline(word) ? EMSinlineData((word), (buf), (length)) : EMSheapData((type), (const char *) EMSheapPtr(word), (length)))
 
 
 //==================================================================
@@ -90,10 +200,18 @@
 #define EMS_ARR_HEAPBOT    (6 * NWORDS_PER_CACHELINE)   // Index of the base of data on the heap -- strings start here
 #define EMS_ARR_MEM_MUTEX  (7 * NWORDS_PER_CACHELINE)   // Mutex lock for thememory allocator of this EMS region's
 #define EMS_ARR_FILESZ     (8 * NWORDS_PER_CACHELINE)   // Total size in bytes of the EMS region
+#define EMS_ARR_NAMEDIR    (9 * NWORDS_PER_CACHELINE)   // Heap offset of the first named object (locks, etc.)
+#define EMS_ARR_READERS   (10 * NWORDS_PER_CACHELINE)   // Byte offset of the reader indicators (0 if none), +1: # of lines
+#define EMS_ARR_VERSIONS  (11 * NWORDS_PER_CACHELINE)   // Byte offset of the element version stamps (0 if none)
+#define EMS_ARR_STMCLOCK  (12 * NWORDS_PER_CACHELINE)   // Version clock of software transactions committed to the region
+#define EMS_ARR_EPOCHS    (13 * NWORDS_PER_CACHELINE)   // Byte offset of the epoch table (0 if none), +1: # of slots
+#define EMS_ARR_INTERN    (14 * NWORDS_PER_CACHELINE)   // Byte offset of the intern table (0 if none), +1: slots per stripe
+#define EMS_ARR_STATS     (15 * NWORDS_PER_CACHELINE)   // Byte offset of the performance counters (0 if none), +1: # of lines
+#define EMS_ARR_HOLDERS   (16 * NWORDS_PER_CACHELINE)   // Byte offset of the records of element tags held (0 if none), +1: # of lines
 // Tag data may follow data by as much as 8 words, so
 // A gap of at least 8 words is required to leave space for
 // the tags associated with header data
-#define EMS_ARR_CB_SIZE   (16 * NWORDS_PER_CACHELINE)   // Index of the first EMS array element
+#define EMS_ARR_CB_SIZE   (17 * NWORDS_PER_CACHELINE)   // Index of the first EMS array element
 
 
 
@@ -114,7 +232,249 @@
 #define    EMS_SCHED_GUIDED  1200
 #define    EMS_SCHED_DYNAMIC 1201
 #define    EMS_SCHED_STATIC  1202
-#define EMS_CB_LOCKS       12     // First index of an array of locks, one lock per thread
+#define EMS_CB_PIDS        12     // First of the process IDs of each process attached, 0 once it exits normally
+
+
+
+//==================================================================
+// Region creation flags
+#define EMS_REGION_SCALABLE_RW  0x1   // Readers-writer locks use per-process reader indicators
+#define EMS_REGION_OPTIMISTIC_READS  0x2   // Elements have version stamps, reads are optimistic
+#define EMS_REGION_MAILBOXES  0x4   // The control block has a fork-join task mailbox for each process
+#define EMS_REGION_EPOCHS  0x8   // Heap storage of replaced values is reclaimed by epochs
+#define EMS_REGION_INTERN  0x10  // Equal strings and blobs share one reference counted copy
+#define EMS_REGION_STATS  0x20  // Processes count waits and probes in their own line of counters
+#define EMS_REGION_RECOVERY  0x40  // Element tags held BUSY are recorded so those of dead processes are restored
+
+// Each process announces the elements it holds under a readers-writer lock
+// in its own cache line of reader indicators.  Entries hold the element index + 1, 0 is unused.
+#define EMS_READERS_PER_LINE  NWORDS_PER_CACHELINE
+
+// Seqlock version stamp of each element, odd while a writer is modifying the element.
+// Writers holding the element's tag bracket changes to the data or heap storage
+// of the element with these.  The atomic increments order the writes.
+#define EMSversionPtr(idx) \
+    ((volatile int64_t *) &bufChar[bufInt64[EMScbData(EMS_ARR_VERSIONS)] + (idx) * sizeof(int64_t)])
+#define EMS_VERSION_BEGIN_WRITE(idx) \
+    do { if (bufInt64[EMScbData(EMS_ARR_VERSIONS)] != 0) __sync_fetch_and_add(EMSversionPtr(idx), 1); } while (0)
+#define EMS_VERSION_END_WRITE(idx)   \
+    do { if (bufInt64[EMScbData(EMS_ARR_VERSIONS)] != 0) __sync_fetch_and_add(EMSversionPtr(idx), 1); } while (0)
+
+// Task mailboxes follow the process IDs of the EMS control block.  Each is a ring of bytes
+// written only by the master process, the count of bytes posted, the poster's PID and
+// the count of messages posted are on one cache line.  The count of bytes received,
+// the count of messages the receiver finished, and whether one of them failed are on
+// the next.
+#define EMS_MAILBOX_SZ  (64 * 1024)
+#define EMS_MAILBOX_STRIDE  (2 * EMS_CACHELINE_SZ + EMS_MAILBOX_SZ)
+#define EMS_CB_MAILBOXES(nThreads) \
+    ((((EMS_CB_PIDS + (nThreads)) * sizeof(int32_t) + EMS_CACHELINE_SZ - 1) / EMS_CACHELINE_SZ) * EMS_CACHELINE_SZ)
+#define EMSmailbox(taskN) \
+    ((volatile int64_t *) &bufChar[EMS_CB_MAILBOXES(bufInt32[EMS_CB_NTHREADS]) + (taskN) * EMS_MAILBOX_STRIDE])
+#define EMS_MAILBOX_POSTED    0
+#define EMS_MAILBOX_PID       1
+#define EMS_MAILBOX_NPOSTED   2
+#define EMS_MAILBOX_RECEIVED  NWORDS_PER_CACHELINE
+#define EMS_MAILBOX_NDONE     (NWORDS_PER_CACHELINE + 1)
+#define EMS_MAILBOX_FAILED    (NWORDS_PER_CACHELINE + 2)
+#define EMSmailboxRing(mailbox)  ((char *) &(mailbox)[2 * NWORDS_PER_CACHELINE])
+
+// Epoch table of regions created with EMS_REGION_EPOCHS.  The first cache line
+// holds the global epoch, followed by a slot for each process: a cache line with
+// the epoch the process announced and the counts of its limbo list, then the
+// limbo list itself, a ring of the heap offsets retired and the epoch of each.
+#define EMS_LIMBO_SZ  1024
+#define EMS_EPOCH_SLOT_SZ  (EMS_CACHELINE_SZ + EMS_LIMBO_SZ * 2 * sizeof(int64_t))
+#define EMSepochGlobal() \
+    ((volatile int64_t *) &bufChar[bufInt64[EMScbData(EMS_ARR_EPOCHS)]])
+#define EMSepochSlot(slot) \
+    ((volatile int64_t *) &bufChar[bufInt64[EMScbData(EMS_ARR_EPOCHS)] + EMS_CACHELINE_SZ + (slot) * EMS_EPOCH_SLOT_SZ])
+#define EMSlimboEntry(epochSlot, n)  (&(epochSlot)[NWORDS_PER_CACHELINE + ((n) % EMS_LIMBO_SZ) * 2])
+#define EMS_EPOCH_ANNOUNCE   0    // (epoch << EMS_EPOCH_SHIFT) | # of epochs entered by the slot's processes
+#define EMS_EPOCH_LIMBO_LOCK 1    // Mutex of the limbo list
+#define EMS_EPOCH_RETIRED    2    // # of offsets ever retired to the limbo list
+#define EMS_EPOCH_FREED      3    // # of those already freed
+#define EMS_EPOCH_PID        4    // Process that announced the epoch, 0 if none, -1 if others joined it
+#define EMS_EPOCH_SHIFT      16
+#define EMS_EPOCH_NENTERED   ((1 << EMS_EPOCH_SHIFT) - 1)
+#define EMS_LIMBO_DRAIN_TRIES  1000   // Naps to wait for the epoch to advance when the heap is exhausted
+
+// Intern table of regions created with EMS_REGION_INTERN, an open addressed hash
+// table of the heap offsets of interned values divided into stripes by hash.
+// Each stripe is a cache line with its lock and # of used slots, then its slots.
+#define EMS_INTERN_STRIPES  64
+#define EMS_INTERN_EMPTY    ((int64_t)-1)
+#define EMS_INTERN_DELETED  ((int64_t)-2)
+#define EMS_INTERN_LOCK     0
+#define EMS_INTERN_USED     1    // Slots holding a value or deleted
+#define EMS_INTERN_NDELETED 2    // Slots deleted
+#define EMS_INTERN_STRIPE_SZ(nSlots)  (EMS_CACHELINE_SZ + (nSlots) * sizeof(int64_t))
+#define EMSinternStripe(stripeN) \
+    ((volatile int64_t *) &bufChar[bufInt64[EMScbData(EMS_ARR_INTERN)] + \
+                                   (stripeN) * EMS_INTERN_STRIPE_SZ(bufInt64[EMScbData(EMS_ARR_INTERN + 1)])])
+#define EMSinternSlots(stripe)  (&(stripe)[NWORDS_PER_CACHELINE])
+
+// Performance counters of regions created with EMS_REGION_STATS, one cache line
+// of counters per EMS process ID.  A process only counts in the line of its ID,
+// with atomic adds because processes attached with the same ID share a line.
+// Waits are only timed once they have begun, so uncontended operations pay for
+// nothing more than the test of whether the region counts them.
+#define EMS_STAT_TAG_WAITS      0    // Full/Empty tag transitions that had to wait
+#define EMS_STAT_TAG_WAIT_NS    1    // Time spent in those waits
+#define EMS_STAT_LOOKUPS        2    // Mapped keys looked up
+#define EMS_STAT_PROBES         3    // Map entries examined by those lookups
+#define EMS_STAT_ALLOC_WAITS    4    // Acquisitions of the heap allocator's mutex that had to wait
+#define EMS_STAT_ALLOC_WAIT_NS  5    // Time spent in those waits
+#define EMS_STAT_ALLOC_FAILS    6    // Heap allocations that failed
+#define EMS_STAT_ADD(region, stat, n)  __sync_fetch_and_add(&(region)->stats[stat], (n))
+#define EMSstatsLine(line) \
+    ((volatile int64_t *) &bufChar[bufInt64[EMScbData(EMS_ARR_STATS)] + (line) * EMS_CACHELINE_SZ])
+
+// The counters are followed by a ring of the most recent waits on tags, written
+// by every process.  A sample is claimed by incrementing the count in the ring's
+// first cache line and is valid once its sequence word holds its claim plus one.
+// Resetting the counters only moves the ring's base past the samples taken so far.
+#define EMS_HOT_RING_COUNT      0    // Samples ever claimed, in the ring's first line
+#define EMS_HOT_RING_BASE       1    // Claims at or below this were taken before a reset
+#define EMS_HOT_RING_LEN        1024 // Waits remembered, a power of 2
+#define EMS_HOT_SAMPLE_WORDS    4
+#define EMS_HOT_SEQ             0    // Claim + 1, 0 if never written
+#define EMS_HOT_TAG             1    // Index of the tag waited on, counting the control block
+#define EMS_HOT_NS              2    // Duration of the wait
+#define EMS_HOT_PROC            3    // Process that waited
+#define EMS_HOT_RING_SZ  (EMS_CACHELINE_SZ + EMS_HOT_RING_LEN * EMS_HOT_SAMPLE_WORDS * sizeof(int64_t))
+
+// Records of the element tags held BUSY in regions created with EMS_REGION_RECOVERY,
+// so the tag of a process that died holding it can be restored.  Each process records its holds in its own cache
+// line, a record is claimed by swapping the holder's PID into its first word
+// once the tag is BUSY, and cleared before the tag is released.
+#define EMS_HOLDS_PER_LINE  4
+#define EMS_HOLD_WORDS      4
+#define EMS_HOLD_PID        0    // Process holding the tag, 0 if the record is unused
+#define EMS_HOLD_TAG        1    // (Byte offset of the tag + 1) << 8 | the tag before it was made BUSY
+#define EMS_HOLD_INDEX      2    // Index of the element
+#define EMS_HOLD_DATA       3    // Data word of the element when its tag was made BUSY
+#define EMSholdLine(line) \
+    ((volatile int64_t *) &bufChar[bufInt64[EMScbData(EMS_ARR_HOLDERS)] + (line) * EMS_CACHELINE_SZ])
+#define EMShotRing \
+    ((volatile int64_t *) &bufChar[bufInt64[EMScbData(EMS_ARR_STATS)] + \
+                                   bufInt64[EMScbData(EMS_ARR_STATS + 1)] * EMS_CACHELINE_SZ])
+#define EMShotSample(ring, n) \
+    (&(ring)[NWORDS_PER_CACHELINE + ((n) & (EMS_HOT_RING_LEN - 1)) * EMS_HOT_SAMPLE_WORDS])
+
+
+
+//==================================================================
+// Named objects allocated on the heap of an EMS region
+//
+#define EMS_HEAP_NULL        ((int64_t)-1)  // Heap offset used as a NULL pointer
+#define EMS_CACHELINE_SZ     (NWORDS_PER_CACHELINE * sizeof(int64_t))
+#define EMS_OBJ_LOCK         1
+#define EMS_OBJ_TASKGRAPH    2
+#define EMS_OBJ_ORDERED      3
+
+// Directory entry, the entries form a list starting at EMS_ARR_NAMEDIR
+typedef struct {
+    int64_t next;       // Heap offset of the next directory entry
+    int64_t object;     // Heap offset of the object's storage
+    int32_t objType;    // Kind of named object (EMS_OBJ_*)
+    int32_t nameLen;    // Length of the name that follows this header
+} EMSnamedObject;
+#define EMSnamedObjectName(obj) ((char *) (((EMSnamedObject *) (obj)) + 1))
+
+// Lock types
+#define EMS_LOCK_MUTEX       0
+#define EMS_LOCK_RW          1
+#define EMS_LOCK_SEMAPHORE   2
+#define EMS_LOCK_WRITER      ((int32_t)-1)          // RW lock state when held by a writer
+#define EMS_LOCK_WRITER_WAIT ((int32_t)(1 << 30))   // Set while writers wait, to hold off new readers
+
+// Each lock occupies its own cache line
+typedef struct {
+    volatile int32_t state;  // Mutex: 0/1,  RW: # readers or EMS_LOCK_WRITER,  Semaphore: count
+    int32_t lockType;        // EMS_LOCK_*
+    volatile int32_t nWriters;  // RW: writers waiting for the lock
+} EMSlock;
+
+// Task graph stored on the heap of an EMS region.  A task is ready when all its inputs
+// are full, tasks are counted as inputs of the tasks which consume their outputs.  Inputs
+// not produced by a task of the graph are polled by idle processes.
+typedef struct {
+    volatile int64_t nPending;  // Producing tasks not yet done, +1 while parked
+    int64_t nProducers;         // Tasks of the graph producing an input of this task
+    int64_t firstConsumer;      // First edge to a task consuming an output, -1 if none
+    int64_t firstExternal;      // First of nExternal inputs not produced by the graph
+    int32_t nExternal;
+    volatile int32_t parked;    // Waiting for external inputs to become full
+} EMStaskNode;
+
+typedef struct {
+    int64_t task;               // Consuming task
+    int64_t next;               // Next edge from the same producer, -1 at the end
+} EMStaskEdge;
+
+typedef struct {
+    int64_t mmapID;             // -1 if the entry is unused
+    int64_t index;
+    int64_t task;
+} EMStaskProducer;
+
+typedef struct {
+    int64_t maxTasks;
+    int64_t maxEdges;
+    volatile int64_t nTasks;
+    volatile int64_t nEdges;    // Edges and external inputs both use up to maxEdges
+    volatile int64_t nExternals;
+    volatile int64_t nOutputs;  // Slots of the producers hash table in use
+    volatile int64_t nDone;
+    volatile int64_t nParked;
+    int64_t nThreads;
+    int64_t nodes;              // Heap offset of EMStaskNode[maxTasks]
+    int64_t edges;              // EMStaskEdge[maxEdges]
+    int64_t externals;          // EMStaskProducer[maxEdges], the task field is unused
+    int64_t producers;          // Hash table of EMStaskProducer[2 * maxEdges]
+    int64_t parkedTasks;        // int64_t[maxTasks]
+    int64_t deques;             // A work-stealing deque of EMS_TASK_DEQUE_SZ(maxTasks) bytes per process
+} EMStaskGraph;
+
+// Every task is pushed once so a deque never holds more than maxTasks and never wraps.
+// The steal end (top) and owner's end (bottom) are on separate cache lines.
+#define EMS_TASK_DEQUE_SZ(maxTasks)  (2 * EMS_CACHELINE_SZ + (maxTasks) * sizeof(int64_t))
+#define EMS_TASK_DEQUE_TOP     0
+#define EMS_TASK_DEQUE_BOTTOM  NWORDS_PER_CACHELINE
+#define EMS_TASK_DEQUE_TASKS   (2 * NWORDS_PER_CACHELINE)
+
+// Ordered index stored on the heap of an EMS region, a skiplist of keys each with
+// a value.  A node's version is even while it is unlocked and odd while a writer
+// holds it.  Readers take no locks, they revalidate the versions of the nodes they
+// read.  Removed nodes are kept for reuse by later inserts instead of being freed,
+// so a node read through a stale link is always a node.
+#define EMS_ORDERED_MAX_HEIGHT  16   // Levels of the skiplist, each 1/4 as dense as the one below
+typedef struct {
+    volatile int64_t version;
+    volatile int64_t keyWord;       // Integer, boolean, or bits of a float key, the length of a string key
+    volatile int64_t valueWord;     // Value as stored in the data word of an element
+    int64_t freeNext;               // Next removed node of the same height, -1 at the end
+    int32_t keyCap;                 // Bytes of string key the node has room for
+    int32_t height;                 // Levels the node is linked at
+    volatile unsigned char keyType;
+    volatile unsigned char valueType;
+    volatile unsigned char marked;  // Removed, or being removed, from the index
+} EMSorderedNode;
+// A node's heap offsets of the next node at each level follow it, then its string key
+#define EMSorderedNext(node)  ((volatile int64_t *) (((EMSorderedNode *) (node)) + 1))
+#define EMSorderedKey(node)   ((char *) &EMSorderedNext(node)[(node)->height])
+
+typedef struct {
+    int64_t head;                   // Node before every key, of EMS_ORDERED_MAX_HEIGHT
+    volatile int64_t nKeys;
+    volatile int64_t freeLock;      // Mutex of the lists of removed nodes
+    volatile int64_t freeNodes[EMS_ORDERED_MAX_HEIGHT];   // Removed nodes by height
+} EMSordered;
+
+// Flags of a scan of an ordered index
+#define EMS_SCAN_AFTER   0x1        // The first key is after the key the scan starts from, not at it
+#define EMS_SCAN_PREFIX  0x2        // The scan ends at the first key not beginning with the end key
 
 
 
@@ -158,8 +518,8 @@ extern char    emsBufFilenames[EMS_MAX_N_BUFS][MAX_FNAME_LEN];
 #define EMSdataData(idx)    ( EMSappIdx2emsIdx((idx) + EMS_ARR_CB_SIZE) )
 #define EMSdataTag(idx)     ( EMSappTag2emsTag((idx) + EMS_ARR_CB_SIZE) )
 #define EMSdataTagWord(idx) ( EMSappIdx2TagWordOffset((idx) + EMS_ARR_CB_SIZE) )
-#define EMSmapData(idx)     ( EMSappIdx2emsIdx((idx) + EMS_ARR_CB_SIZE + bufInt64[EMScbData(EMS_ARR_NELEM)]) )
-#define EMSmapTag(idx)      ( EMSappTag2emsTag((idx) + EMS_ARR_CB_SIZE + bufInt64[EMScbData(EMS_ARR_NELEM)]) )
+#define EMSmapData(idx)     ( EMSappIdx2emsIdx((idx) + EMS_ARR_CB_SIZE + region->nElements) )
+#define EMSmapTag(idx)      ( EMSappTag2emsTag((idx) + EMS_ARR_CB_SIZE + region->nElements) )
 #define EMSheapPtr(idx)     ( &bufChar[ bufInt64[EMScbData(EMS_ARR_HEAPBOT)] + (idx) ] )
 
 #define EMS_MEM_MALLOCBOT(bufChar) ((struct emsMem *) &bufChar[ bufInt64[EMScbData(EMS_ARR_MALLOCBOT)] ])
@@ -183,9 +543,39 @@ extern char    emsBufFilenames[EMS_MAX_N_BUFS][MAX_FNAME_LEN];
  }
 
 
+//==================================================================
+//  Recovery of locks held by processes that died
+//
+//  The long-held locks record the process ID of their holder: the critical
+//  section and heap allocator mutexes in the lock word itself, as do the
+//  stack and queue in the lock word after their control block slot.
+//  A waiter that has slept EMS_STUCK_NAPS times at the longest nap checks
+//  whether the holder is alive, and takes over the lock of a holder that died.
+//  In regions created with EMS_REGION_RECOVERY, reads and writes of elements
+//  that mark the tag BUSY record the holder and the tag's prior state in the
+//  region's hold records.  An element tag whose
+//  recorded holder died is restored to its prior state, or left undefined if
+//  the holder had already begun replacing the data.  Tags held BUSY by the
+//  other operations, and tags whose holder found its line of records full,
+//  are not recorded and never taken over.  A process found dead is removed
+//  from the registry of processes attached to the domain, and only the hold
+//  records of processes not registered alive are checked.
+#define EMS_STUCK_NAPS  2000
+#define EMS_STUCK_CHECK(nLongNaps) \
+    (EMScurrentNapTime == MAX_NAP_TIME  &&  ++(nLongNaps) % EMS_STUCK_NAPS == 0)
+#define EMS_CONTROL_OWNER(slot)   ((slot) + 1)
+#define EMS_CONTROL_HELD(pid)     ((((int64_t) (pid)) << 8) | EMS_TAG_BUSY)
+#define EMS_ALLOC_HELD(pid)       ((((int64_t) (pid)) << 8) | EMS_TAG_FULL)
+#define EMS_CRITICAL_HELD(pid)    ((((int32_t) (pid)) << 8) | EMS_TAG_EMPTY)
+#define EMSlockHolder(word)       ((int) ((word) >> 8))
+
+
+//  When the heap is exhausted, storage waiting to be reclaimed by epochs is freed and the allocation retried
 #define EMS_ALLOC(addr, len, bufChar, errmsg, retval)                    \
-  addr = emsMutexMem_alloc( EMS_MEM_MALLOCBOT(bufChar), \
-                (size_t) len, (char*) &bufInt64[EMScbData(EMS_ARR_MEM_MUTEX)] ); \
+  do { \
+      addr = emsMutexMem_alloc( EMS_MEM_MALLOCBOT(bufChar), \
+                    (size_t) len, (char*) &bufInt64[EMScbData(EMS_ARR_MEM_MUTEX)] ); \
+  } while (addr < 0  &&  EMSlimboDrain((void *) bufChar)); \
   if(addr < 0)  { \
       fprintf(stderr, "%s:%d (%s)  ERROR: EMS memory allocation of len(%zx) failed: %s\n", \
               __FILE__, __LINE__, __FUNCTION__, len, errmsg); \
@@ -196,17 +586,133 @@ extern char    emsBufFilenames[EMS_MAX_N_BUFS][MAX_FNAME_LEN];
   emsMutexMem_free( EMS_MEM_MALLOCBOT(bufChar), \
             (size_t) addr, (char*) &bufInt64[EMScbData(EMS_ARR_MEM_MUTEX)] )
 
+//  Strings and blobs still being viewed are orphaned instead, to be freed
+//  when the last view of them is released.  The value must already be
+//  unlinked from its element, regions with epochs free it once no process
+//  can still be reading it.
+#define EMS_FREE_VALUE(addr) \
+  if (!EMSisInline(addr)  && \
+      (EMSinternRefs((char *) EMSheapPtr(addr)) == 0  ||  EMSinternRelease(emsBuf, addr))  && \
+      EMSorphanValue((char *) EMSheapPtr(addr))) EMSretire(emsBuf, addr)
+
 size_t emsMutexMem_alloc(struct emsMem *heap,   // Base of EMS malloc structs
                          size_t len,    // Number of bytes to allocate
                          volatile char *mutex);  // Pointer to the mem allocator's mutex
 void emsMutexMem_free(struct emsMem *heap,  // Base of EMS malloc structs
                       size_t addr,  // Offset of alloc'd block in EMS memory
                       volatile char *mutex); // Pointer to the mem allocator's mutex
+void emsMutexMem_allocMany(struct emsMem *heap, int64_t nBlocks, const size_t *lens, int64_t *addrs, volatile char *mutex);
+void emsMutexMem_freeMany(struct emsMem *heap, int64_t nBlocks, const int64_t *addrs, volatile char *mutex);
 
 extern int EMSmyID;   // EMS Thread ID
 
-#define EMSisMapped (bufInt64[EMScbData(EMS_ARR_MAPBOT)]*(int64_t)EMSwordSize != bufInt64[EMScbData(EMS_ARR_MALLOCBOT)])
+#define EMSisMapped (region->isMapped)
 
 #include "ems_proto.h"
 
+extern EMSregion emsRegions[EMS_MAX_N_BUFS];
+
+//  Index of a key in a region whose keys are known to be mapped or not.
+//  Integer indexes are reduced here without the general conversion of a key.
+template <bool mapped>
+static inline int64_t EMSkeyIndex(const EMSregion *region, EMSvalueType *key) {
+    if (!mapped  &&  key->type == EMS_TYPE_INTEGER) return llabs((int64_t) key->value) % region->nElements;
+    return EMSkey2index(region, key, mapped);
+}
+
+//  Index of the element a write to a key goes to, allocating a mapped key if it is new
+template <bool mapped>
+static inline int64_t EMSwriteIndex(int mmapID, const EMSregion *region, EMSvalueType *key) {
+    if (!mapped) return EMSkeyIndex<false>(region, key);
+    return EMSwriteIndexMap(mmapID, key);
+}
+
+//  Length of the data of a string, blob, or JSON value passed to or returned by EMS.
+//  Strings and blobs carry their length, JSON describes its own.
+static inline size_t EMSvalueLength(const EMSvalueType *value) {
+    size_t length = value->length;
+    if (value->type == EMS_TYPE_JSON) EMSheapData(value->type, (const char *) value->value, &length);
+    return length;
+}
+
+//  Bytes of heap storage needed to store a string, blob, or JSON value
+static inline size_t EMSheapBytes(const EMSvalueType *value) {
+    if (value->type == EMS_TYPE_JSON) return EMSvalueBytes(value->type, value->value);
+    return EMS_COUNTED_HDR_SZ + value->length + 1;
+}
+
+//  Write the header and trailing NULL of a string or blob of length bytes
+static inline void EMSheapHeader(char *ptr, size_t length) {
+    uint32_t len = (uint32_t) length;
+    memset(ptr, 0, EMS_COUNTED_HDR_SZ);
+    ptr[0] = (char) EMS_VALUE_COUNTED;
+    memcpy(ptr + EMS_COUNTED_LEN, &len, sizeof(len));
+    ptr[EMS_COUNTED_HDR_SZ + length] = '\0';
+}
+
+//  Store a string, blob, or JSON value in EMSheapBytes(value) bytes of heap storage
+static inline void EMSheapStore(char *ptr, const EMSvalueType *value) {
+    if (value->type == EMS_TYPE_JSON) {
+        memcpy(ptr, value->value, EMSvalueBytes(value->type, value->value));
+        return;
+    }
+    EMSheapHeader(ptr, value->length);
+    memcpy(ptr + EMS_COUNTED_HDR_SZ, value->value, value->length);
+}
+
+//  Copy length bytes of a string, blob, or JSON value into memory the caller frees
+static inline void *EMSdataCopy(const void *data, size_t length) {
+    char *copy = (char *) malloc(length + 1);
+    if (copy != NULL) {
+        memcpy(copy, data, length);
+        copy[length] = '\0';
+    }
+    return copy;
+}
+
+//  Copy a string, blob, or JSON value off the heap into memory the caller frees
+static inline void *EMSheapCopy(unsigned char type, const char *ptr, size_t *length) {
+    const char *data = EMSheapData(type, ptr, length);
+    return EMSdataCopy(data, *length);
+}
+
+//  Copy an inline string or blob out of its data word into memory the caller frees
+static inline void *EMSinlineCopy(int64_t word, size_t *length) {
+    char buf[EMS_INLINE_MAX + 1];
+    EMSinlineData(word, buf, length);
+    return EMSdataCopy(buf, *length);
+}
+
+//  Copy the string, blob, or JSON value held by a data word into memory the caller frees
+#define EMSwordCopy(type, word, length) \
+    (EMSisInline(word) ? EMSinlineCopy((word), (length)) : EMSheapCopy((type), (const char *) EMSheapPtr(word), (length)))
+
+//  True for the values stored inline in their data word
+static inline bool EMSinlineable(const EMSvalueType *value) {
+    return (value->type == EMS_TYPE_STRING  ||  value->type == EMS_TYPE_BLOB)  &&  value->length <= EMS_INLINE_MAX;
+}
+
+//  True if the region shares one copy of values equal to this one
+#define EMSinterning(val)  (bufInt64[EMScbData(EMS_ARR_INTERN)] != 0  &&  (val)->type != EMS_TYPE_JSON)
+
+//  Store a string, blob, or JSON value and set word to the data word that holds it.
+//  Regions with an intern table share one copy of equal strings and blobs.
+#define EMS_STORE_VALUE(word, val, errmsg, retval) \
+  do { \
+      if (EMSinlineable(val)) { \
+          word = EMSinlineWord((const char *) (val)->value, (val)->length); \
+      } else if (!EMSinterning(val)  ||  (word = EMSinternShare(emsBuf, val)) < 0) { \
+          EMS_ALLOC(word, EMSheapBytes(val), bufChar, errmsg, retval); \
+          EMSheapStore((char *) EMSheapPtr(word), val); \
+          if (EMSinterning(val)) word = EMSintern(emsBuf, word); \
+      } \
+  } while (0)
+
+//  Strings and blobs longer than their header can describe are refused
+#define EMS_CHECK_LENGTH(value, where, retval) \
+  if ((value)->type != EMS_TYPE_JSON  &&  (value)->length > EMS_MAX_VALUE_LEN)  { \
+      fprintf(stderr, "%s: value of %zu bytes is too long to store\n", where, (size_t) (value)->length); \
+      return retval; \
+  }
+
 #endif //EMSPROJ_EMS_H
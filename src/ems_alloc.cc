@@ -228,6 +228,61 @@ size_t emsMem_size(struct emsMem *self, size_t offset) {
 }
 
 
+//-----------------------------------------------------------------------------+
+//  Sum the free blocks below a node of the tree, and find the largest
+static void EMS_usage(struct emsMem *self, size_t index, int32_t level, size_t *bytesFree, size_t *largestFree) {
+    size_t size = (1UL << (self->level - level)) * EMS_MEM_BLOCKSZ;
+    switch (self->tree[index]) {
+        case BUDDY_UNUSED:
+            *bytesFree += size;
+            if (size > *largestFree) *largestFree = size;
+            break;
+        case BUDDY_USED:
+        case BUDDY_FULL:
+            break;
+        default:
+            EMS_usage(self, index * 2 + 1, level + 1, bytesFree, largestFree);
+            EMS_usage(self, index * 2 + 2, level + 1, bytesFree, largestFree);
+            break;
+    }
+}
+
+//-----------------------------------------------------------------------------+
+//  Bytes not allocated, and the largest block that could be allocated.
+//  Their difference is the free space lost to fragmentation.
+void emsMem_usage(struct emsMem *self, size_t *bytesFree, size_t *largestFree) {
+    *bytesFree = 0;
+    *largestFree = 0;
+    EMS_usage(self, 0, 0, bytesFree, largestFree);
+}
+
+
+//-----------------------------------------------------------------------------+
+//  Count the free and the allocated blocks of each size, walking the tree
+//  like emsMem_dump.  Entry N counts blocks of EMS_MEM_BLOCKSZ << N bytes,
+//  both arrays must have room for self->level + 1 entries.
+static void EMS_blocks(struct emsMem *self, size_t index, int32_t level, int64_t *freeBlocks, int64_t *usedBlocks) {
+    switch (self->tree[index]) {
+        case BUDDY_UNUSED:
+            freeBlocks[self->level - level]++;
+            break;
+        case BUDDY_USED:
+            usedBlocks[self->level - level]++;
+            break;
+        default:
+            EMS_blocks(self, index * 2 + 1, level + 1, freeBlocks, usedBlocks);
+            EMS_blocks(self, index * 2 + 2, level + 1, freeBlocks, usedBlocks);
+            break;
+    }
+}
+
+void emsMem_blocks(struct emsMem *self, int64_t *freeBlocks, int64_t *usedBlocks) {
+    memset(freeBlocks, 0, (self->level + 1) * sizeof(int64_t));
+    memset(usedBlocks, 0, (self->level + 1) * sizeof(int64_t));
+    EMS_blocks(self, 0, 0, freeBlocks, usedBlocks);
+}
+
+
 //-----------------------------------------------------------------------------+
 //  Diagnostic state dump
 static void EMS_dump(struct emsMem *self, size_t index, int32_t level) {
@@ -52,6 +52,8 @@ size_t         emsMem_alloc(struct emsMem *, size_t bytesRequested);
 void           emsMem_free(struct emsMem *, size_t offset);
 size_t         emsMem_size(struct emsMem *, size_t offset);
 void           emsMem_dump(struct emsMem *);
+void           emsMem_usage(struct emsMem *, size_t *bytesFree, size_t *largestFree);
+void           emsMem_blocks(struct emsMem *, int64_t *freeBlocks, int64_t *usedBlocks);
 size_t         emsNextPow2(int64_t x);
 
 #endif
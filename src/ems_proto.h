@@ -34,8 +34,31 @@
 // ---------------------------------------------------------------------------------
 //  Non-exposed API functions
 int64_t EMSwriteIndexMap(const int mmapID, EMSvalueType *key);
-int64_t EMSkey2index(void *emsBuf, EMSvalueType *key, bool is_mapped);
+int64_t EMSkey2index(const EMSregion *region, EMSvalueType *key, bool is_mapped);
 int64_t EMShashString(const char *key);
+void EMSdrainReaders(void *emsBuf, int64_t idx, EMStag_t volatile *mapTag);
+bool EMSheapValueUnlocked(void *emsBuf, unsigned char type, int64_t data, const char **str, size_t *length);
+bool EMSreadOptimistic(void *emsBuf, int64_t idx, EMSvalueType *returnValue, bool waitFull, int64_t *versionRead);
+bool EMSreadIndex(const EMSregion *region, int64_t idx, EMSvalueType *returnValue);
+bool EMSstoreValue(void *emsBuf, int64_t idx, unsigned char oldType, EMSvalueType *value, int64_t stored);
+void EMSretire(void *emsBuf, int64_t offset);
+bool EMSlimboDrain(void *emsBuf);
+int64_t EMSinternShare(void *emsBuf, const EMSvalueType *value);
+int64_t EMSintern(void *emsBuf, int64_t offset);
+int64_t EMSinternFind(void *emsBuf, const char *data, size_t length);
+bool EMSinternRelease(void *emsBuf, int64_t offset);
+void EMSrmwKernels(EMSregion *region);
+int EMSpid(void);
+bool EMSprocessDead(int pid);
+bool EMSrecoverTag(EMStag_t volatile *tag);
+void EMScontrolLock(void *emsBuf, int slot);
+void EMScontrolUnlock(void *emsBuf, int slot);
+size_t EMSpackedHeader(const unsigned char *p, const unsigned char *end, int *kind, uint64_t *count);
+const unsigned char *EMSpackedSkip(const unsigned char *p, const unsigned char *end);
+bool EMSpackedNumber(const unsigned char *p, const unsigned char *end, bool *isInt, int64_t *intValue, double *dblValue);
+size_t EMSpackHeader(unsigned char *out, int kind, uint64_t count);
+size_t EMSpackInteger(unsigned char *out, int64_t i);
+size_t EMSpackDouble(unsigned char *out, double d);
 
 
 // ---------------------------------------------------------------------------------
@@ -43,15 +66,47 @@ int64_t EMShashString(const char *key);
 extern "C" int EMScriticalEnter(int mmapID, int timeout);
 extern "C" bool EMScriticalExit(int mmapID);
 extern "C" int EMSbarrier(int mmapID, int timeout);
+extern "C" bool EMStaskStarted(int mmapID, int taskN, int pid);
+extern "C" bool EMStaskPost(int mmapID, int taskN, const char *msg);
+extern "C" bool EMStaskReceive(int mmapID, int taskN, EMSvalueType *returnValue);
+extern "C" bool EMStaskDone(int mmapID, int taskN, bool failed);
+extern "C" int EMStaskJoin(int mmapID);
+extern "C" int64_t EMStaskGraphNew(int mmapID, const char *name, int64_t maxTasks, int64_t maxEdges);
+extern "C" int64_t EMStaskGraphAdd(int mmapID, int64_t graphID,
+                                   int nInputs, EMStaskElement *inputs, int nOutputs, EMStaskElement *outputs);
+extern "C" bool EMStaskGraphStart(int mmapID, int64_t graphID);
+extern "C" int64_t EMStaskGraphNext(int mmapID, int64_t graphID);
+extern "C" bool EMStaskGraphDone(int mmapID, int64_t graphID, int64_t taskN);
+extern "C" int64_t EMSorderedNew(int mmapID, const char *name);
+extern "C" bool EMSorderedPut(int mmapID, int64_t indexID, EMSvalueType *key, EMSvalueType *value);
+extern "C" bool EMSorderedRemove(int mmapID, int64_t indexID, EMSvalueType *key);
+extern "C" bool EMSorderedGet(int mmapID, int64_t indexID, EMSvalueType *key, EMSvalueType *returnValue);
+extern "C" int64_t EMSorderedCount(int mmapID, int64_t indexID);
+extern "C" int EMSorderedScan(int mmapID, int64_t indexID, EMSvalueType *from, EMSvalueType *to, int flags,
+                              int maxItems, EMSvalueType *keys, EMSvalueType *values);
 extern "C" bool EMSsingleTask(int mmapID);
+extern "C" int64_t EMSnewLock(int mmapID, const char *name, int lockType, int32_t count);
+extern "C" int EMSlockAcquire(int mmapID, int64_t lockID, bool shared, int timeout);
+extern "C" bool EMSlockRelease(int mmapID, int64_t lockID, bool shared);
 extern "C" bool EMScas(int mmapID, EMSvalueType *key,
             EMSvalueType *oldValue, EMSvalueType *newValue,
             EMSvalueType *returnValue);
 extern "C" bool EMSfaa(int mmapID, EMSvalueType *key, EMSvalueType *value, EMSvalueType *returnValue);
+extern "C" bool EMSreadField(int mmapID, EMSvalueType *key, int nPath, EMSvalueType *path, EMSvalueType *returnValue);
+extern "C" bool EMSwriteField(int mmapID, EMSvalueType *key, int nPath, EMSvalueType *path, EMSvalueType *value);
+extern "C" bool EMSfaaField(int mmapID, EMSvalueType *key, int nPath, EMSvalueType *path,
+                            EMSvalueType *value, EMSvalueType *returnValue);
 extern "C" int EMSpush(int mmapID, EMSvalueType *value);
 extern "C" bool EMSpop(int mmapID, EMSvalueType *returnValue);
 extern "C" int EMSenqueue(int mmapID, EMSvalueType *value);
 extern "C" bool EMSdequeue(int mmapID, EMSvalueType *returnValue);
+extern "C" bool EMStmStart(int nElems, EMStmElement *elems);
+extern "C" bool EMStmEnd(int nElems, EMStmElement *elems, bool doCommit);
+extern "C" int EMSstmStart(void);
+extern "C" bool EMSstmRead(int txID, int mmapID, EMSvalueType *key, EMSvalueType *returnValue);
+extern "C" bool EMSstmAborted(int txID);
+extern "C" bool EMSstmWrite(int txID, int mmapID, EMSvalueType *key, EMSvalueType *value);
+extern "C" bool EMSstmEnd(int txID, bool doCommit);
 extern "C" bool EMSloopInit(int mmapID, int32_t start, int32_t end, int32_t minChunk, int schedule_mode);
 extern "C" bool EMSloopChunk(int mmapID, int32_t *start, int32_t *end);
 extern "C" unsigned char EMStransitionFEtag(EMStag_t volatile *tag, EMStag_t volatile *mapTag, unsigned char oldFE, unsigned char newFE, unsigned char oldType);
@@ -59,15 +114,24 @@ extern "C" bool EMSreadRW(const int mmapID, EMSvalueType *key, EMSvalueType *ret
 extern "C" bool EMSreadFF(const int mmapID, EMSvalueType *key, EMSvalueType *returnValue);
 extern "C" bool EMSreadFE(const int mmapID, EMSvalueType *key, EMSvalueType *returnValue);
 extern "C" bool EMSread(const int mmapID, EMSvalueType *key, EMSvalueType *returnValue);
+extern "C" bool EMSreadView(const int mmapID, EMSvalueType *key, EMSvalueType *returnValue, int64_t *view);
+extern "C" bool EMSreleaseView(const int mmapID, int64_t view);
 extern "C" int EMSreleaseRW(const int mmapID, EMSvalueType *key);
 extern "C" bool EMSwriteXF(int mmapID, EMSvalueType *key, EMSvalueType *value);
 extern "C" bool EMSwriteXE(int mmapID, EMSvalueType *key, EMSvalueType *value);
 extern "C" bool EMSwriteEF(int mmapID, EMSvalueType *key, EMSvalueType *value);
 extern "C" bool EMSwrite(int mmapID, EMSvalueType *key, EMSvalueType *value);
+extern "C" int64_t EMSwriteMany(int mmapID, int64_t nItems, EMSvalueType *keys, EMSvalueType *values);
 extern "C" bool EMSsetTag(int mmapID, EMSvalueType *key, bool is_full);
 extern "C" bool EMSdestroy(int mmapID, bool do_unlink);
 extern "C" bool EMSindex2key(int mmapID, int64_t idx, EMSvalueType *key);
 extern "C" bool EMSsync(int mmapID);
+extern "C" bool EMSstats(int mmapID, EMSstatsType *stats, bool reset);
+extern "C" int EMShotspots(int mmapID, EMShotspotType *spots, int maxSpots);
+extern "C" int64_t EMSexport(int mmapID, const char *filename, int format, int64_t start, int64_t end);
+extern "C" int64_t EMSimport(int mmapID, const char *filename, int format, int part, int nParts);
+extern "C" int64_t EMSscanKeys(int mmapID, int64_t start, int64_t end, int64_t maxItems,
+                               EMSvalueType *keys, EMSvalueType *values, int64_t *next);
 extern "C" int EMSinitialize(int64_t nElements,     // 0
                   size_t heapSize,        // 1
                   bool useMap,            // 2
@@ -82,4 +146,5 @@ extern "C" int EMSinitialize(int64_t nElements,     // 0
                   int EMSmyID,            // 11
                   bool pinThreads,        // 12
                   int32_t nThreads,       // 13
-                  int32_t pctMLock );     // 14
+                  int32_t pctMLock,       // 14
+                  int32_t regionFlags );  // 15
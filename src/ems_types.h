@@ -62,5 +62,99 @@ typedef struct {
 } EMSvalueType;
 
 
+// One element of a transaction's read and write sets
+#define EMS_TM_LOCKED      0  // Held empty (read-write) or under a readers-writer lock (read-only)
+#define EMS_TM_OPTIMISTIC  1  // Read-only, not locked, validated against its version stamp at commit
+#define EMS_TM_DUPLICATE   2  // Also appears earlier in the global order, acquired only once
+typedef struct {
+    int mmapID;            // Region holding the element
+    EMSvalueType key;      // Index or mapped key of the element
+    bool readOnly;         // Element is only read by the transaction
+    // Set by EMStmStart
+    int64_t index;         // Index of the element in the region
+    int state;             // EMS_TM_LOCKED, EMS_TM_OPTIMISTIC or EMS_TM_DUPLICATE
+    int64_t version;       // Version stamp an optimistic element was read at
+    EMSvalueType value;    // Value of the element when the transaction started
+} EMStmElement;
+
+
+// Element access kernels compiled for one region configuration
+typedef bool (*EMSreadFn)(int mmapID, EMSvalueType *key, EMSvalueType *returnValue, int64_t *view);
+typedef bool (*EMSwriteFn)(int mmapID, EMSvalueType *key, EMSvalueType *value);
+typedef bool (*EMSfaaFn)(int mmapID, EMSvalueType *key, EMSvalueType *value, EMSvalueType *returnValue);
+typedef bool (*EMScasFn)(int mmapID, EMSvalueType *key, EMSvalueType *oldValue, EMSvalueType *newValue,
+                             EMSvalueType *returnValue);
+
+
+// Per-process descriptor of each mapped region, indexed by the same mmapID
+// as emsBufs.  The geometry of a region does not change once it is initialized,
+// so it is read from here instead of the control block shared by all processes.
+typedef struct {
+    char *buf;             // Base of the mapping, NULL if unused
+    int64_t nElements;     // # of data elements, 0 for the EMS control block
+    int32_t regionFlags;   // EMS_REGION_* tables the region has
+    bool isMapped;         // Keys are mapped to indexes
+    volatile int64_t *stats;   // This process' line of performance counters, NULL if not counted
+    // Kernels specialized for mapped or indexed keys, selected when the region is attached
+    EMSreadFn readAny;     // Ignore the tag
+    EMSreadFn readFF;      // Full and leave full, also used for views
+    EMSreadFn readFE;      // Full and leave empty
+    EMSreadFn readRW;      // Under a readers-writer lock
+    EMSwriteFn writeAny;   // Ignore the tag
+    EMSwriteFn writeXF;    // Any state and leave full
+    EMSwriteFn writeXE;    // Any state and leave empty
+    EMSwriteFn writeEF;    // Empty and leave full
+    EMSfaaFn faa;
+    EMScasFn cas;
+} EMSregion;
+
+
+// Performance counters of a region summed over all processes, and the state
+// of its heap and stack or queue sampled when they are read.  The counters
+// are 0 unless the region was created with EMS_REGION_STATS.
+typedef struct {
+    int64_t tagWaits;          // Full/Empty tag transitions that had to wait
+    int64_t tagWaitNs;         // Time spent in those waits
+    int64_t lookups;           // Mapped keys looked up
+    int64_t probes;            // Map entries examined by those lookups
+    int64_t allocWaits;        // Acquisitions of the heap allocator's mutex that had to wait
+    int64_t allocWaitNs;       // Time spent in those waits
+    int64_t allocFails;        // Heap allocations that failed
+    int64_t heapFree;          // Bytes of heap not allocated
+    int64_t heapLargestFree;   // Largest allocation that would succeed
+    int64_t depth;             // Elements on the stack or queue
+} EMSstatsType;
+
+
+// A tag of a region created with EMS_REGION_STATS that processes recently waited
+// on, with the waits summed from the region's ring of samples
+#define EMS_HOTSPOT_ELEMENT     0    // Tag of a data element
+#define EMS_HOTSPOT_BUCKET      1    // Tag of a map bucket, locked while its key is looked up
+#define EMS_HOTSPOT_CONTROL     2    // Tag of a control block slot, such as the stack top
+#define EMS_HOTSPOT_NBUCKETS    8    // Wait histogram buckets: <1us, <10us, ... <1s, >=1s
+typedef struct {
+    int64_t index;             // Element or map bucket index, or control block slot
+    int32_t kind;              // EMS_HOTSPOT_*
+    int64_t waits;             // Sampled waits on the tag
+    int64_t waitNs;            // Time spent in those waits
+    int64_t maxWaitNs;         // Longest of those waits
+    uint64_t processes;        // Bit (process ID % 64) set for each process that waited
+    int64_t histogram[EMS_HOTSPOT_NBUCKETS];   // Waits by decade of duration
+} EMShotspotType;
+
+
+// Formats of the files written by EMSexport and read by EMSimport
+#define EMS_FORMAT_NDJSON       0    // One JSON array [key,value] per line
+#define EMS_FORMAT_CSV          1    // A key,value header, then one key,value row per element
+#define EMS_FORMAT_COLUMNS      2    // Binary columns of keys and values, described in bulk.cc
+
+
+// An input or output element of a task in a task graph
+typedef struct {
+    int mmapID;            // Region holding the element
+    EMSvalueType key;      // Index or mapped key of the element
+} EMStaskElement;
+
+
 #endif
 //EMSPROJ_EMS_TYPES_H
@@ -0,0 +1,766 @@
+/*-----------------------------------------------------------------------------+
+ |  Extended Memory Semantics (EMS)                            Version 1.6.1   |
+ |  http://mogill.com/                                       jace@mogill.com   |
+ +-----------------------------------------------------------------------------+
+ |  Copyright (c) 2016-2020, Jace A Mogill.  All rights reserved.              |
+ |                                                                             |
+ | Redistribution and use in source and binary forms, with or without          |
+ | modification, are permitted provided that the following conditions are met: |
+ |    * Redistributions of source code must retain the above copyright         |
+ |      notice, this list of conditions and the following disclaimer.          |
+ |    * Redistributions in binary form must reproduce the above copyright      |
+ |      notice, this list of conditions and the following disclaimer in the    |
+ |      documentation and/or other materials provided with the distribution.   |
+ |    * Neither the name of the Synthetic Semantics nor the names of its       |
+ |      contributors may be used to endorse or promote products derived        |
+ |      from this software without specific prior written permission.          |
+ |                                                                             |
+ |    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS      |
+ |    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT        |
+ |    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR    |
+ |    A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SYNTHETIC         |
+ |    SEMANTICS LLC BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,   |
+ |    EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,      |
+ |    PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR       |
+ |    PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF   |
+ |    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING     |
+ |    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS       |
+ |    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.             |
+ |                                                                             |
+ +-----------------------------------------------------------------------------*/
+#include "ems.h"
+
+//==================================================================
+//  Fields of JSON Documents
+//
+//  JSON values stored packed as MessagePack are accessed in place by a
+//  path of map keys and array indexes.  Encodings are skipped over, not
+//  decoded, and an update rewrites only the bytes of the field: a value
+//  of the same encoded size is overwritten, otherwise the rest of the
+//  document is moved within its heap block, or the document is copied
+//  to a new block when it no longer fits.  Map and array headers count
+//  members, not bytes, so the containers enclosing a field are unchanged
+//  unless a member is added to them.
+
+// Position of a field within a document, offsets are from the start of the document
+typedef struct {
+    size_t field;         // Offset of the field's encoding, 0 if the field is not present
+    size_t fieldLen;
+    size_t parent;        // Offset of the header of the map or array holding the field
+    size_t parentHdrLen;
+    size_t parentEnd;     // Offset of the end of the parent's members
+    int parentKind;
+    uint64_t parentCount;
+} EMSfieldPos;
+
+//  Returned strings and documents are copied to a process-local buffer
+static unsigned char *EMSfieldBuf = NULL;
+static size_t EMSfieldBufLen = 0;
+
+
+//  Decode the header of the item at p, for scalars the header is the
+//  whole encoding.  Returns the length of the header, or 0 if it is
+//  truncated or the item is an extension type
+size_t EMSpackedHeader(const unsigned char *p, const unsigned char *end, int *kind, uint64_t *count) {
+    if (p >= end) return 0;
+    unsigned char op = *p;
+    int nBytes;
+    *count = 0;
+    if (op <= 0x7f  ||  op >= 0xe0  ||  op == 0xc0  ||  op == 0xc2  ||  op == 0xc3) {
+        *kind = EMS_PACKED_SCALAR;
+        return 1;
+    } else if (op >= 0x80  &&  op <= 0xbf) {
+        *kind = (op >= 0xa0) ? EMS_PACKED_BYTES : (op >= 0x90) ? EMS_PACKED_ARRAY : EMS_PACKED_MAP;
+        *count = op & ((op >= 0xa0) ? 0x1f : 0x0f);
+        return 1;
+    }
+    switch (op) {
+        case 0xca: *kind = EMS_PACKED_SCALAR;  nBytes = 4;  break;
+        case 0xcb: *kind = EMS_PACKED_SCALAR;  nBytes = 8;  break;
+        case 0xcc: case 0xcd: case 0xce: case 0xcf:
+            *kind = EMS_PACKED_SCALAR;  nBytes = 1 << (op - 0xcc);  break;
+        case 0xd0: case 0xd1: case 0xd2: case 0xd3:
+            *kind = EMS_PACKED_SCALAR;  nBytes = 1 << (op - 0xd0);  break;
+        case 0xc4: case 0xc5: case 0xc6:
+            *kind = EMS_PACKED_BYTES;  nBytes = 1 << (op - 0xc4);  break;
+        case 0xd9: case 0xda: case 0xdb:
+            *kind = EMS_PACKED_BYTES;  nBytes = 1 << (op - 0xd9);  break;
+        case 0xdc: case 0xdd:
+            *kind = EMS_PACKED_ARRAY;  nBytes = 2 << (op - 0xdc);  break;
+        case 0xde: case 0xdf:
+            *kind = EMS_PACKED_MAP;  nBytes = 2 << (op - 0xde);  break;
+        default:
+            return 0;
+    }
+    if ((size_t) (end - p) < (size_t) (1 + nBytes)) return 0;
+    if (*kind != EMS_PACKED_SCALAR) {
+        for (int byteN = 1;  byteN <= nBytes;  byteN++) *count = (*count << 8) | p[byteN];
+    }
+    return 1 + nBytes;
+}
+
+
+//  Returns the end of the encoded value starting at p, or NULL if it is corrupt
+const unsigned char *EMSpackedSkip(const unsigned char *p, const unsigned char *end) {
+    uint64_t pending = 1;
+    while (pending > 0) {
+        int kind;
+        uint64_t count;
+        size_t hdrLen = EMSpackedHeader(p, end, &kind, &count);
+        if (hdrLen == 0) return NULL;
+        p += hdrLen;
+        pending--;
+        if (kind == EMS_PACKED_BYTES) {
+            if ((uint64_t) (end - p) < count) return NULL;
+            p += count;
+        } else if (kind == EMS_PACKED_ARRAY) {
+            pending += count;
+        } else if (kind == EMS_PACKED_MAP) {
+            pending += 2 * count;
+        }
+        if (pending > (uint64_t) (end - p)) return NULL;  // Every item occupies at least one byte
+    }
+    return p;
+}
+
+
+//  Decode an integer or floating point number, returns false if the item is not a number
+bool EMSpackedNumber(const unsigned char *p, const unsigned char *end,
+                     bool *isInt, int64_t *intValue, double *dblValue) {
+    int kind;
+    uint64_t count;
+    size_t hdrLen = EMSpackedHeader(p, end, &kind, &count);
+    if (hdrLen == 0  ||  kind != EMS_PACKED_SCALAR) return false;
+    unsigned char op = *p;
+    uint64_t u64 = 0;
+    for (size_t byteN = 1;  byteN < hdrLen;  byteN++) u64 = (u64 << 8) | p[byteN];
+    *isInt = true;
+    if (op <= 0x7f  ||  op >= 0xe0) {
+        *intValue = (int8_t) op;
+    } else if (op >= 0xcc  &&  op <= 0xcf) {
+        if (u64 > (uint64_t) INT64_MAX) {
+            *isInt = false;
+            *dblValue = (double) u64;
+        }
+        *intValue = (int64_t) u64;
+    } else if (op >= 0xd0  &&  op <= 0xd3) {
+        int shift = 64 - 8 * (int) (hdrLen - 1);  // Sign extend
+        *intValue = (int64_t) (u64 << shift) >> shift;
+    } else if (op == 0xca) {
+        uint32_t u32 = (uint32_t) u64;
+        float f;
+        memcpy(&f, &u32, sizeof(f));
+        *isInt = false;
+        *dblValue = f;
+    } else if (op == 0xcb) {
+        EMSulong_double alias;
+        alias.u64 = u64;
+        *isInt = false;
+        *dblValue = alias.d;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+
+static size_t EMSpackBigEndian(unsigned char *out, uint64_t value, int nBytes) {
+    for (int byteN = 0;  byteN < nBytes;  byteN++) {
+        out[byteN] = (unsigned char) (value >> (8 * (nBytes - 1 - byteN)));
+    }
+    return nBytes;
+}
+
+
+//  Encode the header of a string, array, or map
+size_t EMSpackHeader(unsigned char *out, int kind, uint64_t count) {
+    unsigned char fixBase = (kind == EMS_PACKED_BYTES) ? 0xa0 : (kind == EMS_PACKED_ARRAY) ? 0x90 : 0x80;
+    unsigned char op16 = (kind == EMS_PACKED_BYTES) ? 0xda : (kind == EMS_PACKED_ARRAY) ? 0xdc : 0xde;
+    if (count <= ((kind == EMS_PACKED_BYTES) ? 31u : 15u)) {
+        out[0] = (unsigned char) (fixBase | count);
+        return 1;
+    } else if (kind == EMS_PACKED_BYTES  &&  count <= UINT8_MAX) {
+        out[0] = 0xd9;
+        return 1 + EMSpackBigEndian(out + 1, count, 1);
+    } else if (count <= UINT16_MAX) {
+        out[0] = op16;
+        return 1 + EMSpackBigEndian(out + 1, count, 2);
+    } else {
+        out[0] = (unsigned char) (op16 + 1);
+        return 1 + EMSpackBigEndian(out + 1, count, 4);
+    }
+}
+
+
+size_t EMSpackInteger(unsigned char *out, int64_t i) {
+    if (i >= -32  &&  i <= INT8_MAX) {
+        out[0] = (unsigned char) i;
+        return 1;
+    } else if (i > 0) {
+        int nBytes = (i <= UINT8_MAX) ? 1 : (i <= UINT16_MAX) ? 2 : (i <= UINT32_MAX) ? 4 : 8;
+        out[0] = (unsigned char) (0xcc + ((nBytes == 8) ? 3 : nBytes / 2));
+        return 1 + EMSpackBigEndian(out + 1, (uint64_t) i, nBytes);
+    } else {
+        int nBytes = (i >= INT8_MIN) ? 1 : (i >= INT16_MIN) ? 2 : (i >= INT32_MIN) ? 4 : 8;
+        out[0] = (unsigned char) (0xd0 + ((nBytes == 8) ? 3 : nBytes / 2));
+        return 1 + EMSpackBigEndian(out + 1, (uint64_t) i, nBytes);
+    }
+}
+
+
+size_t EMSpackDouble(unsigned char *out, double d) {
+    EMSulong_double alias;
+    alias.d = d;
+    out[0] = 0xcb;
+    return 1 + EMSpackBigEndian(out + 1, alias.u64, 8);
+}
+
+
+//  Encode a value to be stored in a document.  Numbers are encoded in the
+//  scratch buffer, strings in a buffer the caller frees, and packed JSON
+//  is used in place.  Returns false if the value cannot be stored
+static bool EMSpackValue(EMSvalueType *value, unsigned char *scratch,
+                         const unsigned char **enc, size_t *encLen, unsigned char **toFree) {
+    *enc = scratch;
+    *toFree = NULL;
+    switch (value->type) {
+        case EMS_TYPE_BOOLEAN:
+            scratch[0] = value->value ? 0xc3 : 0xc2;
+            *encLen = 1;
+            return true;
+        case EMS_TYPE_INTEGER:
+            *encLen = EMSpackInteger(scratch, (int64_t) value->value);
+            return true;
+        case EMS_TYPE_FLOAT: {
+            EMSulong_double alias;
+            alias.u64 = (uint64_t) value->value;
+            *encLen = EMSpackDouble(scratch, alias.d);
+            return true;
+        }
+        case EMS_TYPE_UNDEFINED:
+            scratch[0] = 0xc0;
+            *encLen = 1;
+            return true;
+        case EMS_TYPE_STRING:
+        case EMS_TYPE_BLOB: {
+            size_t len = value->length;
+            *toFree = (unsigned char *) malloc(EMS_PACKED_MAX_HDR + len);
+            if (*toFree == NULL) return false;
+            if (value->type == EMS_TYPE_STRING) {
+                *encLen = EMSpackHeader(*toFree, EMS_PACKED_BYTES, len);
+            } else {  //  bin 8, 16, or 32
+                int nBytes = (len <= UINT8_MAX) ? 1 : (len <= UINT16_MAX) ? 2 : 4;
+                (*toFree)[0] = (unsigned char) (0xc4 + nBytes / 2);
+                *encLen = 1 + EMSpackBigEndian(*toFree + 1, len, nBytes);
+            }
+            memcpy(*toFree + *encLen, value->value, len);
+            *encLen += len;
+            *enc = *toFree;
+            return true;
+        }
+        case EMS_TYPE_JSON:
+            if (!EMSisPackedJSON(value->type, value->value)) return false;
+            *enc = ((const unsigned char *) value->value) + EMS_JSON_PACKED_HDR_SZ;
+            *encLen = EMSvalueBytes(value->type, value->value) - EMS_JSON_PACKED_HDR_SZ;
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+//  A path component naming a map member, integer components are decimal names
+static bool EMSpathName(EMSvalueType *component, char *numBuf, const char **name, size_t *nameLen) {
+    if (component->type == EMS_TYPE_STRING) {
+        *name = (const char *) component->value;
+        *nameLen = component->length;
+    } else if (component->type == EMS_TYPE_INTEGER) {
+        *nameLen = sprintf(numBuf, "%" PRId64, (int64_t) component->value);
+        *name = numBuf;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+
+//  A path component indexing an array, strings of digits are indexes
+static bool EMSpathIndex(EMSvalueType *component, int64_t *index) {
+    if (component->type == EMS_TYPE_INTEGER) {
+        *index = (int64_t) component->value;
+    } else if (component->type == EMS_TYPE_STRING) {
+        const char *str = (const char *) component->value;
+        char *endPtr;
+        if (*str < '0'  ||  *str > '9') return false;
+        *index = strtoll(str, &endPtr, 10);
+        if (endPtr != str + component->length) return false;
+    } else {
+        return false;
+    }
+    return *index >= 0;
+}
+
+
+//==================================================================
+//  Find the field named by a path in a document.  If only the last
+//  component of the path is missing the field's offset is 0 and its
+//  parent describes where it would be added.  Returns false if the
+//  path does not lead to the field's parent or the document is corrupt.
+static bool EMSfindField(const unsigned char *doc, size_t docLen, int nPath, EMSvalueType *path, EMSfieldPos *pos) {
+    const unsigned char *end = doc + docLen;
+    const unsigned char *item = doc + EMS_JSON_PACKED_HDR_SZ;
+    for (int pathN = 0;  pathN < nPath;  pathN++) {
+        bool isLast = (pathN == nPath - 1);
+        int kind;
+        uint64_t count;
+        size_t hdrLen = EMSpackedHeader(item, end, &kind, &count);
+        if (hdrLen == 0  ||  (kind != EMS_PACKED_ARRAY  &&  kind != EMS_PACKED_MAP)) return false;
+        pos->parent = item - doc;
+        pos->parentHdrLen = hdrLen;
+        pos->parentKind = kind;
+        pos->parentCount = count;
+        const unsigned char *member = item + hdrLen;
+        const unsigned char *found = NULL;
+        if (kind == EMS_PACKED_ARRAY) {
+            int64_t index;
+            if (!EMSpathIndex(&path[pathN], &index)) return false;
+            for (uint64_t elemN = 0;  member != NULL  &&  elemN < count;  elemN++) {
+                if (elemN == (uint64_t) index) {
+                    found = member;
+                    break;
+                }
+                member = EMSpackedSkip(member, end);
+            }
+        } else {
+            char numBuf[MAX_NUMBER2STR_LEN];
+            const char *name;
+            size_t nameLen;
+            int64_t index = -1;
+            bool hasIndex = EMSpathIndex(&path[pathN], &index);
+            if (!EMSpathName(&path[pathN], numBuf, &name, &nameLen)) return false;
+            for (uint64_t memberN = 0;  member != NULL  &&  memberN < count;  memberN++) {
+                //  Keys are strings, or integers from languages with integer keys
+                int keyKind;
+                uint64_t keyLen;
+                size_t keyHdrLen = EMSpackedHeader(member, end, &keyKind, &keyLen);
+                const unsigned char *value = EMSpackedSkip(member, end);
+                if (keyHdrLen == 0  ||  value == NULL) return false;
+                bool matched;
+                if (EMSpackedIsString(*member)) {
+                    matched = (keyLen == nameLen  &&  memcmp(member + keyHdrLen, name, nameLen) == 0);
+                } else {
+                    bool isInt;
+                    int64_t intKey;
+                    double dblKey;
+                    matched = hasIndex  &&  EMSpackedNumber(member, end, &isInt, &intKey, &dblKey)  &&
+                              isInt  &&  intKey == index;
+                }
+                if (matched) {
+                    found = value;
+                    break;
+                }
+                member = EMSpackedSkip(value, end);
+            }
+        }
+        if (member == NULL) return false;
+        if (found == NULL) {
+            if (!isLast) return false;
+            pos->parentEnd = member - doc;
+            pos->field = 0;
+            pos->fieldLen = 0;
+            return true;
+        }
+        item = found;
+    }
+    const unsigned char *fieldEnd = EMSpackedSkip(item, end);
+    if (fieldEnd == NULL) return false;
+    pos->field = item - doc;
+    pos->fieldLen = fieldEnd - item;
+    return true;
+}
+
+
+//==================================================================
+//  Documents are edited in place under the element's tag, except in
+//  regions with epochs, whose plain reads copy documents without the
+//  tag.  There a write edits a private copy of the document, which
+//  replaces the element's document once it is complete.
+static bool EMSfieldPrivate(void *emsBuf, int64_t *docWord) {
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    if (bufInt64[EMScbData(EMS_ARR_EPOCHS)] == 0) return true;
+    const unsigned char *doc = (const unsigned char *) EMSheapPtr(*docWord);
+    size_t docLen = EMSvalueBytes(EMS_TYPE_JSON, doc);
+    int64_t copyOffset;
+    EMS_ALLOC(copyOffset, docLen, bufChar, "EMSwriteField: out of memory to copy the document", false);
+    memcpy(EMSheapPtr(copyOffset), doc, docLen);
+    *docWord = copyOffset;
+    return true;
+}
+
+
+//  Replace the element's document with the edited one if they differ, or
+//  discard the edited one if the edits failed
+static void EMSfieldPublish(void *emsBuf, int64_t idx, int64_t docWord, bool ok) {
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    int64_t oldOffset = bufInt64[EMSdataData(idx)];
+    if (docWord == oldOffset) return;
+    if (ok) {
+        bufInt64[EMSdataData(idx)] = docWord;
+        EMSretire(emsBuf, oldOffset);
+    } else {
+        EMSretire(emsBuf, docWord);
+    }
+}
+
+
+//  Make room for the document being edited for element idx to grow to
+//  newDocLen bytes, moving it to a larger heap block if it outgrows its
+//  block.  The document is unchanged if there is no memory for it.
+static bool EMSfieldReserve(void *emsBuf, int64_t idx, int64_t *docWord, size_t newDocLen) {
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    unsigned char *doc = (unsigned char *) EMSheapPtr(*docWord);
+    size_t docLen = EMSvalueBytes(EMS_TYPE_JSON, doc);
+    if (newDocLen - EMS_JSON_PACKED_HDR_SZ > UINT32_MAX) {
+        fprintf(stderr, "EMSwriteField: Document is too large\n");
+        return false;
+    }
+    //  Allocations are rounded up to a power of two blocks, the
+    //  document's block is at least as large as this
+    size_t capacity = emsNextPow2((docLen + EMS_MEM_BLOCKSZ - 1) / EMS_MEM_BLOCKSZ) * EMS_MEM_BLOCKSZ;
+    if (newDocLen <= capacity) return true;
+    //  The moved document is complete before it replaces the old one
+    int64_t newOffset;
+    EMS_ALLOC(newOffset, newDocLen, bufChar, "EMSwriteField: out of memory to store the document", false);
+    memcpy(EMSheapPtr(newOffset), doc, docLen);
+    int64_t oldOffset = *docWord;
+    *docWord = newOffset;
+    if (oldOffset != bufInt64[EMSdataData(idx)]) EMSretire(emsBuf, oldOffset);
+    return true;
+}
+
+
+//  Replace oldLen bytes at offset pos of a document with newLen bytes,
+//  the document's block must already have room for the result
+static void EMSfieldEdit(unsigned char *doc, size_t pos, size_t oldLen, const unsigned char *newBytes, size_t newLen) {
+    size_t docLen = EMSvalueBytes(EMS_TYPE_JSON, doc);
+    uint32_t packedLen = (uint32_t) (docLen - oldLen + newLen - EMS_JSON_PACKED_HDR_SZ);
+    memmove(doc + pos + newLen, doc + pos + oldLen, docLen - pos - oldLen);
+    memcpy(doc + pos, newBytes, newLen);
+    memcpy(doc + 1, &packedLen, sizeof(packedLen));
+}
+
+
+//  Replace oldLen bytes at offset pos of the document being edited
+//  for element idx with newLen bytes.  Returns false, leaving the
+//  document unchanged, if there is no memory for it.
+static bool EMSfieldSplice(void *emsBuf, int64_t idx, int64_t *docWord, size_t pos, size_t oldLen,
+                           const unsigned char *newBytes, size_t newLen) {
+    char *bufChar = (char *) emsBuf;
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    size_t docLen = EMSvalueBytes(EMS_TYPE_JSON, (unsigned char *) EMSheapPtr(*docWord));
+    if (!EMSfieldReserve(emsBuf, idx, docWord, docLen - oldLen + newLen)) return false;
+    EMSfieldEdit((unsigned char *) EMSheapPtr(*docWord), pos, oldLen, newBytes, newLen);
+    return true;
+}
+
+
+//  Store the encoding of a field, adding it to its parent if it is not present
+static bool EMSfieldStore(void *emsBuf, int64_t idx, int64_t *docWord, EMSfieldPos *pos,
+                          EMSvalueType *lastComponent, const unsigned char *enc, size_t encLen) {
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    if (pos->field != 0) {
+        if (encLen == pos->fieldLen) {
+            memcpy(EMSheapPtr(*docWord) + pos->field, enc, encLen);
+            return true;
+        }
+        return EMSfieldSplice(emsBuf, idx, docWord, pos->field, pos->fieldLen, enc, encLen);
+    }
+
+    //  Append a new member to the parent and count it in the parent's header,
+    //  the room for both is made before either edit so a failure changes nothing
+    unsigned char header[EMS_PACKED_MAX_HDR];
+    size_t hdrLen = EMSpackHeader(header, pos->parentKind, pos->parentCount + 1);
+    unsigned char *member = NULL;
+    size_t memberLen;
+    if (pos->parentKind == EMS_PACKED_MAP) {
+        char numBuf[MAX_NUMBER2STR_LEN];
+        const char *name;
+        size_t nameLen;
+        if (!EMSpathName(lastComponent, numBuf, &name, &nameLen)) return false;
+        member = (unsigned char *) malloc(EMS_PACKED_MAX_HDR + nameLen + encLen);
+        if (member == NULL) {
+            fprintf(stderr, "EMSwriteField: Unable to allocate space to encode the field\n");
+            return false;
+        }
+        memberLen = EMSpackHeader(member, EMS_PACKED_BYTES, nameLen);
+        memcpy(member + memberLen, name, nameLen);
+        memcpy(member + memberLen + nameLen, enc, encLen);
+        memberLen += nameLen + encLen;
+    } else {
+        int64_t index;
+        if (!EMSpathIndex(lastComponent, &index)  ||  (uint64_t) index != pos->parentCount) {
+            fprintf(stderr, "EMSwriteField: Array elements may only be appended to the end of the array\n");
+            return false;
+        }
+        memberLen = encLen;
+    }
+    size_t docLen = EMSvalueBytes(EMS_TYPE_JSON, (unsigned char *) EMSheapPtr(*docWord));
+    bool stored = EMSfieldReserve(emsBuf, idx, docWord, docLen + memberLen - pos->parentHdrLen + hdrLen);
+    if (stored) {
+        //  The member goes after the parent, whose header is before it and may grow
+        unsigned char *doc = (unsigned char *) EMSheapPtr(*docWord);
+        EMSfieldEdit(doc, pos->parentEnd, 0, (member != NULL) ? member : enc, memberLen);
+        EMSfieldEdit(doc, pos->parent, pos->parentHdrLen, header, hdrLen);
+    }
+    free(member);
+    return stored;
+}
+
+
+//==================================================================
+//  Wait for the element holding a document to be full and mark it busy.
+//  Returns the element's index, or -1 if it does not hold a packed document.
+static int64_t EMSfieldAcquire(int mmapID, EMSvalueType *key, bool isWrite, EMStag_t *oldTag, const char *caller) {
+    const EMSregion *region = &emsRegions[mmapID];
+    void *emsBuf = region->buf;
+    volatile EMStag_t *bufTags = (EMStag_t *) emsBuf;
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    int64_t idx = EMSkey2index(region, key, EMSisMapped);
+    if (idx < 0  ||  idx >= region->nElements) {
+        fprintf(stderr, "%s: index out of bounds\n", caller);
+        return -1;
+    }
+    volatile EMStag_t *maptag;
+    if (EMSisMapped) { maptag = &bufTags[EMSmapTag(idx)]; }
+    else             { maptag = NULL; }
+    oldTag->byte = EMStransitionFEtag(&bufTags[EMSdataTag(idx)], maptag,
+                                      EMS_TAG_FULL, EMS_TAG_BUSY, EMS_TAG_ANY);
+    oldTag->tags.fe = EMS_TAG_FULL;
+    if (isWrite) EMSdrainReaders(emsBuf, idx, maptag);
+    if (oldTag->tags.type != EMS_TYPE_JSON  ||
+        !EMSisPackedJSON(EMS_TYPE_JSON, EMSheapPtr(bufInt64[EMSdataData(idx)]))) {
+        fprintf(stderr, "%s: The element does not hold an object or array\n", caller);
+        bufTags[EMSdataTag(idx)].byte = oldTag->byte;
+        if (EMSisMapped) bufTags[EMSmapTag(idx)].tags.fe = EMS_TAG_FULL;
+        return -1;
+    }
+    if (isWrite) EMS_VERSION_BEGIN_WRITE(idx);
+    return idx;
+}
+
+
+static void EMSfieldRelease(int mmapID, int64_t idx, bool isWrite, EMStag_t oldTag) {
+    const EMSregion *region = &emsRegions[mmapID];
+    void *emsBuf = region->buf;
+    volatile EMStag_t *bufTags = (EMStag_t *) emsBuf;
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    if (isWrite) EMS_VERSION_END_WRITE(idx);
+    bufTags[EMSdataTag(idx)].byte = oldTag.byte;
+    if (EMSisMapped) bufTags[EMSmapTag(idx)].tags.fe = EMS_TAG_FULL;
+}
+
+
+//  Copy the value of a field to the process-local buffer
+static bool EMSfieldValue(const unsigned char *field, size_t fieldLen, EMSvalueType *returnValue) {
+    const unsigned char *end = field + fieldLen;
+    int kind;
+    uint64_t count;
+    bool isInt;
+    int64_t intValue;
+    double dblValue;
+    size_t hdrLen = EMSpackedHeader(field, end, &kind, &count);
+    if (*field == 0xc2  ||  *field == 0xc3) {
+        returnValue->type = EMS_TYPE_BOOLEAN;
+        returnValue->value = (void *) (*field == 0xc3);
+        return true;
+    }
+    if (EMSpackedNumber(field, end, &isInt, &intValue, &dblValue)) {
+        if (isInt) {
+            returnValue->type = EMS_TYPE_INTEGER;
+            returnValue->value = (void *) intValue;
+        } else {
+            EMSulong_double alias;
+            alias.d = dblValue;
+            returnValue->type = EMS_TYPE_FLOAT;
+            returnValue->value = (void *) alias.u64;
+        }
+        return true;
+    }
+    //  Strings are returned as strings, anything else as a packed document
+    bool isString = EMSpackedIsString(*field);
+    size_t len = isString ? count : EMS_JSON_PACKED_HDR_SZ + fieldLen;
+    if (len + 1 > EMSfieldBufLen) {
+        unsigned char *newBuf = (unsigned char *) realloc(EMSfieldBuf, len + 1);
+        if (newBuf == NULL) {
+            fprintf(stderr, "EMSreadField: Unable to allocate space to copy the field\n");
+            return false;
+        }
+        EMSfieldBuf = newBuf;
+        EMSfieldBufLen = len + 1;
+    }
+    if (isString) {
+        memcpy(EMSfieldBuf, field + hdrLen, len);
+        returnValue->type = EMS_TYPE_STRING;
+    } else {
+        uint32_t packedLen = (uint32_t) fieldLen;
+        EMSfieldBuf[0] = EMS_JSON_PACKED;
+        memcpy(EMSfieldBuf + 1, &packedLen, sizeof(packedLen));
+        memcpy(EMSfieldBuf + EMS_JSON_PACKED_HDR_SZ, field, fieldLen);
+        returnValue->type = EMS_TYPE_JSON;
+    }
+    EMSfieldBuf[len] = '\0';
+    returnValue->value = (void *) EMSfieldBuf;
+    returnValue->length = len;
+    return true;
+}
+
+
+//==================================================================
+//  Read the field of the object or array held by an element.
+//  Missing fields are undefined.
+bool EMSreadField(int mmapID, EMSvalueType *key, int nPath, EMSvalueType *path, EMSvalueType *returnValue) {
+    void *emsBuf = emsBufs[mmapID];
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    EMStag_t oldTag;
+    int64_t idx = EMSfieldAcquire(mmapID, key, false, &oldTag, "EMSreadField");
+    if (idx < 0) return false;
+
+    const unsigned char *doc = (const unsigned char *) EMSheapPtr(bufInt64[EMSdataData(idx)]);
+    EMSfieldPos pos;
+    bool ok = EMSfindField(doc, EMSvalueBytes(EMS_TYPE_JSON, doc), nPath, path, &pos);
+    if (ok  &&  pos.field != 0) {
+        ok = EMSfieldValue(doc + pos.field, pos.fieldLen, returnValue);
+    } else {
+        returnValue->type = EMS_TYPE_UNDEFINED;
+        returnValue->value = (void *) 0xdeafbeef;
+        ok = true;
+    }
+    EMSfieldRelease(mmapID, idx, false, oldTag);
+    return ok;
+}
+
+
+//==================================================================
+//  Write the field of the object or array held by an element, the
+//  last component of the path is added to its object if it is missing,
+//  or appended to its array if it is the array's length.
+bool EMSwriteField(int mmapID, EMSvalueType *key, int nPath, EMSvalueType *path, EMSvalueType *value) {
+    void *emsBuf = emsBufs[mmapID];
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    unsigned char scratch[EMS_PACKED_MAX_HDR];
+    const unsigned char *enc;
+    size_t encLen;
+    unsigned char *toFree;
+    if (nPath < 1) {
+        fprintf(stderr, "EMSwriteField: The path is empty\n");
+        return false;
+    }
+    if (!EMSpackValue(value, scratch, &enc, &encLen, &toFree)) {
+        fprintf(stderr, "EMSwriteField: Unable to encode a value of type %d\n", value->type);
+        return false;
+    }
+    EMStag_t oldTag;
+    int64_t idx = EMSfieldAcquire(mmapID, key, true, &oldTag, "EMSwriteField");
+    bool ok = false;
+    if (idx >= 0) {
+        int64_t docWord = bufInt64[EMSdataData(idx)];
+        const unsigned char *doc = (const unsigned char *) EMSheapPtr(docWord);
+        EMSfieldPos pos;
+        if (!EMSfindField(doc, EMSvalueBytes(EMS_TYPE_JSON, doc), nPath, path, &pos)) {
+            fprintf(stderr, "EMSwriteField: The path does not lead to an object or array\n");
+        } else if (EMSfieldPrivate(emsBuf, &docWord)) {
+            ok = EMSfieldStore(emsBuf, idx, &docWord, &pos, &path[nPath - 1], enc, encLen);
+            EMSfieldPublish(emsBuf, idx, docWord, ok);
+        }
+        EMSfieldRelease(mmapID, idx, true, oldTag);
+    }
+    free(toFree);
+    return ok;
+}
+
+
+//==================================================================
+//  Atomically add to a number in the object or array held by an element.
+//  Returns the original value, a missing field is added with the value
+//  of the increment and undefined is returned.
+bool EMSfaaField(int mmapID, EMSvalueType *key, int nPath, EMSvalueType *path,
+                 EMSvalueType *value, EMSvalueType *returnValue) {
+    void *emsBuf = emsBufs[mmapID];
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    bool addIsInt = (value->type == EMS_TYPE_INTEGER  ||  value->type == EMS_TYPE_BOOLEAN);
+    int64_t addInt = addIsInt ? (int64_t) value->value : 0;
+    double addDbl;
+    if (value->type == EMS_TYPE_FLOAT) {
+        EMSulong_double alias;
+        alias.u64 = (uint64_t) value->value;
+        addDbl = alias.d;
+    } else if (addIsInt) {
+        addDbl = (double) addInt;
+    } else {
+        fprintf(stderr, "EMSfaaField: Only numbers may be added to a field\n");
+        return false;
+    }
+    if (nPath < 1) {
+        fprintf(stderr, "EMSfaaField: The path is empty\n");
+        return false;
+    }
+
+    EMStag_t oldTag;
+    int64_t idx = EMSfieldAcquire(mmapID, key, true, &oldTag, "EMSfaaField");
+    if (idx < 0) return false;
+    int64_t docWord = bufInt64[EMSdataData(idx)];
+    const unsigned char *doc = (const unsigned char *) EMSheapPtr(docWord);
+    size_t docLen = EMSvalueBytes(EMS_TYPE_JSON, doc);
+    EMSfieldPos pos;
+    unsigned char enc[EMS_PACKED_MAX_HDR];
+    size_t encLen;
+    bool ok = EMSfindField(doc, docLen, nPath, path, &pos);
+    if (!ok) {
+        fprintf(stderr, "EMSfaaField: The path does not lead to an object or array\n");
+    } else if (pos.field == 0) {
+        returnValue->type = EMS_TYPE_UNDEFINED;
+        returnValue->value = (void *) 0xf00dd00f;
+        encLen = addIsInt ? EMSpackInteger(enc, addInt) : EMSpackDouble(enc, addDbl);
+        ok = EMSfieldPrivate(emsBuf, &docWord)  &&
+             EMSfieldStore(emsBuf, idx, &docWord, &pos, &path[nPath - 1], enc, encLen);
+    } else {
+        bool isInt;
+        int64_t intValue;
+        double dblValue;
+        ok = EMSpackedNumber(doc + pos.field, doc + docLen, &isInt, &intValue, &dblValue);
+        if (!ok) {
+            fprintf(stderr, "EMSfaaField: The field is not a number\n");
+        } else if (isInt) {
+            returnValue->type = EMS_TYPE_INTEGER;
+            returnValue->value = (void *) intValue;
+            //  A sum which overflows an integer becomes a float, as it does in EMSfaa
+            int64_t sum;
+            if (addIsInt  &&  !__builtin_add_overflow(intValue, addInt, &sum)) {
+                encLen = EMSpackInteger(enc, sum);
+            } else {
+                encLen = EMSpackDouble(enc, (double) intValue + addDbl);
+            }
+        } else {
+            EMSulong_double alias;
+            alias.d = dblValue;
+            returnValue->type = EMS_TYPE_FLOAT;
+            returnValue->value = (void *) alias.u64;
+            encLen = EMSpackDouble(enc, dblValue + addDbl);
+        }
+        if (ok) {
+            ok = EMSfieldPrivate(emsBuf, &docWord)  &&
+                 EMSfieldStore(emsBuf, idx, &docWord, &pos, &path[nPath - 1], enc, encLen);
+        }
+    }
+    EMSfieldPublish(emsBuf, idx, docWord, ok);
+    EMSfieldRelease(mmapID, idx, true, oldTag);
+    return ok;
+}
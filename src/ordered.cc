@@ -0,0 +1,766 @@
+/*-----------------------------------------------------------------------------+
+ |  Extended Memory Semantics (EMS)                            Version 1.6.1   |
+ |  http://mogill.com/                                       jace@mogill.com   |
+ +-----------------------------------------------------------------------------+
+ |  Copyright (c) 2016-2020, Jace A Mogill.  All rights reserved.              |
+ |                                                                             |
+ | Redistribution and use in source and binary forms, with or without          |
+ | modification, are permitted provided that the following conditions are met: |
+ |    * Redistributions of source code must retain the above copyright         |
+ |      notice, this list of conditions and the following disclaimer.          |
+ |    * Redistributions in binary form must reproduce the above copyright      |
+ |      notice, this list of conditions and the following disclaimer in the    |
+ |      documentation and/or other materials provided with the distribution.   |
+ |    * Neither the name of the Synthetic Semantics nor the names of its       |
+ |      contributors may be used to endorse or promote products derived        |
+ |      from this software without specific prior written permission.          |
+ |                                                                             |
+ |    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS      |
+ |    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT        |
+ |    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR    |
+ |    A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SYNTHETIC         |
+ |    SEMANTICS LLC BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,   |
+ |    EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,      |
+ |    PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR       |
+ |    PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF   |
+ |    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING     |
+ |    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS       |
+ |    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.             |
+ |                                                                             |
+ +-----------------------------------------------------------------------------*/
+#include "ems.h"
+
+//==================================================================
+//  Ordered Indexes
+//
+//  An ordered index keeps keys in order so they can be scanned by range or
+//  prefix, which the hashed map of a region cannot do.  It is a skiplist
+//  on the heap: booleans come first, then numbers in numeric order, then
+//  strings and blobs ordered by their bytes.
+//
+//  Traversals use optimistic lock coupling.  The version of a node is read
+//  before its fields and revalidated after, and a node's predecessor is
+//  revalidated after the link to it was followed, so every step taken is a
+//  link that was in the list when it was taken.  A traversal which finds a
+//  version changed starts over.  Writers lock the nodes they change by
+//  advancing the version they read when they found them, so a lock is only
+//  acquired if the node has not changed since.  Locks are never waited on
+//  while others are held, a writer unable to lock every node releases the
+//  ones it holds and starts over.
+//
+//  A key is removed by marking its node, which makes the key absent, then
+//  unlinking the node at every level.  Inserts of a key whose node is marked
+//  wait until it is unlinked.
+#define EMSorderedPtr(indexID)      ((EMSordered *) EMSheapPtr(indexID))
+#define EMSorderedNodePtr(offset)   ((EMSorderedNode *) EMSheapPtr(offset))
+
+
+//  Results of a get or scan are returned in a process-local buffer which
+//  remains valid until the next get or scan
+static char  *EMSorderedBuf = NULL;
+static size_t EMSorderedBufLen = 0;
+static size_t EMSorderedBufUsed = 0;
+
+//  Per-process state of the generator of node heights
+static uint64_t EMSorderedSeed = 0;
+
+
+//==================================================================
+//  Node versions
+static inline int64_t EMSorderedStable(EMSorderedNode *node) {
+    RESET_NAP_TIME;
+    int64_t version = node->version;
+    while (version & 1) {
+        NANOSLEEP;
+        version = node->version;
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return version;
+}
+
+static inline bool EMSorderedValid(EMSorderedNode *node, int64_t version) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return node->version == version;
+}
+
+static inline bool EMSorderedLock(EMSorderedNode *node, int64_t version) {
+    return __sync_bool_compare_and_swap(&node->version, version, version + 1);
+}
+
+static inline void EMSorderedLockWait(EMSorderedNode *node) {
+    while (!EMSorderedLock(node, EMSorderedStable(node))) ;
+}
+
+static inline void EMSorderedUnlock(EMSorderedNode *node) {
+    __sync_fetch_and_add(&node->version, 1);
+}
+
+
+//==================================================================
+//  Key order
+static inline int EMSorderedClass(unsigned char type) {
+    switch (type) {
+        case EMS_TYPE_BOOLEAN: return 0;
+        case EMS_TYPE_INTEGER:
+        case EMS_TYPE_FLOAT:   return 1;
+        default:               return 2;
+    }
+}
+
+static inline long double EMSorderedNumber(unsigned char type, int64_t word) {
+    if (type == EMS_TYPE_INTEGER) return (long double) word;
+    EMSulong_double alias;
+    alias.u64 = (uint64_t) word;
+    return (long double) alias.d;
+}
+
+//  Bytes of a node's string key, the length is clamped to the node in case
+//  the node is being reused under the reader
+static inline size_t EMSorderedKeyLen(const EMSorderedNode *node) {
+    uint64_t keyLen = (uint64_t) node->keyWord;
+    return (keyLen > (uint64_t) node->keyCap) ? (size_t) node->keyCap : (size_t) keyLen;
+}
+
+//  Compare a key with the key of a node, negative if the key comes first.
+//  Integers and floats of equal value are ordered integer first.  The node may
+//  be changing under the caller, which only trusts the result once the node's
+//  version is revalidated.
+static int EMSorderedCompare(const EMSvalueType *key, EMSorderedNode *node) {
+    unsigned char nodeType = node->keyType;
+    int64_t nodeWord = node->keyWord;
+    int diff = EMSorderedClass(key->type) - EMSorderedClass(nodeType);
+    if (diff != 0) return diff;
+    switch (EMSorderedClass(key->type)) {
+        case 0:
+            return (key->value != NULL) - (nodeWord != 0);
+        case 1: {
+            if (key->type == EMS_TYPE_INTEGER  &&  nodeType == EMS_TYPE_INTEGER) {
+                int64_t keyInt = (int64_t) key->value;
+                return (keyInt > nodeWord) - (keyInt < nodeWord);
+            }
+            long double keyNum = EMSorderedNumber(key->type, (int64_t) key->value);
+            long double nodeNum = EMSorderedNumber(nodeType, nodeWord);
+            if (keyNum != nodeNum) return (keyNum < nodeNum) ? -1 : 1;
+            return (key->type == EMS_TYPE_FLOAT) - (nodeType == EMS_TYPE_FLOAT);
+        }
+        default: {
+            size_t nodeLen = EMSorderedKeyLen(node);
+            int cmp = memcmp(key->value, EMSorderedKey(node), (key->length < nodeLen) ? key->length : nodeLen);
+            if (cmp != 0) return cmp;
+            if (key->length != nodeLen) return (key->length < nodeLen) ? -1 : 1;
+            return (key->type == EMS_TYPE_BLOB) - (nodeType == EMS_TYPE_BLOB);
+        }
+    }
+}
+
+//  True if the string or blob key of a node begins with the bytes of prefix
+static bool EMSorderedHasPrefix(const EMSvalueType *prefix, EMSorderedNode *node) {
+    return EMSorderedClass(node->keyType) == 2  &&  EMSorderedKeyLen(node) >= prefix->length  &&
+           memcmp(EMSorderedKey(node), prefix->value, prefix->length) == 0;
+}
+
+//  Keys are booleans, numbers other than NaN, strings, or blobs
+static bool EMSorderedKeyValid(const EMSvalueType *key, const char *where) {
+    switch (key->type) {
+        case EMS_TYPE_BOOLEAN:
+        case EMS_TYPE_INTEGER:
+            return true;
+        case EMS_TYPE_FLOAT: {
+            EMSulong_double alias;
+            alias.u64 = (uint64_t) key->value;
+            if (alias.d == alias.d) return true;
+            fprintf(stderr, "%s: NaN is not ordered and cannot be a key\n", where);
+            return false;
+        }
+        case EMS_TYPE_STRING:
+        case EMS_TYPE_BLOB:
+            if (key->length <= INT32_MAX) return true;
+            fprintf(stderr, "%s: Key of %zu bytes is too long\n", where, key->length);
+            return false;
+        default:
+            fprintf(stderr, "%s: Keys must be booleans, numbers, strings, or blobs\n", where);
+            return false;
+    }
+}
+
+
+//==================================================================
+//  Find the last node before key and the first node at or after it at
+//  every level, with the versions the nodes before had when they were read.
+//  Returns the highest level the node after is equal to key at, or -1 if
+//  no node has the key.
+static int EMSorderedFind(void *emsBuf, EMSordered *index, const EMSvalueType *key,
+                          int64_t *preds, int64_t *predVersions, int64_t *succs) {
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+restart:
+    int found = -1;
+    int64_t pred = index->head;
+    EMSorderedNode *predNode = EMSorderedNodePtr(pred);
+    int64_t predVersion = EMSorderedStable(predNode);
+    for (int level = EMS_ORDERED_MAX_HEIGHT - 1;  level >= 0;  level--) {
+        int64_t curr = EMSorderedNext(predNode)[level];
+        while (curr != EMS_HEAP_NULL) {
+            EMSorderedNode *currNode = EMSorderedNodePtr(curr);
+            int64_t currVersion = EMSorderedStable(currNode);
+            if (!EMSorderedValid(predNode, predVersion)) goto restart;
+            int cmp = EMSorderedCompare(key, currNode);
+            if (!EMSorderedValid(currNode, currVersion)) goto restart;
+            if (cmp <= 0) {
+                if (cmp == 0  &&  found < 0) found = level;
+                break;
+            }
+            pred = curr;
+            predNode = currNode;
+            predVersion = currVersion;
+            curr = EMSorderedNext(predNode)[level];
+        }
+        if (curr == EMS_HEAP_NULL  &&  !EMSorderedValid(predNode, predVersion)) goto restart;
+        preds[level] = pred;
+        predVersions[level] = predVersion;
+        succs[level] = curr;
+    }
+    return found;
+}
+
+
+//  Lock the nodes found before a key at the lowest height levels, each only
+//  if it is unchanged since it was found.  Returns false holding no locks
+//  if any of them changed.
+static bool EMSorderedLockPreds(void *emsBuf, int height, const int64_t *preds, const int64_t *predVersions) {
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    for (int level = 0;  level < height;  level++) {
+        if (level > 0  &&  preds[level] == preds[level - 1]) continue;
+        if (!EMSorderedLock(EMSorderedNodePtr(preds[level]), predVersions[level])) {
+            for (int held = 0;  held < level;  held++) {
+                if (held == 0  ||  preds[held] != preds[held - 1]) EMSorderedUnlock(EMSorderedNodePtr(preds[held]));
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+static void EMSorderedUnlockPreds(void *emsBuf, int height, const int64_t *preds) {
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    for (int level = 0;  level < height;  level++) {
+        if (level == 0  ||  preds[level] != preds[level - 1]) EMSorderedUnlock(EMSorderedNodePtr(preds[level]));
+    }
+}
+
+
+//  Height of a new node, each level is linked at 1/4 of the nodes of the level below
+static int EMSorderedHeight() {
+    if (EMSorderedSeed == 0) EMSorderedSeed = ((uint64_t) EMSpid() << 32) ^ (uint64_t) time(NULL) ^ 0x9E3779B97F4A7C15ULL;
+    EMSorderedSeed ^= EMSorderedSeed << 13;
+    EMSorderedSeed ^= EMSorderedSeed >> 7;
+    EMSorderedSeed ^= EMSorderedSeed << 17;
+    int height = 1;
+    for (uint64_t bits = EMSorderedSeed;  height < EMS_ORDERED_MAX_HEIGHT  &&  (bits & 3) == 0;  bits >>= 2) height++;
+    return height;
+}
+
+
+//  A locked node of height levels with room for key, not yet linked into the
+//  index.  Nodes removed from the index are reused before the heap is allocated
+//  from.  Returns EMS_HEAP_NULL if the heap is exhausted.
+static int64_t EMSorderedNodeNew(void *emsBuf, EMSordered *index, int height, const EMSvalueType *key) {
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    size_t keyLen = (EMSorderedClass(key->type) == 2) ? key->length : 0;
+    int64_t offset;
+    EMSorderedNode *node;
+
+    RESET_NAP_TIME;
+    while (__sync_lock_test_and_set(&index->freeLock, 1) != 0) NANOSLEEP;
+    offset = index->freeNodes[height - 1];
+    if (offset != EMS_HEAP_NULL  &&  (size_t) EMSorderedNodePtr(offset)->keyCap >= keyLen) {
+        index->freeNodes[height - 1] = EMSorderedNodePtr(offset)->freeNext;
+    } else {
+        offset = EMS_HEAP_NULL;
+    }
+    __sync_lock_release(&index->freeLock);
+
+    if (offset != EMS_HEAP_NULL) {
+        //  Traversals which read the node before it was removed may still be reading it
+        node = EMSorderedNodePtr(offset);
+        EMSorderedLockWait(node);
+    } else {
+        size_t keyCap = ((keyLen + 1 + sizeof(int64_t) - 1) / sizeof(int64_t)) * sizeof(int64_t);
+        size_t nodeSz = sizeof(EMSorderedNode) + height * sizeof(int64_t) + keyCap;
+        EMS_ALLOC(offset, nodeSz, bufChar, "EMSorderedPut: node", EMS_HEAP_NULL);
+        node = EMSorderedNodePtr(offset);
+        node->version = 1;
+        node->keyCap = (int32_t) keyCap;
+        node->height = height;
+    }
+    node->freeNext = EMS_HEAP_NULL;
+    node->marked = 0;
+    node->valueType = EMS_TYPE_UNDEFINED;
+    node->keyType = key->type;
+    if (EMSorderedClass(key->type) == 2) {
+        memcpy(EMSorderedKey(node), key->value, keyLen);
+        node->keyWord = (int64_t) keyLen;
+    } else if (key->type == EMS_TYPE_BOOLEAN) {
+        node->keyWord = (key->value != NULL);
+    } else {
+        node->keyWord = (int64_t) key->value;
+    }
+    return offset;
+}
+
+
+//  Keep a node unlinked from the index for reuse by a later insert
+static void EMSorderedNodeFree(void *emsBuf, EMSordered *index, int64_t offset) {
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    EMSorderedNode *node = EMSorderedNodePtr(offset);
+    RESET_NAP_TIME;
+    while (__sync_lock_test_and_set(&index->freeLock, 1) != 0) NANOSLEEP;
+    node->freeNext = index->freeNodes[node->height - 1];
+    index->freeNodes[node->height - 1] = offset;
+    __sync_lock_release(&index->freeLock);
+}
+
+
+//  Data word holding a value, strings, blobs, and JSON are stored as they are in elements
+static bool EMSorderedStoreValue(void *emsBuf, EMSvalueType *value, int64_t *word) {
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    switch (value->type) {
+        case EMS_TYPE_BOOLEAN:
+        case EMS_TYPE_INTEGER:
+        case EMS_TYPE_FLOAT:
+            *word = (int64_t) value->value;
+            return true;
+        case EMS_TYPE_UNDEFINED:
+            *word = 0xdeadbeef;
+            return true;
+        case EMS_TYPE_STRING:
+        case EMS_TYPE_BLOB:
+        case EMS_TYPE_JSON: {
+            EMS_CHECK_LENGTH(value, "EMSorderedPut", false);
+            int64_t stored;
+            EMS_STORE_VALUE(stored, value, "EMSorderedPut: value", false);
+            *word = stored;
+            return true;
+        }
+        default:
+            fprintf(stderr, "EMSorderedPut: Unknown type of value\n");
+            return false;
+    }
+}
+
+
+//==================================================================
+//  Copy bytes to the result buffer, returning their offset in it or -1
+static int64_t EMSorderedCopy(const char *data, size_t length) {
+    if (EMSorderedBufUsed + length + 1 > EMSorderedBufLen) {
+        size_t newLen = 2 * (EMSorderedBufUsed + length + 1);
+        char *newBuf = (char *) realloc(EMSorderedBuf, newLen);
+        if (newBuf == NULL) {
+            fprintf(stderr, "EMSordered: Unable to allocate space to copy a result\n");
+            return -1;
+        }
+        EMSorderedBuf = newBuf;
+        EMSorderedBufLen = newLen;
+    }
+    int64_t copied = (int64_t) EMSorderedBufUsed;
+    memcpy(EMSorderedBuf + copied, data, length);
+    EMSorderedBuf[copied + length] = '\0';
+    EMSorderedBufUsed += length + 1;
+    return copied;
+}
+
+//  Strings, blobs, and JSON in results refer to the result buffer by offset
+//  until the buffer stops moving
+static inline bool EMSorderedByRef(unsigned char type) {
+    return type == EMS_TYPE_STRING  ||  type == EMS_TYPE_BLOB  ||  type == EMS_TYPE_JSON;
+}
+
+static inline void EMSorderedResolve(EMSvalueType *result) {
+    if (EMSorderedByRef(result->type)) result->value = EMSorderedBuf + (intptr_t) result->value;
+}
+
+
+//  Copy the key and value of a node read at a version to the result buffer.
+//  The key is not copied if key is NULL.  Returns 1 if copied, 0 if the node
+//  changed and the copy must be discarded, -1 on error.
+static int EMSorderedSnapshot(void *emsBuf, EMSorderedNode *node, int64_t version,
+                              EMSvalueType *key, EMSvalueType *value) {
+    unsigned char valueType = node->valueType;
+    int64_t valueWord = node->valueWord;
+    if (key != NULL) {
+        key->type = node->keyType;
+        key->length = 0;
+        if (EMSorderedClass(key->type) == 2) {
+            key->length = EMSorderedKeyLen(node);
+            int64_t copied = EMSorderedCopy(EMSorderedKey(node), key->length);
+            if (copied < 0) return -1;
+            key->value = (void *) copied;
+        } else {
+            key->value = (void *) node->keyWord;
+        }
+    }
+    value->type = valueType;
+    value->length = 0;
+    value->value = (void *) valueWord;
+    if (EMSorderedByRef(valueType)) {
+        char inlineBuf[EMS_INLINE_MAX + 1];
+        const char *data;
+        if (EMSisInline(valueWord)  &&  valueType != EMS_TYPE_JSON) {
+            data = EMSinlineData(valueWord, inlineBuf, &value->length);
+        } else if (!EMSheapValueUnlocked(emsBuf, valueType, valueWord, &data, &value->length)) {
+            return 0;
+        }
+        int64_t copied = EMSorderedCopy(data, value->length);
+        if (copied < 0) return -1;
+        value->value = (void *) copied;
+    }
+    return EMSorderedValid(node, version) ? 1 : 0;
+}
+
+
+//==================================================================
+//  Find or create the ordered index with this name in the region's heap.
+//  Returns the heap offset of the index or -1 on error.
+int64_t EMSorderedNew(int mmapID, const char *name) {
+    void *emsBuf = emsBufs[mmapID];
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    volatile EMStag_t *bufTags = (EMStag_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    volatile char *memMutex = (char *) &bufInt64[EMScbData(EMS_ARR_MEM_MUTEX)];
+    int32_t nameLen = (int32_t) strlen(name);
+
+    //  Wait until the directory is full, mark it busy while it is searched and extended
+    EMStransitionFEtag(&bufTags[EMScbTag(EMS_ARR_NAMEDIR)], NULL, EMS_TAG_FULL, EMS_TAG_BUSY, EMS_TAG_ANY);
+    int64_t entryOffset = bufInt64[EMScbData(EMS_ARR_NAMEDIR)];
+    while (entryOffset != EMS_HEAP_NULL) {
+        EMSnamedObject *entry = (EMSnamedObject *) EMSheapPtr(entryOffset);
+        if (entry->objType == EMS_OBJ_ORDERED  &&  entry->nameLen == nameLen  &&
+            memcmp(EMSnamedObjectName(entry), name, nameLen) == 0) {
+            bufTags[EMScbTag(EMS_ARR_NAMEDIR)].tags.fe = EMS_TAG_FULL;
+            return entry->object;
+        }
+        entryOffset = entry->next;
+    }
+
+    //  The index and its head node are one allocation
+    size_t indexSz = ((sizeof(EMSordered) + EMS_CACHELINE_SZ - 1) / EMS_CACHELINE_SZ) * EMS_CACHELINE_SZ;
+    size_t headSz = sizeof(EMSorderedNode) + EMS_ORDERED_MAX_HEIGHT * sizeof(int64_t);
+    int64_t indexID = emsMutexMem_alloc(EMS_MEM_MALLOCBOT(bufChar), indexSz + headSz, memMutex);
+    entryOffset = emsMutexMem_alloc(EMS_MEM_MALLOCBOT(bufChar), sizeof(EMSnamedObject) + nameLen + 1, memMutex);
+    if (indexID < 0  ||  entryOffset < 0) {
+        fprintf(stderr, "EMSorderedNew: Out of heap memory to create ordered index \"%s\"\n", name);
+        if (indexID >= 0) EMS_FREE(indexID);
+        if (entryOffset >= 0) EMS_FREE(entryOffset);
+        bufTags[EMScbTag(EMS_ARR_NAMEDIR)].tags.fe = EMS_TAG_FULL;
+        return -1;
+    }
+
+    EMSordered *index = EMSorderedPtr(indexID);
+    index->head = indexID + indexSz;
+    index->nKeys = 0;
+    index->freeLock = 0;
+    for (int level = 0;  level < EMS_ORDERED_MAX_HEIGHT;  level++) index->freeNodes[level] = EMS_HEAP_NULL;
+    EMSorderedNode *head = EMSorderedNodePtr(index->head);
+    head->version = 0;
+    head->keyWord = 0;
+    head->valueWord = 0;
+    head->freeNext = EMS_HEAP_NULL;
+    head->keyCap = 0;
+    head->height = EMS_ORDERED_MAX_HEIGHT;
+    head->keyType = EMS_TYPE_UNDEFINED;
+    head->valueType = EMS_TYPE_UNDEFINED;
+    head->marked = 0;
+    for (int level = 0;  level < EMS_ORDERED_MAX_HEIGHT;  level++) EMSorderedNext(head)[level] = EMS_HEAP_NULL;
+
+    EMSnamedObject *entry = (EMSnamedObject *) EMSheapPtr(entryOffset);
+    entry->object = indexID;
+    entry->objType = EMS_OBJ_ORDERED;
+    entry->nameLen = nameLen;
+    memcpy(EMSnamedObjectName(entry), name, nameLen + 1);
+    entry->next = bufInt64[EMScbData(EMS_ARR_NAMEDIR)];
+    bufInt64[EMScbData(EMS_ARR_NAMEDIR)] = entryOffset;
+
+    bufTags[EMScbTag(EMS_ARR_NAMEDIR)].tags.fe = EMS_TAG_FULL;
+    return indexID;
+}
+
+
+//==================================================================
+//  Insert a key, or replace the value of a key already in the index
+bool EMSorderedPut(int mmapID, int64_t indexID, EMSvalueType *key, EMSvalueType *value) {
+    void *emsBuf = emsBufs[mmapID];
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    EMSordered *index = EMSorderedPtr(indexID);
+    int64_t preds[EMS_ORDERED_MAX_HEIGHT], predVersions[EMS_ORDERED_MAX_HEIGHT], succs[EMS_ORDERED_MAX_HEIGHT];
+    int64_t word;
+
+    if (!EMSorderedKeyValid(key, "EMSorderedPut")) return false;
+    if (!EMSorderedStoreValue(emsBuf, value, &word)) return false;
+
+    int height = EMSorderedHeight();
+    int64_t newOffset = EMS_HEAP_NULL;
+    RESET_NAP_TIME;
+    while (true) {
+        int found = EMSorderedFind(emsBuf, index, key, preds, predVersions, succs);
+        if (found >= 0) {
+            EMSorderedNode *node = EMSorderedNodePtr(succs[found]);
+            EMSorderedLockWait(node);
+            if (node->marked  ||  EMSorderedCompare(key, node) != 0) {
+                //  Being removed, or already removed and reused
+                EMSorderedUnlock(node);
+                NANOSLEEP;
+                continue;
+            }
+            unsigned char oldType = node->valueType;
+            int64_t oldWord = node->valueWord;
+            node->valueType = value->type;
+            node->valueWord = word;
+            EMSorderedUnlock(node);
+            if (EMSisHeapType(oldType)) {
+                EMS_FREE_VALUE(oldWord);
+            }
+            if (newOffset != EMS_HEAP_NULL) {
+                EMSorderedUnlock(EMSorderedNodePtr(newOffset));
+                EMSorderedNodeFree(emsBuf, index, newOffset);
+            }
+            return true;
+        }
+
+        if (newOffset == EMS_HEAP_NULL) {
+            newOffset = EMSorderedNodeNew(emsBuf, index, height, key);
+            if (newOffset == EMS_HEAP_NULL) {
+                if (EMSisHeapType(value->type)) {
+                    EMS_FREE_VALUE(word);
+                }
+                return false;
+            }
+        }
+        if (!EMSorderedLockPreds(emsBuf, height, preds, predVersions)) continue;
+
+        EMSorderedNode *node = EMSorderedNodePtr(newOffset);
+        node->valueType = value->type;
+        node->valueWord = word;
+        for (int level = 0;  level < height;  level++) EMSorderedNext(node)[level] = succs[level];
+        __sync_synchronize();
+        for (int level = 0;  level < height;  level++) EMSorderedNext(EMSorderedNodePtr(preds[level]))[level] = newOffset;
+        EMSorderedUnlockPreds(emsBuf, height, preds);
+        EMSorderedUnlock(node);
+        __sync_fetch_and_add(&index->nKeys, 1);
+        return true;
+    }
+}
+
+
+//==================================================================
+//  Remove a key from the index.  Returns false if the key was not in the index.
+bool EMSorderedRemove(int mmapID, int64_t indexID, EMSvalueType *key) {
+    void *emsBuf = emsBufs[mmapID];
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    EMSordered *index = EMSorderedPtr(indexID);
+    int64_t preds[EMS_ORDERED_MAX_HEIGHT], predVersions[EMS_ORDERED_MAX_HEIGHT], succs[EMS_ORDERED_MAX_HEIGHT];
+
+    if (!EMSorderedKeyValid(key, "EMSorderedRemove")) return false;
+
+    //  Mark the node, after which the key is absent
+    int64_t offset;
+    EMSorderedNode *node;
+    while (true) {
+        int found = EMSorderedFind(emsBuf, index, key, preds, predVersions, succs);
+        if (found < 0) return false;
+        offset = succs[found];
+        node = EMSorderedNodePtr(offset);
+        int64_t version = EMSorderedStable(node);
+        if (!EMSorderedLock(node, version)) continue;
+        if (EMSorderedCompare(key, node) != 0) {
+            EMSorderedUnlock(node);
+            continue;
+        }
+        if (node->marked) {
+            EMSorderedUnlock(node);
+            return false;
+        }
+        node->marked = 1;
+        EMSorderedUnlock(node);
+        break;
+    }
+
+    //  Unlink it at every level, the version of the node is advanced so
+    //  traversals which reached it before it was unlinked start over
+    int height = node->height;
+    while (true) {
+        EMSorderedFind(emsBuf, index, key, preds, predVersions, succs);
+        bool linked = true;
+        for (int level = 0;  level < height;  level++) linked = linked  &&  succs[level] == offset;
+        if (!linked  ||  !EMSorderedLockPreds(emsBuf, height, preds, predVersions)) continue;
+        EMSorderedLockWait(node);
+        for (int level = height - 1;  level >= 0;  level--) {
+            EMSorderedNext(EMSorderedNodePtr(preds[level]))[level] = EMSorderedNext(node)[level];
+        }
+        unsigned char oldType = node->valueType;
+        int64_t oldWord = node->valueWord;
+        node->valueType = EMS_TYPE_UNDEFINED;
+        EMSorderedUnlock(node);
+        EMSorderedUnlockPreds(emsBuf, height, preds);
+        if (EMSisHeapType(oldType)) {
+            EMS_FREE_VALUE(oldWord);
+        }
+        break;
+    }
+    EMSorderedNodeFree(emsBuf, index, offset);
+    __sync_fetch_and_sub(&index->nKeys, 1);
+    return true;
+}
+
+
+//==================================================================
+//  Read the value of a key, returned in a buffer valid until the next
+//  get or scan.  Returns false, with an undefined value, if the key is
+//  not in the index.
+bool EMSorderedGet(int mmapID, int64_t indexID, EMSvalueType *key, EMSvalueType *returnValue) {
+    void *emsBuf = emsBufs[mmapID];
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    EMSordered *index = EMSorderedPtr(indexID);
+    int64_t preds[EMS_ORDERED_MAX_HEIGHT], predVersions[EMS_ORDERED_MAX_HEIGHT], succs[EMS_ORDERED_MAX_HEIGHT];
+
+    returnValue->type = EMS_TYPE_UNDEFINED;
+    returnValue->value = (void *) 0xdeadbeef;
+    returnValue->length = 0;
+    if (!EMSorderedKeyValid(key, "EMSorderedGet")) return false;
+    while (true) {
+        int found = EMSorderedFind(emsBuf, index, key, preds, predVersions, succs);
+        if (found < 0) return false;
+        EMSorderedNode *node = EMSorderedNodePtr(succs[found]);
+        int64_t version = EMSorderedStable(node);
+        bool present = !node->marked  &&  EMSorderedCompare(key, node) == 0;
+        EMSorderedBufUsed = 0;
+        int copied = EMSorderedSnapshot(emsBuf, node, version, NULL, returnValue);
+        if (copied < 0) return false;
+        if (copied == 0) continue;
+        if (!present) {
+            returnValue->type = EMS_TYPE_UNDEFINED;
+            returnValue->value = (void *) 0xdeadbeef;
+            returnValue->length = 0;
+            return false;
+        }
+        EMSorderedResolve(returnValue);
+        return true;
+    }
+}
+
+
+//==================================================================
+//  Number of keys in the index
+int64_t EMSorderedCount(int mmapID, int64_t indexID) {
+    void *emsBuf = emsBufs[mmapID];
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    return EMSorderedPtr(indexID)->nKeys;
+}
+
+
+//==================================================================
+//  Copy up to maxItems keys in order, and their values, starting at the key
+//  from, or after it with EMS_SCAN_AFTER.  The scan ends before the key to, or
+//  with EMS_SCAN_PREFIX at the first key not beginning with to.  An undefined
+//  from or to leaves that end unbounded.  Results are returned in a buffer valid
+//  until the next get or scan, a scan is continued after its last key.
+//  Each key is read consistently with its value, keys inserted or removed while
+//  the scan runs may or may not be seen.
+//  Returns the number of keys copied, -1 on error.
+int EMSorderedScan(int mmapID, int64_t indexID, EMSvalueType *from, EMSvalueType *to, int flags,
+                   int maxItems, EMSvalueType *keys, EMSvalueType *values) {
+    void *emsBuf = emsBufs[mmapID];
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    EMSordered *index = EMSorderedPtr(indexID);
+    int64_t preds[EMS_ORDERED_MAX_HEIGHT], predVersions[EMS_ORDERED_MAX_HEIGHT], succs[EMS_ORDERED_MAX_HEIGHT];
+    bool hasFrom = from->type != EMS_TYPE_UNDEFINED;
+    bool hasTo = to->type != EMS_TYPE_UNDEFINED;
+
+    if (hasFrom  &&  !EMSorderedKeyValid(from, "EMSorderedScan")) return -1;
+    if (hasTo  &&  !EMSorderedKeyValid(to, "EMSorderedScan")) return -1;
+    if ((flags & EMS_SCAN_PREFIX)  &&  (!hasTo  ||  EMSorderedClass(to->type) != 2)) {
+        fprintf(stderr, "EMSorderedScan: A prefix must be a string or blob\n");
+        return -1;
+    }
+
+    EMSorderedBufUsed = 0;
+    int nItems = 0;
+    //  The scan starts over from the last key copied when a node changes under it
+    EMSvalueType resume = *from;
+    bool resumeAfter = (flags & EMS_SCAN_AFTER) != 0;
+restart:
+    if (nItems > 0) {
+        resume = keys[nItems - 1];
+        EMSorderedResolve(&resume);
+        resumeAfter = true;
+    }
+    int64_t pred;
+    int64_t predVersion;
+    if (nItems > 0  ||  hasFrom) {
+        EMSorderedFind(emsBuf, index, &resume, preds, predVersions, succs);
+        pred = preds[0];
+        predVersion = predVersions[0];
+    } else {
+        pred = index->head;
+        predVersion = EMSorderedStable(EMSorderedNodePtr(pred));
+    }
+    EMSorderedNode *predNode = EMSorderedNodePtr(pred);
+
+    while (nItems < maxItems) {
+        int64_t curr = EMSorderedNext(predNode)[0];
+        if (curr == EMS_HEAP_NULL) {
+            if (!EMSorderedValid(predNode, predVersion)) goto restart;
+            break;
+        }
+        EMSorderedNode *currNode = EMSorderedNodePtr(curr);
+        int64_t currVersion = EMSorderedStable(currNode);
+        if (!EMSorderedValid(predNode, predVersion)) goto restart;
+
+        bool skip = currNode->marked;
+        if (nItems > 0  ||  hasFrom) {
+            if (nItems > 0) {
+                resume = keys[nItems - 1];
+                EMSorderedResolve(&resume);
+            }
+            int cmp = EMSorderedCompare(&resume, currNode);
+            skip = skip  ||  cmp > 0  ||  (cmp == 0  &&  resumeAfter);
+        }
+        bool done = false;
+        if (hasTo) {
+            done = (flags & EMS_SCAN_PREFIX) ? !EMSorderedHasPrefix(to, currNode)
+                                             : EMSorderedCompare(to, currNode) <= 0;
+        }
+        if (!skip  &&  !done) {
+            size_t bufMark = EMSorderedBufUsed;
+            int copied = EMSorderedSnapshot(emsBuf, currNode, currVersion, &keys[nItems], &values[nItems]);
+            if (copied < 0) return -1;
+            if (copied == 0) {
+                EMSorderedBufUsed = bufMark;
+                goto restart;
+            }
+            nItems++;
+        } else if (!EMSorderedValid(currNode, currVersion)) {
+            goto restart;
+        } else if (done) {
+            break;
+        }
+        pred = curr;
+        predNode = currNode;
+        predVersion = currVersion;
+    }
+
+    for (int itemN = 0;  itemN < nItems;  itemN++) {
+        EMSorderedResolve(&keys[itemN]);
+        EMSorderedResolve(&values[itemN]);
+    }
+    return nItems;
+}
@@ -35,17 +35,19 @@
 //==================================================================
 //  Push onto stack
 int EMSpush(int mmapID, EMSvalueType *value) {  // TODO: Eventually promote return value to 64bit
-    void *emsBuf = emsBufs[mmapID];
+    const EMSregion *region = &emsRegions[mmapID];
+    void *emsBuf = region->buf;
     int64_t *bufInt64 = (int64_t *) emsBuf;
     EMStag_t *bufTags = (EMStag_t *) emsBuf;
     char *bufChar = (char *) emsBuf;
     EMStag_t newTag;
+    EMS_CHECK_LENGTH(value, "EMSpush", -1);
 
     // Wait until the stack top is full, then mark it busy while updating the stack
-    EMStransitionFEtag(&bufTags[EMScbTag(EMS_ARR_STACKTOP)], NULL, EMS_TAG_FULL, EMS_TAG_BUSY, EMS_TAG_ANY);
+    EMScontrolLock(emsBuf, EMS_ARR_STACKTOP);
     int32_t idx = bufInt64[EMScbData(EMS_ARR_STACKTOP)];  // TODO BUG: Truncating the full 64b range
     bufInt64[EMScbData(EMS_ARR_STACKTOP)]++;
-    if (idx == bufInt64[EMScbData(EMS_ARR_NELEM)] - 1) {
+    if (idx == region->nElements - 1) {
         fprintf(stderr, "EMSpush: Ran out of stack entries\n");
         return -1;
     }
@@ -55,6 +57,7 @@ int EMSpush(int mmapID, EMSvalueType *value) {  // TODO: Eventually promote retu
     newTag.tags.rw = 0;
     newTag.tags.type = value->type;
     newTag.tags.fe = EMS_TAG_FULL;
+    EMS_VERSION_BEGIN_WRITE(idx);
 
     //  Write the value onto the stack
     switch (newTag.tags.type) {
@@ -64,11 +67,11 @@ int EMSpush(int mmapID, EMSvalueType *value) {  // TODO: Eventually promote retu
             bufInt64[EMSdataData(idx)] = (int64_t) value->value;
             break;
         case EMS_TYPE_JSON:
+        case EMS_TYPE_BLOB:
         case EMS_TYPE_STRING: {
             int64_t textOffset;
-            EMS_ALLOC(textOffset, strlen((const char *) value->value) + 1, bufChar, "EMSpush: out of memory to store string\n", -1);
+            EMS_STORE_VALUE(textOffset, value, "EMSpush: out of memory to store string\n", -1);
             bufInt64[EMSdataData(idx)] = textOffset;
-            strcpy(EMSheapPtr(textOffset), (const char *) value->value);
         }
             break;
         case EMS_TYPE_UNDEFINED:
@@ -81,9 +84,10 @@ int EMSpush(int mmapID, EMSvalueType *value) {  // TODO: Eventually promote retu
 
     //  Mark the data on the stack as FULL
     bufTags[EMSdataTag(idx)].byte = newTag.byte;
+    EMS_VERSION_END_WRITE(idx);
 
     //  Push is complete, Mark the stack pointer as full
-    bufTags[EMScbTag(EMS_ARR_STACKTOP)].tags.fe = EMS_TAG_FULL;
+    EMScontrolUnlock(emsBuf, EMS_ARR_STACKTOP);
 
     return idx;
 }
@@ -100,13 +104,13 @@ bool EMSpop(int mmapID, EMSvalueType *returnValue) {
     EMStag_t dataTag;
 
     //  Wait until the stack pointer is full and mark it empty while pop is performed
-    EMStransitionFEtag(&bufTags[EMScbTag(EMS_ARR_STACKTOP)], NULL, EMS_TAG_FULL, EMS_TAG_BUSY, EMS_TAG_ANY);
+    EMScontrolLock(emsBuf, EMS_ARR_STACKTOP);
     bufInt64[EMScbData(EMS_ARR_STACKTOP)]--;
     int64_t idx = bufInt64[EMScbData(EMS_ARR_STACKTOP)];
     if (idx < 0) {
         //  Stack is empty, return undefined
         bufInt64[EMScbData(EMS_ARR_STACKTOP)] = 0;
-        bufTags[EMScbTag(EMS_ARR_STACKTOP)].tags.fe = EMS_TAG_FULL;
+        EMScontrolUnlock(emsBuf, EMS_ARR_STACKTOP);
         returnValue->type = EMS_TYPE_UNDEFINED;
         returnValue->value = (void *) 0xf00dd00f;
         return true;
@@ -114,6 +118,7 @@ bool EMSpop(int mmapID, EMSvalueType *returnValue) {
     //  Wait until the data pointed to by the stack pointer is full, then mark it
     //  busy while it is copied, and set it to EMPTY when finished
     dataTag.byte = EMStransitionFEtag(&bufTags[EMSdataTag(idx)], NULL, EMS_TAG_FULL, EMS_TAG_BUSY, EMS_TAG_ANY);
+    EMSdrainReaders(emsBuf, idx, NULL);
     returnValue->type = dataTag.tags.type;
     switch (dataTag.tags.type) {
         case EMS_TYPE_BOOLEAN:
@@ -121,26 +126,33 @@ bool EMSpop(int mmapID, EMSvalueType *returnValue) {
         case EMS_TYPE_FLOAT: {
             returnValue->value = (void *) bufInt64[EMSdataData(idx)];
             bufTags[EMSdataTag(idx)].tags.fe = EMS_TAG_EMPTY;
-            bufTags[EMScbTag(EMS_ARR_STACKTOP)].tags.fe = EMS_TAG_FULL;
+            EMScontrolUnlock(emsBuf, EMS_ARR_STACKTOP);
             return true;
         }
         case EMS_TYPE_JSON:
+        case EMS_TYPE_BLOB:
         case EMS_TYPE_STRING: {
-            size_t memStrLen = strlen(EMSheapPtr(bufInt64[EMSdataData(idx)]));  // TODO: Use size of allocation, not strlen
-            returnValue->value = malloc(memStrLen + 1);  // freed in NodeJSfaa
+            int64_t word = bufInt64[EMSdataData(idx)];
+            returnValue->value = EMSwordCopy(dataTag.tags.type, word, &returnValue->length);  // freed in NodeJSfaa
             if(returnValue->value == NULL) {
                 fprintf(stderr, "EMSpop: Unable to allocate space to return stack top string\n");
                 return false;
             }
-            strcpy((char *) returnValue->value, EMSheapPtr(bufInt64[EMSdataData(idx)]));
-            EMS_FREE(bufInt64[EMSdataData(idx)]);
-            bufTags[EMSdataTag(idx)].tags.fe = EMS_TAG_EMPTY;
-            bufTags[EMScbTag(EMS_ARR_STACKTOP)].tags.fe = EMS_TAG_FULL;
+            //  Unlink the string before freeing it, the element is left empty and undefined
+            int64_t oldOffset = bufInt64[EMSdataData(idx)];
+            EMS_VERSION_BEGIN_WRITE(idx);
+            bufInt64[EMSdataData(idx)] = 0xdeadbeef;
+            dataTag.tags.type = EMS_TYPE_UNDEFINED;
+            dataTag.tags.fe = EMS_TAG_EMPTY;
+            bufTags[EMSdataTag(idx)].byte = dataTag.byte;
+            EMS_VERSION_END_WRITE(idx);
+            EMS_FREE_VALUE(oldOffset);
+            EMScontrolUnlock(emsBuf, EMS_ARR_STACKTOP);
             return true;
         }
         case EMS_TYPE_UNDEFINED: {
             bufTags[EMSdataTag(idx)].tags.fe = EMS_TAG_EMPTY;
-            bufTags[EMScbTag(EMS_ARR_STACKTOP)].tags.fe = EMS_TAG_FULL;
+            EMScontrolUnlock(emsBuf, EMS_ARR_STACKTOP);
             returnValue->value = (void *) 0xdeadbeef;
             return true;
         }
@@ -156,22 +168,25 @@ bool EMSpop(int mmapID, EMSvalueType *returnValue) {
 //  Heap top and bottom are monotonically increasing, but the index
 //  returned is a circular buffer.
 int EMSenqueue(int mmapID, EMSvalueType *value) {  // TODO: Eventually promote return value to 64bit
-    void *emsBuf = emsBufs[mmapID];
+    const EMSregion *region = &emsRegions[mmapID];
+    void *emsBuf = region->buf;
     int64_t *bufInt64 = (int64_t *) emsBuf;
     EMStag_t *bufTags = (EMStag_t *) emsBuf;
     char *bufChar = (char *) emsBuf;
+    EMS_CHECK_LENGTH(value, "EMSenqueue", -1);
 
     //  Wait until the heap top is full, and mark it busy while data is enqueued
-    EMStransitionFEtag(&bufTags[EMScbTag(EMS_ARR_STACKTOP)], NULL, EMS_TAG_FULL, EMS_TAG_BUSY, EMS_TAG_ANY);
-    int32_t idx = bufInt64[EMScbData(EMS_ARR_STACKTOP)] % bufInt64[EMScbData(EMS_ARR_NELEM)];  // TODO: BUG  This could be truncated
+    EMScontrolLock(emsBuf, EMS_ARR_STACKTOP);
+    int32_t idx = bufInt64[EMScbData(EMS_ARR_STACKTOP)] % region->nElements;  // TODO: BUG  This could be truncated
     bufInt64[EMScbData(EMS_ARR_STACKTOP)]++;
     if (bufInt64[EMScbData(EMS_ARR_STACKTOP)] - bufInt64[EMScbData(EMS_ARR_Q_BOTTOM)] >
-        bufInt64[EMScbData(EMS_ARR_NELEM)]) {
+        region->nElements) {
         fprintf(stderr, "EMSenqueue: Ran out of stack entries\n");
         return -1;
     }
 
     //  Wait for data pointed to by heap top to be empty, then set to Full while it is filled
+    EMS_VERSION_BEGIN_WRITE(idx);
     bufTags[EMSdataTag(idx)].tags.rw = 0;
     bufTags[EMSdataTag(idx)].tags.type = value->type;
     switch (bufTags[EMSdataTag(idx)].tags.type) {
@@ -181,11 +196,11 @@ int EMSenqueue(int mmapID, EMSvalueType *value) {  // TODO: Eventually promote r
             bufInt64[EMSdataData(idx)] = (int64_t) value->value;
             break;
         case EMS_TYPE_JSON:
+        case EMS_TYPE_BLOB:
         case EMS_TYPE_STRING: {
             int64_t textOffset;
-            EMS_ALLOC(textOffset, strlen((const char *) value->value) + 1, bufChar, "EMSenqueue: out of memory to store string\n", -1);
+            EMS_STORE_VALUE(textOffset, value, "EMSenqueue: out of memory to store string\n", -1);
             bufInt64[EMSdataData(idx)] = textOffset;
-            strcpy(EMSheapPtr(textOffset), (const char *) value->value);
         }
             break;
         case EMS_TYPE_UNDEFINED:
@@ -198,9 +213,10 @@ int EMSenqueue(int mmapID, EMSvalueType *value) {  // TODO: Eventually promote r
 
     //  Set the tag on the data to FULL
     bufTags[EMSdataTag(idx)].tags.fe = EMS_TAG_FULL;
+    EMS_VERSION_END_WRITE(idx);
 
     //  Enqueue is complete, set the tag on the heap to to FULL
-    bufTags[EMScbTag(EMS_ARR_STACKTOP)].tags.fe = EMS_TAG_FULL;
+    EMScontrolUnlock(emsBuf, EMS_ARR_STACKTOP);
     return idx;
 }
 
@@ -208,19 +224,20 @@ int EMSenqueue(int mmapID, EMSvalueType *value) {  // TODO: Eventually promote r
 //==================================================================
 //  Dequeue
 bool EMSdequeue(int mmapID, EMSvalueType *returnValue) {
-    void *emsBuf = emsBufs[mmapID];
+    const EMSregion *region = &emsRegions[mmapID];
+    void *emsBuf = region->buf;
     int64_t *bufInt64 = (int64_t *) emsBuf;
     EMStag_t *bufTags = (EMStag_t *) emsBuf;
     char *bufChar = (char *) emsBuf;
     EMStag_t dataTag;
 
     //  Wait for bottom of heap pointer to be full, and mark it busy while data is dequeued
-    EMStransitionFEtag(&bufTags[EMScbTag(EMS_ARR_Q_BOTTOM)], NULL, EMS_TAG_FULL, EMS_TAG_BUSY, EMS_TAG_ANY);
-    int64_t idx = bufInt64[EMScbData(EMS_ARR_Q_BOTTOM)] % bufInt64[EMScbData(EMS_ARR_NELEM)];
+    EMScontrolLock(emsBuf, EMS_ARR_Q_BOTTOM);
+    int64_t idx = bufInt64[EMScbData(EMS_ARR_Q_BOTTOM)] % region->nElements;
     //  If Queue is empty, return undefined
     if (bufInt64[EMScbData(EMS_ARR_Q_BOTTOM)] >= bufInt64[EMScbData(EMS_ARR_STACKTOP)]) {
         bufInt64[EMScbData(EMS_ARR_Q_BOTTOM)] = bufInt64[EMScbData(EMS_ARR_STACKTOP)];
-        bufTags[EMScbTag(EMS_ARR_Q_BOTTOM)].tags.fe = EMS_TAG_FULL;
+        EMScontrolUnlock(emsBuf, EMS_ARR_Q_BOTTOM);
         returnValue->type = EMS_TYPE_UNDEFINED;
         returnValue->value = (void *) 0xf00dd00f;
         return true;
@@ -230,6 +247,7 @@ bool EMSdequeue(int mmapID, EMSvalueType *returnValue) {
     //  Wait for the data pointed to by the bottom of the heap to be full,
     //  then mark busy while copying it, and finally set it to empty when done
     dataTag.byte = EMStransitionFEtag(&bufTags[EMSdataTag(idx)], NULL, EMS_TAG_FULL, EMS_TAG_BUSY, EMS_TAG_ANY);
+    EMSdrainReaders(emsBuf, idx, NULL);
     dataTag.tags.fe = EMS_TAG_EMPTY;
     returnValue->type = dataTag.tags.type;
     switch (dataTag.tags.type) {
@@ -238,26 +256,33 @@ bool EMSdequeue(int mmapID, EMSvalueType *returnValue) {
         case EMS_TYPE_FLOAT: {
             returnValue->value = (void *) bufInt64[EMSdataData(idx)];
             bufTags[EMSdataTag(idx)].byte = dataTag.byte;
-            bufTags[EMScbTag(EMS_ARR_Q_BOTTOM)].tags.fe = EMS_TAG_FULL;
+            EMScontrolUnlock(emsBuf, EMS_ARR_Q_BOTTOM);
             return true;
         }
         case EMS_TYPE_JSON:
+        case EMS_TYPE_BLOB:
         case EMS_TYPE_STRING: {
-            bufTags[EMSdataTag(idx)].byte = dataTag.byte;
-            bufTags[EMScbTag(EMS_ARR_Q_BOTTOM)].tags.fe = EMS_TAG_FULL;
-            size_t memStrLen = strlen(EMSheapPtr(bufInt64[EMSdataData(idx)]));  // TODO: Use size of allocation, not strlen
-            returnValue->value = malloc(memStrLen + 1);  // freed in NodeJSfaa
+            EMScontrolUnlock(emsBuf, EMS_ARR_Q_BOTTOM);
+            int64_t word = bufInt64[EMSdataData(idx)];
+            returnValue->value = EMSwordCopy(dataTag.tags.type, word, &returnValue->length);  // freed in NodeJSfaa
             if(returnValue->value == NULL) {
                 fprintf(stderr, "EMSdequeue: Unable to allocate space to return queue head string\n");
+                bufTags[EMSdataTag(idx)].byte = dataTag.byte;
                 return false;
             }
-            strcpy((char *) returnValue->value, EMSheapPtr(bufInt64[EMSdataData(idx)]));
-            EMS_FREE(bufInt64[EMSdataData(idx)]);
+            //  Unlink the string before freeing it, the element is left empty and undefined
+            int64_t oldOffset = bufInt64[EMSdataData(idx)];
+            EMS_VERSION_BEGIN_WRITE(idx);
+            bufInt64[EMSdataData(idx)] = 0xdeadbeef;
+            dataTag.tags.type = EMS_TYPE_UNDEFINED;
+            bufTags[EMSdataTag(idx)].byte = dataTag.byte;
+            EMS_VERSION_END_WRITE(idx);
+            EMS_FREE_VALUE(oldOffset);
             return true;
         }
         case EMS_TYPE_UNDEFINED: {
             bufTags[EMSdataTag(idx)].byte = dataTag.byte;
-            bufTags[EMScbTag(EMS_ARR_Q_BOTTOM)].tags.fe = EMS_TAG_FULL;
+            EMScontrolUnlock(emsBuf, EMS_ARR_Q_BOTTOM);
             returnValue->value = (void *) 0xdeadbeef;
             return true;
         }
@@ -31,29 +31,72 @@
  +-----------------------------------------------------------------------------*/
 #include "ems.h"
 
+//==================================================================
+//  Length of a number printed by snprintf, which truncates very large floats
+static size_t EMSprintedLen(int nChars, size_t bufLen) {
+    if (nChars < 0) return 0;
+    return ((size_t) nChars >= bufLen) ? bufLen - 1 : (size_t) nChars;
+}
+
+
+//==================================================================
+//  Store the concatenation of two strings, setting word to the data word
+//  that holds it.  Short results are stored inline, others on the heap.
+static bool EMSstoreConcat(void *emsBuf, const char *head, size_t headLen,
+                           const char *tail, size_t tailLen, int64_t *word) {
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    int64_t textOffset;
+    if (headLen + tailLen > EMS_MAX_VALUE_LEN) {
+        fprintf(stderr, "EMSfaa: concatenated string is too long to store\n");
+        return false;
+    }
+    if (headLen + tailLen <= EMS_INLINE_MAX) {
+        char str[EMS_INLINE_MAX];
+        memcpy(str, head, headLen);
+        memcpy(str + headLen, tail, tailLen);
+        *word = EMSinlineWord(str, headLen + tailLen);
+        return true;
+    }
+    EMS_ALLOC(textOffset, EMS_COUNTED_HDR_SZ + headLen + tailLen + 1, bufChar,
+              "EMSfaa: out of memory to store string\n", false);
+    char *str = EMSheapPtr(textOffset);
+    EMSheapHeader(str, headLen + tailLen);
+    memcpy(str + EMS_COUNTED_HDR_SZ, head, headLen);
+    memcpy(str + EMS_COUNTED_HDR_SZ + headLen, tail, tailLen);
+    if (bufInt64[EMScbData(EMS_ARR_INTERN)] != 0) textOffset = EMSintern(emsBuf, textOffset);
+    *word = textOffset;
+    return true;
+}
+
+
 //==================================================================
 //  Fetch and Add Atomic Memory Operation
 //  Returns a+b where a is data in EMS memory and b is an argument
-bool EMSfaa(int mmapID, EMSvalueType *key, EMSvalueType *value, EMSvalueType *returnValue) {
-    void *emsBuf = emsBufs[mmapID];
+template <bool mapped>
+static bool EMSfaaKernel(int mmapID, EMSvalueType *key, EMSvalueType *value, EMSvalueType *returnValue) {
+    const EMSregion *region = &emsRegions[mmapID];
+    void *emsBuf = region->buf;
     volatile EMStag_t *bufTags = (EMStag_t *) emsBuf;
-    int64_t idx = EMSwriteIndexMap(mmapID, key);
+    int64_t idx = EMSwriteIndex<mapped>(mmapID, region, key);
     volatile int64_t *bufInt64 = (int64_t *) emsBuf;
     volatile double *bufDouble = (double *) emsBuf;
     char *bufChar = (char *) emsBuf;
     EMStag_t oldTag;
 
-    if (idx < 0 || idx >= bufInt64[EMScbData(EMS_ARR_NELEM)]) {
+    if (idx < 0 || idx >= region->nElements) {
         fprintf(stderr, "EMSfaa: index out of bounds\n");
         return false;
     }
 
     volatile EMStag_t *maptag;
-    if (EMSisMapped) { maptag = &bufTags[EMSmapTag(idx)]; }
+    if (mapped) { maptag = &bufTags[EMSmapTag(idx)]; }
     else             { maptag = NULL; }
     // Wait until the data is FULL, mark it busy while FAA is performed
     oldTag.byte = EMStransitionFEtag(&bufTags[EMSdataTag(idx)], maptag,
                                      EMS_TAG_FULL, EMS_TAG_BUSY, EMS_TAG_ANY);
+    EMSdrainReaders(emsBuf, idx, maptag);
+    EMS_VERSION_BEGIN_WRITE(idx);
 
     oldTag.tags.fe = EMS_TAG_FULL;  // When written back, mark FULL
     switch (oldTag.tags.type) {
@@ -83,11 +126,10 @@ bool EMSfaa(int mmapID, EMSvalueType *key, EMSvalueType *value, EMSvalueType *re
                     oldTag.tags.type = EMS_TYPE_INTEGER;
                     break;
                 case EMS_TYPE_STRING: {   //  Bool + string
+                    const char *boolStr = bufInt64[EMSdataData(idx)] ? "true" : "false";
                     int64_t textOffset;
-                    EMS_ALLOC(textOffset, value->length + 1 + 5, //  String length + Terminating null + 'false'
-                              bufChar, "EMSfaa(bool+string): out of memory to store string\n", false);
-                    sprintf(EMSheapPtr(textOffset), "%s%s",
-                            bufInt64[EMSdataData(idx)] ? "true" : "false", (const char *) value->value);
+                    if (!EMSstoreConcat(emsBuf, boolStr, strlen(boolStr),
+                                        (const char *) value->value, value->length, &textOffset)) return false;
                     bufInt64[EMSdataData(idx)] = textOffset;
                     oldTag.tags.type = EMS_TYPE_STRING;
                 }
@@ -99,7 +141,8 @@ bool EMSfaa(int mmapID, EMSvalueType *key, EMSvalueType *value, EMSvalueType *re
             }
             //  Write the new type and set the tag to Full, then return the original value
             bufTags[EMSdataTag(idx)].byte = oldTag.byte;
-            if (EMSisMapped) bufTags[EMSmapTag(idx)].tags.fe = EMS_TAG_FULL;
+            EMS_VERSION_END_WRITE(idx);
+            if (mapped) bufTags[EMSmapTag(idx)].tags.fe = EMS_TAG_FULL;
             return true;
         }  // End of:  Bool + ___
 
@@ -135,11 +178,12 @@ bool EMSfaa(int mmapID, EMSvalueType *key, EMSvalueType *value, EMSvalueType *re
                     bufInt64[EMSdataData(idx)] += (int64_t) value->value;
                     break;
                 case EMS_TYPE_STRING: {   // int + string
+                    char numBuf[MAX_NUMBER2STR_LEN];
+                    size_t numLen = EMSprintedLen(snprintf(numBuf, sizeof(numBuf), "%lld",
+                                                           (long long int) bufInt64[EMSdataData(idx)]), sizeof(numBuf));
                     int64_t textOffset;
-                    EMS_ALLOC(textOffset, value->length + 1 + MAX_NUMBER2STR_LEN,
-                              bufChar, "EMSfaa(int+string): out of memory to store string\n", false);
-                    sprintf(EMSheapPtr(textOffset), "%lld%s",
-                            (long long int) bufInt64[EMSdataData(idx)], (const char *) value->value);
+                    if (!EMSstoreConcat(emsBuf, numBuf, numLen,
+                                        (const char *) value->value, value->length, &textOffset)) return false;
                     bufInt64[EMSdataData(idx)] = textOffset;
                     oldTag.tags.type = EMS_TYPE_STRING;
                 }
@@ -150,7 +194,8 @@ bool EMSfaa(int mmapID, EMSvalueType *key, EMSvalueType *value, EMSvalueType *re
             }
             //  Write the new type and set the tag to Full, then return the original value
             bufTags[EMSdataTag(idx)].byte = oldTag.byte;
-            if (EMSisMapped) bufTags[EMSmapTag(idx)].tags.fe = EMS_TAG_FULL;
+            EMS_VERSION_END_WRITE(idx);
+            if (mapped) bufTags[EMSmapTag(idx)].tags.fe = EMS_TAG_FULL;
             return true;
         }  // End of: Integer + ____
 
@@ -175,10 +220,12 @@ bool EMSfaa(int mmapID, EMSvalueType *key, EMSvalueType *value, EMSvalueType *re
                     bufDouble[EMSdataData(idx)] += (double) ((int64_t) value->value);
                     break;
                 case EMS_TYPE_STRING: {   // Float + string
+                    char numBuf[MAX_NUMBER2STR_LEN];
+                    size_t numLen = EMSprintedLen(snprintf(numBuf, sizeof(numBuf), "%lf", bufDouble[EMSdataData(idx)]),
+                                                  sizeof(numBuf));
                     int64_t textOffset;
-                    EMS_ALLOC(textOffset, value->length + 1 + MAX_NUMBER2STR_LEN,
-                              bufChar, "EMSfaa(float+string): out of memory to store string\n", false);
-                    sprintf(EMSheapPtr(textOffset), "%lf%s", bufDouble[EMSdataData(idx)], (const char *) value->value);
+                    if (!EMSstoreConcat(emsBuf, numBuf, numLen,
+                                        (const char *) value->value, value->length, &textOffset)) return false;
                     bufInt64[EMSdataData(idx)] = textOffset;
                     oldTag.tags.type = EMS_TYPE_STRING;
                 }
@@ -192,68 +239,63 @@ bool EMSfaa(int mmapID, EMSvalueType *key, EMSvalueType *value, EMSvalueType *re
             }
             //  Write the new type and set the tag to Full, then return the original value
             bufTags[EMSdataTag(idx)].byte = oldTag.byte;
-            if (EMSisMapped) bufTags[EMSmapTag(idx)].tags.fe = EMS_TAG_FULL;
+            EMS_VERSION_END_WRITE(idx);
+            if (mapped) bufTags[EMSmapTag(idx)].tags.fe = EMS_TAG_FULL;
             return true;
         } //  End of: float + _______
 
         case EMS_TYPE_STRING: {
-            // size_t oldStrLen = (size_t) emsMem_size(EMS_MEM_MALLOCBOT(bufChar), bufInt64[EMSdataData(idx)]);
-            size_t oldStrLen = strlen(EMSheapPtr(bufInt64[EMSdataData(idx)]));
+            size_t oldStrLen;
+            char inlineBuf[EMS_INLINE_MAX + 1];
+            int64_t oldWord = bufInt64[EMSdataData(idx)];
+            const char *oldStr = EMSwordData(EMS_TYPE_STRING, oldWord, inlineBuf, &oldStrLen);
             returnValue->type = EMS_TYPE_STRING;
-            returnValue->value = malloc(oldStrLen + 1);  // freed in NodeJSfaa
+            returnValue->value = EMSdataCopy(oldStr, oldStrLen);  // freed in NodeJSfaa
+            returnValue->length = oldStrLen;
             if(returnValue->value == NULL) {
                 fprintf(stderr, "EMSfaa: Unable to malloc temporary old string\n");
                 return false;
             }
-            strcpy((char *) returnValue->value, EMSheapPtr(bufInt64[EMSdataData(idx)]));
-            int64_t textOffset;
-            size_t len;
+            char numBuf[MAX_NUMBER2STR_LEN];
+            const char *tail = numBuf;
+            size_t tailLen;
             switch (value->type) {
                 case EMS_TYPE_INTEGER: // string + int
-                    len = oldStrLen + 1 + MAX_NUMBER2STR_LEN;
-                    EMS_ALLOC(textOffset, len, bufChar, "EMSfaa(string+int): out of memory to store string\n", false);
-                    sprintf(EMSheapPtr(textOffset), "%s%lld",
-                            EMSheapPtr(bufInt64[EMSdataData(idx)]),
-                            (long long int) value->value);
+                    tailLen = EMSprintedLen(snprintf(numBuf, sizeof(numBuf), "%lld", (long long int) value->value),
+                                            sizeof(numBuf));
                     break;
                 case EMS_TYPE_FLOAT: {  // string + dbl
                     EMSulong_double alias;
                     alias.u64 = (uint64_t) value->value;
-                    len = oldStrLen + 1 + MAX_NUMBER2STR_LEN;
-                    EMS_ALLOC(textOffset, len, bufChar, "EMSfaa(string+dbl): out of memory to store string\n", false);
-                    sprintf(EMSheapPtr(textOffset), "%s%lf",
-                            EMSheapPtr(bufInt64[EMSdataData(idx)]), alias.d);
+                    tailLen = EMSprintedLen(snprintf(numBuf, sizeof(numBuf), "%lf", alias.d), sizeof(numBuf));
                 }
                     break;
-                case EMS_TYPE_STRING: { // string + string
-                    len = oldStrLen + 1 + value->length;
-                    EMS_ALLOC(textOffset, len, bufChar, "EMSfaa(string+string): out of memory to store string\n", false);
-                    sprintf(EMSheapPtr(textOffset), "%s%s",
-                            EMSheapPtr(bufInt64[EMSdataData(idx)]), (const char *) value->value);
-                }
+                case EMS_TYPE_STRING: // string + string
+                    tail = (const char *) value->value;
+                    tailLen = value->length;
                     break;
                 case EMS_TYPE_BOOLEAN:   // string + bool
-                    len = strlen(EMSheapPtr(bufInt64[EMSdataData(idx)])) + 1 + 5;  // 5==strlen("false")
-                    EMS_ALLOC(textOffset, len, bufChar, "EMSfaa(string+bool): out of memory to store string\n", false);
-                    sprintf(EMSheapPtr(textOffset), "%s%s",
-                            EMSheapPtr(bufInt64[EMSdataData(idx)]), (bool) value->value ? "true" : "false");
+                    tail = (bool) value->value ? "true" : "false";
+                    tailLen = strlen(tail);
                     break;
                 case EMS_TYPE_UNDEFINED: // string + undefined
-                    len = strlen(EMSheapPtr(bufInt64[EMSdataData(idx)])) + 1 + 9; // 9 == strlen("undefined");
-                    EMS_ALLOC(textOffset, len, bufChar, "EMSfaa(string+undefined): out of memory to store string\n", false);
-                    sprintf(EMSheapPtr(textOffset), "%s%s",
-                            EMSheapPtr(bufInt64[EMSdataData(idx)]), "undefined");
+                    tail = "undefined";
+                    tailLen = strlen(tail);
                     break;
                 default:
                     fprintf(stderr, "EMSfaa(string+?): Unknown data type\n");
                     return false;
             }
-            EMS_FREE(bufInt64[EMSdataData(idx)]);
+            int64_t textOffset;
+            if (!EMSstoreConcat(emsBuf, oldStr, oldStrLen, tail, tailLen, &textOffset)) return false;
+            int64_t oldOffset = bufInt64[EMSdataData(idx)];
             bufInt64[EMSdataData(idx)] = textOffset;
+            EMS_FREE_VALUE(oldOffset);
             oldTag.tags.type = EMS_TYPE_STRING;
             //  Write the new type and set the tag to Full, then return the original value
             bufTags[EMSdataTag(idx)].byte = oldTag.byte;
-            if (EMSisMapped) bufTags[EMSmapTag(idx)].tags.fe = EMS_TAG_FULL;
+            EMS_VERSION_END_WRITE(idx);
+            if (mapped) bufTags[EMSmapTag(idx)].tags.fe = EMS_TAG_FULL;
             // return value was set at the top of this block
             return true;
         }  // End of: String + __________
@@ -271,9 +313,8 @@ bool EMSfaa(int mmapID, EMSvalueType *key, EMSvalueType *value, EMSvalueType *re
                     break;
                 case EMS_TYPE_STRING: { // Undefined + string
                     int64_t textOffset;
-                    EMS_ALLOC(textOffset, value->length + 1 + 3, //  3 = strlen("NaN");
-                              bufChar, "EMSfaa(undef+String): out of memory to store string\n", false);
-                    sprintf(EMSheapPtr(textOffset), "NaN%s", (const char *) value->value);
+                    if (!EMSstoreConcat(emsBuf, "NaN", 3,
+                                        (const char *) value->value, value->length, &textOffset)) return false;
                     bufInt64[EMSdataData(idx)] = textOffset;
                     oldTag.tags.type = EMS_TYPE_UNDEFINED;
                 }
@@ -284,7 +325,8 @@ bool EMSfaa(int mmapID, EMSvalueType *key, EMSvalueType *value, EMSvalueType *re
             }
             //  Write the new type and set the tag to Full, then return the original value
             bufTags[EMSdataTag(idx)].byte = oldTag.byte;
-            if (EMSisMapped) bufTags[EMSmapTag(idx)].tags.fe = EMS_TAG_FULL;
+            EMS_VERSION_END_WRITE(idx);
+            if (mapped) bufTags[EMSmapTag(idx)].tags.fe = EMS_TAG_FULL;
             return true;
         }
         default:
@@ -298,36 +340,38 @@ bool EMSfaa(int mmapID, EMSvalueType *key, EMSvalueType *value, EMSvalueType *re
 
 //==================================================================
 //  Atomic Compare and Swap
-bool EMScas(int mmapID, EMSvalueType *key,
-            EMSvalueType *oldValue, EMSvalueType *newValue,
-            EMSvalueType *returnValue) {
-    void *emsBuf = emsBufs[mmapID];
+template <bool mapped>
+static bool EMScasKernel(int mmapID, EMSvalueType *key,
+                         EMSvalueType *oldValue, EMSvalueType *newValue,
+                         EMSvalueType *returnValue) {
+    const EMSregion *region = &emsRegions[mmapID];
+    void *emsBuf = region->buf;
     volatile int64_t *bufInt64 = (int64_t *) emsBuf;
-    int64_t idx = EMSkey2index(emsBuf, key, EMSisMapped);
+    int64_t idx = EMSkeyIndex<mapped>(region, key);
     char * bufChar = (char *) emsBuf;
     volatile EMStag_t *bufTags = (EMStag_t *) emsBuf;
     EMStag_t newTag;
     int64_t textOffset;
     int swapped = false;
 
-    if ((!EMSisMapped  &&  idx < 0) || idx >= bufInt64[EMScbData(EMS_ARR_NELEM)]) {
+    if ((!mapped  &&  idx < 0) || idx >= region->nElements) {
         fprintf(stderr, "EMScas: index out of bounds\n");
         return false;
     }
 
-    size_t memStrLen;
     unsigned char memType;
 retry_on_undefined:
-    if(EMSisMapped  &&  idx < 0) {
+    if(mapped  &&  idx < 0) {
         memType = EMS_TYPE_UNDEFINED;
     } else {
         //  Wait for the memory to be Full, then mark it Busy while CAS works
         volatile EMStag_t *maptag;
-        if (EMSisMapped) { maptag = &bufTags[EMSmapTag(idx)]; }
+        if (mapped) { maptag = &bufTags[EMSmapTag(idx)]; }
         else             { maptag = NULL; }
         // Wait until the data is FULL, mark it busy while FAA is performed
         EMStransitionFEtag(&bufTags[EMSdataTag(idx)], maptag,
                            EMS_TAG_FULL, EMS_TAG_BUSY, EMS_TAG_ANY);
+        EMSdrainReaders(emsBuf, idx, maptag);
         memType = bufTags[EMSdataTag(idx)].tags.type;
     }
 
@@ -343,14 +387,14 @@ retry_on_undefined:
             returnValue->value =  (void *) bufInt64[EMSdataData(idx)];
             break;
         case EMS_TYPE_JSON:
+        case EMS_TYPE_BLOB:
         case EMS_TYPE_STRING:
-            memStrLen = strlen(EMSheapPtr(bufInt64[EMSdataData(idx)]));
-            returnValue->value = malloc(memStrLen + 1);  // freed in NodeJSfaa
+            returnValue->value = EMSwordCopy(memType, bufInt64[EMSdataData(idx)],
+                                             &returnValue->length);  // freed in NodeJSfaa
             if(returnValue->value == NULL) {
                 fprintf(stderr, "EMScas: Unable to allocate space to return old string\n");
                 return false;
             }
-            strcpy((char *) returnValue->value, EMSheapPtr(bufInt64[EMSdataData(idx)]));
             break;
         default:
             fprintf(stderr, "EMScas: memType not recognized\n");
@@ -361,17 +405,19 @@ retry_on_undefined:
     if (oldValue->type == memType) {
         //  Allocate on Write: If this memory was undefined (ie: unallocated),
         //  allocate the index map, store the undefined, and start over again.
-        if(EMSisMapped  &&  idx < 0) {
+        if(mapped  &&  idx < 0) {
             idx = EMSwriteIndexMap(mmapID, key);
             if (idx < 0) {
                 fprintf(stderr, "EMScas: Not able to allocate map on CAS of undefined data\n");
                 return false;
             }
+            EMS_VERSION_BEGIN_WRITE(idx);
             bufInt64[EMSdataData(idx)] = 0xcafebabe;
             newTag.tags.fe = EMS_TAG_FULL;
             newTag.tags.rw = 0;
             newTag.tags.type = EMS_TYPE_UNDEFINED;
             bufTags[EMSdataTag(idx)].byte = newTag.byte;
+            EMS_VERSION_END_WRITE(idx);
             goto retry_on_undefined;
         }
         switch (memType) {
@@ -385,8 +431,10 @@ retry_on_undefined:
                     swapped = true;
                 break;
             case EMS_TYPE_JSON:
+            case EMS_TYPE_BLOB:
             case EMS_TYPE_STRING:
-                if (strcmp((const char *) returnValue->value, (const char *) oldValue->value) == 0) {
+                if (returnValue->length == EMSvalueLength(oldValue)  &&
+                    memcmp(returnValue->value, oldValue->value, returnValue->length) == 0) {
                     swapped = true;
                 }
                 break;
@@ -401,8 +449,8 @@ retry_on_undefined:
     newTag.tags.rw = 0;
     newTag.tags.type = memType;
     if (swapped) {
-        if (memType == EMS_TYPE_STRING  ||  memType == EMS_TYPE_JSON)
-            EMS_FREE((size_t) bufInt64[EMSdataData(idx)]);
+        EMS_VERSION_BEGIN_WRITE(idx);
+        int64_t oldOffset = bufInt64[EMSdataData(idx)];
         newTag.tags.type = newValue->type;
         switch (newValue->type) {
             case EMS_TYPE_UNDEFINED:
@@ -414,23 +462,54 @@ retry_on_undefined:
                 bufInt64[EMSdataData(idx)] = (int64_t) newValue->value;
                 break;
             case EMS_TYPE_JSON:
+            case EMS_TYPE_BLOB:
             case EMS_TYPE_STRING:
-                EMS_ALLOC(textOffset, newValue->length + 1,
-                          bufChar, "EMScas(string): out of memory to store string\n", false);
-                strcpy(EMSheapPtr(textOffset), (const char *) newValue->value);
+                EMS_STORE_VALUE(textOffset, newValue, "EMScas(string): out of memory to store string\n", false);
                 bufInt64[EMSdataData(idx)] = textOffset;
                 break;
             default:
                 fprintf(stderr, "EMScas(): Unrecognized new type\n");
                 return false;
         }
+        if (EMSisHeapType(memType))
+            EMS_FREE_VALUE(oldOffset);
     }
 
     //  Set the tag back to Full and return the original value
     bufTags[EMSdataTag(idx)].byte = newTag.byte;
+    if (swapped) EMS_VERSION_END_WRITE(idx);
     //  If there is a map, set the map's tag back to full
-    if (EMSisMapped)
+    if (mapped)
         bufTags[EMSmapTag(idx)].tags.fe = EMS_TAG_FULL;
 
     return true;
 }
+
+
+//==================================================================
+//  Fetch and Add using the kernel selected for the region
+bool EMSfaa(int mmapID, EMSvalueType *key, EMSvalueType *value, EMSvalueType *returnValue) {
+    return emsRegions[mmapID].faa(mmapID, key, value, returnValue);
+}
+
+
+//==================================================================
+//  Compare and Swap using the kernel selected for the region
+bool EMScas(int mmapID, EMSvalueType *key,
+            EMSvalueType *oldValue, EMSvalueType *newValue,
+            EMSvalueType *returnValue) {
+    return emsRegions[mmapID].cas(mmapID, key, oldValue, newValue, returnValue);
+}
+
+
+//==================================================================
+//  Select the read-modify-write kernels of a region when it is attached
+void EMSrmwKernels(EMSregion *region) {
+    if (region->isMapped) {
+        region->faa = EMSfaaKernel<true>;
+        region->cas = EMScasKernel<true>;
+    } else {
+        region->faa = EMSfaaKernel<false>;
+        region->cas = EMScasKernel<false>;
+    }
+}
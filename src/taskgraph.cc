@@ -0,0 +1,427 @@
+/*-----------------------------------------------------------------------------+
+ |  Extended Memory Semantics (EMS)                            Version 1.6.1   |
+ |  http://mogill.com/                                       jace@mogill.com   |
+ +-----------------------------------------------------------------------------+
+ |  Copyright (c) 2016-2020, Jace A Mogill.  All rights reserved.              |
+ |                                                                             |
+ | Redistribution and use in source and binary forms, with or without          |
+ | modification, are permitted provided that the following conditions are met: |
+ |    * Redistributions of source code must retain the above copyright         |
+ |      notice, this list of conditions and the following disclaimer.          |
+ |    * Redistributions in binary form must reproduce the above copyright      |
+ |      notice, this list of conditions and the following disclaimer in the    |
+ |      documentation and/or other materials provided with the distribution.   |
+ |    * Neither the name of the Synthetic Semantics nor the names of its       |
+ |      contributors may be used to endorse or promote products derived        |
+ |      from this software without specific prior written permission.          |
+ |                                                                             |
+ |    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS      |
+ |    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT        |
+ |    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR    |
+ |    A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SYNTHETIC         |
+ |    SEMANTICS LLC BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,   |
+ |    EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,      |
+ |    PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR       |
+ |    PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF   |
+ |    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING     |
+ |    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS       |
+ |    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.             |
+ |                                                                             |
+ +-----------------------------------------------------------------------------*/
+#include "ems.h"
+
+//==================================================================
+//  Task Graphs
+//
+//  Tasks are added with the EMS elements they read and write.  An input
+//  written by an earlier task of the graph makes the task a consumer of
+//  that producer, each task counts its producers which are not yet done.
+//  When a task is done its consumers' counts are decremented and tasks
+//  which become ready are pushed on the deque of the process which
+//  finished the producer.  Idle processes steal from other processes'
+//  deques.  Inputs not written by the graph are only checked by idle
+//  processes, the task is parked until all of them are full.
+//
+//  Every process reads the graph's descriptor from the heap, the
+//  processes must agree on the mmapID of every region named in the graph.
+#define EMStaskGraphPtr(graphID)  ((EMStaskGraph *) EMSheapPtr(graphID))
+#define EMStaskNodePtr(graph, taskN)  (&((EMStaskNode *) EMSheapPtr((graph)->nodes))[taskN])
+#define EMStaskDeque(graph, procN) \
+    ((volatile int64_t *) EMSheapPtr((graph)->deques + (procN) * EMS_TASK_DEQUE_SZ((graph)->maxTasks)))
+
+
+static uint64_t EMStaskElementHash(int64_t mmapID, int64_t index) {
+    uint64_t hash = (uint64_t) index * 0x9E3779B97F4A7C15ULL;
+    return hash ^ ((uint64_t) mmapID * 0xC2B2AE3D27D4EB4FULL);
+}
+
+
+//  Resolve the index of a task's input or output element
+static int64_t EMStaskElementIndex(EMStaskElement *elem) {
+    if (elem->mmapID < 0  ||  elem->mmapID >= EMS_MAX_N_BUFS  ||  emsBufs[elem->mmapID] == NULL) return -1;
+    const EMSregion *region = &emsRegions[elem->mmapID];
+    int64_t idx = EMSkey2index(region, &elem->key, EMSisMapped);
+    if (idx >= region->nElements) return -1;
+    return idx;
+}
+
+
+static bool EMStaskElementIsFull(int64_t mmapID, int64_t idx) {
+    volatile EMStag_t *bufTags = (EMStag_t *) emsBufs[mmapID];
+    return bufTags[EMSdataTag(idx)].tags.fe == EMS_TAG_FULL;
+}
+
+
+//==================================================================
+//  Find or create a named task graph on the heap of an EMS region.
+//  Returns the graph ID, the heap offset of the graph, or -1 on error
+int64_t EMStaskGraphNew(int mmapID, const char *name, int64_t maxTasks, int64_t maxEdges) {
+    void *emsBuf = emsBufs[mmapID];
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    volatile EMStag_t *bufTags = (EMStag_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    volatile char *memMutex = (char *) &bufInt64[EMScbData(EMS_ARR_MEM_MUTEX)];
+    int32_t nameLen = (int32_t) strlen(name);
+    int64_t nThreads = bufInt64[EMScbData(EMS_ARR_READERS + 1)];
+
+    if (maxTasks <= 0  ||  maxEdges <= 0) {
+        fprintf(stderr, "EMStaskGraphNew: The graph must have room for tasks and edges\n");
+        return -1;
+    }
+
+    //  Wait until the directory is full, mark it busy while it is searched and extended
+    EMStransitionFEtag(&bufTags[EMScbTag(EMS_ARR_NAMEDIR)], NULL, EMS_TAG_FULL, EMS_TAG_BUSY, EMS_TAG_ANY);
+    int64_t entryOffset = bufInt64[EMScbData(EMS_ARR_NAMEDIR)];
+    while (entryOffset != EMS_HEAP_NULL) {
+        EMSnamedObject *entry = (EMSnamedObject *) EMSheapPtr(entryOffset);
+        if (entry->objType == EMS_OBJ_TASKGRAPH  &&  entry->nameLen == nameLen  &&
+            memcmp(EMSnamedObjectName(entry), name, nameLen) == 0) {
+            bufTags[EMScbTag(EMS_ARR_NAMEDIR)].tags.fe = EMS_TAG_FULL;
+            return entry->object;
+        }
+        entryOffset = entry->next;
+    }
+
+    //  The graph and all its tables are one allocation
+    size_t nodesSz = maxTasks * sizeof(EMStaskNode);
+    size_t edgesSz = maxEdges * sizeof(EMStaskEdge);
+    size_t externalsSz = maxEdges * sizeof(EMStaskProducer);
+    size_t producersSz = 2 * maxEdges * sizeof(EMStaskProducer);
+    size_t parkedSz = maxTasks * sizeof(int64_t);
+    size_t graphSz = ((sizeof(EMStaskGraph) + EMS_CACHELINE_SZ - 1) / EMS_CACHELINE_SZ) * EMS_CACHELINE_SZ;
+    size_t tablesSz = ((nodesSz + edgesSz + externalsSz + producersSz + parkedSz + EMS_CACHELINE_SZ - 1) /
+                       EMS_CACHELINE_SZ) * EMS_CACHELINE_SZ;
+    size_t totalSz = graphSz + tablesSz + nThreads * EMS_TASK_DEQUE_SZ(maxTasks);
+    int64_t graphID = emsMutexMem_alloc(EMS_MEM_MALLOCBOT(bufChar), totalSz, memMutex);
+    entryOffset = emsMutexMem_alloc(EMS_MEM_MALLOCBOT(bufChar), sizeof(EMSnamedObject) + nameLen + 1, memMutex);
+    if (graphID < 0  ||  entryOffset < 0) {
+        fprintf(stderr, "EMStaskGraphNew: Out of heap memory to create task graph \"%s\"\n", name);
+        if (graphID >= 0) EMS_FREE(graphID);
+        if (entryOffset >= 0) EMS_FREE(entryOffset);
+        bufTags[EMScbTag(EMS_ARR_NAMEDIR)].tags.fe = EMS_TAG_FULL;
+        return -1;
+    }
+
+    EMStaskGraph *graph = EMStaskGraphPtr(graphID);
+    graph->maxTasks = maxTasks;
+    graph->maxEdges = maxEdges;
+    graph->nTasks = 0;
+    graph->nEdges = 0;
+    graph->nExternals = 0;
+    graph->nOutputs = 0;
+    graph->nDone = 0;
+    graph->nParked = 0;
+    graph->nThreads = nThreads;
+    graph->nodes = graphID + graphSz;
+    graph->edges = graph->nodes + nodesSz;
+    graph->externals = graph->edges + edgesSz;
+    graph->producers = graph->externals + externalsSz;
+    graph->parkedTasks = graph->producers + producersSz;
+    graph->deques = graphID + graphSz + tablesSz;
+    EMStaskProducer *producers = (EMStaskProducer *) EMSheapPtr(graph->producers);
+    for (int64_t slot = 0; slot < 2 * maxEdges; slot++) producers[slot].mmapID = -1;
+    for (int64_t procN = 0; procN < nThreads; procN++) {
+        volatile int64_t *deque = EMStaskDeque(graph, procN);
+        deque[EMS_TASK_DEQUE_TOP] = 0;
+        deque[EMS_TASK_DEQUE_BOTTOM] = 0;
+    }
+
+    EMSnamedObject *entry = (EMSnamedObject *) EMSheapPtr(entryOffset);
+    entry->object = graphID;
+    entry->objType = EMS_OBJ_TASKGRAPH;
+    entry->nameLen = nameLen;
+    memcpy(EMSnamedObjectName(entry), name, nameLen + 1);
+    entry->next = bufInt64[EMScbData(EMS_ARR_NAMEDIR)];
+    bufInt64[EMScbData(EMS_ARR_NAMEDIR)] = entryOffset;
+
+    bufTags[EMScbTag(EMS_ARR_NAMEDIR)].tags.fe = EMS_TAG_FULL;
+    return graphID;
+}
+
+
+//==================================================================
+//  Add a task to the graph, tasks must be added by one process and before
+//  the graph is started.  Producers must be added before their consumers,
+//  otherwise the input is treated as written outside the graph.
+//  The graph is unchanged if the task cannot be added.
+//  Returns the task number or -1 on error
+int64_t EMStaskGraphAdd(int mmapID, int64_t graphID,
+                        int nInputs, EMStaskElement *inputs, int nOutputs, EMStaskElement *outputs) {
+    void *emsBuf = emsBufs[mmapID];
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    EMStaskGraph *graph = EMStaskGraphPtr(graphID);
+    EMStaskEdge *edges = (EMStaskEdge *) EMSheapPtr(graph->edges);
+    EMStaskProducer *externals = (EMStaskProducer *) EMSheapPtr(graph->externals);
+    EMStaskProducer *producers = (EMStaskProducer *) EMSheapPtr(graph->producers);
+    int64_t nSlots = 2 * graph->maxEdges;
+
+    if (nInputs < 0  ||  nOutputs < 0) {
+        fprintf(stderr, "EMStaskGraphAdd: Invalid number of inputs (%d) or outputs (%d)\n", nInputs, nOutputs);
+        return -1;
+    }
+    if (graph->nTasks >= graph->maxTasks) {
+        fprintf(stderr, "EMStaskGraphAdd: The graph already has the maximum number of tasks (%" PRIi64 ")\n",
+                graph->maxTasks);
+        return -1;
+    }
+    if (graph->nEdges + graph->nExternals + nInputs > graph->maxEdges  ||  nOutputs > graph->maxEdges) {
+        fprintf(stderr, "EMStaskGraphAdd: The graph already has the maximum number of edges (%" PRIi64 ")\n",
+                graph->maxEdges);
+        return -1;
+    }
+
+    if (graph->nOutputs + nOutputs > nSlots) {
+        fprintf(stderr, "EMStaskGraphAdd: The graph has too many outputs\n");
+        return -1;
+    }
+
+    //  Every input and output is resolved before the graph is changed
+    int64_t taskN = graph->nTasks;
+    int64_t *indexes = (int64_t *) malloc(((size_t) nInputs + nOutputs + 1) * sizeof(int64_t));
+    if (indexes == NULL) {
+        fprintf(stderr, "EMStaskGraphAdd: Unable to allocate the element indexes of task %" PRIi64 "\n", taskN);
+        return -1;
+    }
+    for (int elemN = 0; elemN < nInputs + nOutputs; elemN++) {
+        bool isInput = elemN < nInputs;
+        indexes[elemN] = EMStaskElementIndex(isInput ? &inputs[elemN] : &outputs[elemN - nInputs]);
+        if (indexes[elemN] < 0) {
+            fprintf(stderr, "EMStaskGraphAdd: %s %d of task %" PRIi64 " is not an element\n",
+                    isInput ? "Input" : "Output", isInput ? elemN : elemN - nInputs, taskN);
+            free(indexes);
+            return -1;
+        }
+    }
+
+    EMStaskNode *node = EMStaskNodePtr(graph, taskN);
+    node->nProducers = 0;
+    node->firstConsumer = -1;
+    node->firstExternal = graph->nExternals;
+    node->nExternal = 0;
+    node->parked = 0;
+
+    //  Each input is either an edge from the task producing it or an external input
+    for (int inputN = 0; inputN < nInputs; inputN++) {
+        int64_t idx = indexes[inputN];
+        int64_t producer = -1;
+        uint64_t slot = EMStaskElementHash(inputs[inputN].mmapID, idx) % nSlots;
+        for (int64_t nProbes = 0;  nProbes < nSlots  &&  producers[slot].mmapID >= 0;  nProbes++) {
+            if (producers[slot].mmapID == inputs[inputN].mmapID  &&  producers[slot].index == idx) {
+                producer = producers[slot].task;
+                break;
+            }
+            slot = (slot + 1) % nSlots;
+        }
+        if (producer >= 0) {
+            EMStaskNode *producerNode = EMStaskNodePtr(graph, producer);
+            EMStaskEdge *edge = &edges[graph->nEdges++];
+            edge->task = taskN;
+            edge->next = producerNode->firstConsumer;
+            producerNode->firstConsumer = edge - edges;
+            node->nProducers++;
+        } else {
+            EMStaskProducer *external = &externals[graph->nExternals++];
+            external->mmapID = inputs[inputN].mmapID;
+            external->index = idx;
+            node->nExternal++;
+        }
+    }
+
+    //  Later tasks reading the outputs of this task depend on it
+    for (int outputN = 0; outputN < nOutputs; outputN++) {
+        int64_t idx = indexes[nInputs + outputN];
+        uint64_t slot = EMStaskElementHash(outputs[outputN].mmapID, idx) % nSlots;
+        //  There are at least nOutputs free slots, the probe always ends
+        while (producers[slot].mmapID >= 0  &&
+               !(producers[slot].mmapID == outputs[outputN].mmapID  &&  producers[slot].index == idx)) {
+            slot = (slot + 1) % nSlots;
+        }
+        if (producers[slot].mmapID < 0) graph->nOutputs++;
+        producers[slot].mmapID = outputs[outputN].mmapID;
+        producers[slot].index = idx;
+        producers[slot].task = taskN;
+    }
+    free(indexes);
+    graph->nTasks = taskN + 1;
+    return taskN;
+}
+
+
+//==================================================================
+//  Work-stealing deques, only the owning process pushes and pops
+static void EMStaskPush(volatile int64_t *deque, int64_t taskN) {
+    int64_t bottom = deque[EMS_TASK_DEQUE_BOTTOM];
+    deque[EMS_TASK_DEQUE_TASKS + bottom] = taskN;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    deque[EMS_TASK_DEQUE_BOTTOM] = bottom + 1;
+}
+
+
+static int64_t EMStaskPop(volatile int64_t *deque) {
+    int64_t bottom = deque[EMS_TASK_DEQUE_BOTTOM] - 1;
+    deque[EMS_TASK_DEQUE_BOTTOM] = bottom;
+    __sync_synchronize();
+    int64_t top = deque[EMS_TASK_DEQUE_TOP];
+    if (top > bottom) {
+        deque[EMS_TASK_DEQUE_BOTTOM] = bottom + 1;
+        return -1;
+    }
+    int64_t taskN = deque[EMS_TASK_DEQUE_TASKS + bottom];
+    if (top == bottom) {
+        //  Last task, race any thieves for it
+        if (!__sync_bool_compare_and_swap(&deque[EMS_TASK_DEQUE_TOP], top, top + 1)) taskN = -1;
+        deque[EMS_TASK_DEQUE_BOTTOM] = bottom + 1;
+    }
+    return taskN;
+}
+
+
+static int64_t EMStaskSteal(volatile int64_t *deque) {
+    int64_t top = deque[EMS_TASK_DEQUE_TOP];
+    __sync_synchronize();
+    int64_t bottom = deque[EMS_TASK_DEQUE_BOTTOM];
+    if (top >= bottom) return -1;
+    int64_t taskN = deque[EMS_TASK_DEQUE_TASKS + top];
+    if (!__sync_bool_compare_and_swap(&deque[EMS_TASK_DEQUE_TOP], top, top + 1)) return -1;
+    return taskN;
+}
+
+
+//  Claim a parked task whose external inputs are all full, returns
+//  the task if it is now ready
+static int64_t EMStaskUnpark(char *bufChar, volatile int64_t *bufInt64, EMStaskGraph *graph) {
+    int64_t *parkedTasks = (int64_t *) EMSheapPtr(graph->parkedTasks);
+    EMStaskProducer *externals = (EMStaskProducer *) EMSheapPtr(graph->externals);
+    for (int64_t parkedN = 0; parkedN < graph->nParked; parkedN++) {
+        int64_t taskN = parkedTasks[parkedN];
+        EMStaskNode *node = EMStaskNodePtr(graph, taskN);
+        if (!node->parked) continue;
+        bool allFull = true;
+        for (int32_t inputN = 0; allFull  &&  inputN < node->nExternal; inputN++) {
+            EMStaskProducer *external = &externals[node->firstExternal + inputN];
+            allFull = EMStaskElementIsFull(external->mmapID, external->index);
+        }
+        if (allFull  &&  __sync_bool_compare_and_swap(&node->parked, 1, 0)  &&
+            __sync_sub_and_fetch(&node->nPending, 1) == 0) {
+            return taskN;
+        }
+    }
+    return -1;
+}
+
+
+//==================================================================
+//  Start executing the graph, called by one process after all the tasks
+//  have been added and before any process asks for a task.  A graph
+//  may be executed again after every task is done.
+//  Ready tasks are dealt round-robin to the processes' deques.
+bool EMStaskGraphStart(int mmapID, int64_t graphID) {
+    void *emsBuf = emsBufs[mmapID];
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    EMStaskGraph *graph = EMStaskGraphPtr(graphID);
+    EMStaskProducer *externals = (EMStaskProducer *) EMSheapPtr(graph->externals);
+    int64_t *parkedTasks = (int64_t *) EMSheapPtr(graph->parkedTasks);
+    int64_t procN = 0;
+
+    graph->nDone = 0;
+    graph->nParked = 0;
+    for (procN = 0; procN < graph->nThreads; procN++) {
+        volatile int64_t *deque = EMStaskDeque(graph, procN);
+        deque[EMS_TASK_DEQUE_TOP] = 0;
+        deque[EMS_TASK_DEQUE_BOTTOM] = 0;
+    }
+    procN = 0;
+    for (int64_t taskN = 0; taskN < graph->nTasks; taskN++) {
+        EMStaskNode *node = EMStaskNodePtr(graph, taskN);
+        node->nPending = node->nProducers;
+        node->parked = 0;
+        for (int32_t inputN = 0; inputN < node->nExternal; inputN++) {
+            EMStaskProducer *external = &externals[node->firstExternal + inputN];
+            if (!EMStaskElementIsFull(external->mmapID, external->index)) {
+                node->parked = 1;
+                node->nPending++;
+                parkedTasks[graph->nParked++] = taskN;
+                break;
+            }
+        }
+        if (node->nPending == 0) {
+            EMStaskPush(EMStaskDeque(graph, procN), taskN);
+            procN = (procN + 1) % graph->nThreads;
+        }
+    }
+    __sync_synchronize();
+    return true;
+}
+
+
+//==================================================================
+//  Wait for a ready task.  The process's own deque is used first, then
+//  tasks are stolen from other processes, then parked tasks are checked.
+//  Returns the task number, or -1 when every task in the graph is done.
+int64_t EMStaskGraphNext(int mmapID, int64_t graphID) {
+    void *emsBuf = emsBufs[mmapID];
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    EMStaskGraph *graph = EMStaskGraphPtr(graphID);
+    int64_t myProc = EMSmyID % graph->nThreads;
+    RESET_NAP_TIME;
+
+    while (graph->nDone < graph->nTasks) {
+        int64_t taskN = EMStaskPop(EMStaskDeque(graph, myProc));
+        for (int64_t victimN = 1; taskN < 0  &&  victimN < graph->nThreads; victimN++) {
+            taskN = EMStaskSteal(EMStaskDeque(graph, (myProc + victimN) % graph->nThreads));
+        }
+        if (taskN < 0  &&  graph->nParked > 0) taskN = EMStaskUnpark(bufChar, bufInt64, graph);
+        if (taskN >= 0) return taskN;
+        NANOSLEEP;
+    }
+    return -1;
+}
+
+
+//==================================================================
+//  Mark a task done, consumers which become ready are pushed on this
+//  process's deque
+bool EMStaskGraphDone(int mmapID, int64_t graphID, int64_t taskN) {
+    void *emsBuf = emsBufs[mmapID];
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    EMStaskGraph *graph = EMStaskGraphPtr(graphID);
+    EMStaskEdge *edges = (EMStaskEdge *) EMSheapPtr(graph->edges);
+    if (taskN < 0  ||  taskN >= graph->nTasks) {
+        fprintf(stderr, "EMStaskGraphDone: Invalid task (%" PRIi64 ")\n", taskN);
+        return false;
+    }
+
+    volatile int64_t *deque = EMStaskDeque(graph, EMSmyID % graph->nThreads);
+    for (int64_t edgeN = EMStaskNodePtr(graph, taskN)->firstConsumer; edgeN >= 0; edgeN = edges[edgeN].next) {
+        EMStaskNode *consumer = EMStaskNodePtr(graph, edges[edgeN].task);
+        if (__sync_sub_and_fetch(&consumer->nPending, 1) == 0) {
+            EMStaskPush(deque, edges[edgeN].task);
+        }
+    }
+    __sync_fetch_and_add(&graph->nDone, 1);
+    return true;
+}
@@ -0,0 +1,637 @@
+/*-----------------------------------------------------------------------------+
+ |  Extended Memory Semantics (EMS)                            Version 1.6.1   |
+ |  http://mogill.com/                                       jace@mogill.com   |
+ +-----------------------------------------------------------------------------+
+ |  Copyright (c) 2016-2020, Jace A Mogill.  All rights reserved.              |
+ |                                                                             |
+ | Redistribution and use in source and binary forms, with or without          |
+ | modification, are permitted provided that the following conditions are met: |
+ |    * Redistributions of source code must retain the above copyright         |
+ |      notice, this list of conditions and the following disclaimer.          |
+ |    * Redistributions in binary form must reproduce the above copyright      |
+ |      notice, this list of conditions and the following disclaimer in the    |
+ |      documentation and/or other materials provided with the distribution.   |
+ |    * Neither the name of the Synthetic Semantics nor the names of its       |
+ |      contributors may be used to endorse or promote products derived        |
+ |      from this software without specific prior written permission.          |
+ |                                                                             |
+ |    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS      |
+ |    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT        |
+ |    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR    |
+ |    A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL SYNTHETIC         |
+ |    SEMANTICS LLC BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,   |
+ |    EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,      |
+ |    PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR       |
+ |    PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF   |
+ |    LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING     |
+ |    NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS       |
+ |    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.             |
+ |                                                                             |
+ +-----------------------------------------------------------------------------*/
+#include "ems.h"
+
+
+//==================================================================
+//  Order elements by region and index so every transaction acquires
+//  its elements in the same global order.  Within one element,
+//  read-write use sorts before read-only use.
+static int EMStmCompare(const void *a, const void *b) {
+    const EMStmElement *elemA = *(const EMStmElement **) a;
+    const EMStmElement *elemB = *(const EMStmElement **) b;
+    if (elemA->mmapID != elemB->mmapID) return (elemA->mmapID < elemB->mmapID) ? -1 : 1;
+    if (elemA->index != elemB->index) return (elemA->index < elemB->index) ? -1 : 1;
+    return (int) elemA->readOnly - (int) elemB->readOnly;
+}
+
+
+//==================================================================
+//  Replace a string, blob, or JSON value with a private copy which outlives
+//  changes to the element during the transaction
+static bool EMStmCopyValue(EMSvalueType *value) {
+    if (!EMSisHeapType(value->type)) return true;
+    value->length = EMSvalueLength(value);
+    value->value = EMSdataCopy(value->value, value->length);
+    if (value->value == NULL) {
+        fprintf(stderr, "EMStmStart: Unable to allocate space to save the original value\n");
+        value->type = EMS_TYPE_UNDEFINED;
+        return false;
+    }
+    return true;
+}
+
+
+//==================================================================
+//  Release one element of a transaction.  Read-write elements keep
+//  their new value when committed, or have the original value
+//  restored when aborted.
+static void EMStmRelease(EMStmElement *elem, bool doCommit) {
+    bool isCopy = false;
+    switch (elem->state) {
+        case EMS_TM_DUPLICATE:
+            return;
+        case EMS_TM_OPTIMISTIC:
+            isCopy = true;
+            break;
+        case EMS_TM_LOCKED:
+            if (elem->readOnly) {
+                EMSreleaseRW(elem->mmapID, &elem->key);
+            } else {
+                isCopy = true;
+                if (doCommit) {
+                    EMSsetTag(elem->mmapID, &elem->key, true);
+                } else {
+                    EMSwriteEF(elem->mmapID, &elem->key, &elem->value);
+                }
+            }
+            break;
+        default:
+            fprintf(stderr, "EMStmRelease: Unknown transaction element state (%d)\n", elem->state);
+            return;
+    }
+    if (isCopy  &&  EMSisHeapType(elem->value.type)) {
+        free(elem->value.value);
+        elem->value.type = EMS_TYPE_UNDEFINED;
+    }
+}
+
+
+//==================================================================
+//  Start a transaction on all the elements of its read and write sets.
+//  Elements are acquired in a global order to avoid deadlock:
+//  read-write elements are marked empty, read-only elements are held
+//  under a readers-writer lock, or in regions with version stamps
+//  are read optimistically and validated when the transaction ends.
+//  The value of every element when it was acquired is returned in
+//  the element.  Returns false if any element could not be acquired,
+//  in which case no element is held.
+bool EMStmStart(int nElems, EMStmElement *elems) {
+    EMStmElement **order = (EMStmElement **) malloc(nElems * sizeof(EMStmElement *));
+    if (order == NULL) {
+        fprintf(stderr, "EMStmStart: Unable to allocate the transaction order\n");
+        return false;
+    }
+
+    //  Find the index of every element, adding mapped keys which do not exist yet
+    for (int elemN = 0; elemN < nElems; elemN++) {
+        EMStmElement *elem = &elems[elemN];
+        const EMSregion *region = &emsRegions[elem->mmapID];
+        volatile EMStag_t *bufTags = (EMStag_t *) region->buf;
+        elem->index = EMSkey2index(region, &elem->key, EMSisMapped);
+        if (elem->index < 0  &&  EMSisMapped  &&  elem->key.type != EMS_TYPE_UNDEFINED) {
+            elem->index = EMSwriteIndexMap(elem->mmapID, &elem->key);
+            if (elem->index >= 0) bufTags[EMSmapTag(elem->index)].tags.fe = EMS_TAG_FULL;
+        }
+        if (elem->index < 0  ||  elem->index >= region->nElements) {
+            fprintf(stderr, "EMStmStart: Element %d has an invalid index (%" PRIi64 ")\n", elemN, elem->index);
+            free(order);
+            return false;
+        }
+        elem->state = EMS_TM_LOCKED;
+        elem->version = 0;
+        elem->value.type = EMS_TYPE_UNDEFINED;
+        order[elemN] = elem;
+    }
+    qsort(order, (size_t) nElems, sizeof(EMStmElement *), EMStmCompare);
+
+    //  Acquire the elements in the global order
+    for (int orderN = 0; orderN < nElems; orderN++) {
+        EMStmElement *elem = order[orderN];
+        if (orderN > 0  &&  order[orderN - 1]->mmapID == elem->mmapID  &&  order[orderN - 1]->index == elem->index) {
+            elem->state = EMS_TM_DUPLICATE;
+            elem->value = order[orderN - 1]->value;
+            continue;
+        }
+        const EMSregion *region = &emsRegions[elem->mmapID];
+        void *emsBuf = region->buf;
+        volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+        bool acquired;
+        if (elem->readOnly  &&  bufInt64[EMScbData(EMS_ARR_VERSIONS)] != 0) {
+            elem->state = EMS_TM_OPTIMISTIC;
+            acquired = EMSreadOptimistic(emsBuf, elem->index, &elem->value, true, &elem->version)  &&
+                       EMStmCopyValue(&elem->value);
+        } else if (elem->readOnly) {
+            acquired = EMSreadRW(elem->mmapID, &elem->key, &elem->value);
+        } else {
+            acquired = EMSreadFE(elem->mmapID, &elem->key, &elem->value);
+            if (acquired  &&  !EMStmCopyValue(&elem->value)) {
+                EMSsetTag(elem->mmapID, &elem->key, true);
+                acquired = false;
+            }
+        }
+        if (!acquired) {
+            //  Nothing has been modified yet, release everything already held
+            for (int releaseN = 0; releaseN < orderN; releaseN++) {
+                EMStmRelease(order[releaseN], true);
+            }
+            free(order);
+            return false;
+        }
+    }
+    free(order);
+    return true;
+}
+
+
+//==================================================================
+//  End a transaction started by EMStmStart.  A commit first validates
+//  the optimistically read elements have not been written since they
+//  were read, and aborts if any were.  Aborting restores the original
+//  values of the read-write elements.  Returns true if committed.
+bool EMStmEnd(int nElems, EMStmElement *elems, bool doCommit) {
+    //  Validate while the read-write elements are still held
+    for (int elemN = 0;  doCommit  &&  elemN < nElems;  elemN++) {
+        EMStmElement *elem = &elems[elemN];
+        if (elem->state == EMS_TM_OPTIMISTIC) {
+            void *emsBuf = emsBufs[elem->mmapID];
+            volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+            const char *bufChar = (const char *) emsBuf;
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (*EMSversionPtr(elem->index) != elem->version) doCommit = false;
+        }
+    }
+    for (int elemN = 0; elemN < nElems; elemN++) {
+        EMStmRelease(&elems[elemN], doCommit);
+    }
+    return doCommit;
+}
+
+
+//==================================================================
+//  Software Transactional Memory
+//
+//  Optimistic transactions in the style of TL2 over elements of regions
+//  with version stamps.  Reads are validated against the version stamps
+//  and buffered writes are only applied, under the element's tag, when
+//  the transaction commits.  Each region keeps a version clock in its
+//  control block which is advanced by every commit that writes to the
+//  region.  Version stamps only count the writes of their element and are
+//  never compared with the clock.
+//
+//  A transaction's read version is the clock value of each region when
+//  the transaction first touched the region.  A read finding the clock
+//  advanced since then extends the snapshot if everything read so far is
+//  unchanged, otherwise the transaction must abort.  Commits validate
+//  every element read is unchanged while holding every element written,
+//  so read-only transactions never write to EMS memory.  Mapped keys read
+//  while absent are validated by confirming they are still absent.
+//  Transactions do not wait for empty elements: reading one, or committing
+//  with one read or written, is a conflict.
+//
+//  Transactions are process-local and identified by their index in
+//  a table of transactions in progress.
+typedef struct {
+    int mmapID;
+    int64_t readVersion;    // Region clock when the snapshot of the region was last validated
+} EMSstmRegion;
+
+typedef struct {
+    int mmapID;
+    int64_t index;          // EMS_STM_ABSENT if the key was not in the map
+    int64_t version;        // Version stamp of the element when it was read
+    EMSvalueType key;       // Key of an absent element, strings are private copies
+} EMSstmReadEntry;
+
+typedef struct {
+    int mmapID;
+    int64_t index;
+    EMSvalueType value;     // Buffered value, strings are private copies
+    int64_t stored;         // Heap copy of the value made by the commit, or EMS_HEAP_NULL
+} EMSstmWriteEntry;
+
+#define EMS_STM_ABSENT  ((int64_t) -2)   // Index of a mapped key not in the map
+
+typedef struct {
+    bool inUse;
+    bool aborted;           // A conflict was detected, the transaction can only abort
+    int nRegions, maxRegions;
+    int nReads, maxReads;
+    int nWrites, maxWrites;
+    EMSstmRegion *regions;
+    EMSstmReadEntry *reads;
+    EMSstmWriteEntry *writes;
+} EMSstmTx;
+
+static EMSstmTx *EMSstmTxs = NULL;
+static int EMSstmNTxs = 0;
+
+//  Make room for one more entry in a transaction's read, write or region set
+#define EMS_STM_GROW(array, n, max, type, errmsg, retval) {                 \
+    if ((n) >= (max)) {                                                     \
+        int newMax = ((max) == 0) ? 16 : (max) * 2;                         \
+        type *newArray = (type *) realloc((array), newMax * sizeof(type));  \
+        if (newArray == NULL) {                                             \
+            fprintf(stderr, "%s: Unable to grow the transaction\n", errmsg);\
+            return retval;                                                  \
+        }                                                                   \
+        (array) = newArray;                                                 \
+        (max) = newMax;                                                     \
+    }                                                                       \
+}
+
+
+static EMSstmTx *EMSstmGetTx(int txID, const char *caller) {
+    if (txID < 0  ||  txID >= EMSstmNTxs  ||  !EMSstmTxs[txID].inUse) {
+        fprintf(stderr, "%s: Invalid transaction (%d)\n", caller, txID);
+        return NULL;
+    }
+    return &EMSstmTxs[txID];
+}
+
+
+//  Find the region in the transaction, adding it with the region's current
+//  clock as its read version.  A region added after other elements were read
+//  has no read version, so its first read validates the snapshot.
+static EMSstmRegion *EMSstmRegionOf(EMSstmTx *tx, int mmapID) {
+    for (int regionN = 0; regionN < tx->nRegions; regionN++) {
+        if (tx->regions[regionN].mmapID == mmapID) return &tx->regions[regionN];
+    }
+    EMS_STM_GROW(tx->regions, tx->nRegions, tx->maxRegions, EMSstmRegion, "EMSstmRegionOf", NULL);
+    volatile int64_t *bufInt64 = (int64_t *) emsBufs[mmapID];
+    EMSstmRegion *region = &tx->regions[tx->nRegions++];
+    region->mmapID = mmapID;
+    region->readVersion = (tx->nReads > 0) ? -1 : bufInt64[EMScbData(EMS_ARR_STMCLOCK)];
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return region;
+}
+
+
+static EMSstmWriteEntry *EMSstmFindWrite(EMSstmTx *tx, int mmapID, int64_t idx) {
+    for (int writeN = 0; writeN < tx->nWrites; writeN++) {
+        if (tx->writes[writeN].mmapID == mmapID  &&  tx->writes[writeN].index == idx) return &tx->writes[writeN];
+    }
+    return NULL;
+}
+
+
+//  Confirm every element read is unchanged and not empty.  Elements the
+//  committing transaction itself holds have had their version made odd.  A
+//  key read while absent must still be absent, unless the transaction added it.
+static bool EMSstmValidate(EMSstmTx *tx, bool holdingWrites) {
+    for (int readN = 0; readN < tx->nReads; readN++) {
+        EMSstmReadEntry *read = &tx->reads[readN];
+        volatile int64_t *bufInt64 = (int64_t *) emsBufs[read->mmapID];
+        volatile EMStag_t *bufTags = (EMStag_t *) emsBufs[read->mmapID];
+        const char *bufChar = (const char *) emsBufs[read->mmapID];
+        if (read->index == EMS_STM_ABSENT) {
+            const EMSregion *region = &emsRegions[read->mmapID];
+            int64_t idx = EMSkey2index(region, &read->key, true);
+            if (idx >= 0  &&  EMSstmFindWrite(tx, read->mmapID, idx) == NULL) return false;
+            continue;
+        }
+        int64_t expected = read->version;
+        if (holdingWrites  &&  EMSstmFindWrite(tx, read->mmapID, read->index) != NULL) expected++;
+        if (*EMSversionPtr(read->index) != expected  ||
+            bufTags[EMSdataTag(read->index)].tags.fe == EMS_TAG_EMPTY) return false;
+    }
+    return true;
+}
+
+
+static void EMSstmFree(EMSstmTx *tx) {
+    for (int readN = 0; readN < tx->nReads; readN++) {
+        EMSstmReadEntry *read = &tx->reads[readN];
+        if (read->index == EMS_STM_ABSENT  &&  read->key.type == EMS_TYPE_STRING) free(read->key.value);
+    }
+    for (int writeN = 0; writeN < tx->nWrites; writeN++) {
+        EMSvalueType *value = &tx->writes[writeN].value;
+        if (EMSisHeapType(value->type)) free(value->value);
+    }
+    tx->nRegions = 0;
+    tx->nReads = 0;
+    tx->nWrites = 0;
+    tx->inUse = false;
+}
+
+
+//  Find the index of the key in a region with version stamps, adding mapped keys
+//  if requested.  Returns EMS_STM_ABSENT for a mapped key not added, -1 on error.
+static int64_t EMSstmIndex(int mmapID, EMSvalueType *key, bool addKey, const char *caller) {
+    const EMSregion *region = &emsRegions[mmapID];
+    void *emsBuf = region->buf;
+    volatile EMStag_t *bufTags = (EMStag_t *) emsBuf;
+    if (!(region->regionFlags & EMS_REGION_OPTIMISTIC_READS)) {
+        fprintf(stderr, "%s: Transactions require a region created with optimisticReads\n", caller);
+        return -1;
+    }
+    int64_t idx = EMSkey2index(region, key, EMSisMapped);
+    if (idx < 0  &&  EMSisMapped) {
+        if (!addKey) return EMS_STM_ABSENT;
+        idx = EMSwriteIndexMap(mmapID, key);
+        if (idx >= 0) bufTags[EMSmapTag(idx)].tags.fe = EMS_TAG_FULL;
+    }
+    if (idx >= region->nElements) {
+        fprintf(stderr, "%s: Index out of bounds (%" PRIi64 ")\n", caller, idx);
+        return -1;
+    }
+    return idx;
+}
+
+
+//==================================================================
+//  Begin a software transaction, returns the transaction ID or -1
+int EMSstmStart(void) {
+    int txID;
+    for (txID = 0; txID < EMSstmNTxs; txID++) {
+        if (!EMSstmTxs[txID].inUse) break;
+    }
+    if (txID == EMSstmNTxs) {
+        int maxTxs = EMSstmNTxs;
+        EMS_STM_GROW(EMSstmTxs, EMSstmNTxs, maxTxs, EMSstmTx, "EMSstmStart", -1);
+        memset(&EMSstmTxs[EMSstmNTxs], 0, (maxTxs - EMSstmNTxs) * sizeof(EMSstmTx));
+        EMSstmNTxs = maxTxs;
+    }
+    EMSstmTx *tx = &EMSstmTxs[txID];
+    tx->inUse = true;
+    tx->aborted = false;
+    tx->nRegions = 0;
+    tx->nReads = 0;
+    tx->nWrites = 0;
+    return txID;
+}
+
+
+//==================================================================
+//  Read an element within a software transaction.  Returns false if
+//  the element conflicts with the transaction's snapshot, after which
+//  the transaction can only be aborted, or if the element cannot be read.
+bool EMSstmRead(int txID, int mmapID, EMSvalueType *key, EMSvalueType *returnValue) {
+    EMSstmTx *tx = EMSstmGetTx(txID, "EMSstmRead");
+    if (tx == NULL  ||  tx->aborted) return false;
+    int64_t idx = EMSstmIndex(mmapID, key, false, "EMSstmRead");
+    if (idx == EMS_STM_ABSENT) {
+        //  Mapped keys which do not exist yet read as undefined, until another transaction adds them
+        EMS_STM_GROW(tx->reads, tx->nReads, tx->maxReads, EMSstmReadEntry, "EMSstmRead", false);
+        EMSstmReadEntry *read = &tx->reads[tx->nReads];
+        read->mmapID = mmapID;
+        read->index = EMS_STM_ABSENT;
+        read->version = 0;
+        read->key = *key;
+        if (key->type == EMS_TYPE_STRING) {
+            read->key.value = EMSdataCopy(key->value, key->length);
+            if (read->key.value == NULL) {
+                fprintf(stderr, "EMSstmRead: Unable to allocate space to record the key\n");
+                return false;
+            }
+        }
+        tx->nReads++;
+        returnValue->type = EMS_TYPE_UNDEFINED;
+        returnValue->value = (void *) 0xcafebeef;
+        return true;
+    }
+    if (idx < 0) return false;
+
+    //  Read the transaction's own writes
+    EMSstmWriteEntry *write = EMSstmFindWrite(tx, mmapID, idx);
+    if (write != NULL) {
+        *returnValue = write->value;
+        return true;
+    }
+
+    EMSstmRegion *region = EMSstmRegionOf(tx, mmapID);
+    EMS_STM_GROW(tx->reads, tx->nReads, tx->maxReads, EMSstmReadEntry, "EMSstmRead", false);
+    if (region == NULL) return false;
+    volatile int64_t *bufInt64 = (int64_t *) emsBufs[mmapID];
+    volatile EMStag_t *bufTags = (EMStag_t *) emsBufs[mmapID];
+    if (bufTags[EMSdataTag(idx)].tags.fe == EMS_TAG_EMPTY) {
+        tx->aborted = true;
+        return false;
+    }
+    int64_t version;
+    if (!EMSreadOptimistic(emsBufs[mmapID], idx, returnValue, false, &version)) return false;
+    //  A commit stores its values after advancing the clock, so the clock is
+    //  read after the value: if it has not advanced, the value is in the snapshot
+    int64_t clock = bufInt64[EMScbData(EMS_ARR_STMCLOCK)];
+    if (clock != region->readVersion) {
+        //  A transaction committed to the region, extend the snapshot if nothing read has changed
+        if (!EMSstmValidate(tx, false)) {
+            tx->aborted = true;
+            return false;
+        }
+        region->readVersion = clock;
+    }
+    EMSstmReadEntry *read = &tx->reads[tx->nReads++];
+    read->mmapID = mmapID;
+    read->index = idx;
+    read->version = version;
+    return true;
+}
+
+
+//==================================================================
+//  True if a transaction conflicted and can only be aborted, which
+//  tells a conflict apart from an element that could not be read
+bool EMSstmAborted(int txID) {
+    EMSstmTx *tx = EMSstmGetTx(txID, "EMSstmAborted");
+    return tx != NULL  &&  tx->aborted;
+}
+
+
+//==================================================================
+//  Buffer a write to an element within a software transaction
+bool EMSstmWrite(int txID, int mmapID, EMSvalueType *key, EMSvalueType *value) {
+    EMSstmTx *tx = EMSstmGetTx(txID, "EMSstmWrite");
+    if (tx == NULL  ||  tx->aborted) return false;
+    int64_t idx = EMSstmIndex(mmapID, key, true, "EMSstmWrite");
+    if (idx < 0) return false;
+    if (EMSstmRegionOf(tx, mmapID) == NULL) return false;
+
+    EMSstmWriteEntry *write = EMSstmFindWrite(tx, mmapID, idx);
+    if (write == NULL) {
+        EMS_STM_GROW(tx->writes, tx->nWrites, tx->maxWrites, EMSstmWriteEntry, "EMSstmWrite", false);
+        write = &tx->writes[tx->nWrites++];
+        write->mmapID = mmapID;
+        write->index = idx;
+        write->stored = EMS_HEAP_NULL;
+    } else if (EMSisHeapType(write->value.type)) {
+        free(write->value.value);
+    }
+    write->value = *value;
+    if (EMSisHeapType(value->type)) {
+        EMS_CHECK_LENGTH(value, "EMSstmWrite", false);
+        write->value.type = EMS_TYPE_UNDEFINED;
+        write->value.length = EMSvalueLength(value);
+        write->value.value = EMSdataCopy(value->value, write->value.length);
+        if (write->value.value == NULL) {
+            fprintf(stderr, "EMSstmWrite: Unable to allocate space to buffer the value\n");
+            return false;
+        }
+        write->value.type = value->type;
+    }
+    return true;
+}
+
+
+//  Copy a buffered string, blob, or JSON value to the heap of the element's region
+static int64_t EMSstmStore(void *emsBuf, EMSvalueType *value) {
+    volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+    char *bufChar = (char *) emsBuf;
+    int64_t word;
+    EMS_STORE_VALUE(word, value, "EMSstmEnd: out of memory to store string", EMS_HEAP_NULL);
+    return word;
+}
+
+
+//  Free the heap copies of buffered values a commit made and did not store
+static void EMSstmUnstore(EMSstmTx *tx) {
+    for (int writeN = 0; writeN < tx->nWrites; writeN++) {
+        EMSstmWriteEntry *write = &tx->writes[writeN];
+        if (write->stored == EMS_HEAP_NULL) continue;
+        void *emsBuf = emsBufs[write->mmapID];
+        volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+        char *bufChar = (char *) emsBuf;
+        EMS_FREE_VALUE(write->stored);
+        write->stored = EMS_HEAP_NULL;
+    }
+}
+
+
+//  Hold an element a commit writes, BUSY from FULL.  Returns false without
+//  waiting if the element is empty, which the transaction conflicts with.
+static bool EMSstmHold(volatile EMStag_t *tag) {
+    RESET_NAP_TIME;
+    int nLongNaps = 0;
+    for (;;) {
+        EMStag_t oldTag, newTag;
+        oldTag.byte = tag->byte;
+        if (oldTag.tags.fe == EMS_TAG_EMPTY) return false;
+        newTag.byte = oldTag.byte;
+        newTag.tags.fe = EMS_TAG_BUSY;
+        if (oldTag.tags.fe == EMS_TAG_FULL  &&  __sync_bool_compare_and_swap(&tag->byte, oldTag.byte, newTag.byte)) {
+            return true;
+        }
+        NANOSLEEP;
+        if (EMS_STUCK_CHECK(nLongNaps)) EMSrecoverTag(tag);
+    }
+}
+
+
+static int EMSstmWriteCompare(const void *a, const void *b) {
+    const EMSstmWriteEntry *writeA = (const EMSstmWriteEntry *) a;
+    const EMSstmWriteEntry *writeB = (const EMSstmWriteEntry *) b;
+    if (writeA->mmapID != writeB->mmapID) return (writeA->mmapID < writeB->mmapID) ? -1 : 1;
+    if (writeA->index != writeB->index) return (writeA->index < writeB->index) ? -1 : 1;
+    return 0;
+}
+
+
+//==================================================================
+//  Commit or abort a software transaction.  Returns true if committed,
+//  false if aborted by the caller or by a conflict.  The transaction
+//  ends either way.
+bool EMSstmEnd(int txID, bool doCommit) {
+    EMSstmTx *tx = EMSstmGetTx(txID, "EMSstmEnd");
+    if (tx == NULL) return false;
+    if (!doCommit  ||  tx->aborted) {
+        EMSstmFree(tx);
+        return false;
+    }
+
+    //  Read-only transactions commit if everything read is still unchanged
+    if (tx->nWrites == 0) {
+        bool committed = EMSstmValidate(tx, false);
+        EMSstmFree(tx);
+        return committed;
+    }
+
+    //  Copy the buffered strings to the heap first, so nothing can fail once elements are written
+    for (int writeN = 0; writeN < tx->nWrites; writeN++) {
+        EMSstmWriteEntry *write = &tx->writes[writeN];
+        if (!EMSisHeapType(write->value.type)) continue;
+        write->stored = EMSstmStore(emsBufs[write->mmapID], &write->value);
+        if (write->stored == EMS_HEAP_NULL) {
+            EMSstmUnstore(tx);
+            EMSstmFree(tx);
+            return false;
+        }
+    }
+
+    //  Hold every element written, in the global order, and mark it as being modified
+    qsort(tx->writes, (size_t) tx->nWrites, sizeof(EMSstmWriteEntry), EMSstmWriteCompare);
+    int nHeld;
+    for (nHeld = 0; nHeld < tx->nWrites; nHeld++) {
+        EMSstmWriteEntry *write = &tx->writes[nHeld];
+        void *emsBuf = emsBufs[write->mmapID];
+        volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+        volatile EMStag_t *bufTags = (EMStag_t *) emsBuf;
+        const char *bufChar = (const char *) emsBuf;
+        if (!EMSstmHold(&bufTags[EMSdataTag(write->index)])) break;
+        EMSdrainReaders(emsBuf, write->index, NULL);
+        EMS_VERSION_BEGIN_WRITE(write->index);
+    }
+    bool committed = (nHeld == tx->nWrites);
+
+    //  Advance the clock of each region written, before any value is stored
+    for (int regionN = 0; committed  &&  regionN < tx->nRegions; regionN++) {
+        EMSstmRegion *region = &tx->regions[regionN];
+        volatile int64_t *bufInt64 = (int64_t *) emsBufs[region->mmapID];
+        for (int writeN = 0; writeN < tx->nWrites; writeN++) {
+            if (tx->writes[writeN].mmapID == region->mmapID) {
+                __sync_add_and_fetch(&bufInt64[EMScbData(EMS_ARR_STMCLOCK)], 1);
+                break;
+            }
+        }
+    }
+
+    committed = committed  &&  EMSstmValidate(tx, true);
+    for (int writeN = 0; writeN < nHeld; writeN++) {
+        EMSstmWriteEntry *write = &tx->writes[writeN];
+        void *emsBuf = emsBufs[write->mmapID];
+        volatile int64_t *bufInt64 = (int64_t *) emsBuf;
+        volatile EMStag_t *bufTags = (EMStag_t *) emsBuf;
+        const char *bufChar = (const char *) emsBuf;
+        EMStag_t newTag;
+        newTag.byte = bufTags[EMSdataTag(write->index)].byte;
+        if (committed) {
+            EMSstoreValue(emsBuf, write->index, newTag.tags.type, &write->value, write->stored);
+            write->stored = EMS_HEAP_NULL;
+            newTag.tags.type = write->value.type;
+        }
+        newTag.tags.fe = EMS_TAG_FULL;
+        newTag.tags.rw = 0;
+        bufTags[EMSdataTag(write->index)].byte = newTag.byte;
+        EMS_VERSION_END_WRITE(write->index);
+    }
+    EMSstmUnstore(tx);
+    EMSstmFree(tx);
+    return committed;
+}